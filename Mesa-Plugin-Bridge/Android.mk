@@ -2,9 +2,47 @@ LOCAL_PATH := $(call my-dir)
 
 include $(CLEAR_VARS)
 LOCAL_MODULE := OSMBridge
-LOCAL_SRC_FILES := src/bridge.c
+LOCAL_SRC_FILES := src/bridge.c \
+                   src/context_pool.c \
+                   src/context_reaper.c \
+                   src/context_precreate.c \
+                   src/upload_worker.c \
+                   src/cpu_topology.c \
+                   src/thread_placement.c \
+                   src/probe.c \
+                   src/llvmpipe_tune.c \
+                   src/gl_offload.c \
+                   src/gl_offload_stubs.S \
+                   src/task_pool.c \
+                   src/env_bin.c \
+                   src/runtime_config.c \
+                   src/profile.c \
+                   src/driver_select.c \
+                   src/call_stats.c \
+                   src/gl_trace.c \
+                   src/hud.c \
+                   src/timeline.c \
+                   src/gpu_timing.c \
+                   src/gl_debug.c \
+                   src/log.c \
+                   src/startup_timing.c
 LOCAL_C_INCLUDES := $(LOCAL_PATH)
-LOCAL_CFLAGS := -Wall -fPIC
+LOCAL_CFLAGS := -Wall -fPIC -D_GNU_SOURCE
 LOCAL_LDLIBS := -ldl
 
-include $(BUILD_SHARED_LIBRARY)
\ No newline at end of file
+include $(BUILD_SHARED_LIBRARY)
+
+# Benchmark run by the plugin app. app/build.gradle.kts packages
+# libs/<abi>/osm-bench as libosmbench.so: only lib*.so files are installed
+# to the native library directory, the one place an app may execute files
+# from.
+include $(CLEAR_VARS)
+LOCAL_MODULE := osm-bench
+LOCAL_SRC_FILES := tools/osm-bench.c \
+                   tools/bench_run.c \
+                   src/workload.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/src
+LOCAL_CFLAGS := -Wall -D_GNU_SOURCE
+LOCAL_LDLIBS := -ldl
+
+include $(BUILD_EXECUTABLE)
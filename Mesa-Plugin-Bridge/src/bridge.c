@@ -7,29 +7,65 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
 #include "bridge.h"
+#include "internal.h"
+#include "context_pool.h"
+#include "context_reaper.h"
+#include "context_precreate.h"
+#include "upload_worker.h"
+#include "thread_placement.h"
+#include "llvmpipe_tune.h"
+#include "probe.h"
+#include "gl_offload.h"
+#include "task_pool.h"
+#include "env_bin.h"
+#include "runtime_config.h"
+#include "profile.h"
+#include "driver_select.h"
+#include "call_stats.h"
+#include "gl_trace.h"
+#include "hud.h"
+#include "timeline.h"
+#include "gpu_timing.h"
+#include "gl_debug.h"
+#include "log.h"
+#include "startup_timing.h"
 #include <GL/osmesa.h>
 #include <GL/gl.h>
+#include <GL/glext.h>
 
 #define EXPORT __attribute__((visibility("default"), used))
 #define FILE_PATH "/sdcard/Mesa/env.txt"
 #define MAX_LINE 256
+#define MAX_DEFERRED_RECORDS 8
 
-static bool logOutPut = false;
-static bool isFollowSystem = false;
-static bool isCustomMesaGL_GLSL = false;
-static bool onlyUseGetProcAddress = false;
+bool logOutPut = false;
+// Built while env.txt is parsed and published once by init(); everything
+// after that reads runtime_config_acquire() or runtime_config_startup().
+static RuntimeConfig startupConfig;
+static ProfileFilter startupProfile;
 static void* dl_handle = NULL;
 static void* self_handle = NULL;
-static char *glVersion;
-static char *glslVersion;
-static char *customGL_GLSL;
-
-static OSMESAproc (*real_OSMesaGetProcAddress)(const char *);
-static GLboolean (*real_OSMesaMakeCurrent)(OSMesaContext, void*, GLenum, GLsizei, GLsizei);
+static long long initTimeNs = 0;
+static bool firstContextCreated = false;
+static bool firstFrameReported = false;
+static bool firstMadeCurrent = false;
+
+// Shadow of the context made current on this thread through the bridge,
+// so OSMesaGetCurrentContext() does not have to call into Mesa.
+__thread OSMesaContext currentContext = NULL;
+static __thread void *currentBuffer = NULL;
+static __thread GLenum currentType = 0;
+static __thread GLsizei currentWidth = 0;
+static __thread GLsizei currentHeight = 0;
+
+OSMESAproc (*real_OSMesaGetProcAddress)(const char *);
+GLboolean (*real_OSMesaMakeCurrent)(OSMesaContext, void*, GLenum, GLsizei, GLsizei);
 static OSMesaContext (*real_OSMesaGetCurrentContext)(void);
-static OSMesaContext (*real_OSMesaCreateContext)(GLenum, OSMesaContext);
-static void (*real_OSMesaDestroyContext)(OSMesaContext);
+OSMesaContext (*real_OSMesaCreateContext)(GLenum, OSMesaContext);
+void (*real_OSMesaDestroyContext)(OSMesaContext);
 static void (*real_OSMesaFlushFrontbuffer)(void);
 static void (*real_OSMesaPixelStore)(GLint, GLint);
 static const GLubyte* (*real_glGetString)(GLenum);
@@ -44,16 +80,18 @@ bool checkHandle() {
         char* mesa_library = getenv("MESA_LIBRARY");
         if (!mesa_library)
         {
-            if (logOutPut) fprintf(stderr, "Error[OSM Plugin Bridge]: MESA_LIBRARY environment variable is not set\n");
+            OSM_LOGE("MESA_LIBRARY environment variable is not set");
             return false;
         }
 
         dlerror();
+        long long start = bridge_now_ns();
         dl_handle = dlopen(mesa_library, RTLD_LAZY);
         char* error = dlerror();
+        startup_stage("dlopen MESA_LIBRARY", start, bridge_now_ns());
         if (!dl_handle)
         {
-            if (logOutPut) fprintf(stderr, "Error[OSM Plugin Bridge]: Failed to load %s: %s\n", mesa_library, error);
+            OSM_LOGE("Failed to load %s: %s", mesa_library, error);
             return false;
         }
     }
@@ -64,159 +102,355 @@ void checkGalliumDriver() {
     char* gallium_driver = getenv("GALLIUM_DRIVER");
     if (!gallium_driver)
     {
-        fprintf(stderr, "Error[OSM Plugin Bridge]: Failed to get Gallium Driver Env\n");
+        log_write(NULL, LOG_LEVEL_ERROR, "Failed to get Gallium Driver Env");
         if (setenv("GALLIUM_DRIVER", "zink", 1) == 0)
         {
-            printf("[OSM Plugin Bridge]: Put Env GALLIUM_DRIVER=zink\n");
+            OSM_LOGN("Put Env GALLIUM_DRIVER=zink");
         }
     }
 }
 
 void setGLversion() {
-    if (!customGL_GLSL) return;
+    const StartupConfig *startup = &startupConfig.startup;
 
-    if (!strcmp(customGL_GLSL, "1"))
+    if (startup->customGLVersion == 2)
     {
-        isFollowSystem = true;
+        setenv("MESA_GL_VERSION_OVERRIDE", "4.6", 1);
+        setenv("MESA_GLSL_VERSION_OVERRIDE", "460", 1);
         return;
     }
 
-    if (!strcmp(customGL_GLSL, "2"))
+    if (startup->customGLVersion == 3 && startup->glVersion[0] && startup->glslVersion[0])
     {
-        setenv("MESA_GL_VERSION_OVERRIDE", "4.6", 1);
-        setenv("MESA_GLSL_VERSION_OVERRIDE", "460", 1);
+        setenv("MESA_GL_VERSION_OVERRIDE", startup->glVersion, 1);
+        setenv("MESA_GLSL_VERSION_OVERRIDE", startup->glslVersion, 1);
+        return;
+    }
+}
+
+// Apply one key=value from env.txt or env.bin. Keys the bridge knows go
+// into startupConfig; everything else is exported to Mesa through setenv().
+static void apply_env_entry(const char *key, const char *value) {
+    if (!profile_filter_accept(&startupProfile, key)) return;
+
+    if (runtime_config_entry(&startupConfig, key, value))
+    {
+        logOutPut = startupConfig.logOutPut;
+        return;
+    }
+
+    if (!strcmp(key, "mesa_glthread"))
+    {
+        if (!strcmp(value, "false")) return;
+        if (setenv(key, value, 1) != 0) {
+            OSM_LOGW("Failed to set environment variable %s=%s", key, value);
+            return;
+        }
+        OSM_LOGN("Set Env %s=%s", key, value);
         return;
     }
 
-    if (!strcmp(customGL_GLSL, "3") && glVersion && glslVersion)
+    if (setenv(key, value, 1) != 0)
     {
-        isCustomMesaGL_GLSL = true;
-        setenv("MESA_GL_VERSION_OVERRIDE", glVersion, 1);
-        setenv("MESA_GLSL_VERSION_OVERRIDE", glslVersion, 1);
+        OSM_LOGW("Failed to set environment variable %s=%s", key, value);
         return;
     }
+    OSM_LOGN("Set Env %s=%s", key, value);
 }
 
-void set_env_from_file(const char *file_path) {
-    FILE *file = fopen(file_path, "r");
-    if (!file) return checkGalliumDriver();
+// Everything that depends on the complete set of entries.
+static void finish_env(const char *file_path) {
+    StartupConfig *startup = &startupConfig.startup;
+    if (startupProfile.chosen)
+    {
+        strcpy(startup->profile, startupProfile.name);
+        OSM_LOGI("Using profile %s", startup->profile);
+    }
 
-    char glVersionBuffer[MAX_LINE] = {0};
-    char glslVersionBuffer[MAX_LINE] = {0};
-    char customGL_GLSL_Buffer[MAX_LINE] = {0};
+    long long start = bridge_now_ns();
+    setGLversion();
+    startup_stage("setGLversion", start, bridge_now_ns());
 
+    char *mesaGLVersion = getenv("MESA_GL_VERSION_OVERRIDE");
+    char *mesaGLSLVersion = getenv("MESA_GLSL_VERSION_OVERRIDE");
+
+    if (mesaGLVersion && mesaGLSLVersion)
+    {
+        OSM_LOGN("Set Env MESA_GL_VERSION_OVERRIDE=%s", mesaGLVersion);
+        OSM_LOGN("Set Env MESA_GLSL_VERSION_OVERRIDE=%s", mesaGLSLVersion);
+    }
+    else
+    {
+        if (startup->customGLVersion != 1 && startup->glVersion[0] && startup->glslVersion[0])
+        {
+            setenv("MESA_GL_VERSION_OVERRIDE", startup->glVersion, 1);
+            setenv("MESA_GLSL_VERSION_OVERRIDE", startup->glslVersion, 1);
+            OSM_LOGN("Set Env MESA_GL_VERSION_OVERRIDE=%s", startup->glVersion);
+            OSM_LOGN("Set Env MESA_GLSL_VERSION_OVERRIDE=%s", startup->glslVersion);
+        }
+    }
+
+    driver_select_prepare(file_path, startup->autoDriver, startup->autoDriverCandidates);
+    if (startup->llvmpipeTune) llvmpipe_tune_prepare(file_path, startup->llvmpipeCalibrated, startup->llvmpipeTuneAll);
+
+    checkGalliumDriver();
+}
+
+// Feed every entry of env.txt to apply (if any) and to the env.bin builder.
+static void parse_env_text(FILE *file, EnvBinBuilder *builder, EnvEntryFn apply) {
     char line[MAX_LINE];
     while (fgets(line, sizeof(line), file))
     {
         line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '[')
+        {
+            if (apply) apply(line, "");
+            env_bin_add(builder, line, "");
+            continue;
+        }
+
         char *delimiter = strchr(line, '=');
         if (delimiter)
         {
             *delimiter = '\0';
             char *key = line;
             char *value = delimiter + 1;
+            if (apply) apply(key, value);
+            env_bin_add(builder, key, value);
+        }
+    }
+}
 
-            if (!strcmp(key, "OSM_PLUGIN_LOGE"))
-            {
-                if (!strcmp(value, "true"))
-                {
-                    logOutPut = true;
-                }
-                continue;
-            }
-
-            if (!strcmp(key, "mesa_glthread"))
-            {
-                if (!strcmp(value, "false")) continue;
-                if (setenv(key, value, 1) != 0) {
-                    if (logOutPut)
-                    {
-                        fprintf(stderr, "Warning[OSM Plugin Bridge]: Failed to set environment variable %s=%s\n", key, value);
-                    }
-                    continue;
-                }
-                printf("[OSM Plugin Bridge]: Set Env %s=%s\n", key, value);
-                continue;
-            }
+// The probes record from the task pool while the render thread may record too.
+static pthread_mutex_t recordLock = PTHREAD_MUTEX_INITIALIZER;
+// Counts env.txt rewrites by record_env_value(), under recordLock.
+static unsigned int envRewrites = 0;
 
-            if (!strcmp(key, "CUSTOM_GL_GLSL"))
-            {
-                strncpy(customGL_GLSL_Buffer, value, sizeof(customGL_GLSL_Buffer) - 1);
-                customGL_GLSL = customGL_GLSL_Buffer;
-                continue;
-            }
+void set_env_from_file(const char *file_path) {
+    runtime_config_defaults(&startupConfig);
+    profile_filter_init(&startupProfile);
+    snprintf(startupConfig.startup.path, sizeof(startupConfig.startup.path), "%s", file_path);
+    file_path = startupConfig.startup.path;
+
+    char bin_path[MAX_LINE];
+    env_bin_path(file_path, bin_path, sizeof(bin_path));
+    long long start = bridge_now_ns();
+    if (env_bin_apply(bin_path, file_path, apply_env_entry))
+    {
+        startup_stage("Read env.bin", start, bridge_now_ns());
+        startupConfig.startup.source = "env.bin";
+        finish_env(file_path);
+        return;
+    }
 
-            if (!strcmp(key, "MESA_GL_VERSION_OVERRIDE"))
-            {
-                strncpy(glVersionBuffer, value, sizeof(glVersionBuffer) - 1);
-                glVersion = glVersionBuffer;
-                continue;
-            }
+    start = bridge_now_ns();
+    FILE *file = fopen(file_path, "r");
+    startup_stage("fopen env.txt", start, bridge_now_ns());
+    if (!file) return checkGalliumDriver();
+    startupConfig.startup.source = "env.txt";
+    pthread_mutex_lock(&recordLock);
+    unsigned int rewrites = envRewrites;
+    pthread_mutex_unlock(&recordLock);
+    start = bridge_now_ns();
 
-            if (!strcmp(key, "MESA_GLSL_VERSION_OVERRIDE"))
-            {
-                strncpy(glslVersionBuffer, value, sizeof(glslVersionBuffer) - 1);
-                glslVersion = glslVersionBuffer;
-                continue;
-            }
+    EnvBinBuilder builder;
+    env_bin_begin(&builder, fileno(file));
+    parse_env_text(file, &builder, apply_env_entry);
+    startup_stage("Parse env.txt", start, bridge_now_ns());
 
-            if (!strcmp(key, "ONLY_GET_PROC_ADDRESS"))
-            {
-                if (!strcmp(value, "true"))
-                {
-                    onlyUseGetProcAddress = true;
-                }
-                continue;
-            }
+    finish_env(file_path);
 
-            if (setenv(key, value, 1) != 0)
-            {
-                if (logOutPut)
-                {
-                    fprintf(stderr, "Warning[OSM Plugin Bridge]: Failed to set environment variable %s=%s\n", key, value);
-                }
-                continue;
-            }
-            printf("[OSM Plugin Bridge]: Set Env %s=%s\n", key, value);
-        }
+    if (fclose(file) != 0) {
+        OSM_LOGW("Failed to close file %s", file_path);
     }
 
-    setGLversion();
+    // Next launch can skip the text parser unless env.txt changes again. A
+    // value recorded meanwhile left a newer env.bin than this one.
+    pthread_mutex_lock(&recordLock);
+    if (envRewrites == rewrites) env_bin_commit(&builder, bin_path);
+    pthread_mutex_unlock(&recordLock);
+}
 
-    char *mesaGLVersion = getenv("MESA_GL_VERSION_OVERRIDE");
-    char *mesaGLSLVersion = getenv("MESA_GLSL_VERSION_OVERRIDE");
+// Build env.bin for the new env.txt still at tmp_path. Like the app, this
+// happens before the rename, which keeps the size and mtime the blob is
+// stamped with, so env.bin is never stale for the env.txt in place.
+static void write_env_bin(const char *tmp_path, const char *file_path) {
+    FILE *text = fopen(tmp_path, "r");
+    if (!text) return;
+    EnvBinBuilder builder;
+    env_bin_begin(&builder, fileno(text));
+    parse_env_text(text, &builder, NULL);
+    fclose(text);
+
+    char bin_path[MAX_LINE];
+    env_bin_path(file_path, bin_path, sizeof(bin_path));
+    env_bin_commit(&builder, bin_path);
+}
 
-    if (mesaGLVersion && mesaGLSLVersion)
+// Replace (or add) a single key among the entries before the first profile
+// section of env.txt. The file is rewritten to a temporary and renamed
+// over the original so readers never see it torn.
+void record_env_value(const char *file_path, const char *key, const char *value) {
+    char tmp_path[MAX_LINE];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", file_path);
+
+    pthread_mutex_lock(&recordLock);
+    FILE *out = fopen(tmp_path, "w");
+    if (!out)
     {
-        printf("[OSM Plugin Bridge]: Set Env MESA_GL_VERSION_OVERRIDE=%s\n", mesaGLVersion);
-        printf("[OSM Plugin Bridge]: Set Env MESA_GLSL_VERSION_OVERRIDE=%s\n", mesaGLSLVersion);
+        pthread_mutex_unlock(&recordLock);
+        OSM_LOGW("Failed to open %s for writing", tmp_path);
+        return;
     }
-    else
+
+    size_t key_length = strlen(key);
+    bool replaced = false;
+    bool in_section = false;
+    FILE *in = fopen(file_path, "r");
+    if (in)
     {
-        if (!isFollowSystem && glVersion && glslVersion)
+        char line[MAX_LINE];
+        while (fgets(line, sizeof(line), in))
         {
-            if (!isCustomMesaGL_GLSL)
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == '[' && !in_section)
             {
-                setenv("MESA_GL_VERSION_OVERRIDE", glVersion, 1);
-                setenv("MESA_GLSL_VERSION_OVERRIDE", glslVersion, 1);
+                in_section = true;
+                if (!replaced) fprintf(out, "%s=%s\n", key, value);
+                replaced = true;
             }
-            printf("[OSM Plugin Bridge]: Set Env MESA_GL_VERSION_OVERRIDE=%s\n", glVersion);
-            printf("[OSM Plugin Bridge]: Set Env MESA_GLSL_VERSION_OVERRIDE=%s\n", glslVersion);
+            if (!in_section && !strncmp(line, key, key_length) && line[key_length] == '=')
+            {
+                if (replaced) continue;
+                fprintf(out, "%s=%s\n", key, value);
+                replaced = true;
+                continue;
+            }
+            fprintf(out, "%s\n", line);
         }
+        fclose(in);
     }
+    if (!replaced) fprintf(out, "%s=%s\n", key, value);
 
-    checkGalliumDriver();
+    bool written = fclose(out) == 0;
+    if (written) write_env_bin(tmp_path, file_path);
+    if (!written || rename(tmp_path, file_path) != 0)
+    {
+        OSM_LOGW("Failed to update %s in %s", key, file_path);
+        remove(tmp_path);
+    }
+    envRewrites++;
+    pthread_mutex_unlock(&recordLock);
+}
 
-    if (fclose(file) != 0) {
-        if (logOutPut) fprintf(stderr, "Warning[OSM Plugin Bridge]: Failed to close file %s\n", file_path);
+typedef struct {
+    char key[64];
+    char value[MAX_LINE];
+} DeferredRecord;
+
+static pthread_mutex_t deferredLock = PTHREAD_MUTEX_INITIALIZER;
+static DeferredRecord deferredRecords[MAX_DEFERRED_RECORDS];
+static int deferredCount = 0;
+static bool deferredStarted = false;
+// One task drains at a time, so values for the same key land in order.
+static bool deferredDraining = false;
+
+static void record_task(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&deferredLock);
+    if (deferredDraining)
+    {
+        pthread_mutex_unlock(&deferredLock);
+        return;
+    }
+    deferredDraining = true;
+    while (deferredCount)
+    {
+        DeferredRecord record = deferredRecords[0];
+        deferredCount--;
+        memmove(deferredRecords, deferredRecords + 1, sizeof(DeferredRecord) * (size_t)deferredCount);
+        pthread_mutex_unlock(&deferredLock);
+        record_env_value(startupConfig.startup.path, record.key, record.value);
+        pthread_mutex_lock(&deferredLock);
     }
+    deferredDraining = false;
+    pthread_mutex_unlock(&deferredLock);
+}
+
+void record_env_value_async(const char *key, const char *value) {
+    pthread_mutex_lock(&deferredLock);
+    if (deferredCount == MAX_DEFERRED_RECORDS)
+    {
+        pthread_mutex_unlock(&deferredLock);
+        record_env_value(startupConfig.startup.path, key, value);
+        return;
+    }
+    DeferredRecord *record = &deferredRecords[deferredCount++];
+    snprintf(record->key, sizeof(record->key), "%s", key);
+    snprintf(record->value, sizeof(record->value), "%s", value);
+    bool submit = deferredStarted;
+    pthread_mutex_unlock(&deferredLock);
+
+    if (submit && !task_pool_submit(record_task, NULL)) record_task(NULL);
+}
+
+// Records queued while env.txt was parsed wait for the task pool to be sized.
+static void start_deferred_records(void) {
+    pthread_mutex_lock(&deferredLock);
+    deferredStarted = true;
+    bool pending = deferredCount > 0;
+    pthread_mutex_unlock(&deferredLock);
+
+    if (pending && !task_pool_submit(record_task, NULL)) record_task(NULL);
+}
+
+long long bridge_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Runs on the task pool while the game starts; what it settles on is
+// recorded in env.txt for the next launch.
+static void probe_task(void *arg) {
+    (void)arg;
+
+    long long start = bridge_now_ns();
+    const char *driver = driver_select_run();
+    // The probe may settle on llvmpipe, which then wants its own tuning.
+    if (driver && !strcmp(driver, "llvmpipe")) llvmpipe_tune_request();
+    llvmpipe_tune_calibrate();
+    startup_stage("Driver probe", start, bridge_now_ns());
 }
 
 __attribute__((constructor))
 static void init() {
-    set_env_from_file(FILE_PATH);
+    initTimeNs = bridge_now_ns();
+    // Lets host tools such as tools/osm-sweep run the bridge with their own config.
+    char *env_file = getenv("OSM_ENV_FILE");
+    set_env_from_file(env_file && env_file[0] ? env_file : FILE_PATH);
+    long long configNs = bridge_now_ns() - initTimeNs;
+
+    StartupConfig *startup = &startupConfig.startup;
+    // Sized before anything below starts it.
+    task_pool_configure(startup->taskThreads);
+    start_deferred_records();
+    // What was logged while parsing is still in the ring.
+    log_start(startup->logSink, startup->logLevel);
+    thread_placement_configure(startup->threadPlacement, startup->workerPlacement, startup->workerThreads, startup->renderNice);
+    // Publish what took effect, not what was asked for.
+    startup->glOffload = gl_offload_configure(startup->glOffload);
+    if (!gl_trace_start(startup->traceFile)) startup->traceFile[0] = '\0';
+    gpu_timing_configure(startup->gpuTiming);
+    // Mesa decides at context creation whether it reports anything.
+    gl_debug_configure(startup->glDebug);
+    if (!timeline_start(startup->timelineFile, startup->timelineSeconds, initTimeNs)) startup->timelineFile[0] = '\0';
+    startup_timing_configure(startup->startupReport, initTimeNs);
+    runtime_config_publish(&startupConfig);
+    if (startup->configReload) runtime_config_watch(startup->path);
 
     Dl_info info;
+    long long start = bridge_now_ns();
     if (dladdr((void*)init, &info))
     {
         self_handle = dlopen(info.dli_fname, RTLD_NOW | RTLD_NOLOAD);
@@ -225,15 +459,18 @@ static void init() {
             self_handle = dlopen(info.dli_fname, RTLD_NOW);
         }
     }
+    startup_stage("dlopen self", start, bridge_now_ns());
 
     if (!self_handle) {
-        if (logOutPut) fprintf(stderr, "Error[OSM Plugin Bridge]: Failed to get self_handle: %s\n", dlerror());
+        OSM_LOGE("Failed to get self_handle: %s", dlerror());
     }
 
     if (checkHandle()) {
         #define LOAD_SYMBOL(name) \
+            start = bridge_now_ns(); \
             real_##name = dlsym(dl_handle, #name); \
-            if (!real_##name && logOutPut) fprintf(stderr, "Error[OSM Plugin Bridge]: Failed to find symbol '%s' in Mesa Library: %s\n", #name, dlerror());
+            startup_stage("dlsym " #name, start, bridge_now_ns()); \
+            if (!real_##name) OSM_LOGE("Failed to find symbol '%s' in Mesa Library: %s", #name, dlerror());
 
         LOAD_SYMBOL(OSMesaGetProcAddress);
         LOAD_SYMBOL(OSMesaMakeCurrent);
@@ -248,96 +485,427 @@ static void init() {
         LOAD_SYMBOL(glClear);
         LOAD_SYMBOL(glReadPixels);
         LOAD_SYMBOL(glReadBuffer);
+
+        bool probing = driver_select_pending() || llvmpipe_tune_pending();
+        // A create competing with the probe for cores would skew what it
+        // measures, so the first launch of a setup creates on demand.
+        if (startup->precreateContext && probing) OSM_LOGI("Not pre-creating a context while the driver probe is pending");
+        else if (startup->precreateContext) context_precreate_start(startup->lastContextFormat);
+        if (probing && !task_pool_submit(probe_task, NULL)) OSM_LOGW("No task pool to run the driver probe on");
     }
+
+    startup_stage("Constructor", initTimeNs, bridge_now_ns());
+    OSM_LOGI("Constructor took %.2f ms, config from %s took %.2f ms",
+            (bridge_now_ns() - initTimeNs) / 1e6, startup->source, configNs / 1e6);
 }
 
 void* GetProcAddress(const char *funcName) {
-    if (!checkHandle() && !onlyUseGetProcAddress) return NULL;
+    if (!checkHandle() && !runtime_config_startup()->onlyGetProcAddress) return NULL;
 
     dlerror();
     void* symbol = dlsym(dl_handle, funcName);
     char* error = dlerror();
     if (error)
     {
-        if (logOutPut) fprintf(stderr, "Error[OSM Plugin Bridge]: Failed to find symbol '%s' in Mesa Library: %s\n", funcName, error);
+        OSM_LOGE("Failed to find symbol '%s' in Mesa Library: %s", funcName, error);
         return NULL;
     }
 
     return symbol;
 }
 
+void* bridge_get_proc(const char *funcName) {
+    if (real_OSMesaGetProcAddress) return (void*)real_OSMesaGetProcAddress(funcName);
+    return GetProcAddress(funcName);
+}
+
+GLboolean bridge_bind_scratch(OSMesaContext ctx, GLenum type) {
+    static GLfloat scratch[4];
+    if (!real_OSMesaMakeCurrent) return GL_FALSE;
+    return real_OSMesaMakeCurrent(ctx, scratch, type, 1, 1);
+}
+
+void bridge_restore_current(void) {
+    if (!real_OSMesaMakeCurrent) return;
+    if (currentContext)
+    {
+        real_OSMesaMakeCurrent(currentContext, currentBuffer, currentType, currentWidth, currentHeight);
+    }
+    else
+    {
+        real_OSMesaMakeCurrent(NULL, NULL, 0, 0, 0);
+    }
+}
+
+int bridge_gl_version(void) {
+    int major = 0, minor = 0;
+    const char *version = real_glGetString ? (const char*)real_glGetString(GL_VERSION) : NULL;
+    if (!version || sscanf(version, "%d.%d", &major, &minor) != 2) return 0;
+    return major * 10 + minor;
+}
+
+bool bridge_has_extension(int version, const char *name) {
+    if (!real_glGetString) return false;
+
+    // Core profiles only list extensions through glGetStringi().
+    static const GLubyte* (*getStringi)(GLenum, GLuint);
+    static void (*getIntegerv)(GLenum, GLint*);
+    if (!getStringi) getStringi = (__typeof__(getStringi))bridge_get_proc("glGetStringi");
+    if (!getIntegerv) getIntegerv = (__typeof__(getIntegerv))bridge_get_proc("glGetIntegerv");
+    if (version >= 30 && getStringi && getIntegerv)
+    {
+        GLint count = 0;
+        getIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char *extension = (const char*)getStringi(GL_EXTENSIONS, (GLuint)i);
+            if (extension && !strcmp(extension, name)) return true;
+        }
+        return false;
+    }
+
+    const char *extensions = (const char*)real_glGetString(GL_EXTENSIONS);
+    size_t length = strlen(name);
+    for (const char *p = extensions; p && (p = strstr(p, name)); p += length)
+    {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) return true;
+    }
+    return false;
+}
+
+// Entry points the bridge exports itself. Looked up through
+// OSMesaGetProcAddress() they must resolve to the bridge too: Mesa's
+// OSMesaMakeCurrent() would bypass the current context shadow and the
+// context pool, and Mesa's glFinish() the frame bookkeeping.
+static const struct {
+    const char *name;
+    void *proc;
+} bridgeProcs[] = {
+#define X(n) { #n, (void*)n },
+    BRIDGE_ENTRY_POINTS(X)
+#undef X
+};
+
+static OSMESAproc get_proc_address(const char *funcName) {
+    if (funcName)
+    {
+        for (size_t i = 0; i < sizeof(bridgeProcs) / sizeof(bridgeProcs[0]); i++)
+        {
+            if (!strcmp(bridgeProcs[i].name, funcName)) return (OSMESAproc)bridgeProcs[i].proc;
+        }
+    }
+    if (glDebugEnabled)
+    {
+        OSMESAproc proc = gl_debug_wrap_proc(funcName);
+        if (proc) return proc;
+    }
+    OSMESAproc proc = real_OSMesaGetProcAddress ? real_OSMesaGetProcAddress(funcName) : (OSMESAproc)GetProcAddress(funcName);
+    return context_pool_wrap_proc(funcName, gl_trace_wrap_proc(funcName, gl_offload_wrap_proc(funcName, proc)));
+}
+
 EXPORT
 OSMESAproc OSMesaGetProcAddress(const char *funcName) {
-    if (!real_OSMesaGetProcAddress) return GetProcAddress(funcName);
-    return real_OSMesaGetProcAddress(funcName);
+    CALL_STATS(CALL_OSMesaGetProcAddress, get_proc_address, (funcName));
+}
+
+static GLboolean make_current(OSMesaContext ctx, void *buffer, GLenum type, GLsizei width, GLsizei height) {
+    if (!real_OSMesaMakeCurrent) return GL_FALSE;
+    bool first = ctx && !__atomic_load_n(&firstMadeCurrent, __ATOMIC_RELAXED);
+    long long start = timelineEnabled || first ? bridge_now_ns() : 0;
+    gl_offload_before_make_current();
+    GLboolean result = real_OSMesaMakeCurrent(ctx, buffer, type, width, height);
+    if (result)
+    {
+        context_pool_on_make_current(currentContext, ctx, width, height);
+        if (ctx) thread_placement_on_make_current();
+        currentContext = ctx;
+        currentBuffer = buffer;
+        currentType = type;
+        currentWidth = width;
+        currentHeight = height;
+        gl_offload_after_make_current(ctx, buffer, type, width, height);
+        if (traceEnabled) gl_trace_MakeCurrent(ctx, type, width, height);
+        if (glDebugEnabled) gl_debug_on_make_current(ctx);
+    }
+    if (timelineEnabled) timeline_span("MakeCurrent", start, bridge_now_ns());
+    if (first && result && !__atomic_exchange_n(&firstMadeCurrent, true, __ATOMIC_RELAXED))
+    {
+        startup_stage("First OSMesaMakeCurrent", start, bridge_now_ns());
+    }
+    return result;
 }
 
 EXPORT
 GLboolean OSMesaMakeCurrent(OSMesaContext ctx, void *buffer, GLenum type, GLsizei width, GLsizei height) {
-    if (!real_OSMesaMakeCurrent) return GL_FALSE;
-    return real_OSMesaMakeCurrent(ctx, buffer, type, width, height);
+    CALL_STATS(CALL_OSMesaMakeCurrent, make_current, (ctx, buffer, type, width, height));
+}
+
+static OSMesaContext get_current_context(void) {
+    if (!RUNTIME_CONFIG_GET(checkCurrentContext) || !real_OSMesaGetCurrentContext) return currentContext;
+    // The offload worker may hold the context for this thread right now.
+    if (gl_offload_active()) return currentContext;
+
+    OSMesaContext ctx = real_OSMesaGetCurrentContext();
+    if (ctx != currentContext)
+    {
+        OSM_LOGW("Current context mismatch, bridge has %p but Mesa has %p", (void*)currentContext, (void*)ctx);
+        currentContext = ctx;
+    }
+    return ctx;
 }
 
 EXPORT
 OSMesaContext OSMesaGetCurrentContext(void) {
-    if (!real_OSMesaGetCurrentContext) return NULL;
-    return real_OSMesaGetCurrentContext();
+    CALL_STATS(CALL_OSMesaGetCurrentContext, get_current_context, ());
+}
+
+void bridge_destroy_context(OSMesaContext ctx) {
+    if (!ctx || !real_OSMesaDestroyContext) return;
+
+    if (RUNTIME_CONFIG_GET(asyncDestroy))
+    {
+        // Finish pending rendering and move the context off the client's
+        // buffer, so nothing the reaper does can touch memory the caller
+        // is free to release once we return.
+        if (ctx == currentContext)
+        {
+            if (real_glFinish) real_glFinish();
+            bridge_bind_scratch(ctx, currentType);
+            real_OSMesaMakeCurrent(NULL, NULL, 0, 0, 0);
+        }
+        if (context_reaper_submit(ctx)) return;
+    }
+
+    real_OSMesaDestroyContext(ctx);
+}
+
+static OSMesaContext create_context(GLenum format, OSMesaContext sharelist) {
+    if (!real_OSMesaCreateContext) return NULL;
+
+    const StartupConfig *startup = runtime_config_startup();
+    bool first = !firstContextCreated;
+    firstContextCreated = true;
+    long long start = bridge_now_ns();
+
+    OSMesaContext ctx = context_pool_take(format, sharelist);
+    if (ctx)
+    {
+        if (traceEnabled) gl_trace_CreateContext(format, sharelist, ctx);
+        return ctx;
+    }
+
+    if (startup->precreateContext)
+    {
+        ctx = context_precreate_adopt(format, sharelist);
+        if (first && !sharelist && format != startup->lastContextFormat)
+        {
+            char value[16];
+            snprintf(value, sizeof(value), "0x%x", format);
+            record_env_value_async("OSM_LAST_CONTEXT_FORMAT", value);
+        }
+    }
+
+    if (!ctx) ctx = real_OSMesaCreateContext(format, sharelist);
+    context_pool_on_create(ctx, format, sharelist);
+    gl_offload_on_create(ctx);
+    if (traceEnabled && ctx) gl_trace_CreateContext(format, sharelist, ctx);
+
+    if (first)
+    {
+        long long end = bridge_now_ns();
+        startup_stage("First OSMesaCreateContext", start, end);
+        OSM_LOGI("First OSMesaCreateContext took %.2f ms (pre-create %s)",
+                (end - start) / 1e6, startup->precreateContext ? "on" : "off");
+    }
+    return ctx;
 }
 
 EXPORT
 OSMesaContext OSMesaCreateContext(GLenum format, OSMesaContext sharelist) {
-    if (!real_OSMesaCreateContext) return NULL;
-    return real_OSMesaCreateContext(format, sharelist);
+    CALL_STATS(CALL_OSMesaCreateContext, create_context, (format, sharelist));
+}
+
+static void destroy_context(OSMesaContext ctx) {
+    if (traceEnabled && ctx) gl_trace_DestroyContext(ctx);
+    upload_worker_on_destroy(ctx);
+    gl_offload_before_destroy(ctx);
+    if (glDebugEnabled) gl_debug_on_destroy(ctx);
+    if (!context_pool_park(ctx))
+    {
+        if (gpuTimingEnabled) gpu_timing_on_destroy(ctx, false);
+        context_pool_forget(ctx);
+        bridge_destroy_context(ctx);
+    }
+    if (ctx && ctx == currentContext) currentContext = NULL;
 }
 
 EXPORT
 void OSMesaDestroyContext(OSMesaContext ctx) {
-    if (real_OSMesaDestroyContext) real_OSMesaDestroyContext(ctx);
+    CALL_STATS_VOID(CALL_OSMesaDestroyContext, destroy_context, (ctx));
 }
 
-EXPORT
-void OSMesaFlushFrontbuffer(void) {
+static void draw_hud(bool fromFlush) {
+    if (!currentContext || !RUNTIME_CONFIG_GET(hud)) return;
+    long long start = timelineEnabled ? bridge_now_ns() : 0;
+    bool drawn = hud_present(fromFlush, currentBuffer, currentType, currentWidth, currentHeight);
+    if (timelineEnabled && drawn) timeline_span("HUD", start, bridge_now_ns());
+}
+
+static void flush_frontbuffer(void) {
+    if (traceEnabled) gl_trace_FlushFrontbuffer();
+    long long start = timelineEnabled ? bridge_now_ns() : 0;
+    gl_offload_drain();
+    if (gpuTimingEnabled) gpu_timing_frame_end();
     if (real_OSMesaFlushFrontbuffer) real_OSMesaFlushFrontbuffer();
+    if (timelineEnabled) timeline_frame("Present", start, bridge_now_ns());
+    if (gpuTimingEnabled) gpu_timing_frame_begin();
+    if (threadPlacementEnabled) thread_placement_on_frame();
+    draw_hud(true);
 }
 
 EXPORT
-void OSMesaPixelStore(GLint pname, GLint value) {
+void OSMesaFlushFrontbuffer(void) {
+    CALL_STATS_VOID(CALL_OSMesaFlushFrontbuffer, flush_frontbuffer, ());
+}
+
+static void pixel_store(GLint pname, GLint value) {
+    if (traceEnabled) gl_trace_PixelStore(pname, value);
+    gl_offload_drain();
     if (real_OSMesaPixelStore) real_OSMesaPixelStore(pname, value);
 }
 
 EXPORT
-const GLubyte* glGetString(GLenum name) {
+void OSMesaPixelStore(GLint pname, GLint value) {
+    CALL_STATS_VOID(CALL_OSMesaPixelStore, pixel_store, (pname, value));
+}
+
+static const GLubyte* get_string(GLenum name) {
+    gl_offload_drain();
     if (real_glGetString) return real_glGetString(name);
     return NULL;
 }
 
 EXPORT
-void glFinish(void) {
+const GLubyte* glGetString(GLenum name) {
+    CALL_STATS(CALL_glGetString, get_string, (name));
+}
+
+static void finish(void) {
+    if (traceEnabled) gl_trace_Finish();
+    long long start = timelineEnabled ? bridge_now_ns() : 0;
+    gl_offload_drain();
+    if (gpuTimingEnabled) gpu_timing_frame_end();
     if (real_glFinish) real_glFinish();
+    if (timelineEnabled) timeline_frame("glFinish", start, bridge_now_ns());
+    if (gpuTimingEnabled) gpu_timing_frame_begin();
+    if (threadPlacementEnabled) thread_placement_on_frame();
+    draw_hud(false);
+
+    if (!firstFrameReported && currentContext)
+    {
+        firstFrameReported = true;
+        long long now = bridge_now_ns();
+        startup_stage("First frame", initTimeNs, now);
+        OSM_LOGI("Time to first frame %.2f ms since library load (pre-create %s)",
+                (now - initTimeNs) / 1e6, runtime_config_startup()->precreateContext ? "on" : "off");
+        startup_timing_report();
+    }
 }
 
 EXPORT
-void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {
+void glFinish(void) {
+    CALL_STATS_VOID(CALL_glFinish, finish, ());
+}
+
+static void clear_color(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {
+    if (traceEnabled) gl_trace_ClearColor(red, green, blue, alpha);
+    if (gl_offload_active())
+    {
+        gl_offload_ClearColor(red, green, blue, alpha);
+        return;
+    }
     if (real_glClearColor) real_glClearColor(red, green, blue, alpha);
 }
 
 EXPORT
-void glClear(GLbitfield mask) {
+void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {
+    CALL_STATS_VOID(CALL_glClearColor, clear_color, (red, green, blue, alpha));
+}
+
+static void clear(GLbitfield mask) {
+    if (traceEnabled) gl_trace_Clear(mask);
+    if (gl_offload_active())
+    {
+        gl_offload_Clear(mask);
+        return;
+    }
     if (real_glClear) real_glClear(mask);
 }
 
 EXPORT
-void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* data) {
+void glClear(GLbitfield mask) {
+    CALL_STATS_VOID(CALL_glClear, clear, (mask));
+}
+
+static void read_pixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* data) {
+    if (traceEnabled) gl_trace_ReadPixels(x, y, width, height, format, type, data);
+    bool hud = RUNTIME_CONFIG_GET(hud);
+    long long start = hud || timelineEnabled ? bridge_now_ns() : 0;
+    gl_offload_drain();
+    if (gpuTimingEnabled) gpu_timing_readback_begin();
     if (real_glReadPixels) real_glReadPixels(x, y, width, height, format, type, data);
+    if (gpuTimingEnabled) gpu_timing_readback_end();
+    if (hud || timelineEnabled)
+    {
+        long long end = bridge_now_ns();
+        if (hud) hud_add_readback(end - start);
+        if (timelineEnabled) timeline_span("Readback", start, end);
+    }
 }
 
 EXPORT
-void glReadBuffer(GLenum mode) {
+void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* data) {
+    CALL_STATS_VOID(CALL_glReadPixels, read_pixels, (x, y, width, height, format, type, data));
+}
+
+static void read_buffer(GLenum mode) {
+    if (traceEnabled) gl_trace_ReadBuffer(mode);
+    if (gl_offload_active())
+    {
+        gl_offload_ReadBuffer(mode);
+        return;
+    }
     if (real_glReadBuffer) real_glReadBuffer(mode);
 }
 
+EXPORT
+void glReadBuffer(GLenum mode) {
+    CALL_STATS_VOID(CALL_glReadBuffer, read_buffer, (mode));
+}
+
 __attribute__((destructor))
 static void cleanup() {
+    call_stats_stop();
+    gl_trace_stop();
+    hud_stop();
+    gpu_timing_stop();
+    gl_debug_stop();
+    startup_timing_report();
+    timeline_stop();
+    runtime_config_stop();
+    gl_offload_stop();
+    upload_worker_stop();
+    // Before anything that waits for the pool, whose workers may be busy
+    // running the probe.
+    probe_cancel();
+    context_precreate_stop();
+    context_reaper_stop();
+    context_pool_drain();
+    task_pool_stop();
+    // Last, so the reports above and game threads still logging during
+    // teardown go through the ring rather than writing inline.
+    log_stop();
+
     if (dl_handle) {
         dlclose(dl_handle);
         dl_handle = NULL;
@@ -27,6 +27,120 @@ EXPORT void glClear(GLbitfield mask);
 EXPORT void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* data);
 EXPORT void glReadBuffer(GLenum mode);
 
+// Queue a large upload on the bridge's upload worker, whose context shares
+// lists with the current one. Source data is copied before returning.
+// GL_FALSE means nothing was queued and the caller must upload itself.
+EXPORT GLboolean OSMesaBridgeBufferDataAsync(GLuint buffer, GLsizeiptr size, const void *data, GLenum usage);
+// pixels is read with the current context's GL_UNPACK_ALIGNMENT,
+// GL_UNPACK_ROW_LENGTH, GL_UNPACK_SKIP_ROWS and GL_UNPACK_SKIP_PIXELS, as
+// glTexSubImage2D would; with a pixel unpack buffer bound it returns
+// GL_FALSE.
+EXPORT GLboolean OSMesaBridgeTexSubImage2DAsync(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels);
+// Order every upload queued so far before later commands of the current context.
+EXPORT void OSMesaBridgeUploadBarrier(void);
+
+// Counters of the bridge's shared task pool, for profiling.
+typedef struct {
+    GLuint workers;
+    GLuint queued;
+    GLuint peakQueued;
+    GLuint64 submitted;
+    GLuint64 executed;
+    GLuint64 steals;
+} OSMesaBridgeTaskPoolStats;
+
+EXPORT void OSMesaBridgeGetTaskPoolStats(OSMesaBridgeTaskPoolStats *stats);
+
+// Settings the bridge is running with, once env.txt, the matching profile
+// and the launcher environment have been resolved. The tunables follow
+// OSM_CONFIG_RELOAD; generation changes whenever they are reloaded.
+typedef struct {
+    GLuint generation;
+    char source[16];             // "env.bin", "env.txt" or "defaults"
+    char path[256];
+    char profile[128];           // empty when no profile section matched
+    // As exported to Mesa; empty when unset.
+    char galliumDriver[32];
+    char glVersion[32];
+    char glslVersion[32];
+    GLboolean glthread;
+    // Tunables.
+    GLboolean logOutput;
+    GLboolean checkCurrentContext;
+    GLboolean asyncDestroy;
+    GLint contextPoolSize;
+    GLuint64 contextPoolBytes;
+    GLuint64 uploadMinBytes;
+    GLuint64 uploadQueueBytes;
+    GLboolean callStats;
+    GLboolean hud;
+    // Fixed at load time.
+    GLboolean onlyGetProcAddress;
+    GLboolean precreateContext;
+    GLenum lastContextFormat;
+    GLboolean threadPlacement;
+    GLboolean llvmpipeTune;
+    GLboolean glOffload;
+    GLboolean configReload;
+    GLint taskThreads;
+    char traceFile[256];         // empty unless a GL trace is being recorded
+    char timelineFile[256];      // empty unless a timeline is being recorded
+    GLint timelineSeconds;       // 0 records until exit
+    GLboolean gpuTiming;
+    GLboolean glDebug;           // also on with callStats or gpuTiming at load
+    char logSink[256];           // empty for stderr
+    GLint logLevel;              // 0 debug, 1 info, 2 warning, 3 error
+    char startupReport[256];     // empty unless a startup report is written
+} OSMesaBridgeConfig;
+
+EXPORT void OSMesaBridgeGetConfig(OSMesaBridgeConfig *config);
+// The same settings as env.txt lines. Like snprintf(), writes at most size
+// bytes including the NUL and returns the length of the whole dump.
+EXPORT GLsizei OSMesaBridgeDumpConfig(char *buffer, GLsizei size);
+
+// Calls into one bridge entry point, counted while OSM_CALL_STATS=true.
+// Bucket i counts calls that took [2^i, 2^(i+1)) ns; the last is open.
+#define OSMESA_BRIDGE_CALL_BUCKETS 32
+
+typedef struct {
+    const char *name;
+    GLuint64 calls;
+    GLuint64 totalNs;
+    GLuint64 maxNs;
+    GLuint64 buckets[OSMESA_BRIDGE_CALL_BUCKETS];
+} OSMesaBridgeCallStats;
+
+// Fill up to count entries, one per instrumented entry point in a fixed
+// order, summed over every thread. Returns the number of entry points.
+EXPORT GLuint OSMesaBridgeGetCallStats(OSMesaBridgeCallStats *stats, GLuint count);
+
+// One frame segment timed with GL_TIMESTAMP queries while
+// OSM_GPU_TIMING=true: the GL work between frame boundaries, or a
+// glReadPixels() within it. Summed over every thread.
+typedef struct {
+    const char *name;
+    GLuint64 samples;
+    GLuint64 cpuNs;
+    GLuint64 gpuNs;
+    GLuint64 maxGpuNs;
+    GLuint64 late;               // results not ready in time, dropped
+} OSMesaBridgeGpuStats;
+
+// Fill up to count segments. Returns the number of segments.
+EXPORT GLuint OSMesaBridgeGetGpuStats(OSMesaBridgeGpuStats *stats, GLuint count);
+
+// One stage of starting up, in CLOCK_MONOTONIC nanoseconds. The
+// "Constructor" stage starts when the library was loaded.
+typedef struct {
+    const char *name;
+    GLuint64 startNs;
+    GLuint64 endNs;
+} OSMesaBridgeStartupStage;
+
+// Fill up to count stages in the order they finished. Returns the number
+// recorded so far.
+EXPORT GLuint OSMesaBridgeGetStartupStages(OSMesaBridgeStartupStage *stages, GLuint count);
+
 #ifdef __cplusplus
 }
 #endif
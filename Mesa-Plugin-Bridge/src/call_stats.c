@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include "bridge.h"
+#include "internal.h"
+#include "call_stats.h"
+#include "task_pool.h"
+#include "log.h"
+
+#define CACHE_LINE 64
+
+_Static_assert(CALL_STATS_BUCKETS == OSMESA_BRIDGE_CALL_BUCKETS, "bucket counts differ");
+
+// Own line each, so neighbouring entry points called from different
+// cores never share one.
+typedef struct {
+    unsigned long long calls;
+    unsigned long long totalNs;
+    unsigned long long maxNs;
+    unsigned long long buckets[CALL_STATS_BUCKETS];
+} __attribute__((aligned(CACHE_LINE))) CallCounter;
+
+// One block per thread that made an instrumented call, written by that
+// thread only. Blocks are pushed onto a list that only ever grows and
+// outlive their threads, so readers walk it without locking.
+typedef struct ThreadCounters {
+    CallCounter counters[CALL_COUNT];
+    struct ThreadCounters *next;
+} ThreadCounters;
+
+bool callStatsEnabled = false;
+static ThreadCounters *threads = NULL;
+static __thread ThreadCounters *ownCounters = NULL;
+
+static pthread_mutex_t enableLock = PTHREAD_MUTEX_INITIALIZER;
+static bool handlerInstalled = false;
+static struct sigaction previousAction;
+
+static const char *const callNames[CALL_COUNT] = {
+#define X(n) #n,
+    BRIDGE_ENTRY_POINTS(X)
+#undef X
+#define GL_CMD0(n) "gl" #n " (offload)",
+#define GL_CMD1(n, ...) "gl" #n " (offload)",
+#define GL_CMD2(n, ...) "gl" #n " (offload)",
+#define GL_CMD3(n, ...) "gl" #n " (offload)",
+#define GL_CMD4(n, ...) "gl" #n " (offload)",
+#define GL_CMD5(n, ...) "gl" #n " (offload)",
+#define GL_CMD6(n, ...) "gl" #n " (offload)",
+#define GL_UNIFORMV(n, ...) "gl" #n " (offload)",
+#define GL_UNIFORM_MATRIX(n, ...) "gl" #n " (offload)",
+#define GL_MATRIX(n) "gl" #n " (offload)",
+#include "gl_commands.h"
+#undef GL_CMD0
+#undef GL_CMD1
+#undef GL_CMD2
+#undef GL_CMD3
+#undef GL_CMD4
+#undef GL_CMD5
+#undef GL_CMD6
+#undef GL_UNIFORMV
+#undef GL_UNIFORM_MATRIX
+#undef GL_MATRIX
+    "glDeleteBuffers (offload)",
+    "glDeleteVertexArrays (offload)",
+    "glVertexArrayElementBuffer (offload)",
+    // Time spent in the trampolines before they jump to Mesa.
+    "other gl* (offload trampolines)",
+};
+
+static ThreadCounters* attach_thread(void) {
+    ThreadCounters *counters;
+    if (posix_memalign((void**)&counters, CACHE_LINE, sizeof(ThreadCounters)) != 0) return NULL;
+    memset(counters, 0, sizeof(ThreadCounters));
+
+    counters->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&threads, &counters->next, counters, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    ownCounters = counters;
+    return counters;
+}
+
+CallScope call_stats_enter(CallId id) {
+    return (CallScope){ id, bridge_now_ns() };
+}
+
+void call_stats_leave(CallScope *scope) {
+    unsigned long long ns = (unsigned long long)(bridge_now_ns() - scope->start);
+    ThreadCounters *counters = ownCounters ? ownCounters : attach_thread();
+    if (!counters) return;
+
+    // This thread is the only writer, so plain reads are exact; the stores
+    // are atomic so a reader on another thread never sees a torn value.
+    CallCounter *counter = &counters->counters[scope->id];
+    int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= CALL_STATS_BUCKETS) bucket = CALL_STATS_BUCKETS - 1;
+    __atomic_store_n(&counter->calls, counter->calls + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&counter->totalNs, counter->totalNs + ns, __ATOMIC_RELAXED);
+    if (ns > counter->maxNs) __atomic_store_n(&counter->maxNs, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&counter->buckets[bucket], counter->buckets[bucket] + 1, __ATOMIC_RELAXED);
+}
+
+static void collect(OSMesaBridgeCallStats *stats) {
+    memset(stats, 0, sizeof(OSMesaBridgeCallStats) * CALL_COUNT);
+    for (int id = 0; id < CALL_COUNT; id++) stats[id].name = callNames[id];
+
+    for (ThreadCounters *t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t; t = t->next)
+    {
+        for (int id = 0; id < CALL_COUNT; id++)
+        {
+            CallCounter *counter = &t->counters[id];
+            unsigned long long calls = __atomic_load_n(&counter->calls, __ATOMIC_RELAXED);
+            if (!calls) continue;
+
+            stats[id].calls += calls;
+            stats[id].totalNs += __atomic_load_n(&counter->totalNs, __ATOMIC_RELAXED);
+            unsigned long long maxNs = __atomic_load_n(&counter->maxNs, __ATOMIC_RELAXED);
+            if (maxNs > stats[id].maxNs) stats[id].maxNs = maxNs;
+            for (int i = 0; i < CALL_STATS_BUCKETS; i++) stats[id].buckets[i] += __atomic_load_n(&counter->buckets[i], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+GLuint OSMesaBridgeGetCallStats(OSMesaBridgeCallStats *stats, GLuint count) {
+    if (!stats || !count) return CALL_COUNT;
+
+    OSMesaBridgeCallStats *all = malloc(sizeof(OSMesaBridgeCallStats) * CALL_COUNT);
+    if (!all) return 0;
+    collect(all);
+    memcpy(stats, all, sizeof(OSMesaBridgeCallStats) * (count < CALL_COUNT ? count : CALL_COUNT));
+    free(all);
+    return CALL_COUNT;
+}
+
+// Upper bound, in microseconds, of the bucket holding the given fraction of calls.
+static double percentile_us(const OSMesaBridgeCallStats *stats, double fraction) {
+    GLuint64 target = (GLuint64)(stats->calls * fraction);
+    GLuint64 seen = 0;
+    int i = 0;
+    for (; i < CALL_STATS_BUCKETS - 1; i++)
+    {
+        seen += stats->buckets[i];
+        if (seen > target) break;
+    }
+    return (double)(2ULL << i) / 1e3;
+}
+
+static int compare_calls(const void *a, const void *b) {
+    const OSMesaBridgeCallStats *x = a, *y = b;
+    return (x->calls < y->calls) - (x->calls > y->calls);
+}
+
+void call_stats_dump(void) {
+    OSMesaBridgeCallStats *stats = malloc(sizeof(OSMesaBridgeCallStats) * CALL_COUNT);
+    if (!stats) return;
+    collect(stats);
+    qsort(stats, CALL_COUNT, sizeof(OSMesaBridgeCallStats), compare_calls);
+
+    OSM_LOGN("Call stats (calls, mean, p50 and p99 upper bounds, max; us)");
+    for (int i = 0; i < CALL_COUNT && stats[i].calls; i++)
+    {
+        OSM_LOGN("  %-40s %10llu %10.2f %10.2f %10.2f %10.2f",
+                stats[i].name, (unsigned long long)stats[i].calls, stats[i].totalNs / 1e3 / stats[i].calls,
+                percentile_us(&stats[i], 0.5), percentile_us(&stats[i], 0.99), stats[i].maxNs / 1e3);
+    }
+    free(stats);
+}
+
+// Formatting and stdio are not async-signal-safe, so the handler only
+// raises an event and a task pool worker writes the report.
+static void on_sigusr1(int signal, siginfo_t *info, void *context) {
+    int saved = errno;
+    task_pool_raise(TASK_EVENT_CALL_STATS);
+    errno = saved;
+
+    if (previousAction.sa_flags & SA_SIGINFO)
+    {
+        if (previousAction.sa_sigaction) previousAction.sa_sigaction(signal, info, context);
+    }
+    else if (previousAction.sa_handler != SIG_DFL && previousAction.sa_handler != SIG_IGN)
+    {
+        previousAction.sa_handler(signal);
+    }
+}
+
+static void dump_task(void *arg) {
+    (void)arg;
+    call_stats_dump();
+}
+
+static void install_handler(void) {
+    if (!task_pool_on_event(TASK_EVENT_CALL_STATS, dump_task))
+    {
+        OSM_LOGW("No task pool to write call stats on SIGUSR1");
+        return;
+    }
+    handlerInstalled = true;
+
+    // On Android the runtime blocks SIGUSR1 in every thread for its own
+    // signal catcher, so there the handler rarely runs; use the query API.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = on_sigusr1;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, &previousAction);
+}
+
+void call_stats_enable(bool enabled) {
+    pthread_mutex_lock(&enableLock);
+    if (enabled && !handlerInstalled) install_handler();
+    __atomic_store_n(&callStatsEnabled, enabled, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&enableLock);
+}
+
+void call_stats_stop(void) {
+    __atomic_store_n(&callStatsEnabled, false, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&enableLock);
+    if (handlerInstalled)
+    {
+        sigaction(SIGUSR1, &previousAction, NULL);
+        handlerInstalled = false;
+    }
+    pthread_mutex_unlock(&enableLock);
+
+    // Blocks stay allocated: a thread of the game may still be inside an
+    // instrumented call.
+    if (__atomic_load_n(&threads, __ATOMIC_ACQUIRE)) call_stats_dump();
+}
@@ -0,0 +1,116 @@
+#ifndef CALL_STATS_H
+#define CALL_STATS_H
+
+#include <stdbool.h>
+
+// Per entry point call counts and latency histograms, on while
+// OSM_CALL_STATS=true. Every thread writes its own cache-line aligned
+// counters; readers add up the counters of all threads without locking.
+// Dumped at unload, on SIGUSR1 and through OSMesaBridgeGetCallStats().
+
+// Bucket i counts calls that took [2^i, 2^(i+1)) ns; the last one is open.
+#define CALL_STATS_BUCKETS 32
+
+// The bridge's own wrappers, in bridge.c.
+#define BRIDGE_ENTRY_POINTS(X) \
+    X(OSMesaGetProcAddress) \
+    X(OSMesaMakeCurrent) \
+    X(OSMesaGetCurrentContext) \
+    X(OSMesaCreateContext) \
+    X(OSMesaDestroyContext) \
+    X(OSMesaFlushFrontbuffer) \
+    X(OSMesaPixelStore) \
+    X(glGetString) \
+    X(glFinish) \
+    X(glClearColor) \
+    X(glClear) \
+    X(glReadPixels) \
+    X(glReadBuffer)
+
+// Entry points gl_offload.c hands out in place of Mesa's: one per
+// gl_commands.h command, the hooks it has no command for, and all of its
+// trampolines together.
+#define OFFLOAD_EXTRA_ENTRY_POINTS(X) \
+    X(DeleteBuffers) \
+    X(DeleteVertexArrays) \
+    X(VertexArrayElementBuffer) \
+    X(Trampolines)
+
+#define CALL_OFFLOAD(n) CALL_OFFLOAD_##n
+
+typedef enum {
+#define X(n) CALL_##n,
+    BRIDGE_ENTRY_POINTS(X)
+#undef X
+#define GL_CMD0(n) CALL_OFFLOAD(n),
+#define GL_CMD1(n, ...) CALL_OFFLOAD(n),
+#define GL_CMD2(n, ...) CALL_OFFLOAD(n),
+#define GL_CMD3(n, ...) CALL_OFFLOAD(n),
+#define GL_CMD4(n, ...) CALL_OFFLOAD(n),
+#define GL_CMD5(n, ...) CALL_OFFLOAD(n),
+#define GL_CMD6(n, ...) CALL_OFFLOAD(n),
+#define GL_UNIFORMV(n, ...) CALL_OFFLOAD(n),
+#define GL_UNIFORM_MATRIX(n, ...) CALL_OFFLOAD(n),
+#define GL_MATRIX(n) CALL_OFFLOAD(n),
+#include "gl_commands.h"
+#undef GL_CMD0
+#undef GL_CMD1
+#undef GL_CMD2
+#undef GL_CMD3
+#undef GL_CMD4
+#undef GL_CMD5
+#undef GL_CMD6
+#undef GL_UNIFORMV
+#undef GL_UNIFORM_MATRIX
+#undef GL_MATRIX
+#define X(n) CALL_OFFLOAD(n),
+    OFFLOAD_EXTRA_ENTRY_POINTS(X)
+#undef X
+    CALL_COUNT
+} CallId;
+
+typedef struct {
+    CallId id;
+    long long start;
+} CallScope;
+
+// Read by every instrumented call; only call_stats_enable() writes it.
+// Hidden so the check is a direct load rather than one through the GOT.
+__attribute__((visibility("hidden"))) extern bool callStatsEnabled;
+
+__attribute__((visibility("hidden"))) CallScope call_stats_enter(CallId id);
+__attribute__((visibility("hidden"))) void call_stats_leave(CallScope *scope);
+
+// Body of an instrumented entry point: return impl args, timed under id
+// while stats are on. Off, this is one branch and a tail call.
+#define CALL_STATS(id, impl, args) \
+    do { \
+        if (__builtin_expect(callStatsEnabled, 0)) \
+        { \
+            __attribute__((cleanup(call_stats_leave))) CallScope callScope = call_stats_enter(id); \
+            return impl args; \
+        } \
+        return impl args; \
+    } while (0)
+// The same for entry points that return nothing.
+#define CALL_STATS_VOID(id, impl, args) \
+    do { \
+        if (__builtin_expect(callStatsEnabled, 0)) \
+        { \
+            __attribute__((cleanup(call_stats_leave))) CallScope callScope = call_stats_enter(id); \
+            impl args; \
+            return; \
+        } \
+        impl args; \
+    } while (0)
+
+// Follow OSM_CALL_STATS. The first time it is turned on this also installs
+// the SIGUSR1 handler, whose dumps run as a task pool event.
+void call_stats_enable(bool enabled);
+// Log one line per entry point that was called, busiest first.
+void call_stats_dump(void);
+// Restore the previous SIGUSR1 handler and dump at unload if anything was
+// counted.
+void call_stats_stop(void);
+
+#endif // CALL_STATS_H
@@ -0,0 +1,642 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "internal.h"
+#include "context_pool.h"
+#include "runtime_config.h"
+#include "gpu_timing.h"
+#include "log.h"
+
+// Kinds of objects a reset deletes, by the names the game got for them.
+typedef enum {
+    NAMES_TEXTURE,
+    NAMES_BUFFER,
+    NAMES_FRAMEBUFFER,
+    NAMES_RENDERBUFFER,
+    NAMES_VERTEX_ARRAY,
+    NAMES_QUERY,
+    NAMES_SAMPLER,
+    NAMES_PIPELINE,
+    NAMES_TRANSFORM_FEEDBACK,
+    NAMES_PROGRAM,
+    NAMES_SHADER,
+    NAMES_LIST,
+    NAME_KINDS
+} NameKind;
+
+// Open addressing set of live names; 0 marks a free slot.
+typedef struct {
+    GLuint *slots;
+    unsigned int capacity;
+    unsigned int count;
+} NameSet;
+
+typedef struct {
+    OSMesaContext ctx;
+    GLenum format;
+    bool shared;
+    // Set when a name could not be recorded, which rules out a reset.
+    bool untracked;
+    NameSet names[NAME_KINDS];
+    bool bound;
+    pthread_t owner;
+    bool parked;
+    bool resetViewport;
+    size_t bytes;
+    unsigned long parkedSerial;
+} ContextEntry;
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static ContextEntry *entries = NULL;
+static int entryCount = 0;
+static int entryCapacity = 0;
+static unsigned long parkSerial = 0;
+// A gen or delete entry point was handed out unhooked while the pool was
+// off, so names can have been created that no entry knows about.
+static bool hooksMissed = false;
+
+bool context_pool_enabled(void) {
+    return RUNTIME_CONFIG_GET(contextPoolSize) > 0;
+}
+
+static ContextEntry* find_entry(OSMesaContext ctx) {
+    for (int i = 0; i < entryCount; i++)
+    {
+        if (entries[i].ctx == ctx) return &entries[i];
+    }
+    return NULL;
+}
+
+static void clear_names(ContextEntry *entry) {
+    for (int kind = 0; kind < NAME_KINDS; kind++)
+    {
+        free(entry->names[kind].slots);
+        memset(&entry->names[kind], 0, sizeof(NameSet));
+    }
+}
+
+static void remove_entry(ContextEntry *entry) {
+    clear_names(entry);
+    *entry = entries[--entryCount];
+}
+
+static unsigned int name_slot(const NameSet *set, GLuint name) {
+    return (name * 2654435761u) & (set->capacity - 1);
+}
+
+static bool name_set_add(NameSet *set, GLuint name) {
+    if ((set->count + 1) * 4 > set->capacity * 3)
+    {
+        unsigned int capacity = set->capacity ? set->capacity * 2 : 64;
+        GLuint *slots = calloc(capacity, sizeof(GLuint));
+        if (!slots) return false;
+        NameSet grown = { slots, capacity, 0 };
+        for (unsigned int i = 0; i < set->capacity; i++)
+        {
+            if (set->slots[i]) name_set_add(&grown, set->slots[i]);
+        }
+        free(set->slots);
+        *set = grown;
+    }
+
+    unsigned int i = name_slot(set, name);
+    while (set->slots[i] && set->slots[i] != name) i = (i + 1) & (set->capacity - 1);
+    if (!set->slots[i]) set->count++;
+    set->slots[i] = name;
+    return true;
+}
+
+static void name_set_remove(NameSet *set, GLuint name) {
+    if (!set->count) return;
+    unsigned int i = name_slot(set, name);
+    while (set->slots[i] != name)
+    {
+        if (!set->slots[i]) return;
+        i = (i + 1) & (set->capacity - 1);
+    }
+
+    // Shift later members of the probe run back so lookups still find them.
+    set->slots[i] = 0;
+    set->count--;
+    for (unsigned int j = (i + 1) & (set->capacity - 1); set->slots[j]; j = (j + 1) & (set->capacity - 1))
+    {
+        GLuint moved = set->slots[j];
+        unsigned int home = name_slot(set, moved);
+        bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+        if (stays) continue;
+        set->slots[i] = moved;
+        set->slots[j] = 0;
+        i = j;
+    }
+}
+
+static void track_names(NameKind kind, GLsizei n, const GLuint *names, bool created) {
+    OSMesaContext ctx = currentContext;
+    if (!ctx || n <= 0 || !names) return;
+
+    pthread_mutex_lock(&poolLock);
+    ContextEntry *entry = find_entry(ctx);
+    for (GLsizei i = 0; entry && i < n; i++)
+    {
+        if (!names[i]) continue;
+        if (!created) name_set_remove(&entry->names[kind], names[i]);
+        else if (!name_set_add(&entry->names[kind], names[i])) entry->untracked = true;
+    }
+    pthread_mutex_unlock(&poolLock);
+}
+
+static void track_range(NameKind kind, GLuint first, GLsizei range, bool created) {
+    for (GLsizei i = 0; first && i < range; i++)
+    {
+        GLuint name = first + (GLuint)i;
+        track_names(kind, 1, &name, created);
+    }
+}
+
+// Hooks OSMesaGetProcAddress() hands out for the calls that create and
+// delete objects while the pool is on. They call on to what the game
+// would have got otherwise and record the names in the current context's
+// entry.
+#define MULTI_NAME_KINDS(X) \
+    X(Textures, NAMES_TEXTURE) \
+    X(Buffers, NAMES_BUFFER) \
+    X(Framebuffers, NAMES_FRAMEBUFFER) \
+    X(Renderbuffers, NAMES_RENDERBUFFER) \
+    X(VertexArrays, NAMES_VERTEX_ARRAY) \
+    X(Queries, NAMES_QUERY) \
+    X(Samplers, NAMES_SAMPLER) \
+    X(ProgramPipelines, NAMES_PIPELINE) \
+    X(TransformFeedbacks, NAMES_TRANSFORM_FEEDBACK)
+
+static struct {
+#define X(n, kind) \
+    void (*Gen##n)(GLsizei, GLuint*); \
+    void (*Delete##n)(GLsizei, const GLuint*);
+    MULTI_NAME_KINDS(X)
+#undef X
+    void (*CreateTextures)(GLenum, GLsizei, GLuint*);
+    void (*CreateQueries)(GLenum, GLsizei, GLuint*);
+    void (*CreateBuffers)(GLsizei, GLuint*);
+    void (*CreateFramebuffers)(GLsizei, GLuint*);
+    void (*CreateRenderbuffers)(GLsizei, GLuint*);
+    void (*CreateVertexArrays)(GLsizei, GLuint*);
+    void (*CreateSamplers)(GLsizei, GLuint*);
+    void (*CreateProgramPipelines)(GLsizei, GLuint*);
+    void (*CreateTransformFeedbacks)(GLsizei, GLuint*);
+    GLuint (*CreateProgram)(void);
+    GLuint (*CreateShaderProgramv)(GLenum, GLsizei, const GLchar* const*);
+    void (*DeleteProgram)(GLuint);
+    GLuint (*CreateShader)(GLenum);
+    void (*DeleteShader)(GLuint);
+    GLuint (*GenLists)(GLsizei);
+    void (*DeleteLists)(GLuint, GLsizei);
+} next;
+
+#define X(n, kind) \
+    static void GLAPIENTRY hook_Gen##n(GLsizei count, GLuint *names) { \
+        next.Gen##n(count, names); \
+        track_names(kind, count, names, true); \
+    } \
+    static void GLAPIENTRY hook_Delete##n(GLsizei count, const GLuint *names) { \
+        track_names(kind, count, names, false); \
+        next.Delete##n(count, names); \
+    }
+MULTI_NAME_KINDS(X)
+#undef X
+
+#define CREATE_HOOK(n, kind) \
+    static void GLAPIENTRY hook_Create##n(GLsizei count, GLuint *names) { \
+        next.Create##n(count, names); \
+        track_names(kind, count, names, true); \
+    }
+#define CREATE_TARGET_HOOK(n, kind) \
+    static void GLAPIENTRY hook_Create##n(GLenum target, GLsizei count, GLuint *names) { \
+        next.Create##n(target, count, names); \
+        track_names(kind, count, names, true); \
+    }
+CREATE_TARGET_HOOK(Textures, NAMES_TEXTURE)
+CREATE_TARGET_HOOK(Queries, NAMES_QUERY)
+CREATE_HOOK(Buffers, NAMES_BUFFER)
+CREATE_HOOK(Framebuffers, NAMES_FRAMEBUFFER)
+CREATE_HOOK(Renderbuffers, NAMES_RENDERBUFFER)
+CREATE_HOOK(VertexArrays, NAMES_VERTEX_ARRAY)
+CREATE_HOOK(Samplers, NAMES_SAMPLER)
+CREATE_HOOK(ProgramPipelines, NAMES_PIPELINE)
+CREATE_HOOK(TransformFeedbacks, NAMES_TRANSFORM_FEEDBACK)
+#undef CREATE_HOOK
+#undef CREATE_TARGET_HOOK
+
+static GLuint GLAPIENTRY hook_CreateProgram(void) {
+    GLuint program = next.CreateProgram();
+    track_names(NAMES_PROGRAM, 1, &program, true);
+    return program;
+}
+
+static GLuint GLAPIENTRY hook_CreateShaderProgramv(GLenum type, GLsizei count, const GLchar* const *strings) {
+    GLuint program = next.CreateShaderProgramv(type, count, strings);
+    track_names(NAMES_PROGRAM, 1, &program, true);
+    return program;
+}
+
+static void GLAPIENTRY hook_DeleteProgram(GLuint program) {
+    track_names(NAMES_PROGRAM, 1, &program, false);
+    next.DeleteProgram(program);
+}
+
+static GLuint GLAPIENTRY hook_CreateShader(GLenum type) {
+    GLuint shader = next.CreateShader(type);
+    track_names(NAMES_SHADER, 1, &shader, true);
+    return shader;
+}
+
+static void GLAPIENTRY hook_DeleteShader(GLuint shader) {
+    track_names(NAMES_SHADER, 1, &shader, false);
+    next.DeleteShader(shader);
+}
+
+static GLuint GLAPIENTRY hook_GenLists(GLsizei range) {
+    GLuint first = next.GenLists(range);
+    track_range(NAMES_LIST, first, range, true);
+    return first;
+}
+
+static void GLAPIENTRY hook_DeleteLists(GLuint list, GLsizei range) {
+    track_range(NAMES_LIST, list, range, false);
+    next.DeleteLists(list, range);
+}
+
+static const struct {
+    const char *name;
+    void *hook;
+    void **next;
+} nameHooks[] = {
+#define X(n, kind) \
+    { "glGen" #n, (void*)hook_Gen##n, (void**)&next.Gen##n }, \
+    { "glCreate" #n, (void*)hook_Create##n, (void**)&next.Create##n }, \
+    { "glDelete" #n, (void*)hook_Delete##n, (void**)&next.Delete##n },
+    MULTI_NAME_KINDS(X)
+#undef X
+    { "glCreateProgram", (void*)hook_CreateProgram, (void**)&next.CreateProgram },
+    { "glCreateShaderProgramv", (void*)hook_CreateShaderProgramv, (void**)&next.CreateShaderProgramv },
+    { "glDeleteProgram", (void*)hook_DeleteProgram, (void**)&next.DeleteProgram },
+    { "glCreateShader", (void*)hook_CreateShader, (void**)&next.CreateShader },
+    { "glDeleteShader", (void*)hook_DeleteShader, (void**)&next.DeleteShader },
+    { "glGenLists", (void*)hook_GenLists, (void**)&next.GenLists },
+    { "glDeleteLists", (void*)hook_DeleteLists, (void**)&next.DeleteLists },
+};
+
+OSMESAproc context_pool_wrap_proc(const char *funcName, OSMESAproc proc) {
+    if (!proc || !funcName || strncmp(funcName, "gl", 2)) return proc;
+
+    // glGenBuffersARB and the like behave as the core call.
+    size_t length = strlen(funcName);
+    while (length > 2 && funcName[length - 1] >= 'A' && funcName[length - 1] <= 'Z') length--;
+    for (size_t i = 0; i < sizeof(nameHooks) / sizeof(nameHooks[0]); i++)
+    {
+        if (strlen(nameHooks[i].name) != length || strncmp(nameHooks[i].name, funcName, length)) continue;
+        if (!context_pool_enabled())
+        {
+            __atomic_store_n(&hooksMissed, true, __ATOMIC_RELAXED);
+            return proc;
+        }
+        __atomic_store_n(nameHooks[i].next, (void*)proc, __ATOMIC_RELEASE);
+        return (OSMESAproc)nameHooks[i].hook;
+    }
+    return proc;
+}
+
+void context_pool_on_create(OSMesaContext ctx, GLenum format, OSMesaContext sharelist) {
+    if (!context_pool_enabled() || !ctx) return;
+
+    pthread_mutex_lock(&poolLock);
+    if (entryCount == entryCapacity)
+    {
+        int capacity = entryCapacity ? entryCapacity * 2 : 8;
+        ContextEntry *grown = realloc(entries, capacity * sizeof(ContextEntry));
+        if (!grown)
+        {
+            pthread_mutex_unlock(&poolLock);
+            return;
+        }
+        entries = grown;
+        entryCapacity = capacity;
+    }
+
+    ContextEntry *entry = &entries[entryCount++];
+    memset(entry, 0, sizeof(*entry));
+    entry->ctx = ctx;
+    entry->format = format;
+    entry->shared = sharelist != NULL;
+
+    if (sharelist)
+    {
+        ContextEntry *parent = find_entry(sharelist);
+        if (parent) parent->shared = true;
+    }
+    pthread_mutex_unlock(&poolLock);
+}
+
+void context_pool_on_make_current(OSMesaContext previous, OSMesaContext ctx, GLsizei width, GLsizei height) {
+    if (!context_pool_enabled()) return;
+
+    bool resetViewport = false;
+
+    pthread_mutex_lock(&poolLock);
+    ContextEntry *entry = previous ? find_entry(previous) : NULL;
+    if (entry) entry->bound = false;
+
+    entry = ctx ? find_entry(ctx) : NULL;
+    if (entry)
+    {
+        entry->bound = true;
+        entry->owner = pthread_self();
+        // Color plus depth/stencil for the framebuffer this context renders to.
+        entry->bytes = (size_t)width * (size_t)height * 8;
+        resetViewport = entry->resetViewport;
+        entry->resetViewport = false;
+    }
+    pthread_mutex_unlock(&poolLock);
+
+    // Mesa only sizes the viewport the first time a context is made
+    // current, so a reused context would keep the previous owner's size.
+    if (resetViewport)
+    {
+        void (*viewport)(GLint, GLint, GLsizei, GLsizei) = (void (*)(GLint, GLint, GLsizei, GLsizei))bridge_get_proc("glViewport");
+        void (*scissor)(GLint, GLint, GLsizei, GLsizei) = (void (*)(GLint, GLint, GLsizei, GLsizei))bridge_get_proc("glScissor");
+        if (viewport) viewport(0, 0, width, height);
+        if (scissor) scissor(0, 0, width, height);
+    }
+}
+
+OSMesaContext context_pool_take(GLenum format, OSMesaContext sharelist) {
+    if (!context_pool_enabled() || sharelist) return NULL;
+
+    OSMesaContext ctx = NULL;
+
+    pthread_mutex_lock(&poolLock);
+    ContextEntry *best = NULL;
+    for (int i = 0; i < entryCount; i++)
+    {
+        ContextEntry *entry = &entries[i];
+        if (!entry->parked || entry->format != format) continue;
+        if (!best || entry->parkedSerial > best->parkedSerial) best = entry;
+    }
+    if (best)
+    {
+        best->parked = false;
+        best->resetViewport = true;
+        ctx = best->ctx;
+    }
+    pthread_mutex_unlock(&poolLock);
+
+    if (ctx) OSM_LOGI("Reusing pooled context %p", (void*)ctx);
+    return ctx;
+}
+
+typedef void (*DeleteNamesProc)(GLsizei, const GLuint*);
+
+// Take the recorded names of ctx out of its entry. NULL when there were none.
+static GLuint* take_names(OSMesaContext ctx, NameKind kind, unsigned int *count) {
+    GLuint *names = NULL;
+    *count = 0;
+
+    pthread_mutex_lock(&poolLock);
+    ContextEntry *entry = find_entry(ctx);
+    NameSet *set = entry ? &entry->names[kind] : NULL;
+    if (set && set->count && (names = malloc(set->count * sizeof(GLuint))))
+    {
+        for (unsigned int i = 0; i < set->capacity; i++)
+        {
+            if (set->slots[i]) names[(*count)++] = set->slots[i];
+        }
+    }
+    if (set)
+    {
+        free(set->slots);
+        memset(set, 0, sizeof(*set));
+    }
+    pthread_mutex_unlock(&poolLock);
+    return names;
+}
+
+static void delete_names(OSMesaContext ctx, NameKind kind, const char *deleteNames) {
+    unsigned int count;
+    GLuint *names = take_names(ctx, kind, &count);
+    DeleteNamesProc del = (DeleteNamesProc)bridge_get_proc(deleteNames);
+    if (names && del) del((GLsizei)count, names);
+    free(names);
+}
+
+static void delete_each(OSMesaContext ctx, NameKind kind, const char *deleteName) {
+    unsigned int count;
+    GLuint *names = take_names(ctx, kind, &count);
+    void (*del)(GLuint) = (void (*)(GLuint))bridge_get_proc(deleteName);
+    for (unsigned int i = 0; names && del && i < count; i++) del(names[i]);
+    free(names);
+}
+
+static void delete_lists(OSMesaContext ctx) {
+    unsigned int count;
+    GLuint *names = take_names(ctx, NAMES_LIST, &count);
+    void (*del)(GLuint, GLsizei) = (void (*)(GLuint, GLsizei))bridge_get_proc("glDeleteLists");
+    for (unsigned int i = 0; names && del && i < count; i++) del(names[i], 1);
+    free(names);
+}
+
+#define RESET_CALL(name, params, ...) \
+    do { void (*fn) params = (void (*) params)bridge_get_proc(#name); if (fn) fn(__VA_ARGS__); } while (0)
+
+// Bring ctx, bound on this thread, back to what a freshly created context
+// would look like, for the state games commonly touch. Every object the
+// game created through the hooks above is deleted.
+static void reset_context_state(OSMesaContext ctx) {
+    RESET_CALL(glUseProgram, (GLuint), 0);
+    RESET_CALL(glBindVertexArray, (GLuint), 0);
+
+    delete_names(ctx, NAMES_TEXTURE, "glDeleteTextures");
+    delete_names(ctx, NAMES_BUFFER, "glDeleteBuffers");
+    delete_names(ctx, NAMES_FRAMEBUFFER, "glDeleteFramebuffers");
+    delete_names(ctx, NAMES_RENDERBUFFER, "glDeleteRenderbuffers");
+    delete_names(ctx, NAMES_VERTEX_ARRAY, "glDeleteVertexArrays");
+    delete_names(ctx, NAMES_QUERY, "glDeleteQueries");
+    delete_names(ctx, NAMES_SAMPLER, "glDeleteSamplers");
+    delete_names(ctx, NAMES_PIPELINE, "glDeleteProgramPipelines");
+    delete_names(ctx, NAMES_TRANSFORM_FEEDBACK, "glDeleteTransformFeedbacks");
+    delete_each(ctx, NAMES_PROGRAM, "glDeleteProgram");
+    delete_each(ctx, NAMES_SHADER, "glDeleteShader");
+    delete_lists(ctx);
+
+    // The game's debug callback would otherwise outlive it. A fresh debug
+    // context starts with output on, any other with it off; low severity
+    // messages start muted.
+    RESET_CALL(glDebugMessageCallback, (GLDEBUGPROC, const void*), NULL, NULL);
+    RESET_CALL(glDebugMessageControl, (GLenum, GLenum, GLenum, GLsizei, const GLuint*, GLboolean), GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    RESET_CALL(glDebugMessageControl, (GLenum, GLenum, GLenum, GLsizei, const GLuint*, GLboolean), GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_LOW, 0, NULL, GL_FALSE);
+    GLint contextFlags = 0;
+    RESET_CALL(glGetIntegerv, (GLenum, GLint*), GL_CONTEXT_FLAGS, &contextFlags);
+    if (contextFlags & GL_CONTEXT_FLAG_DEBUG_BIT) RESET_CALL(glEnable, (GLenum), GL_DEBUG_OUTPUT);
+    else RESET_CALL(glDisable, (GLenum), GL_DEBUG_OUTPUT);
+    RESET_CALL(glDisable, (GLenum), GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+    static const GLenum disabledCaps[] = {
+        GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_STENCIL_TEST, GL_SCISSOR_TEST,
+        GL_POLYGON_OFFSET_FILL, GL_POLYGON_OFFSET_LINE, GL_SAMPLE_ALPHA_TO_COVERAGE,
+        GL_COLOR_LOGIC_OP, GL_ALPHA_TEST, GL_LIGHTING, GL_FOG, GL_TEXTURE_2D,
+        GL_COLOR_MATERIAL, GL_NORMALIZE, GL_RESCALE_NORMAL, GL_LINE_SMOOTH,
+    };
+    void (*disable)(GLenum) = (void (*)(GLenum))bridge_get_proc("glDisable");
+    if (disable)
+    {
+        for (size_t i = 0; i < sizeof(disabledCaps) / sizeof(disabledCaps[0]); i++) disable(disabledCaps[i]);
+    }
+    RESET_CALL(glEnable, (GLenum), GL_DITHER);
+
+    RESET_CALL(glClearColor, (GLclampf, GLclampf, GLclampf, GLclampf), 0.0f, 0.0f, 0.0f, 0.0f);
+    RESET_CALL(glClearDepth, (GLclampd), 1.0);
+    RESET_CALL(glClearStencil, (GLint), 0);
+    RESET_CALL(glColorMask, (GLboolean, GLboolean, GLboolean, GLboolean), GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    RESET_CALL(glDepthMask, (GLboolean), GL_TRUE);
+    RESET_CALL(glStencilMask, (GLuint), ~0u);
+    RESET_CALL(glDepthFunc, (GLenum), GL_LESS);
+    RESET_CALL(glStencilFunc, (GLenum, GLint, GLuint), GL_ALWAYS, 0, ~0u);
+    RESET_CALL(glStencilOp, (GLenum, GLenum, GLenum), GL_KEEP, GL_KEEP, GL_KEEP);
+    RESET_CALL(glBlendFunc, (GLenum, GLenum), GL_ONE, GL_ZERO);
+    RESET_CALL(glBlendEquation, (GLenum), GL_FUNC_ADD);
+    RESET_CALL(glCullFace, (GLenum), GL_BACK);
+    RESET_CALL(glFrontFace, (GLenum), GL_CCW);
+    RESET_CALL(glPolygonMode, (GLenum, GLenum), GL_FRONT_AND_BACK, GL_FILL);
+    RESET_CALL(glPolygonOffset, (GLfloat, GLfloat), 0.0f, 0.0f);
+    RESET_CALL(glLineWidth, (GLfloat), 1.0f);
+    RESET_CALL(glActiveTexture, (GLenum), GL_TEXTURE0);
+    RESET_CALL(glPixelStorei, (GLenum, GLint), GL_PACK_ALIGNMENT, 4);
+    RESET_CALL(glPixelStorei, (GLenum, GLint), GL_UNPACK_ALIGNMENT, 4);
+    RESET_CALL(glPixelStorei, (GLenum, GLint), GL_PACK_ROW_LENGTH, 0);
+    RESET_CALL(glPixelStorei, (GLenum, GLint), GL_UNPACK_ROW_LENGTH, 0);
+    RESET_CALL(glReadBuffer, (GLenum), GL_FRONT);
+    RESET_CALL(glDrawBuffer, (GLenum), GL_FRONT);
+
+    static const GLenum matrixModes[] = { GL_TEXTURE, GL_PROJECTION, GL_MODELVIEW };
+    void (*matrixMode)(GLenum) = (void (*)(GLenum))bridge_get_proc("glMatrixMode");
+    void (*loadIdentity)(void) = (void (*)(void))bridge_get_proc("glLoadIdentity");
+    if (matrixMode && loadIdentity)
+    {
+        for (size_t i = 0; i < sizeof(matrixModes) / sizeof(matrixModes[0]); i++)
+        {
+            matrixMode(matrixModes[i]);
+            loadIdentity();
+        }
+    }
+    RESET_CALL(glColor4f, (GLfloat, GLfloat, GLfloat, GLfloat), 1.0f, 1.0f, 1.0f, 1.0f);
+
+    // Drop errors raised by calls the profile does not support.
+    GLenum (*getError)(void) = (GLenum (*)(void))bridge_get_proc("glGetError");
+    if (getError)
+    {
+        for (int i = 0; i < 32 && getError() != GL_NO_ERROR; i++);
+    }
+}
+
+#undef RESET_CALL
+
+bool context_pool_park(OSMesaContext ctx) {
+    const RuntimeConfig *config = runtime_config_acquire();
+    int poolSize = config->contextPoolSize;
+    size_t poolBytes = config->contextPoolBytes;
+    runtime_config_release();
+    if (poolSize <= 0 || !ctx || !real_OSMesaMakeCurrent) return false;
+
+    pthread_mutex_lock(&poolLock);
+    ContextEntry *entry = find_entry(ctx);
+    bool poolable = entry && !entry->shared && !entry->untracked && !entry->parked && entry->bytes <= poolBytes
+        && (!entry->bound || pthread_equal(entry->owner, pthread_self()));
+    GLenum format = entry ? entry->format : 0;
+    pthread_mutex_unlock(&poolLock);
+
+    if (!poolable) return false;
+    if (__atomic_load_n(&hooksMissed, __ATOMIC_RELAXED))
+    {
+        static bool warned = false;
+        if (!warned) OSM_LOGW("Not pooling contexts: the game looked up GL entry points while the pool was off, so their objects cannot be found");
+        warned = true;
+        return false;
+    }
+
+    bool wasCurrent = ctx == currentContext;
+    GLenum type = format == OSMESA_RGB_565 ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE;
+    if (!wasCurrent && !bridge_bind_scratch(ctx, type)) return false;
+
+    if (gpuTimingEnabled) gpu_timing_on_destroy(ctx, true);
+    reset_context_state(ctx);
+
+    if (wasCurrent)
+    {
+        real_OSMesaMakeCurrent(NULL, NULL, 0, 0, 0);
+    }
+    else
+    {
+        bridge_restore_current();
+    }
+
+    // Evict the oldest parked contexts until the new one fits.
+    OSMesaContext evicted[16];
+    int evictedCount = 0;
+
+    pthread_mutex_lock(&poolLock);
+    entry = find_entry(ctx);
+    if (entry)
+    {
+        entry->bound = false;
+        entry->parked = true;
+        entry->parkedSerial = ++parkSerial;
+    }
+
+    for (;;)
+    {
+        int parked = 0;
+        size_t bytes = 0;
+        ContextEntry *oldest = NULL;
+        for (int i = 0; i < entryCount; i++)
+        {
+            if (!entries[i].parked) continue;
+            parked++;
+            bytes += entries[i].bytes;
+            if (!oldest || entries[i].parkedSerial < oldest->parkedSerial) oldest = &entries[i];
+        }
+        if ((parked <= poolSize && bytes <= poolBytes) || !oldest || evictedCount == 16) break;
+        evicted[evictedCount++] = oldest->ctx;
+        remove_entry(oldest);
+    }
+    pthread_mutex_unlock(&poolLock);
+
+    for (int i = 0; i < evictedCount; i++)
+    {
+        OSM_LOGI("Evicting pooled context %p", (void*)evicted[i]);
+        bridge_destroy_context(evicted[i]);
+    }
+    return true;
+}
+
+void context_pool_forget(OSMesaContext ctx) {
+    if (!context_pool_enabled() || !ctx) return;
+
+    pthread_mutex_lock(&poolLock);
+    ContextEntry *entry = find_entry(ctx);
+    if (entry) remove_entry(entry);
+    pthread_mutex_unlock(&poolLock);
+}
+
+void context_pool_drain(void) {
+    pthread_mutex_lock(&poolLock);
+    for (int i = 0; i < entryCount;)
+    {
+        if (!entries[i].parked)
+        {
+            i++;
+            continue;
+        }
+        if (real_OSMesaDestroyContext) real_OSMesaDestroyContext(entries[i].ctx);
+        remove_entry(&entries[i]);
+    }
+    pthread_mutex_unlock(&poolLock);
+}
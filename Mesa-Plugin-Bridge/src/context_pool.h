@@ -0,0 +1,35 @@
+#ifndef CONTEXT_POOL_H
+#define CONTEXT_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <GL/osmesa.h>
+
+// Contexts handed to OSMesaDestroyContext() are parked here instead of
+// being torn down, so a later OSMesaCreateContext() with the same format
+// can skip driver initialization (a full Vulkan device bring-up on zink).
+// Only contexts that never shared lists are pooled, because resetting a
+// parked context deletes every object it owns. Those objects are found by
+// the names the game got from the gen and create calls, which the pool
+// hooks through OSMesaGetProcAddress(); objects of kinds without such a
+// hook (e.g. fences, ARB programs) survive into the next user.
+
+// Limits come from the current RuntimeConfig, so they follow reloads.
+bool context_pool_enabled(void);
+
+void context_pool_on_create(OSMesaContext ctx, GLenum format, OSMesaContext sharelist);
+void context_pool_on_make_current(OSMesaContext previous, OSMesaContext ctx, GLsizei width, GLsizei height);
+
+// Returns a parked context compatible with the request, or NULL.
+OSMesaContext context_pool_take(GLenum format, OSMesaContext sharelist);
+// Resets ctx and parks it. Returns false if the caller must destroy it.
+bool context_pool_park(OSMesaContext ctx);
+// Forget a context that is about to be destroyed for real.
+void context_pool_forget(OSMesaContext ctx);
+// Hook the gl* calls that create or delete objects so their names are known
+// at reset. Returns proc itself for every other name.
+OSMESAproc context_pool_wrap_proc(const char *funcName, OSMESAproc proc);
+// Destroy every parked context.
+void context_pool_drain(void);
+
+#endif // CONTEXT_POOL_H
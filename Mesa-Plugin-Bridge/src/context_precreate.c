@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "internal.h"
+#include "context_precreate.h"
+#include "task_pool.h"
+#include "startup_timing.h"
+#include "log.h"
+
+typedef enum {
+    PRECREATE_IDLE,
+    // Submitted, but no worker has picked it up yet.
+    PRECREATE_QUEUED,
+    PRECREATE_RUNNING,
+    PRECREATE_DONE,
+    PRECREATE_DISOWNED,
+} PrecreateState;
+
+static pthread_mutex_t precreateLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t precreateCond = PTHREAD_COND_INITIALIZER;
+static bool taskPending = false;
+// Set once the task is past the point where it can still back out.
+static bool taskStarted = false;
+static PrecreateState state = PRECREATE_IDLE;
+static GLenum precreateFormat = 0;
+static OSMesaContext precreatedContext = NULL;
+// How long the task took to create it, which the first create saves less
+// whatever it waited for the task.
+static long long createNs = 0;
+
+static void precreate_task(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&precreateLock);
+    bool cancelled = state == PRECREATE_DISOWNED;
+    if (cancelled)
+    {
+        taskPending = false;
+    }
+    else
+    {
+        state = PRECREATE_RUNNING;
+        taskStarted = true;
+    }
+    pthread_mutex_unlock(&precreateLock);
+    if (cancelled) return;
+
+    long long start = bridge_now_ns();
+    OSMesaContext ctx = real_OSMesaCreateContext(precreateFormat, NULL);
+    long long end = bridge_now_ns();
+    startup_stage("Pre-create context", start, end);
+
+    pthread_mutex_lock(&precreateLock);
+    bool disowned = state == PRECREATE_DISOWNED;
+    if (!disowned)
+    {
+        precreatedContext = ctx;
+        createNs = end - start;
+        state = PRECREATE_DONE;
+    }
+    pthread_cond_broadcast(&precreateCond);
+    pthread_mutex_unlock(&precreateLock);
+
+    if (disowned && ctx) bridge_destroy_context(ctx);
+
+    pthread_mutex_lock(&precreateLock);
+    taskPending = false;
+    pthread_cond_broadcast(&precreateCond);
+    pthread_mutex_unlock(&precreateLock);
+}
+
+void context_precreate_start(GLenum format) {
+    if (!real_OSMesaCreateContext || !format) return;
+
+    pthread_mutex_lock(&precreateLock);
+    if (state == PRECREATE_IDLE)
+    {
+        precreateFormat = format;
+        state = PRECREATE_QUEUED;
+        taskPending = true;
+        if (task_pool_submit(precreate_task, NULL))
+        {
+            OSM_LOGI("Pre-creating context with format 0x%x", format);
+        }
+        else
+        {
+            state = PRECREATE_IDLE;
+            taskPending = false;
+        }
+    }
+    pthread_mutex_unlock(&precreateLock);
+}
+
+OSMesaContext context_precreate_adopt(GLenum format, OSMesaContext sharelist) {
+    OSMesaContext ctx = NULL;
+    OSMesaContext discarded = NULL;
+
+    pthread_mutex_lock(&precreateLock);
+    if (state == PRECREATE_QUEUED)
+    {
+        // Still behind other work on the pool: creating here is sooner
+        // than waiting for it to start, and the task skips its create.
+        state = PRECREATE_DISOWNED;
+        pthread_mutex_unlock(&precreateLock);
+
+        long long now = bridge_now_ns();
+        startup_stage("Pre-created context discarded", now, now);
+        OSM_LOGI("Pre-create had not started by the first create, creating directly");
+        return NULL;
+    }
+    if (state != PRECREATE_RUNNING && state != PRECREATE_DONE)
+    {
+        pthread_mutex_unlock(&precreateLock);
+        return NULL;
+    }
+
+    if (format != precreateFormat || sharelist)
+    {
+        // Let the task dispose of its context when it finishes rather
+        // than making this create wait for it.
+        if (state == PRECREATE_DONE) discarded = precreatedContext;
+        precreatedContext = NULL;
+        state = PRECREATE_DISOWNED;
+        pthread_mutex_unlock(&precreateLock);
+
+        long long now = bridge_now_ns();
+        startup_stage("Pre-created context discarded", now, now);
+        OSM_LOGI("Discarding pre-created context, format 0x%x was requested", format);
+        if (discarded) bridge_destroy_context(discarded);
+        return NULL;
+    }
+
+    long long start = bridge_now_ns();
+    while (state == PRECREATE_RUNNING) pthread_cond_wait(&precreateCond, &precreateLock);
+    long long end = bridge_now_ns();
+    ctx = precreatedContext;
+    precreatedContext = NULL;
+    state = PRECREATE_IDLE;
+    long long created = createNs;
+    pthread_mutex_unlock(&precreateLock);
+
+    if (ctx)
+    {
+        // The stage spans the wait, so the report shows how much of the
+        // create the game still sat through.
+        startup_stage("Pre-created context adopted", start, end);
+        OSM_LOGI("Adopted pre-created context %p: it took %.2f ms to create, the first create waited %.2f ms for it",
+                (void*)ctx, created / 1e6, (end - start) / 1e6);
+    }
+    return ctx;
+}
+
+void context_precreate_stop(void) {
+    pthread_mutex_lock(&precreateLock);
+    // A task that has not started returns as soon as it runs and needs no
+    // waiting for; one that is creating must finish before Mesa goes.
+    if (state == PRECREATE_QUEUED || state == PRECREATE_RUNNING) state = PRECREATE_DISOWNED;
+    OSMesaContext ctx = precreatedContext;
+    precreatedContext = NULL;
+    while (taskStarted && taskPending) pthread_cond_wait(&precreateCond, &precreateLock);
+    pthread_mutex_unlock(&precreateLock);
+
+    if (ctx && real_OSMesaDestroyContext) real_OSMesaDestroyContext(ctx);
+}
@@ -0,0 +1,17 @@
+#ifndef CONTEXT_PRECREATE_H
+#define CONTEXT_PRECREATE_H
+
+#include <GL/osmesa.h>
+
+// Speculatively creates a context on the task pool while the game is
+// still starting up, using the format the previous session asked for.
+
+void context_precreate_start(GLenum format);
+// Returns the speculative context if it matches the request (waiting for
+// it to finish if it is being created), or NULL. A mismatch discards it,
+// and so does a task that has not started yet.
+OSMesaContext context_precreate_adopt(GLenum format, OSMesaContext sharelist);
+// Wait for a running task and destroy a context nobody adopted.
+void context_precreate_stop(void);
+
+#endif // CONTEXT_PRECREATE_H
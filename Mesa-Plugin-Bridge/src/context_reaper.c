@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "internal.h"
+#include "context_reaper.h"
+#include "task_pool.h"
+#include "log.h"
+
+typedef struct ReapNode {
+    OSMesaContext ctx;
+    struct ReapNode *next;
+} ReapNode;
+
+static pthread_mutex_t reaperLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reaperCond = PTHREAD_COND_INITIALIZER;
+static ReapNode *queueHead = NULL;
+static ReapNode *queueTail = NULL;
+// A reap task is queued or running. Only one at a time, so contexts go in
+// submission order even though the pool runs tasks in any order.
+static bool reaperActive = false;
+static bool reaperStopping = false;
+
+static void reap_task(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&reaperLock);
+    while (queueHead)
+    {
+        ReapNode *node = queueHead;
+        queueHead = node->next;
+        if (!queueHead) queueTail = NULL;
+        pthread_mutex_unlock(&reaperLock);
+
+        if (real_OSMesaDestroyContext) real_OSMesaDestroyContext(node->ctx);
+        OSM_LOGI("Destroyed context %p in background", (void*)node->ctx);
+        free(node);
+
+        pthread_mutex_lock(&reaperLock);
+    }
+    reaperActive = false;
+    pthread_cond_broadcast(&reaperCond);
+    pthread_mutex_unlock(&reaperLock);
+}
+
+// The caller destroys ctx itself when the reaper cannot take it, which must
+// not overtake contexts submitted before it.
+static bool refuse(ReapNode *node) {
+    while (reaperActive) pthread_cond_wait(&reaperCond, &reaperLock);
+    pthread_mutex_unlock(&reaperLock);
+    free(node);
+    return false;
+}
+
+bool context_reaper_submit(OSMesaContext ctx) {
+    if (!ctx) return false;
+
+    ReapNode *node = malloc(sizeof(ReapNode));
+    pthread_mutex_lock(&reaperLock);
+    if (!node || reaperStopping || (!reaperActive && !task_pool_submit(reap_task, NULL))) return refuse(node);
+    node->ctx = ctx;
+    node->next = NULL;
+    reaperActive = true;
+
+    if (queueTail)
+    {
+        queueTail->next = node;
+    }
+    else
+    {
+        queueHead = node;
+    }
+    queueTail = node;
+    pthread_mutex_unlock(&reaperLock);
+    return true;
+}
+
+void context_reaper_stop(void) {
+    pthread_mutex_lock(&reaperLock);
+    reaperStopping = true;
+    while (reaperActive) pthread_cond_wait(&reaperCond, &reaperLock);
+    pthread_mutex_unlock(&reaperLock);
+}
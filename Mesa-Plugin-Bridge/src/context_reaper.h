@@ -0,0 +1,17 @@
+#ifndef CONTEXT_REAPER_H
+#define CONTEXT_REAPER_H
+
+#include <stdbool.h>
+#include <GL/osmesa.h>
+
+// Runs OSMesaDestroyContext() on the task pool for the bridge, so driver
+// teardown does not stall the render thread. Contexts are destroyed
+// strictly in submission order, which keeps sharelist groups consistent.
+
+// Queue ctx for destruction. Returns false if the caller must destroy it,
+// after waiting for everything queued before.
+bool context_reaper_submit(OSMesaContext ctx);
+// Wait until everything queued is destroyed.
+void context_reaper_stop(void);
+
+#endif // CONTEXT_REAPER_H
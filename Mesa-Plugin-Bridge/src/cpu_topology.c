@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cpu_topology.h"
+
+static bool read_long(const char *path, long *value) {
+    FILE *file = fopen(path, "r");
+    if (!file) return false;
+    bool ok = fscanf(file, "%ld", value) == 1;
+    fclose(file);
+    return ok;
+}
+
+// Parse a cpulist such as "0-3,6,8-9" into set, returning the highest cpu + 1.
+static int parse_cpu_list(const char *list, cpu_set_t *set) {
+    int highest = 0;
+    const char *p = list;
+    while (*p)
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        if (*end == '-') last = strtol(end + 1, &end, 10);
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, set);
+            if (cpu + 1 > highest) highest = (int)cpu + 1;
+        }
+        p = *end == ',' ? end + 1 : end;
+        if (*p == '\n') break;
+    }
+    return highest;
+}
+
+bool cpu_topology_detect(const char *sysfsRoot, CpuTopology *topology) {
+    char path[512];
+    char list[256] = {0};
+    cpu_set_t possible;
+
+    memset(topology, 0, sizeof(*topology));
+    CPU_ZERO(&possible);
+
+    snprintf(path, sizeof(path), "%s/devices/system/cpu/possible", sysfsRoot);
+    FILE *file = fopen(path, "r");
+    if (!file) return false;
+    if (!fgets(list, sizeof(list), file)) list[0] = '\0';
+    fclose(file);
+
+    topology->cpuCount = parse_cpu_list(list, &possible);
+    if (!topology->cpuCount) return false;
+
+    int maxCapacity = 0;
+    for (int cpu = 0; cpu < topology->cpuCount; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &possible)) continue;
+
+        long value;
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/online", sysfsRoot, cpu);
+        if (read_long(path, &value) && value == 0) continue;
+
+        // Prefer the scheduler's capacity, fall back to the maximum clock.
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/cpu_capacity", sysfsRoot, cpu);
+        if (!read_long(path, &value))
+        {
+            snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", sysfsRoot, cpu);
+            if (!read_long(path, &value)) value = 1;
+        }
+        if (value <= 0) value = 1;
+
+        topology->capacity[cpu] = (int)value;
+        CPU_SET(cpu, &topology->online);
+        topology->onlineCount++;
+        if (value > maxCapacity) maxCapacity = (int)value;
+    }
+    if (!topology->onlineCount) return false;
+
+    for (int cpu = 0; cpu < topology->cpuCount; cpu++)
+    {
+        if (!topology->capacity[cpu]) continue;
+        if (topology->capacity[cpu] * 10 >= maxCapacity * 8)
+        {
+            CPU_SET(cpu, &topology->big);
+            topology->bigCount++;
+        }
+        else
+        {
+            CPU_SET(cpu, &topology->little);
+            topology->littleCount++;
+        }
+    }
+    if (!topology->littleCount)
+    {
+        topology->little = topology->big;
+        topology->littleCount = topology->bigCount;
+    }
+    return true;
+}
+
+static CpuTopology cachedTopology;
+static bool cachedValid = false;
+static pthread_once_t detectOnce = PTHREAD_ONCE_INIT;
+
+static const char* sysfs_root(void) {
+    const char *root = getenv("OSM_SYSFS_ROOT");
+    return root && *root ? root : "/sys";
+}
+
+static void detect_cached(void) {
+    cachedValid = cpu_topology_detect(sysfs_root(), &cachedTopology);
+}
+
+const CpuTopology* cpu_topology_get(void) {
+    pthread_once(&detectOnce, detect_cached);
+    return cachedValid ? &cachedTopology : NULL;
+}
+
+bool cpu_topology_detect_current(CpuTopology *topology) {
+    return cpu_topology_detect(sysfs_root(), topology);
+}
@@ -0,0 +1,27 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <stdbool.h>
+#include <sched.h>
+
+// Core capacities as reported under <sysfs>/devices/system/cpu. Cores
+// within 80% of the fastest one count as big, everything else as little;
+// on a homogeneous SoC both sets hold every online core.
+typedef struct {
+    int cpuCount;
+    int onlineCount;
+    int bigCount;
+    int littleCount;
+    int capacity[CPU_SETSIZE];
+    cpu_set_t online;
+    cpu_set_t big;
+    cpu_set_t little;
+} CpuTopology;
+
+bool cpu_topology_detect(const char *sysfsRoot, CpuTopology *topology);
+// Detected once from $OSM_SYSFS_ROOT (default /sys) and cached.
+const CpuTopology* cpu_topology_get(void);
+// Detected again from the same root, for callers following hotplug.
+bool cpu_topology_detect_current(CpuTopology *topology);
+
+#endif // CPU_TOPOLOGY_H
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "internal.h"
+#include "probe.h"
+#include "driver_select.h"
+#include "log.h"
+
+#define MAX_DRIVERS 8
+#define MAX_NAME 32
+#define PROBE_WIDTH 640
+#define PROBE_HEIGHT 360
+#define PROBE_FRAMES 20
+#define PROBE_TIMEOUT_MS 10000
+// A driver whose slow frames are this many times its median stutters too
+// much to pick over a steadier one.
+#define MAX_JITTER 4.0
+
+#ifdef __ANDROID__
+#define DEFAULT_CANDIDATES "zink,freedreno,panfrost,llvmpipe"
+#define FALLBACK_DRIVER "zink"
+#else
+#define DEFAULT_CANDIDATES "llvmpipe,softpipe,zink"
+#define FALLBACK_DRIVER "llvmpipe"
+#endif
+
+static const char *envFilePath = NULL;
+static bool pending = false;
+static char candidateList[256];
+static char chosenDriver[MAX_NAME];
+
+void driver_select_prepare(const char *file_path, const char *recorded, const char *candidates) {
+    const char *driver = getenv("GALLIUM_DRIVER");
+    if (!driver || strcmp(driver, "auto")) return;
+
+    if (recorded && recorded[0])
+    {
+        setenv("GALLIUM_DRIVER", recorded, 1);
+        OSM_LOGN("Set Env GALLIUM_DRIVER=%s (auto)", recorded);
+        return;
+    }
+
+    envFilePath = file_path;
+    snprintf(candidateList, sizeof(candidateList), "%s", candidates && candidates[0] ? candidates : DEFAULT_CANDIDATES);
+    pending = true;
+    // Mesa does not know "auto", and the probe finishes long after the
+    // first context; this launch makes do with the fallback.
+    setenv("GALLIUM_DRIVER", FALLBACK_DRIVER, 1);
+    OSM_LOGN("Set Env GALLIUM_DRIVER=%s (auto, probing for the next launch)", FALLBACK_DRIVER);
+}
+
+bool driver_select_pending(void) {
+    return pending;
+}
+
+// Mesa falls back to a software rasterizer when the requested driver is
+// missing, so make sure the renderer really is the one asked for.
+static bool renderer_matches(const char *driver, const char *renderer) {
+    if (strcasestr(renderer, driver)) return true;
+    if (!strcmp(driver, "llvmpipe") || !strcmp(driver, "softpipe") || !strcmp(driver, "zink")) return false;
+    return !strcasestr(renderer, "llvmpipe") && !strcasestr(renderer, "softpipe") && !strcasestr(renderer, "zink");
+}
+
+const char* driver_select_run(void) {
+    if (!pending) return NULL;
+    pending = false;
+
+    char names[MAX_DRIVERS][MAX_NAME];
+    int count = 0;
+    char list[sizeof(candidateList)];
+    strcpy(list, candidateList);
+    for (char *save = NULL, *name = strtok_r(list, ",", &save); name && count < MAX_DRIVERS; name = strtok_r(NULL, ",", &save))
+    {
+        if (name[0]) snprintf(names[count++], MAX_NAME, "%s", name);
+    }
+
+    char timings[512] = "";
+    int best = -1;
+    bool bestStable = false;
+    double bestMs = 0;
+    long long start = bridge_now_ns();
+
+    for (int i = 0; i < count; i++)
+    {
+        char driver[MAX_NAME + 16];
+        snprintf(driver, sizeof(driver), "GALLIUM_DRIVER=%.*s", MAX_NAME, names[i]);
+        const char *settings[] = { driver };
+        ProbeResult result;
+        bool ok = probe_run(settings, 1, PROBE_WIDTH, PROBE_HEIGHT, PROBE_FRAMES, PROBE_TIMEOUT_MS, &result)
+            && renderer_matches(names[i], result.renderer);
+
+        char timing[64];
+        size_t used = strlen(timings);
+        if (!ok)
+        {
+            snprintf(timing, sizeof(timing), "%.*s:fail", MAX_NAME, names[i]);
+            snprintf(timings + used, sizeof(timings) - used, "%s%s", used ? "," : "", timing);
+            OSM_LOGW("Gallium driver %s is not usable", names[i]);
+            continue;
+        }
+
+        double median = result.p50Ms;
+        double slow = result.p95Ms;
+        bool stable = slow <= median * MAX_JITTER;
+        snprintf(timing, sizeof(timing), "%.*s:%.2f%s", MAX_NAME, names[i], median, stable ? "" : "~");
+        snprintf(timings + used, sizeof(timings) - used, "%s%s", used ? "," : "", timing);
+        OSM_LOGI("Gallium driver %s (%s): create %.1f ms, p50 %.2f ms, p95 %.2f ms%s",
+                names[i], result.renderer, result.createMs, median, slow, stable ? "" : ", unstable");
+
+        // Any stable driver beats an unstable one, then the lower median wins.
+        if (best < 0 || (stable && !bestStable) || (stable == bestStable && median < bestMs))
+        {
+            best = i;
+            bestStable = stable;
+            bestMs = median;
+        }
+    }
+
+    OSM_LOGI("Gallium driver probe took %.2f ms", (bridge_now_ns() - start) / 1e6);
+    // Nothing worked: keep probing on later launches rather than pinning the fallback.
+    if (best < 0) return NULL;
+
+    // Mesa has read GALLIUM_DRIVER by now, and setenv() would race the
+    // game's getenv() calls anyway.
+    snprintf(chosenDriver, sizeof(chosenDriver), "%s", names[best]);
+    record_env_value(envFilePath, "OSM_AUTO_DRIVER", chosenDriver);
+    record_env_value(envFilePath, "OSM_AUTO_DRIVER_TIMINGS", timings);
+    OSM_LOGN("Chose GALLIUM_DRIVER=%s (auto), from the next launch", chosenDriver);
+    return chosenDriver;
+}
@@ -0,0 +1,19 @@
+#ifndef DRIVER_SELECT_H
+#define DRIVER_SELECT_H
+
+#include <stdbool.h>
+
+// GALLIUM_DRIVER=auto. prepare() runs while env.txt is parsed: with a
+// driver recorded by an earlier launch it simply switches to it. Otherwise
+// this launch starts on a fallback driver, and run() times the reference
+// workload under every candidate on the task pool, each in an osm-bench
+// process (see probe.h). It records the fastest stable one together with
+// every driver's timing, for the next launch to pick up. Choosing auto
+// again in the app clears the record and re-runs the probe.
+
+void driver_select_prepare(const char *file_path, const char *recorded, const char *candidates);
+bool driver_select_pending(void);
+// Returns the driver recorded, or NULL if none worked.
+const char* driver_select_run(void);
+
+#endif // DRIVER_SELECT_H
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "internal.h"
+#include "env_bin.h"
+#include "log.h"
+
+#define HEADER_SIZE 40
+#define MAX_FIELD 0xffff
+
+static const unsigned char envBinMagic[4] = { 'O', 'S', 'M', 'B' };
+
+static uint32_t fnv1a(const unsigned char *data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+static uint64_t read_le(const unsigned char *p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static void write_le(unsigned char *p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++, value >>= 8) p[i] = (unsigned char)value;
+}
+
+static int64_t mtime_ms(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000 + st->st_mtim.tv_nsec / 1000000;
+}
+
+void env_bin_path(const char *textPath, char *binPath, size_t size) {
+    const char *slash = strrchr(textPath, '/');
+    const char *dot = strrchr(textPath, '.');
+    size_t stem = dot && (!slash || dot > slash) ? (size_t)(dot - textPath) : strlen(textPath);
+    snprintf(binPath, size, "%.*s.bin", (int)stem, textPath);
+}
+
+// Walk the entries; with apply == NULL only check that they are well formed.
+static bool walk_entries(const unsigned char *payload, size_t size, uint32_t count, EnvEntryFn apply) {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (size - offset < 4) return false;
+        size_t keyLength = (size_t)read_le(payload + offset, 2);
+        size_t valueLength = (size_t)read_le(payload + offset + 2, 2);
+        offset += 4;
+        if (size - offset < keyLength + valueLength + 2) return false;
+
+        const char *key = (const char*)payload + offset;
+        const char *value = key + keyLength + 1;
+        if (key[keyLength] || value[valueLength]) return false;
+        if (apply) apply(key, value);
+        offset += keyLength + valueLength + 2;
+    }
+    return offset == size;
+}
+
+static bool read_header(const char *binPath, unsigned char header[HEADER_SIZE]) {
+    int fd = open(binPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = pread(fd, header, HEADER_SIZE, 0) == HEADER_SIZE &&
+              !memcmp(header, envBinMagic, sizeof(envBinMagic)) &&
+              read_le(header + 4, 4) == ENV_BIN_VERSION;
+    close(fd);
+    return ok;
+}
+
+static bool header_matches(const unsigned char *header, const struct stat *textStat) {
+    return !memcmp(header, envBinMagic, sizeof(envBinMagic)) &&
+           read_le(header + 4, 4) == ENV_BIN_VERSION &&
+           read_le(header + 8, 8) == (uint64_t)textStat->st_size &&
+           (int64_t)read_le(header + 16, 8) == mtime_ms(textStat);
+}
+
+bool env_bin_stamp(const char *binPath, const char *textPath, EnvBinStamp *stamp) {
+    struct stat textStat;
+    unsigned char header[HEADER_SIZE];
+    if (stat(textPath, &textStat) != 0 || !read_header(binPath, header) || !header_matches(header, &textStat)) return false;
+
+    stamp->checksum = (uint32_t)read_le(header + 28, 4);
+    stamp->generation = (uint32_t)read_le(header + 32, 4);
+    return true;
+}
+
+bool env_bin_apply(const char *binPath, const char *textPath, EnvEntryFn apply) {
+    struct stat textStat;
+    if (stat(textPath, &textStat) != 0) return false;
+
+    int fd = open(binPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat binStat;
+    if (fstat(fd, &binStat) != 0 || binStat.st_size < HEADER_SIZE)
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)binStat.st_size;
+    const unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    bool current = header_matches(data, &textStat);
+    const unsigned char *payload = data + HEADER_SIZE;
+    size_t payloadSize = size - HEADER_SIZE;
+    uint32_t count = (uint32_t)read_le(data + 24, 4);
+    bool valid = current &&
+                 (uint32_t)read_le(data + 28, 4) == fnv1a(payload, payloadSize) &&
+                 walk_entries(payload, payloadSize, count, NULL);
+
+    if (valid) walk_entries(payload, payloadSize, count, apply);
+    munmap((void*)data, size);
+
+    if (!valid) OSM_LOGI("%s is %s, parsing %s", binPath, current ? "corrupt" : "stale", textPath);
+    return valid;
+}
+
+void env_bin_begin(EnvBinBuilder *builder, int fd) {
+    memset(builder, 0, sizeof(*builder));
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        builder->failed = true;
+        return;
+    }
+    builder->sourceSize = (uint64_t)st.st_size;
+    builder->sourceMtimeMs = mtime_ms(&st);
+}
+
+void env_bin_add(EnvBinBuilder *builder, const char *key, const char *value) {
+    if (builder->failed) return;
+
+    size_t keyLength = strlen(key);
+    size_t valueLength = strlen(value);
+    if (keyLength > MAX_FIELD || valueLength > MAX_FIELD)
+    {
+        builder->failed = true;
+        return;
+    }
+
+    size_t needed = HEADER_SIZE + builder->size + 4 + keyLength + valueLength + 2;
+    if (needed > builder->capacity)
+    {
+        size_t capacity = builder->capacity ? builder->capacity : 1024;
+        while (capacity < needed) capacity *= 2;
+        unsigned char *data = realloc(builder->data, capacity);
+        if (!data)
+        {
+            builder->failed = true;
+            return;
+        }
+        builder->data = data;
+        builder->capacity = capacity;
+    }
+
+    unsigned char *p = builder->data + HEADER_SIZE + builder->size;
+    write_le(p, keyLength, 2);
+    write_le(p + 2, valueLength, 2);
+    memcpy(p + 4, key, keyLength + 1);
+    memcpy(p + 4 + keyLength + 1, value, valueLength + 1);
+    builder->size += 4 + keyLength + valueLength + 2;
+    builder->count++;
+}
+
+void env_bin_commit(EnvBinBuilder *builder, const char *binPath) {
+    if (builder->failed || !builder->data)
+    {
+        free(builder->data);
+        builder->data = NULL;
+        return;
+    }
+
+    unsigned char *header = builder->data;
+    memcpy(header, envBinMagic, sizeof(envBinMagic));
+    write_le(header + 4, ENV_BIN_VERSION, 4);
+    write_le(header + 8, builder->sourceSize, 8);
+    write_le(header + 16, (uint64_t)builder->sourceMtimeMs, 8);
+    write_le(header + 24, builder->count, 4);
+    write_le(header + 28, fnv1a(header + HEADER_SIZE, builder->size), 4);
+    // Rebuilding from the text is a change of its own as far as watchers go.
+    unsigned char previous[HEADER_SIZE];
+    write_le(header + 32, read_header(binPath, previous) ? (uint32_t)read_le(previous + 32, 4) + 1 : 1, 4);
+    write_le(header + 36, 0, 4);
+
+    char tmpPath[512];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", binPath);
+    FILE *out = fopen(tmpPath, "wb");
+    bool written = out && fwrite(header, 1, HEADER_SIZE + builder->size, out) == HEADER_SIZE + builder->size;
+    if (out && fclose(out) != 0) written = false;
+    if (!written || rename(tmpPath, binPath) != 0)
+    {
+        OSM_LOGW("Failed to write %s", binPath);
+        remove(tmpPath);
+    }
+
+    free(builder->data);
+    builder->data = NULL;
+}
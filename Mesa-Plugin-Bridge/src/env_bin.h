@@ -0,0 +1,52 @@
+#ifndef ENV_BIN_H
+#define ENV_BIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// env.bin is env.txt pre-split into entries, written by the app (and by
+// the bridge after it had to parse the text). All fields little-endian:
+//
+//   "OSMB", u32 version, u64 env.txt size, i64 env.txt mtime (ms),
+//   u32 entry count, u32 FNV-1a of the payload, u32 generation, u32 0
+//   entry: u16 key length, u16 value length, key, NUL, value, NUL
+//
+// The blob only counts when size and mtime still match env.txt. Every
+// writer bumps the generation, and the app writes env.bin before renaming
+// the new env.txt into place, so a watcher can tell from the header alone
+// whether anything changed.
+
+#define ENV_BIN_VERSION 2
+
+typedef void (*EnvEntryFn)(const char *key, const char *value);
+
+typedef struct {
+    uint32_t generation;
+    uint32_t checksum;
+} EnvBinStamp;
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    uint32_t count;
+    uint64_t sourceSize;
+    int64_t sourceMtimeMs;
+    bool failed;
+} EnvBinBuilder;
+
+// "<dir>/env.txt" -> "<dir>/env.bin".
+void env_bin_path(const char *textPath, char *binPath, size_t size);
+// Map binPath and apply every entry in order, if it is current for
+// textPath. Returns false without applying anything otherwise.
+bool env_bin_apply(const char *binPath, const char *textPath, EnvEntryFn apply);
+// Read only the header. Returns false unless it is current for textPath.
+bool env_bin_stamp(const char *binPath, const char *textPath, EnvBinStamp *stamp);
+
+// Collect the entries of the text file open as fd, then write them out.
+void env_bin_begin(EnvBinBuilder *builder, int fd);
+void env_bin_add(EnvBinBuilder *builder, const char *key, const char *value);
+void env_bin_commit(EnvBinBuilder *builder, const char *binPath);
+
+#endif // ENV_BIN_H
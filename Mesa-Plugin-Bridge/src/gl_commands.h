@@ -0,0 +1,124 @@
+// GL entry points the bridge knows the full signature of, as an X-macro
+// table. Include this file after defining the shapes you need:
+//
+//   GL_CMDn(name, types...)          plain call with n by-value arguments
+//   GL_UNIFORMV(name, type, n)       (GLint, GLsizei count, const type*), count * n values
+//   GL_UNIFORM_MATRIX(name, n)       (GLint, GLsizei count, GLboolean, const GLfloat*), count * n values
+//   GL_MATRIX(name)                  (const GLfloat*), 16 values
+//
+// None of these return a value or keep a client pointer past the call,
+// except the *Pointer setters and the indexed draws, which callers have
+// to treat specially (see gl_offload.c).
+
+GL_CMD0(LoadIdentity)
+GL_CMD0(PushMatrix)
+GL_CMD0(PopMatrix)
+GL_CMD0(PopAttrib)
+GL_CMD0(End)
+GL_CMD0(Flush)
+
+GL_CMD1(Enable, GLenum)
+GL_CMD1(Disable, GLenum)
+GL_CMD1(EnableClientState, GLenum)
+GL_CMD1(DisableClientState, GLenum)
+GL_CMD1(EnableVertexAttribArray, GLuint)
+GL_CMD1(DisableVertexAttribArray, GLuint)
+GL_CMD1(CullFace, GLenum)
+GL_CMD1(FrontFace, GLenum)
+GL_CMD1(DepthFunc, GLenum)
+GL_CMD1(DepthMask, GLboolean)
+GL_CMD1(ShadeModel, GLenum)
+GL_CMD1(MatrixMode, GLenum)
+GL_CMD1(ActiveTexture, GLenum)
+GL_CMD1(ClientActiveTexture, GLenum)
+GL_CMD1(UseProgram, GLuint)
+GL_CMD1(Clear, GLbitfield)
+GL_CMD1(ClearDepth, GLdouble)
+GL_CMD1(ClearStencil, GLint)
+GL_CMD1(BlendEquation, GLenum)
+GL_CMD1(LogicOp, GLenum)
+GL_CMD1(LineWidth, GLfloat)
+GL_CMD1(PointSize, GLfloat)
+GL_CMD1(StencilMask, GLuint)
+GL_CMD1(PushAttrib, GLbitfield)
+GL_CMD1(PushClientAttrib, GLbitfield)
+GL_CMD1(CallList, GLuint)
+GL_CMD1(Begin, GLenum)
+GL_CMD1(ReadBuffer, GLenum)
+GL_CMD1(DrawBuffer, GLenum)
+GL_CMD1(BindVertexArray, GLuint)
+
+GL_CMD2(BlendFunc, GLenum, GLenum)
+GL_CMD2(BlendEquationSeparate, GLenum, GLenum)
+GL_CMD2(BindTexture, GLenum, GLuint)
+GL_CMD2(BindBuffer, GLenum, GLuint)
+GL_CMD2(BindFramebuffer, GLenum, GLuint)
+GL_CMD2(BindRenderbuffer, GLenum, GLuint)
+GL_CMD2(BindSampler, GLuint, GLuint)
+GL_CMD2(PolygonMode, GLenum, GLenum)
+GL_CMD2(PolygonOffset, GLfloat, GLfloat)
+GL_CMD2(AlphaFunc, GLenum, GLclampf)
+GL_CMD2(Hint, GLenum, GLenum)
+GL_CMD2(PixelStorei, GLenum, GLint)
+GL_CMD2(Fogi, GLenum, GLint)
+GL_CMD2(Fogf, GLenum, GLfloat)
+GL_CMD2(Uniform1i, GLint, GLint)
+GL_CMD2(Uniform1f, GLint, GLfloat)
+GL_CMD2(Vertex2f, GLfloat, GLfloat)
+GL_CMD2(TexCoord2f, GLfloat, GLfloat)
+
+GL_CMD3(TexParameteri, GLenum, GLenum, GLint)
+GL_CMD3(TexParameterf, GLenum, GLenum, GLfloat)
+GL_CMD3(TexEnvi, GLenum, GLenum, GLint)
+GL_CMD3(TexEnvf, GLenum, GLenum, GLfloat)
+GL_CMD3(SamplerParameteri, GLuint, GLenum, GLint)
+GL_CMD3(StencilOp, GLenum, GLenum, GLenum)
+GL_CMD3(StencilFunc, GLenum, GLint, GLuint)
+GL_CMD3(Uniform2i, GLint, GLint, GLint)
+GL_CMD3(Uniform2f, GLint, GLfloat, GLfloat)
+GL_CMD3(Vertex3f, GLfloat, GLfloat, GLfloat)
+GL_CMD3(Normal3f, GLfloat, GLfloat, GLfloat)
+GL_CMD3(Color3f, GLfloat, GLfloat, GLfloat)
+GL_CMD3(Color3ub, GLubyte, GLubyte, GLubyte)
+GL_CMD3(Translatef, GLfloat, GLfloat, GLfloat)
+GL_CMD3(Scalef, GLfloat, GLfloat, GLfloat)
+GL_CMD3(NormalPointer, GLenum, GLsizei, const void*)
+GL_CMD3(DrawArrays, GLenum, GLint, GLsizei)
+
+GL_CMD4(ClearColor, GLclampf, GLclampf, GLclampf, GLclampf)
+GL_CMD4(BlendColor, GLclampf, GLclampf, GLclampf, GLclampf)
+GL_CMD4(BlendFuncSeparate, GLenum, GLenum, GLenum, GLenum)
+GL_CMD4(ColorMask, GLboolean, GLboolean, GLboolean, GLboolean)
+GL_CMD4(Viewport, GLint, GLint, GLsizei, GLsizei)
+GL_CMD4(Scissor, GLint, GLint, GLsizei, GLsizei)
+GL_CMD4(StencilFuncSeparate, GLenum, GLenum, GLint, GLuint)
+GL_CMD4(StencilOpSeparate, GLenum, GLenum, GLenum, GLenum)
+GL_CMD4(Uniform3i, GLint, GLint, GLint, GLint)
+GL_CMD4(Uniform3f, GLint, GLfloat, GLfloat, GLfloat)
+GL_CMD4(Color4f, GLfloat, GLfloat, GLfloat, GLfloat)
+GL_CMD4(Color4ub, GLubyte, GLubyte, GLubyte, GLubyte)
+GL_CMD4(Rotatef, GLfloat, GLfloat, GLfloat, GLfloat)
+GL_CMD4(VertexPointer, GLint, GLenum, GLsizei, const void*)
+GL_CMD4(ColorPointer, GLint, GLenum, GLsizei, const void*)
+GL_CMD4(TexCoordPointer, GLint, GLenum, GLsizei, const void*)
+GL_CMD4(DrawElements, GLenum, GLsizei, GLenum, const void*)
+GL_CMD4(DrawArraysInstanced, GLenum, GLint, GLsizei, GLsizei)
+
+GL_CMD5(Uniform4i, GLint, GLint, GLint, GLint, GLint)
+GL_CMD5(Uniform4f, GLint, GLfloat, GLfloat, GLfloat, GLfloat)
+GL_CMD5(VertexAttribIPointer, GLuint, GLint, GLenum, GLsizei, const void*)
+GL_CMD5(DrawElementsInstanced, GLenum, GLsizei, GLenum, const void*, GLsizei)
+
+GL_CMD6(Ortho, GLdouble, GLdouble, GLdouble, GLdouble, GLdouble, GLdouble)
+GL_CMD6(Frustum, GLdouble, GLdouble, GLdouble, GLdouble, GLdouble, GLdouble)
+GL_CMD6(VertexAttribPointer, GLuint, GLint, GLenum, GLboolean, GLsizei, const void*)
+
+GL_UNIFORMV(Uniform1iv, GLint, 1)
+GL_UNIFORMV(Uniform1fv, GLfloat, 1)
+GL_UNIFORMV(Uniform2fv, GLfloat, 2)
+GL_UNIFORMV(Uniform3fv, GLfloat, 3)
+GL_UNIFORMV(Uniform4fv, GLfloat, 4)
+GL_UNIFORM_MATRIX(UniformMatrix3fv, 9)
+GL_UNIFORM_MATRIX(UniformMatrix4fv, 16)
+GL_MATRIX(LoadMatrixf)
+GL_MATRIX(MultMatrixf)
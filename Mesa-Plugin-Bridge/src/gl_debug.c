@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include <unwind.h>
+#include <pthread.h>
+#include "internal.h"
+#include "gl_debug.h"
+#include "gl_offload.h"
+#include "log.h"
+
+// Distinct messages counted; later ones are only tallied.
+#define MAX_MESSAGES 256
+// Distinct call stacks kept per message.
+#define MAX_STACKS 4
+#define STACK_DEPTH 16
+// Frames printed per stack in the report.
+#define REPORT_FRAMES 6
+#define MESSAGE_MAX 200
+// Indent of a report line continued on the next.
+#define CONTINUATION "      "
+
+typedef struct {
+    uint32_t hash;
+    int depth;
+    void *pcs[STACK_DEPTH];
+    unsigned long long count;
+} Stack;
+
+typedef struct {
+    GLenum source;
+    GLenum type;
+    GLenum severity;
+    GLuint id;
+    char text[MESSAGE_MAX];
+    unsigned long long count;
+    unsigned long long otherStacks;
+    int stackCount;
+    Stack stacks[MAX_STACKS];
+} Message;
+
+typedef struct {
+    OSMesaContext ctx;
+    bool installed;
+    // What the game had before the bridge turned debug output on, put back
+    // once it installs a callback of its own.
+    bool appOutput;
+    bool appSynchronous;
+    bool appOwnsOutput;
+    // The game's own callback, called after the bridge counted the message.
+    GLDEBUGPROC appCallback;
+    const void *appUserParam;
+} HookedContext;
+
+typedef struct {
+    void **pcs;
+    int depth;
+} Unwind;
+
+static struct {
+    PFNGLDEBUGMESSAGECALLBACKPROC DebugMessageCallback;
+    PFNGLDEBUGMESSAGECONTROLPROC DebugMessageControl;
+    void (*Enable)(GLenum);
+    void (*Disable)(GLenum);
+    GLboolean (*IsEnabled)(GLenum);
+} gl;
+
+bool glDebugEnabled = false;
+static pthread_once_t resolveOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t debugLock = PTHREAD_MUTEX_INITIALIZER;
+static Message messages[MAX_MESSAGES];
+static int messageCount = 0;
+static unsigned long long untracked = 0;
+static HookedContext *hooked = NULL;
+static int hookedCount = 0;
+static int hookedCapacity = 0;
+static bool warnedUnsupported = false;
+
+static void resolve_procs(void) {
+    gl.DebugMessageCallback = (PFNGLDEBUGMESSAGECALLBACKPROC)bridge_get_proc("glDebugMessageCallback");
+    gl.DebugMessageControl = (PFNGLDEBUGMESSAGECONTROLPROC)bridge_get_proc("glDebugMessageControl");
+    gl.Enable = (__typeof__(gl.Enable))bridge_get_proc("glEnable");
+    gl.Disable = (__typeof__(gl.Disable))bridge_get_proc("glDisable");
+    gl.IsEnabled = (__typeof__(gl.IsEnabled))bridge_get_proc("glIsEnabled");
+}
+
+static HookedContext* find_hook(OSMesaContext ctx) {
+    for (int i = 0; i < hookedCount; i++)
+    {
+        if (hooked[i].ctx == ctx) return &hooked[i];
+    }
+    return NULL;
+}
+
+static _Unwind_Reason_Code unwind_frame(struct _Unwind_Context *context, void *arg) {
+    Unwind *state = arg;
+    uintptr_t pc = _Unwind_GetIP(context);
+    if (!pc) return _URC_END_OF_STACK;
+    state->pcs[state->depth++] = (void*)pc;
+    return state->depth < STACK_DEPTH ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+static void count_message(GLenum source, GLenum type, GLuint id, GLenum severity, const char *text, void **pcs, int depth) {
+    Message *message = NULL;
+    for (int i = 0; i < messageCount && !message; i++)
+    {
+        Message *m = &messages[i];
+        // Some drivers give every message ID 0; tell those apart by text.
+        if (m->id == id && m->source == source && m->type == type && (id || !strncmp(m->text, text, MESSAGE_MAX - 1))) message = m;
+    }
+    if (!message)
+    {
+        if (messageCount == MAX_MESSAGES)
+        {
+            untracked++;
+            return;
+        }
+        message = &messages[messageCount++];
+        message->source = source;
+        message->type = type;
+        message->severity = severity;
+        message->id = id;
+        snprintf(message->text, sizeof(message->text), "%s", text);
+    }
+    message->count++;
+
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < depth; i++) hash = (hash ^ (uint32_t)(uintptr_t)pcs[i]) * 16777619u;
+    for (int i = 0; i < message->stackCount; i++)
+    {
+        Stack *stack = &message->stacks[i];
+        if (stack->hash == hash && stack->depth == depth && !memcmp(stack->pcs, pcs, sizeof(void*) * depth))
+        {
+            stack->count++;
+            return;
+        }
+    }
+    if (message->stackCount == MAX_STACKS)
+    {
+        message->otherStacks++;
+        return;
+    }
+    Stack *stack = &message->stacks[message->stackCount++];
+    stack->hash = hash;
+    stack->depth = depth;
+    memcpy(stack->pcs, pcs, sizeof(void*) * depth);
+    stack->count = 1;
+}
+
+// Runs on the thread that made the GL call, inside it. With OSM_GL_OFFLOAD
+// that is the worker replaying the call, so the game's frames are not on
+// the stack.
+static void GLAPIENTRY on_message(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *text, const void *userParam) {
+    bool counted = severity != GL_DEBUG_SEVERITY_NOTIFICATION && type != GL_DEBUG_TYPE_PUSH_GROUP && type != GL_DEBUG_TYPE_POP_GROUP;
+    void *pcs[STACK_DEPTH];
+    Unwind unwind = { pcs, 0 };
+    if (counted) _Unwind_Backtrace(unwind_frame, &unwind);
+
+    pthread_mutex_lock(&debugLock);
+    HookedContext *hook = find_hook((OSMesaContext)userParam);
+    GLDEBUGPROC appCallback = hook ? hook->appCallback : NULL;
+    const void *appUserParam = hook ? hook->appUserParam : NULL;
+    if (counted) count_message(source, type, id, severity, text ? text : "", pcs, unwind.depth);
+    pthread_mutex_unlock(&debugLock);
+
+    if (appCallback) appCallback(source, type, id, severity, length, text, appUserParam);
+}
+
+static void set_enabled(GLenum cap, bool enabled) {
+    if (enabled) gl.Enable(cap);
+    else gl.Disable(cap);
+}
+
+// The game takes over debug output: its callback is chained, and
+// GL_DEBUG_OUTPUT and GL_DEBUG_OUTPUT_SYNCHRONOUS go back to what it had
+// set, so it only gets messages it asked for. The bridge keeps counting
+// whatever still comes through.
+static void GLAPIENTRY app_debug_message_callback(GLDEBUGPROC callback, const void *userParam) {
+    pthread_mutex_lock(&debugLock);
+    HookedContext *hook = find_hook(currentContext);
+    bool chained = hook && hook->installed;
+    bool restore = false, output = false, synchronous = false;
+    if (chained)
+    {
+        hook->appCallback = callback;
+        hook->appUserParam = userParam;
+        restore = !hook->appOwnsOutput;
+        hook->appOwnsOutput = true;
+        output = hook->appOutput;
+        synchronous = hook->appSynchronous;
+    }
+    pthread_mutex_unlock(&debugLock);
+
+    if (!chained)
+    {
+        if (gl.DebugMessageCallback) gl.DebugMessageCallback(callback, userParam);
+        return;
+    }
+    if (restore && gl.Disable)
+    {
+        gl_offload_drain();
+        set_enabled(GL_DEBUG_OUTPUT, output);
+        set_enabled(GL_DEBUG_OUTPUT_SYNCHRONOUS, synchronous);
+    }
+}
+
+void gl_debug_configure(bool enabled) {
+    glDebugEnabled = enabled;
+    if (!enabled) return;
+
+    // Mesa only reports performance warnings on debug contexts, which
+    // OSMesa has no attribute for; MESA_DEBUG=context makes every context
+    // one. Left alone when the user set MESA_DEBUG.
+    if (!getenv("MESA_DEBUG")) setenv("MESA_DEBUG", "context", 1);
+    OSM_LOGI("Collecting GL debug messages, report at exit");
+}
+
+void gl_debug_on_make_current(OSMesaContext ctx) {
+    if (!ctx) return;
+
+    pthread_mutex_lock(&debugLock);
+    if (find_hook(ctx))
+    {
+        pthread_mutex_unlock(&debugLock);
+        return;
+    }
+    if (hookedCount == hookedCapacity)
+    {
+        int capacity = hookedCapacity ? hookedCapacity * 2 : 8;
+        HookedContext *grown = realloc(hooked, capacity * sizeof(HookedContext));
+        if (!grown)
+        {
+            pthread_mutex_unlock(&debugLock);
+            return;
+        }
+        hooked = grown;
+        hookedCapacity = capacity;
+    }
+    HookedContext *hook = &hooked[hookedCount++];
+    memset(hook, 0, sizeof(*hook));
+    hook->ctx = ctx;
+    pthread_mutex_unlock(&debugLock);
+
+    pthread_once(&resolveOnce, resolve_procs);
+    int version = bridge_gl_version();
+    if (!gl.DebugMessageCallback || !gl.DebugMessageControl || !gl.Enable ||
+        (version < 43 && !bridge_has_extension(version, "GL_KHR_debug")))
+    {
+        if (!warnedUnsupported) OSM_LOGW("OSM_GL_DEBUG needs GL_KHR_debug, which this context does not have");
+        warnedUnsupported = true;
+        return;
+    }
+
+    // The offload worker has this context current as well.
+    gl_offload_drain();
+    bool appOutput = gl.IsEnabled && gl.IsEnabled(GL_DEBUG_OUTPUT);
+    bool appSynchronous = gl.IsEnabled && gl.IsEnabled(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    gl.DebugMessageCallback(on_message, ctx);
+    gl.DebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PERFORMANCE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    gl.Enable(GL_DEBUG_OUTPUT);
+    gl.Enable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+    pthread_mutex_lock(&debugLock);
+    hook = find_hook(ctx);
+    if (hook)
+    {
+        hook->installed = true;
+        hook->appOutput = appOutput;
+        hook->appSynchronous = appSynchronous;
+    }
+    pthread_mutex_unlock(&debugLock);
+}
+
+void gl_debug_on_destroy(OSMesaContext ctx) {
+    pthread_mutex_lock(&debugLock);
+    HookedContext *hook = find_hook(ctx);
+    if (hook) *hook = hooked[--hookedCount];
+    pthread_mutex_unlock(&debugLock);
+}
+
+OSMESAproc gl_debug_wrap_proc(const char *funcName) {
+    if (!funcName || strncmp(funcName, "glDebugMessageCallback", 22) != 0) return NULL;
+    const char *suffix = funcName + 22;
+    if (suffix[0] && strcmp(suffix, "ARB") != 0 && strcmp(suffix, "KHR") != 0) return NULL;
+    pthread_once(&resolveOnce, resolve_procs);
+    return (OSMESAproc)app_debug_message_callback;
+}
+
+static const char* type_name(GLenum type) {
+    switch (type)
+    {
+        case GL_DEBUG_TYPE_ERROR: return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined";
+        case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+        case GL_DEBUG_TYPE_MARKER: return "marker";
+        default: return "other";
+    }
+}
+
+static const char* severity_name(GLenum severity) {
+    switch (severity)
+    {
+        case GL_DEBUG_SEVERITY_HIGH: return "high";
+        case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+        case GL_DEBUG_SEVERITY_LOW: return "low";
+        default: return "notification";
+    }
+}
+
+// Frames outside libOSMBridge.so, innermost first: the GL entry point in
+// Mesa and the game code that called it.
+static void format_stack(const Stack *stack, char *out, size_t size) {
+    Dl_info self;
+    void *selfBase = dladdr((void*)format_stack, &self) ? self.dli_fbase : NULL;
+    size_t length = 0;
+    int printed = 0;
+    out[0] = '\0';
+    for (int i = 0; i < stack->depth && printed < REPORT_FRAMES && length < size; i++)
+    {
+        Dl_info info;
+        if (!dladdr(stack->pcs[i], &info)) continue;
+        if (info.dli_fbase == selfBase) continue;
+
+        const char *separator = printed ? " <- " : "";
+        const char *file = info.dli_fname ? strrchr(info.dli_fname, '/') : NULL;
+        file = file ? file + 1 : info.dli_fname ? info.dli_fname : "?";
+        int written;
+        if (info.dli_sname) written = snprintf(out + length, size - length, "%s%s", separator, info.dli_sname);
+        else written = snprintf(out + length, size - length, "%s%s+0x%lx", separator, file, (unsigned long)((char*)stack->pcs[i] - (char*)info.dli_fbase));
+        if (written < 0) break;
+        length += (size_t)written;
+        printed++;
+    }
+}
+
+static int compare_count(const void *a, const void *b) {
+    const Message *x = *(const Message* const*)a, *y = *(const Message* const*)b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+// A full report has more lines than the log ring has slots, and stack
+// lines run longer than a slot holds. Lines are split at a space to fit,
+// and the ring is written out every half ring.
+__attribute__((format(printf, 1, 2)))
+static void report_line(const char *format, ...) {
+    static int reportLines = 0;
+    char line[MESSAGE_MAX + 512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    const char *text = line;
+    size_t length = strlen(text);
+    bool first = true;
+    while (first || length)
+    {
+        size_t limit = LOG_TEXT_MAX - 1 - (first ? 0 : sizeof(CONTINUATION) - 1);
+        size_t take = length;
+        if (take > limit)
+        {
+            const char *space = memrchr(text, ' ', limit);
+            take = space && space > text ? (size_t)(space - text) : limit;
+        }
+        OSM_LOGN("%s%.*s", first ? "" : CONTINUATION, (int)take, text);
+        text += take;
+        length -= take;
+        while (*text == ' ')
+        {
+            text++;
+            length--;
+        }
+        first = false;
+        if (++reportLines % (LOG_SLOTS / 2) == 0) log_flush();
+    }
+}
+
+void gl_debug_stop(void) {
+    if (!glDebugEnabled) return;
+
+    pthread_mutex_lock(&debugLock);
+    Message *sorted[MAX_MESSAGES];
+    for (int i = 0; i < messageCount; i++) sorted[i] = &messages[i];
+    qsort(sorted, messageCount, sizeof(Message*), compare_count);
+
+    report_line("GL debug messages: %d distinct", messageCount);
+    for (int i = 0; i < messageCount; i++)
+    {
+        const Message *message = sorted[i];
+        report_line("  %llu x %s, %s, id %u: %s", message->count,
+                type_name(message->type), severity_name(message->severity), message->id, message->text);
+        for (int s = 0; s < message->stackCount; s++)
+        {
+            char frames[512];
+            format_stack(&message->stacks[s], frames, sizeof(frames));
+            report_line("    %llu x from %s", message->stacks[s].count, frames[0] ? frames : "?");
+        }
+        if (message->otherStacks) report_line("    %llu x from other call stacks", message->otherStacks);
+    }
+    if (untracked) report_line("  %llu more messages past the first %d distinct ones", untracked, MAX_MESSAGES);
+    pthread_mutex_unlock(&debugLock);
+}
@@ -0,0 +1,36 @@
+#ifndef GL_DEBUG_H
+#define GL_DEBUG_H
+
+#include <stdbool.h>
+#include <GL/osmesa.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+// Collects what Mesa and the driver report through GL_KHR_debug:
+// performance warnings about fallback paths, shader recompiles and slow
+// format conversions, plus errors and portability notes. On with
+// OSM_GL_DEBUG=true only: synchronous debug output slows every GL call
+// down, which would skew OSM_CALL_STATS and OSM_GPU_TIMING numbers.
+//
+// Every context made current through the bridge gets the bridge's
+// callback, with synchronous output so the callback runs inside the GL
+// call that caused the message. Messages are counted by ID together with
+// the call stack that led to them, and summarized at exit. A callback
+// the game installs itself is chained rather than replaced, and the
+// game's GL_DEBUG_OUTPUT settings are put back then.
+
+// Checked on every OSMesaMakeCurrent(); only gl_debug_configure() sets it.
+__attribute__((visibility("hidden"))) extern bool glDebugEnabled;
+
+// Must run before the first context is created.
+void gl_debug_configure(bool enabled);
+// Install the callback the first time ctx is current on some thread.
+void gl_debug_on_make_current(OSMesaContext ctx);
+void gl_debug_on_destroy(OSMesaContext ctx);
+// What OSMesaGetProcAddress() hands out for glDebugMessageCallback and
+// its ARB and KHR names, or NULL for every other name.
+OSMESAproc gl_debug_wrap_proc(const char *funcName);
+// Print the report.
+void gl_debug_stop(void);
+
+#endif // GL_DEBUG_H
@@ -0,0 +1,817 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "internal.h"
+#include "gl_offload.h"
+#include "call_stats.h"
+#include "gl_trace.h"
+#include "log.h"
+#include <GL/glext.h>
+
+#if defined(__x86_64__)
+#define STUB_SIZE 16
+#elif defined(__aarch64__) || defined(__arm__)
+#define STUB_SIZE 8
+#endif
+// Must match gl_offload_stubs.S.
+#define STUB_COUNT 8192
+#define STUB_HASH_SIZE (STUB_COUNT * 2)
+
+#define BLOCK_BYTES (64 * 1024)
+#define MAX_BLOCKS 64
+// Hand a partly filled block to an idle worker once it holds this much.
+#define SUBMIT_BYTES 4096
+// Larger array arguments are not copied; the call runs directly instead.
+#define MAX_PAYLOAD (BLOCK_BYTES / 4)
+#define ALIGN8(size) (((size) + 7) & ~(size_t)7)
+#define BINDING_UNKNOWN 0xffffffffu
+#define MAX_TRACKED_VERTEX_ARRAYS 65536
+
+#define UNPAREN(...) __VA_ARGS__
+
+// Shapes used by gl_commands.h, reduced to one CMD() per pass:
+// CMD(name, parameters, arguments, replay arguments, argument fields).
+#define GL_CMD0(n)                          CMD(n, (void), (), (), )
+#define GL_CMD1(n, t1)                      CMD(n, (t1 a1), (a1), (p->a1), t1 a1;)
+#define GL_CMD2(n, t1, t2)                  CMD(n, (t1 a1, t2 a2), (a1, a2), (p->a1, p->a2), t1 a1; t2 a2;)
+#define GL_CMD3(n, t1, t2, t3)              CMD(n, (t1 a1, t2 a2, t3 a3), (a1, a2, a3), (p->a1, p->a2, p->a3), t1 a1; t2 a2; t3 a3;)
+#define GL_CMD4(n, t1, t2, t3, t4)          CMD(n, (t1 a1, t2 a2, t3 a3, t4 a4), (a1, a2, a3, a4), (p->a1, p->a2, p->a3, p->a4), t1 a1; t2 a2; t3 a3; t4 a4;)
+#define GL_CMD5(n, t1, t2, t3, t4, t5)      CMD(n, (t1 a1, t2 a2, t3 a3, t4 a4, t5 a5), (a1, a2, a3, a4, a5), (p->a1, p->a2, p->a3, p->a4, p->a5), t1 a1; t2 a2; t3 a3; t4 a4; t5 a5;)
+#define GL_CMD6(n, t1, t2, t3, t4, t5, t6)  CMD(n, (t1 a1, t2 a2, t3 a3, t4 a4, t5 a5, t6 a6), (a1, a2, a3, a4, a5, a6), (p->a1, p->a2, p->a3, p->a4, p->a5, p->a6), t1 a1; t2 a2; t3 a3; t4 a4; t5 a5; t6 a6;)
+#define GL_UNIFORMV(n, type, width)         UNIFORMV(n, type, width)
+#define GL_UNIFORM_MATRIX(n, width)         UNIFORM_MATRIX(n, width)
+#define GL_MATRIX(n)                        MATRIX(n)
+
+#define CMD(n, params, args, call, fields) void (APIENTRY *n) params;
+#define UNIFORMV(n, type, width) void (APIENTRY *n)(GLint, GLsizei, const type*);
+#define UNIFORM_MATRIX(n, width) void (APIENTRY *n)(GLint, GLsizei, GLboolean, const GLfloat*);
+#define MATRIX(n) void (APIENTRY *n)(const GLfloat*);
+static struct {
+#include "gl_commands.h"
+    void (APIENTRY *DeleteBuffers)(GLsizei, const GLuint*);
+    void (APIENTRY *DeleteVertexArrays)(GLsizei, const GLuint*);
+    void (APIENTRY *VertexArrayElementBuffer)(GLuint, GLuint);
+} gl;
+#undef CMD
+#undef UNIFORMV
+#undef UNIFORM_MATRIX
+#undef MATRIX
+
+#define CMD(n, ...) OP_##n,
+#define UNIFORMV(n, ...) OP_##n,
+#define UNIFORM_MATRIX(n, ...) OP_##n,
+#define MATRIX(n) OP_##n,
+enum {
+    OP_MakeCurrent,
+#include "gl_commands.h"
+};
+#undef CMD
+#undef UNIFORMV
+#undef UNIFORM_MATRIX
+#undef MATRIX
+
+#define CMD(n, params, args, call, fields) typedef struct { fields } Args_##n;
+#define UNIFORMV(n, ...)
+#define UNIFORM_MATRIX(n, ...)
+#define MATRIX(n)
+#include "gl_commands.h"
+#undef CMD
+#undef UNIFORMV
+#undef UNIFORM_MATRIX
+#undef MATRIX
+
+typedef struct {
+    OSMesaContext ctx;
+    void *buffer;
+    GLenum type;
+    GLsizei width, height;
+} Args_MakeCurrent;
+
+typedef struct {
+    GLint location;
+    GLsizei count;
+    GLboolean transpose;
+} Args_Uniform;
+
+typedef struct {
+    uint32_t op;
+    uint32_t size;
+} CmdHeader;
+
+typedef struct CmdBlock {
+    struct CmdBlock *next;
+    size_t used;
+    unsigned char data[BLOCK_BYTES] __attribute__((aligned(8)));
+} CmdBlock;
+
+static bool offloadEnabled = false;
+static pthread_once_t procsOnce = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t offloadLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t doneCond = PTHREAD_COND_INITIALIZER;
+static pthread_t workerThread;
+static bool workerRunning = false;
+static bool workerStopping = false;
+static CmdBlock *pendingHead = NULL;
+static CmdBlock *pendingTail = NULL;
+static CmdBlock *freeBlocks = NULL;
+static int blockCount = 0;
+static int pendingBlocks = 0;
+
+// Recording side. Only the owning thread touches these while it records.
+static __thread bool recording = false;
+static bool ownerActive = false;
+static CmdBlock *recordBlock = NULL;
+static OSMesaContext boundContext = NULL;
+static void *boundBuffer = NULL;
+static GLenum boundType = 0;
+static GLsizei boundWidth = 0, boundHeight = 0;
+static OSMesaContext freshContext = NULL;
+// boundContext is current on the worker rather than on the owning thread.
+static bool handedOver = false;
+
+// What the recorder knows about vertex array state of boundContext. Draws
+// are only deferred while it is certain they read no client memory.
+static bool clientArrays = false;
+static GLuint arrayBuffer = BINDING_UNKNOWN;
+static GLuint vertexArray = BINDING_UNKNOWN;
+static GLuint *elementBuffers = NULL;
+static size_t elementBufferCount = 0;
+static GLuint elementBufferDefault = BINDING_UNKNOWN;
+
+#ifdef STUB_SIZE
+extern const unsigned char gl_offload_stubs[];
+static void *stubTargets[STUB_COUNT];
+static bool stubPoison[STUB_COUNT];
+static char *stubNames[STUB_COUNT];
+static int stubHash[STUB_HASH_SIZE];
+static int stubCount = 0;
+#endif
+
+bool gl_offload_configure(bool enabled) {
+    if (!enabled) return false;
+
+#ifndef STUB_SIZE
+    OSM_LOGW("OSM_GL_OFFLOAD is not supported on this architecture");
+    return false;
+#else
+    char *glthread = getenv("mesa_glthread");
+    if (glthread && !strcmp(glthread, "true"))
+    {
+        OSM_LOGW("OSM_GL_OFFLOAD ignored because mesa_glthread is enabled");
+        return false;
+    }
+    // Keep the driver from stacking its own thread on top of ours.
+    setenv("mesa_glthread", "false", 1);
+    offloadEnabled = true;
+    return true;
+#endif
+}
+
+static void load_procs(void) {
+    #define CMD(n, ...) gl.n = (__typeof__(gl.n))bridge_get_proc("gl" #n);
+    #define UNIFORMV(n, ...) gl.n = (__typeof__(gl.n))bridge_get_proc("gl" #n);
+    #define UNIFORM_MATRIX(n, ...) gl.n = (__typeof__(gl.n))bridge_get_proc("gl" #n);
+    #define MATRIX(n) gl.n = (__typeof__(gl.n))bridge_get_proc("gl" #n);
+    #include "gl_commands.h"
+    #undef CMD
+    #undef UNIFORMV
+    #undef UNIFORM_MATRIX
+    #undef MATRIX
+    gl.DeleteBuffers = (__typeof__(gl.DeleteBuffers))bridge_get_proc("glDeleteBuffers");
+    gl.DeleteVertexArrays = (__typeof__(gl.DeleteVertexArrays))bridge_get_proc("glDeleteVertexArrays");
+    gl.VertexArrayElementBuffer = (__typeof__(gl.VertexArrayElementBuffer))bridge_get_proc("glVertexArrayElementBuffer");
+}
+
+static CmdBlock* take_block(void) {
+    CmdBlock *block = freeBlocks;
+    if (block)
+    {
+        freeBlocks = block->next;
+    }
+    else if (blockCount < MAX_BLOCKS && (block = malloc(sizeof(CmdBlock))))
+    {
+        blockCount++;
+    }
+    if (block)
+    {
+        block->next = NULL;
+        block->used = 0;
+    }
+    return block;
+}
+
+static void replay_block(const CmdBlock *block) {
+    size_t offset = 0;
+    while (offset < block->used)
+    {
+        const CmdHeader *h = (const CmdHeader*)(block->data + offset);
+        const void *body = h + 1;
+        switch (h->op)
+        {
+            case OP_MakeCurrent:
+            {
+                const Args_MakeCurrent *p = body;
+                if (!real_OSMesaMakeCurrent(p->ctx, p->buffer, p->type, p->width, p->height))
+                {
+                    OSM_LOGE("Offload worker failed to make context %p current", (void*)p->ctx);
+                }
+                break;
+            }
+            #define CMD(n, params, args, call, fields) \
+                case OP_##n: { const Args_##n *p = body; (void)p; gl.n call; break; }
+            #define UNIFORMV(n, type, width) \
+                case OP_##n: { const Args_Uniform *p = body; gl.n(p->location, p->count, (const type*)((const unsigned char*)p + ALIGN8(sizeof(*p)))); break; }
+            #define UNIFORM_MATRIX(n, width) \
+                case OP_##n: { const Args_Uniform *p = body; gl.n(p->location, p->count, p->transpose, (const GLfloat*)((const unsigned char*)p + ALIGN8(sizeof(*p)))); break; }
+            #define MATRIX(n) \
+                case OP_##n: gl.n((const GLfloat*)body); break;
+            #include "gl_commands.h"
+            #undef CMD
+            #undef UNIFORMV
+            #undef UNIFORM_MATRIX
+            #undef MATRIX
+        }
+        offset += h->size;
+    }
+}
+
+static void* worker_main(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&offloadLock);
+    for (;;)
+    {
+        while (!pendingHead && !workerStopping) pthread_cond_wait(&workCond, &offloadLock);
+        if (!pendingHead) break;
+
+        CmdBlock *block = pendingHead;
+        pendingHead = block->next;
+        if (!pendingHead) pendingTail = NULL;
+        pthread_mutex_unlock(&offloadLock);
+
+        replay_block(block);
+
+        pthread_mutex_lock(&offloadLock);
+        block->next = freeBlocks;
+        freeBlocks = block;
+        __atomic_store_n(&pendingBlocks, pendingBlocks - 1, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&doneCond);
+    }
+    pthread_mutex_unlock(&offloadLock);
+
+    real_OSMesaMakeCurrent(NULL, NULL, 0, 0, 0);
+    return NULL;
+}
+
+// Queue recordBlock for the worker and start a new one. Blocks once
+// MAX_BLOCKS are in flight, which bounds how far the client can run ahead.
+static void submit_block(void) {
+    pthread_mutex_lock(&offloadLock);
+    if (pendingTail)
+    {
+        pendingTail->next = recordBlock;
+    }
+    else
+    {
+        pendingHead = recordBlock;
+    }
+    pendingTail = recordBlock;
+    recordBlock->next = NULL;
+    __atomic_store_n(&pendingBlocks, pendingBlocks + 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&workCond);
+
+    CmdBlock *block;
+    while (!(block = take_block())) pthread_cond_wait(&doneCond, &offloadLock);
+    pthread_mutex_unlock(&offloadLock);
+    recordBlock = block;
+}
+
+static void* record(uint32_t op, size_t argsSize, size_t payloadSize);
+
+static void record_make_current(OSMesaContext ctx, void *buffer, GLenum type, GLsizei width, GLsizei height) {
+    Args_MakeCurrent *p = record(OP_MakeCurrent, sizeof(Args_MakeCurrent), 0);
+    p->ctx = ctx;
+    p->buffer = buffer;
+    p->type = type;
+    p->width = width;
+    p->height = height;
+}
+
+// A context may only be current on one thread at a time, so the owning
+// thread unbinds it before the worker binds it for the commands that
+// follow.
+static void hand_over(void) {
+    real_OSMesaMakeCurrent(NULL, NULL, 0, 0, 0);
+    handedOver = true;
+    record_make_current(boundContext, boundBuffer, boundType, boundWidth, boundHeight);
+}
+
+// Wait for everything recorded so far and take the context back, so the
+// owning thread can call Mesa directly.
+static void drain(void) {
+    bool takeBack = handedOver;
+    if (takeBack) record_make_current(NULL, NULL, 0, 0, 0);
+    handedOver = false;
+
+    if (recordBlock->used) submit_block();
+    if (__atomic_load_n(&pendingBlocks, __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_lock(&offloadLock);
+        while (pendingBlocks) pthread_cond_wait(&doneCond, &offloadLock);
+        pthread_mutex_unlock(&offloadLock);
+    }
+
+    if (takeBack && !real_OSMesaMakeCurrent(boundContext, boundBuffer, boundType, boundWidth, boundHeight))
+    {
+        OSM_LOGE("Failed to take context %p back from the offload worker", (void*)boundContext);
+    }
+}
+
+// Reserve a command in recordBlock and return where its arguments go. The
+// caller fills them in before the next record() or drain() can submit it.
+static void* record(uint32_t op, size_t argsSize, size_t payloadSize) {
+    if (!handedOver) hand_over();
+
+    size_t size = sizeof(CmdHeader) + ALIGN8(argsSize) + ALIGN8(payloadSize);
+    if (recordBlock->used + size > BLOCK_BYTES ||
+        (recordBlock->used >= SUBMIT_BYTES && !__atomic_load_n(&pendingBlocks, __ATOMIC_RELAXED)))
+    {
+        submit_block();
+    }
+
+    CmdHeader *h = (CmdHeader*)(recordBlock->data + recordBlock->used);
+    h->op = op;
+    h->size = (uint32_t)size;
+    recordBlock->used += size;
+    return h + 1;
+}
+
+static void reset_tracking(bool fresh) {
+    GLuint initial = fresh ? 0 : BINDING_UNKNOWN;
+    clientArrays = !fresh;
+    arrayBuffer = initial;
+    vertexArray = initial;
+    free(elementBuffers);
+    elementBuffers = NULL;
+    elementBufferCount = 0;
+    elementBufferDefault = initial;
+}
+
+static GLuint element_buffer(void) {
+    if (vertexArray == BINDING_UNKNOWN) return BINDING_UNKNOWN;
+    if (vertexArray < elementBufferCount) return elementBuffers[vertexArray];
+    return elementBufferDefault;
+}
+
+static void set_element_buffer(GLuint array, GLuint buffer) {
+    if (array >= MAX_TRACKED_VERTEX_ARRAYS) return;
+    if (array >= elementBufferCount)
+    {
+        size_t count = elementBufferCount ? elementBufferCount : 64;
+        while (count <= array) count *= 2;
+        GLuint *grown = realloc(elementBuffers, count * sizeof(GLuint));
+        if (!grown)
+        {
+            // Untracked arrays read as elementBufferDefault, never as a buffer.
+            return;
+        }
+        for (size_t i = elementBufferCount; i < count; i++) grown[i] = elementBufferDefault;
+        elementBuffers = grown;
+        elementBufferCount = count;
+    }
+    elementBuffers[array] = buffer;
+}
+
+static bool indices_in_buffer(void) {
+    GLuint buffer = element_buffer();
+    return buffer != 0 && buffer != BINDING_UNKNOWN;
+}
+
+// Generated recorders and thunks. A thunk records while this thread owns
+// the offload and calls Mesa directly otherwise; its body is offload_##n
+// so the thunk itself can be traced and counted by call_stats.
+#define CMD(n, params, args, call, fields) \
+    __attribute__((unused)) static void record_##n params { \
+        Args_##n *p = record(OP_##n, sizeof(Args_##n), 0); \
+        *p = (Args_##n){ UNPAREN args }; \
+    } \
+    __attribute__((unused)) static void offload_##n params { \
+        if (!recording) { gl.n args; return; } \
+        record_##n args; \
+    } \
+    __attribute__((unused)) static void APIENTRY thunk_##n params { \
+        if (__builtin_expect(traceEnabled, 0)) gl_trace_##n args; \
+        CALL_STATS_VOID(CALL_OFFLOAD(n), offload_##n, args); \
+    }
+#define UNIFORMV(n, type, width) \
+    static void offload_##n(GLint location, GLsizei count, const type *value) { \
+        size_t bytes = (size_t)count * (width) * sizeof(type); \
+        if (!recording || count <= 0 || !value || bytes > MAX_PAYLOAD) { gl_offload_drain(); gl.n(location, count, value); return; } \
+        Args_Uniform *p = record(OP_##n, sizeof(Args_Uniform), bytes); \
+        p->location = location; \
+        p->count = count; \
+        memcpy((unsigned char*)p + ALIGN8(sizeof(*p)), value, bytes); \
+    } \
+    static void APIENTRY thunk_##n(GLint location, GLsizei count, const type *value) { \
+        if (__builtin_expect(traceEnabled, 0)) gl_trace_##n(location, count, value); \
+        CALL_STATS_VOID(CALL_OFFLOAD(n), offload_##n, (location, count, value)); \
+    }
+#define UNIFORM_MATRIX(n, width) \
+    static void offload_##n(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) { \
+        size_t bytes = (size_t)count * (width) * sizeof(GLfloat); \
+        if (!recording || count <= 0 || !value || bytes > MAX_PAYLOAD) { gl_offload_drain(); gl.n(location, count, transpose, value); return; } \
+        Args_Uniform *p = record(OP_##n, sizeof(Args_Uniform), bytes); \
+        p->location = location; \
+        p->count = count; \
+        p->transpose = transpose; \
+        memcpy((unsigned char*)p + ALIGN8(sizeof(*p)), value, bytes); \
+    } \
+    static void APIENTRY thunk_##n(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) { \
+        if (__builtin_expect(traceEnabled, 0)) gl_trace_##n(location, count, transpose, value); \
+        CALL_STATS_VOID(CALL_OFFLOAD(n), offload_##n, (location, count, transpose, value)); \
+    }
+#define MATRIX(n) \
+    static void offload_##n(const GLfloat *m) { \
+        if (!recording || !m) { gl_offload_drain(); gl.n(m); return; } \
+        memcpy(record(OP_##n, 0, 16 * sizeof(GLfloat)), m, 16 * sizeof(GLfloat)); \
+    } \
+    static void APIENTRY thunk_##n(const GLfloat *m) { \
+        if (__builtin_expect(traceEnabled, 0)) gl_trace_##n(m); \
+        CALL_STATS_VOID(CALL_OFFLOAD(n), offload_##n, (m)); \
+    }
+#include "gl_commands.h"
+#undef CMD
+#undef UNIFORMV
+#undef UNIFORM_MATRIX
+#undef MATRIX
+
+// Calls that change what the recorder knows about vertex array state.
+// Hooks that do their own work trace and count it under their entry
+// point; the pointer hooks below leave that to the thunk they forward to.
+#define COUNTED_HOOK(n, params, args) \
+    static void APIENTRY hook_##n params { \
+        if (__builtin_expect(traceEnabled, 0)) gl_trace_##n args; \
+        CALL_STATS_VOID(CALL_OFFLOAD(n), do_##n, args); \
+    }
+
+static void do_BindBuffer(GLenum target, GLuint buffer) {
+    if (!recording)
+    {
+        gl.BindBuffer(target, buffer);
+        return;
+    }
+    if (target == GL_ARRAY_BUFFER) arrayBuffer = buffer;
+    if (target == GL_ELEMENT_ARRAY_BUFFER) set_element_buffer(vertexArray, buffer);
+    record_BindBuffer(target, buffer);
+}
+COUNTED_HOOK(BindBuffer, (GLenum target, GLuint buffer), (target, buffer))
+
+static void do_BindVertexArray(GLuint array) {
+    if (!recording)
+    {
+        gl.BindVertexArray(array);
+        return;
+    }
+    vertexArray = array;
+    record_BindVertexArray(array);
+}
+COUNTED_HOOK(BindVertexArray, (GLuint array), (array))
+
+// A pointer set while no array buffer is bound is client memory, which a
+// deferred draw could read after the client has reused it.
+#define POINTER_HOOK(n, params, args) \
+    static void APIENTRY hook_##n params { \
+        if (recording && (arrayBuffer == 0 || arrayBuffer == BINDING_UNKNOWN)) clientArrays = true; \
+        thunk_##n args; \
+    }
+POINTER_HOOK(VertexPointer, (GLint size, GLenum type, GLsizei stride, const void *pointer), (size, type, stride, pointer))
+POINTER_HOOK(ColorPointer, (GLint size, GLenum type, GLsizei stride, const void *pointer), (size, type, stride, pointer))
+POINTER_HOOK(TexCoordPointer, (GLint size, GLenum type, GLsizei stride, const void *pointer), (size, type, stride, pointer))
+POINTER_HOOK(NormalPointer, (GLenum type, GLsizei stride, const void *pointer), (type, stride, pointer))
+POINTER_HOOK(VertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer), (index, size, type, normalized, stride, pointer))
+POINTER_HOOK(VertexAttribIPointer, (GLuint index, GLint size, GLenum type, GLsizei stride, const void *pointer), (index, size, type, stride, pointer))
+#undef POINTER_HOOK
+
+static void do_DrawArrays(GLenum mode, GLint first, GLsizei count) {
+    if (recording && !clientArrays)
+    {
+        record_DrawArrays(mode, first, count);
+        return;
+    }
+    gl_offload_drain();
+    gl.DrawArrays(mode, first, count);
+}
+COUNTED_HOOK(DrawArrays, (GLenum mode, GLint first, GLsizei count), (mode, first, count))
+
+static void do_DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount) {
+    if (recording && !clientArrays)
+    {
+        record_DrawArraysInstanced(mode, first, count, instancecount);
+        return;
+    }
+    gl_offload_drain();
+    gl.DrawArraysInstanced(mode, first, count, instancecount);
+}
+COUNTED_HOOK(DrawArraysInstanced, (GLenum mode, GLint first, GLsizei count, GLsizei instancecount), (mode, first, count, instancecount))
+
+static void do_DrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices) {
+    if (recording && !clientArrays && indices_in_buffer())
+    {
+        record_DrawElements(mode, count, type, indices);
+        return;
+    }
+    gl_offload_drain();
+    gl.DrawElements(mode, count, type, indices);
+}
+COUNTED_HOOK(DrawElements, (GLenum mode, GLsizei count, GLenum type, const void *indices), (mode, count, type, indices))
+
+static void do_DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount) {
+    if (recording && !clientArrays && indices_in_buffer())
+    {
+        record_DrawElementsInstanced(mode, count, type, indices, instancecount);
+        return;
+    }
+    gl_offload_drain();
+    gl.DrawElementsInstanced(mode, count, type, indices, instancecount);
+}
+COUNTED_HOOK(DrawElementsInstanced, (GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount), (mode, count, type, indices, instancecount))
+
+static void do_DeleteBuffers(GLsizei n, const GLuint *buffers) {
+    gl_offload_drain();
+    gl.DeleteBuffers(n, buffers);
+    if (!recording || !buffers) return;
+    for (GLsizei i = 0; i < n; i++)
+    {
+        if (!buffers[i]) continue;
+        if (arrayBuffer == buffers[i]) arrayBuffer = 0;
+        if (element_buffer() == buffers[i]) set_element_buffer(vertexArray, 0);
+    }
+}
+COUNTED_HOOK(DeleteBuffers, (GLsizei n, const GLuint *buffers), (n, buffers))
+
+static void do_DeleteVertexArrays(GLsizei n, const GLuint *arrays) {
+    gl_offload_drain();
+    gl.DeleteVertexArrays(n, arrays);
+    if (!recording || !arrays) return;
+    for (GLsizei i = 0; i < n; i++)
+    {
+        if (!arrays[i]) continue;
+        if (vertexArray == arrays[i]) vertexArray = 0;
+        set_element_buffer(arrays[i], 0);
+    }
+}
+COUNTED_HOOK(DeleteVertexArrays, (GLsizei n, const GLuint *arrays), (n, arrays))
+
+static void do_VertexArrayElementBuffer(GLuint vaobj, GLuint buffer) {
+    gl_offload_drain();
+    gl.VertexArrayElementBuffer(vaobj, buffer);
+    if (recording) set_element_buffer(vaobj, buffer);
+}
+COUNTED_HOOK(VertexArrayElementBuffer, (GLuint vaobj, GLuint buffer), (vaobj, buffer))
+#undef COUNTED_HOOK
+
+static const struct {
+    const char *name;
+    void *proc;
+} offloadProcs[] = {
+    { "glBindBuffer", (void*)hook_BindBuffer },
+    { "glBindVertexArray", (void*)hook_BindVertexArray },
+    { "glVertexPointer", (void*)hook_VertexPointer },
+    { "glColorPointer", (void*)hook_ColorPointer },
+    { "glTexCoordPointer", (void*)hook_TexCoordPointer },
+    { "glNormalPointer", (void*)hook_NormalPointer },
+    { "glVertexAttribPointer", (void*)hook_VertexAttribPointer },
+    { "glVertexAttribIPointer", (void*)hook_VertexAttribIPointer },
+    { "glDrawArrays", (void*)hook_DrawArrays },
+    { "glDrawArraysInstanced", (void*)hook_DrawArraysInstanced },
+    { "glDrawElements", (void*)hook_DrawElements },
+    { "glDrawElementsInstanced", (void*)hook_DrawElementsInstanced },
+    { "glDeleteBuffers", (void*)hook_DeleteBuffers },
+    { "glDeleteVertexArrays", (void*)hook_DeleteVertexArrays },
+    { "glVertexArrayElementBuffer", (void*)hook_VertexArrayElementBuffer },
+    #define CMD(n, ...) { "gl" #n, (void*)thunk_##n },
+    #define UNIFORMV(n, ...) { "gl" #n, (void*)thunk_##n },
+    #define UNIFORM_MATRIX(n, ...) { "gl" #n, (void*)thunk_##n },
+    #define MATRIX(n) { "gl" #n, (void*)thunk_##n },
+    #include "gl_commands.h"
+    #undef CMD
+    #undef UNIFORMV
+    #undef UNIFORM_MATRIX
+    #undef MATRIX
+};
+
+#ifdef STUB_SIZE
+// Entry points outside the tables above that can still change vertex array
+// state, e.g. vendor aliases or glPopClientAttrib. Calling one of them makes
+// the recorder stop deferring draws for the current context.
+static bool changes_vertex_arrays(const char *funcName) {
+    static const char *names[] = {
+        "glBindBuffer", "glDeleteBuffers", "glBindVertexArray", "glDeleteVertexArrays",
+        "glPopClientAttrib", "glInterleavedArrays", "glVertexArrayElementBuffer",
+    };
+    if (strncmp(funcName, "glGet", 5) && strstr(funcName, "Pointer")) return true;
+
+    size_t length = strlen(funcName);
+    while (length > 2 && funcName[length - 1] >= 'A' && funcName[length - 1] <= 'Z') length--;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (strlen(names[i]) == length && !strncmp(funcName, names[i], length)) return true;
+    }
+    return false;
+}
+
+static unsigned int hash_name(const char *name) {
+    unsigned int hash = 2166136261u;
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 16777619u;
+    return hash;
+}
+
+static OSMESAproc stub_for(const char *funcName, OSMESAproc proc) {
+    pthread_mutex_lock(&offloadLock);
+    unsigned int slot = hash_name(funcName) % STUB_HASH_SIZE;
+    while (stubHash[slot])
+    {
+        int index = stubHash[slot] - 1;
+        if (!strcmp(stubNames[index], funcName))
+        {
+            pthread_mutex_unlock(&offloadLock);
+            return (OSMESAproc)(gl_offload_stubs + (size_t)index * STUB_SIZE);
+        }
+        slot = (slot + 1) % STUB_HASH_SIZE;
+    }
+
+    char *name = stubCount < STUB_COUNT ? strdup(funcName) : NULL;
+    if (!name)
+    {
+        pthread_mutex_unlock(&offloadLock);
+        OSM_LOGE("No offload trampoline left for %s", funcName);
+        return NULL;
+    }
+    int index = stubCount++;
+    stubNames[index] = name;
+    stubTargets[index] = (void*)proc;
+    stubPoison[index] = changes_vertex_arrays(funcName);
+    stubHash[slot] = index + 1;
+    pthread_mutex_unlock(&offloadLock);
+    return (OSMESAproc)(gl_offload_stubs + (size_t)index * STUB_SIZE);
+}
+
+static void* stub_target(unsigned int index) {
+    if (recording)
+    {
+        if (stubPoison[index]) reset_tracking(false);
+        drain();
+    }
+    return stubTargets[index];
+}
+
+// Called from the trampolines in gl_offload_stubs.S, which jump on to
+// Mesa, so only the part before the jump can be timed.
+__attribute__((visibility("hidden")))
+void* gl_offload_stub_target(unsigned int index) {
+    if (__builtin_expect(traceEnabled, 0)) gl_trace_untraced(index, stubNames[index]);
+    CALL_STATS(CALL_OFFLOAD(Trampolines), stub_target, (index));
+}
+#endif
+
+OSMESAproc gl_offload_wrap_proc(const char *funcName, OSMESAproc proc) {
+    // Tracing needs the thunks and trampolines even without the offload.
+    if (!(offloadEnabled || traceEnabled) || !proc || !funcName || strncmp(funcName, "gl", 2)) return proc;
+    pthread_once(&procsOnce, load_procs);
+
+    for (size_t i = 0; i < sizeof(offloadProcs) / sizeof(offloadProcs[0]); i++)
+    {
+        if (!strcmp(offloadProcs[i].name, funcName)) return (OSMESAproc)offloadProcs[i].proc;
+    }
+#ifdef STUB_SIZE
+    return stub_for(funcName, proc);
+#else
+    return proc;
+#endif
+}
+
+bool gl_offload_active(void) {
+    return recording;
+}
+
+void gl_offload_drain(void) {
+    if (recording) drain();
+}
+
+void gl_offload_on_create(OSMesaContext ctx) {
+    if (offloadEnabled) freshContext = ctx;
+}
+
+void gl_offload_before_make_current(void) {
+    gl_offload_drain();
+}
+
+static bool start_worker(void) {
+    pthread_once(&procsOnce, load_procs);
+
+    pthread_mutex_lock(&offloadLock);
+    if (ownerActive || workerStopping)
+    {
+        pthread_mutex_unlock(&offloadLock);
+        return false;
+    }
+    if (!recordBlock && !(recordBlock = take_block()))
+    {
+        pthread_mutex_unlock(&offloadLock);
+        return false;
+    }
+    if (!workerRunning)
+    {
+        if (pthread_create(&workerThread, NULL, worker_main, NULL) != 0)
+        {
+            pthread_mutex_unlock(&offloadLock);
+            OSM_LOGW("Failed to start GL offload thread");
+            return false;
+        }
+        workerRunning = true;
+    }
+    ownerActive = true;
+    pthread_mutex_unlock(&offloadLock);
+    return true;
+}
+
+static void stop_recording(void) {
+    drain();
+    recording = false;
+    boundContext = NULL;
+
+    pthread_mutex_lock(&offloadLock);
+    ownerActive = false;
+    pthread_mutex_unlock(&offloadLock);
+}
+
+// The caller's MakeCurrent already succeeded and the queue is drained. The
+// context stays with the caller until the first recorded call hands it to
+// the worker.
+void gl_offload_after_make_current(OSMesaContext ctx, void *buffer, GLenum type, GLsizei width, GLsizei height) {
+    if (!offloadEnabled) return;
+    if (!recording)
+    {
+        if (!ctx || !start_worker()) return;
+        recording = true;
+    }
+    if (!ctx)
+    {
+        stop_recording();
+        return;
+    }
+
+    if (ctx != boundContext) reset_tracking(ctx == freshContext);
+    if (ctx == freshContext) freshContext = NULL;
+    boundContext = ctx;
+    boundBuffer = buffer;
+    boundType = type;
+    boundWidth = width;
+    boundHeight = height;
+}
+
+void gl_offload_before_destroy(OSMesaContext ctx) {
+    if (!recording) return;
+    if (ctx == boundContext) stop_recording();
+    else drain();
+}
+
+void gl_offload_stop(void) {
+    pthread_mutex_lock(&offloadLock);
+    bool running = workerRunning;
+    workerStopping = true;
+    pthread_cond_signal(&workCond);
+    pthread_mutex_unlock(&offloadLock);
+
+    if (running) pthread_join(workerThread, NULL);
+    workerRunning = false;
+    recording = false;
+
+    while (freeBlocks)
+    {
+        CmdBlock *next = freeBlocks->next;
+        free(freeBlocks);
+        freeBlocks = next;
+    }
+    free(recordBlock);
+    recordBlock = NULL;
+    free(elementBuffers);
+    elementBuffers = NULL;
+    elementBufferCount = 0;
+}
+
+void gl_offload_ClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {
+    offload_ClearColor(red, green, blue, alpha);
+}
+
+void gl_offload_Clear(GLbitfield mask) {
+    offload_Clear(mask);
+}
+
+void gl_offload_ReadBuffer(GLenum mode) {
+    offload_ReadBuffer(mode);
+}
@@ -0,0 +1,41 @@
+#ifndef GL_OFFLOAD_H
+#define GL_OFFLOAD_H
+
+#include <stdbool.h>
+#include <GL/osmesa.h>
+#include <GL/gl.h>
+
+// Bridge-side alternative to mesa_glthread. While a context is current on
+// the thread that owns the offload, calls listed in gl_commands.h are
+// recorded into command blocks and replayed on a worker thread. The first
+// recorded call hands the context over: the owning thread unbinds it and
+// the worker binds it. Every other GL entry point handed out by
+// OSMesaGetProcAddress() goes through a trampoline that drains the queue,
+// has the worker unbind the context and binds it on the owning thread again
+// before jumping to Mesa, so the context is never current on both threads.
+// Each handover costs a pair of MakeCurrent calls, so the offload only pays
+// off when most calls in a frame are listed commands.
+
+bool gl_offload_configure(bool enabled);
+// Wrap a Mesa entry point for the client. Returns proc unless the offload
+// or OSM_TRACE is on.
+OSMESAproc gl_offload_wrap_proc(const char *funcName, OSMESAproc proc);
+
+// True when calls on this thread are being recorded.
+bool gl_offload_active(void);
+// Wait until everything recorded on this thread has run and bind the
+// context on this thread again. Cheap when idle.
+void gl_offload_drain(void);
+
+void gl_offload_on_create(OSMesaContext ctx);
+void gl_offload_before_make_current(void);
+void gl_offload_after_make_current(OSMesaContext ctx, void *buffer, GLenum type, GLsizei width, GLsizei height);
+void gl_offload_before_destroy(OSMesaContext ctx);
+void gl_offload_stop(void);
+
+// Recording versions of the entry points libOSMBridge.so exports itself.
+void gl_offload_ClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha);
+void gl_offload_Clear(GLbitfield mask);
+void gl_offload_ReadBuffer(GLenum mode);
+
+#endif // GL_OFFLOAD_H
@@ -0,0 +1,1121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "internal.h"
+#include "gl_trace.h"
+#include "gl_offload.h"
+#include "trace_format.h"
+#include "task_pool.h"
+#include "log.h"
+#include <GL/glext.h>
+
+// Power of two, so ring offsets are a mask of the running counters.
+#define RING_BYTES ((size_t)4 << 20)
+#define MAX_RECORD (256 * 1024)
+// Room for the opcode and every field ahead of a payload.
+#define MAX_PAYLOAD (MAX_RECORD - 128)
+// A ring this full asks for a flush ahead of the frame end.
+#define FLUSH_BYTES (RING_BYTES / 4)
+// Matches STUB_COUNT in gl_offload.c.
+#define MAX_NAMES 8192
+// Larger client arrays are left to the replay to skip.
+#define MAX_CLIENT_ARRAY ((size_t)64 << 20)
+
+typedef struct {
+    bool enabled;
+    bool client;
+    unsigned char flags;
+    GLint size;
+    GLenum type;
+    GLsizei stride;
+    const unsigned char *pointer;
+} ClientArray;
+
+// One per recording thread. Only the owner writes head and only a flush
+// writes tail; the owner never waits on a lock.
+typedef struct TraceRing {
+    unsigned char *data;
+    size_t head;
+    size_t tail;
+    unsigned int thread;
+    long long lastFrameNs;
+    TraceDelta delta;
+    unsigned char named[MAX_NAMES / 8];
+    // What the draws of this thread read from client memory, shadowed from
+    // the calls recorded since its context was made current. Only the
+    // default vertex array object is followed.
+    ClientArray arrays[TRACE_ARRAY_SLOTS];
+    GLuint arrayBuffer;
+    GLuint elementBuffer;
+    GLuint vertexArray;
+    GLuint clientTexture;
+    OSMesaContext context;
+    unsigned char scratch[MAX_RECORD];
+    struct TraceRing *next;
+} TraceRing;
+
+typedef struct {
+    TraceRing *ring;
+    unsigned char *p;
+    TraceOp op;
+    int field;
+} Record;
+
+bool traceEnabled = false;
+static TraceRing *rings = NULL;
+static __thread TraceRing *ownRing = NULL;
+static unsigned int nextThread = 0;
+static int traceFd = -1;
+static char tracePath[256];
+static bool traceStarted = false;
+// Serializes flushes: task pool workers, and recording threads once there
+// is no pool to hand the flush to.
+static pthread_mutex_t flushLock = PTHREAD_MUTEX_INITIALIZER;
+// Set from a flush request until that flush starts, so a frame raises the
+// flush event once.
+static bool flushPending = false;
+static bool writeFailed = false;
+static unsigned long long bytesWritten = 0;
+static unsigned long long droppedCalls = 0;
+// Set while a hook below calls on, so the trampoline it calls through does
+// not record the same call again by name.
+static __thread bool inHook = false;
+static void (GLAPIENTRY *getIntegerv)(GLenum, GLint*) = NULL;
+
+static TraceRing* attach_ring(void) {
+    TraceRing *ring = calloc(1, sizeof(TraceRing));
+    if (ring && !(ring->data = malloc(RING_BYTES)))
+    {
+        free(ring);
+        ring = NULL;
+    }
+    if (!ring)
+    {
+        traceEnabled = false;
+        OSM_LOGE("Out of memory for the GL trace, recording stopped");
+        return NULL;
+    }
+    ring->thread = __atomic_fetch_add(&nextThread, 1, __ATOMIC_RELAXED);
+
+    ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    ownRing = ring;
+    return ring;
+}
+
+static bool begin(Record *record, TraceOp op, size_t payload) {
+    if (!__atomic_load_n(&traceEnabled, __ATOMIC_RELAXED)) return false;
+    if (payload > MAX_PAYLOAD)
+    {
+        // Dropped before any field is coded, so the stream stays decodable.
+        __atomic_fetch_add(&droppedCalls, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    TraceRing *ring = ownRing ? ownRing : attach_ring();
+    if (!ring) return false;
+
+    record->ring = ring;
+    record->p = trace_put_varint(ring->scratch, op);
+    record->op = op;
+    record->field = 0;
+    return true;
+}
+
+static void put_field(Record *record, uint64_t bits, bool isFloat) {
+    uint64_t *last = &record->ring->delta.last[record->op][record->field++];
+    record->p = trace_put_varint(record->p, trace_encode(last, bits, isFloat));
+}
+
+#define PUT(record, value) put_field(record, TRACE_BITS(value), TRACE_IS_FLOAT(value))
+
+static void put_payload(Record *record, const void *data, size_t bytes) {
+    record->p = trace_put_varint(record->p, bytes);
+    if (bytes) memcpy(record->p, data, bytes);
+    record->p += bytes;
+}
+
+static void request_flush(void);
+static void flush_rings(void);
+
+static void end(Record *record) {
+    TraceRing *ring = record->ring;
+    size_t length = (size_t)(record->p - ring->scratch);
+    size_t head = ring->head;
+
+    // A full ring waits for a flush instead of dropping the record: a gap
+    // would break the delta coding of everything after it. The pool gets
+    // one go; if the ring is still full after that, this thread writes it
+    // out rather than spin on a worker that may be busy.
+    bool raised = false;
+    while (RING_BYTES - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) < length)
+    {
+        if (!__atomic_load_n(&traceStarted, __ATOMIC_ACQUIRE)) return;
+        if (!raised)
+        {
+            request_flush();
+            raised = true;
+            sched_yield();
+            continue;
+        }
+        pthread_mutex_lock(&flushLock);
+        flush_rings();
+        pthread_mutex_unlock(&flushLock);
+    }
+
+    size_t offset = head & (RING_BYTES - 1);
+    size_t first = length < RING_BYTES - offset ? length : RING_BYTES - offset;
+    memcpy(ring->data + offset, ring->scratch, first);
+    memcpy(ring->data, ring->scratch + first, length - first);
+    __atomic_store_n(&ring->head, head + length, __ATOMIC_RELEASE);
+
+    size_t queued = head + length - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    if (queued >= FLUSH_BYTES && queued - length < FLUSH_BYTES) request_flush();
+}
+
+static bool write_all(struct iovec *iov, int count) {
+    while (count > 0)
+    {
+        ssize_t written = writev(traceFd, iov, count);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) return false;
+        bytesWritten += (unsigned long long)written;
+        while (count > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    return true;
+}
+
+// Called with flushLock held.
+static void flush_rings(void) {
+    if (traceFd < 0) return;
+    for (TraceRing *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+    {
+        size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        size_t tail = ring->tail;
+        if (head == tail) continue;
+
+        size_t length = head - tail;
+        size_t offset = tail & (RING_BYTES - 1);
+        size_t first = length < RING_BYTES - offset ? length : RING_BYTES - offset;
+        unsigned char chunk[20];
+        unsigned char *p = trace_put_varint(chunk, ring->thread);
+        p = trace_put_varint(p, length);
+
+        struct iovec iov[3] = {
+            { chunk, (size_t)(p - chunk) },
+            { ring->data + offset, first },
+            { ring->data, length - first },
+        };
+        if (!writeFailed && !write_all(iov, length > first ? 3 : 2))
+        {
+            // Keep draining so recording threads never block on a full ring.
+            writeFailed = true;
+            __atomic_store_n(&traceEnabled, false, __ATOMIC_RELAXED);
+            OSM_LOGE("Failed to write GL trace %s: %s", tracePath, strerror(errno));
+        }
+        __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+    }
+}
+
+static void flush_task(void *arg) {
+    (void)arg;
+
+    __atomic_store_n(&flushPending, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&flushLock);
+    flush_rings();
+    pthread_mutex_unlock(&flushLock);
+}
+
+// Flushes run on the task pool at frame ends and when a ring fills up;
+// without a pool the recording thread flushes itself.
+static void request_flush(void) {
+    if (__atomic_exchange_n(&flushPending, true, __ATOMIC_SEQ_CST)) return;
+    if (task_pool_raise(TASK_EVENT_TRACE)) return;
+    flush_task(NULL);
+}
+
+bool gl_trace_start(const char *path) {
+    if (!path || !path[0] || traceStarted) return false;
+    snprintf(tracePath, sizeof(tracePath), "%s", path);
+
+    traceFd = open(tracePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (traceFd < 0)
+    {
+        OSM_LOGE("Failed to create GL trace %s: %s", tracePath, strerror(errno));
+        return false;
+    }
+
+    unsigned char header[TRACE_HEADER_SIZE];
+    uint32_t fields[4] = { TRACE_VERSION, TRACE_OP_COUNT, trace_table_hash(), 0 };
+    memcpy(header, TRACE_MAGIC, 8);
+    for (int i = 0; i < 4; i++)
+    {
+        for (int b = 0; b < 4; b++) header[8 + i * 4 + b] = (unsigned char)(fields[i] >> (b * 8));
+    }
+    struct iovec iov = { header, sizeof(header) };
+    if (!write_all(&iov, 1))
+    {
+        OSM_LOGE("Failed to start GL trace %s", tracePath);
+        close(traceFd);
+        traceFd = -1;
+        return false;
+    }
+    task_pool_on_event(TASK_EVENT_TRACE, flush_task);
+    __atomic_store_n(&traceStarted, true, __ATOMIC_RELEASE);
+    __atomic_store_n(&traceEnabled, true, __ATOMIC_RELEASE);
+    OSM_LOGI("Recording GL trace to %s", tracePath);
+    return true;
+}
+
+void gl_trace_stop(void) {
+    if (!traceStarted) return;
+    __atomic_store_n(&traceEnabled, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&traceStarted, false, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&flushLock);
+    flush_rings();
+    close(traceFd);
+    traceFd = -1;
+    pthread_mutex_unlock(&flushLock);
+
+    OSM_LOGI("GL trace %s: %llu KB from %u threads, %llu oversized calls dropped",
+            tracePath, bytesWritten >> 10, nextThread, droppedCalls);
+    // Rings stay allocated: a game thread may still be inside a record.
+}
+
+void gl_trace_CreateContext(GLenum format, OSMesaContext sharelist, OSMesaContext ctx) {
+    Record record;
+    if (!begin(&record, TRACE_CreateContext, 0)) return;
+    PUT(&record, format);
+    PUT(&record, (const void*)sharelist);
+    PUT(&record, (const void*)ctx);
+    end(&record);
+}
+
+void gl_trace_MakeCurrent(OSMesaContext ctx, GLenum type, GLsizei width, GLsizei height) {
+    Record record;
+    if (!begin(&record, TRACE_MakeCurrent, 0)) return;
+    TraceRing *ring = record.ring;
+    if (ctx != ring->context)
+    {
+        memset(ring->arrays, 0, sizeof(ring->arrays));
+        ring->arrayBuffer = ring->elementBuffer = ring->vertexArray = ring->clientTexture = 0;
+        ring->context = ctx;
+    }
+    PUT(&record, (const void*)ctx);
+    PUT(&record, type);
+    PUT(&record, width);
+    PUT(&record, height);
+    end(&record);
+}
+
+void gl_trace_DestroyContext(OSMesaContext ctx) {
+    Record record;
+    if (!begin(&record, TRACE_DestroyContext, 0)) return;
+    PUT(&record, (const void*)ctx);
+    end(&record);
+}
+
+void gl_trace_PixelStore(GLint pname, GLint value) {
+    Record record;
+    if (!begin(&record, TRACE_PixelStore, 0)) return;
+    PUT(&record, pname);
+    PUT(&record, value);
+    end(&record);
+}
+
+void gl_trace_ReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) {
+    Record record;
+    if (!begin(&record, TRACE_ReadPixels, 0)) return;
+    PUT(&record, x);
+    PUT(&record, y);
+    PUT(&record, width);
+    PUT(&record, height);
+    PUT(&record, format);
+    PUT(&record, type);
+    // Only meaningful as an offset into a pixel pack buffer.
+    PUT(&record, pixels);
+    end(&record);
+}
+
+static void end_frame(TraceOp op) {
+    Record record;
+    if (!begin(&record, op, 0)) return;
+    long long now = bridge_now_ns();
+    long long elapsed = record.ring->lastFrameNs ? now - record.ring->lastFrameNs : 0;
+    record.ring->lastFrameNs = now;
+    PUT(&record, elapsed);
+    end(&record);
+    request_flush();
+}
+
+void gl_trace_Finish(void) {
+    end_frame(TRACE_Finish);
+}
+
+void gl_trace_FlushFrontbuffer(void) {
+    end_frame(TRACE_FlushFrontbuffer);
+}
+
+void gl_trace_untraced(unsigned int id, const char *name) {
+    if (id >= MAX_NAMES || inHook) return;
+
+    // Name the id once per thread, so each thread's stream reads alone.
+    if (!ownRing || !(ownRing->named[id / 8] & (1 << (id % 8))))
+    {
+        size_t length = strlen(name);
+        if (length > 255) length = 255;
+        Record named;
+        if (!begin(&named, TRACE_Name, length)) return;
+        PUT(&named, id);
+        put_payload(&named, name, length);
+        end(&named);
+        named.ring->named[id / 8] |= (unsigned char)(1 << (id % 8));
+    }
+
+    Record record;
+    if (!begin(&record, TRACE_Untraced, 0)) return;
+    PUT(&record, id);
+    end(&record);
+}
+
+static void trace_names(TraceOp op, GLsizei n, const GLuint *names) {
+    size_t bytes = n > 0 && names ? (size_t)n * sizeof(GLuint) : 0;
+    Record record;
+    if (!begin(&record, op, bytes)) return;
+    PUT(&record, n);
+    put_payload(&record, names, bytes);
+    end(&record);
+}
+
+void gl_trace_DeleteBuffers(GLsizei n, const GLuint *buffers) {
+    trace_names(TRACE_DeleteBuffers, n, buffers);
+}
+
+void gl_trace_DeleteVertexArrays(GLsizei n, const GLuint *arrays) {
+    trace_names(TRACE_DeleteVertexArrays, n, arrays);
+}
+
+void gl_trace_VertexArrayElementBuffer(GLuint vaobj, GLuint buffer) {
+    Record record;
+    if (!begin(&record, TRACE_VertexArrayElementBuffer, 0)) return;
+    PUT(&record, vaobj);
+    PUT(&record, buffer);
+    end(&record);
+}
+
+static size_t type_size(GLenum type) {
+    switch (type)
+    {
+        case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+        case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: return 2;
+        case GL_INT: case GL_UNSIGNED_INT: case GL_FLOAT: case GL_FIXED: return 4;
+        case GL_DOUBLE: return 8;
+        default: return 0;
+    }
+}
+
+// Bytes of one vertex of a client array; 0 if unknown.
+static size_t element_size(GLint size, GLenum type) {
+    if (type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_10F_11F_11F_REV) return 4;
+    return (size_t)(size == GL_BGRA ? 4 : size > 0 ? size : 0) * type_size(type);
+}
+
+// Bytes of one pixel of a texture upload; 0 if unknown.
+static size_t pixel_size(GLenum format, GLenum type) {
+    switch (type)
+    {
+        case GL_UNSIGNED_BYTE_3_3_2: case GL_UNSIGNED_BYTE_2_3_3_REV:
+            return 1;
+        case GL_UNSIGNED_SHORT_5_6_5: case GL_UNSIGNED_SHORT_5_6_5_REV:
+        case GL_UNSIGNED_SHORT_4_4_4_4: case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+        case GL_UNSIGNED_SHORT_5_5_5_1: case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+            return 2;
+        case GL_UNSIGNED_INT_8_8_8_8: case GL_UNSIGNED_INT_8_8_8_8_REV:
+        case GL_UNSIGNED_INT_10_10_10_2: case GL_UNSIGNED_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_24_8: case GL_UNSIGNED_INT_10F_11F_11F_REV: case GL_UNSIGNED_INT_5_9_9_9_REV:
+            return 4;
+        case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+            return 8;
+    }
+    size_t components;
+    switch (format)
+    {
+        case GL_RED: case GL_GREEN: case GL_BLUE: case GL_ALPHA: case GL_LUMINANCE: case GL_INTENSITY:
+        case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX: case GL_COLOR_INDEX:
+            components = 1;
+            break;
+        case GL_RG: case GL_RG_INTEGER: case GL_LUMINANCE_ALPHA:
+            components = 2;
+            break;
+        case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: case GL_BGR_INTEGER:
+            components = 3;
+            break;
+        case GL_RGBA: case GL_BGRA: case GL_RGBA_INTEGER: case GL_BGRA_INTEGER:
+            components = 4;
+            break;
+        default:
+            return 0;
+    }
+    return components * type_size(type);
+}
+
+static GLint get_integer(GLenum pname) {
+    if (!getIntegerv) getIntegerv = (void (GLAPIENTRY*)(GLenum, GLint*))bridge_get_proc("glGetIntegerv");
+    GLint value = 0;
+    if (getIntegerv) getIntegerv(pname, &value);
+    return value;
+}
+
+// --- Client arrays ---
+
+static ClientArray* client_state_array(TraceRing *ring, GLenum array) {
+    switch (array)
+    {
+        case GL_VERTEX_ARRAY: return &ring->arrays[TRACE_ARRAY_VERTEX];
+        case GL_NORMAL_ARRAY: return &ring->arrays[TRACE_ARRAY_NORMAL];
+        case GL_COLOR_ARRAY: return &ring->arrays[TRACE_ARRAY_COLOR];
+        case GL_TEXTURE_COORD_ARRAY:
+            return ring->clientTexture < TRACE_TEXCOORD_UNITS ? &ring->arrays[TRACE_ARRAY_TEXCOORD + ring->clientTexture] : NULL;
+        default: return NULL;
+    }
+}
+
+static ClientArray* attrib_array(TraceRing *ring, uint64_t index) {
+    return index < TRACE_ATTRIBS ? &ring->arrays[TRACE_ARRAY_ATTRIB + index] : NULL;
+}
+
+static void set_array(TraceRing *ring, ClientArray *array, uint64_t size, uint64_t type, uint64_t stride, uint64_t pointer, unsigned char flags) {
+    if (!array) return;
+    array->size = (GLint)size;
+    array->type = (GLenum)type;
+    array->stride = (GLsizei)stride;
+    array->pointer = (const unsigned char*)(uintptr_t)pointer;
+    array->flags = flags;
+    // With a buffer bound the pointer is an offset the replay has too.
+    array->client = !ring->arrayBuffer && pointer;
+}
+
+static void record_array_bytes(TraceOp op, int slot, const ClientArray *array, size_t start, const unsigned char *data, size_t bytes) {
+    for (size_t offset = 0; offset < bytes; offset += MAX_PAYLOAD)
+    {
+        size_t chunk = bytes - offset < MAX_PAYLOAD ? bytes - offset : MAX_PAYLOAD;
+        Record record;
+        if (!begin(&record, op, chunk)) return;
+        if (array)
+        {
+            PUT(&record, slot);
+            PUT(&record, array->size);
+            PUT(&record, array->type);
+            PUT(&record, array->stride);
+            PUT(&record, array->flags);
+            PUT(&record, start);
+        }
+        PUT(&record, offset);
+        put_payload(&record, data + offset, chunk);
+        end(&record);
+    }
+}
+
+static bool index_range(GLenum type, const void *indices, GLsizei count, GLint *lo, GLint *hi) {
+    uint32_t min = UINT32_MAX, max = 0;
+    for (GLsizei i = 0; i < count; i++)
+    {
+        uint32_t index;
+        switch (type)
+        {
+            case GL_UNSIGNED_BYTE: index = ((const uint8_t*)indices)[i]; break;
+            case GL_UNSIGNED_SHORT: index = ((const uint16_t*)indices)[i]; break;
+            case GL_UNSIGNED_INT: index = ((const uint32_t*)indices)[i]; break;
+            default: return false;
+        }
+        if (index < min) min = index;
+        if (index > max) max = index;
+    }
+    if (max >= (uint32_t)INT32_MAX) return false;
+    *lo = (GLint)min;
+    *hi = (GLint)max + 1;
+    return true;
+}
+
+// Ahead of a draw, record what it reads from client memory: the vertices
+// from lo up to hi of every enabled client array, and the indices when they
+// are in client memory, so the replay can draw from copies.
+static void capture_draw(TraceRing *ring, GLint lo, GLint hi, GLsizei count, GLenum indexType, const void *indices, bool indexed) {
+    bool captured = true;
+    bool clientArrays = false;
+    if (!ring->vertexArray)
+    {
+        for (int slot = 0; slot < TRACE_ARRAY_SLOTS; slot++)
+        {
+            const ClientArray *array = &ring->arrays[slot];
+            if (!array->enabled || !array->client) continue;
+            clientArrays = true;
+            if (!element_size(array->size, array->type)) captured = false;
+        }
+    }
+    const void *clientIndices = indexed && !ring->vertexArray && !ring->elementBuffer ? indices : NULL;
+    if (indexed && count > 0 && clientArrays)
+    {
+        // Indices in a buffer cannot be read here to find the range.
+        if (!clientIndices || !index_range(indexType, clientIndices, count, &lo, &hi)) captured = false;
+    }
+    if (lo < 0) captured = false;
+
+    if (captured && clientArrays && count > 0)
+    {
+        for (int slot = 0; slot < TRACE_ARRAY_SLOTS; slot++)
+        {
+            const ClientArray *array = &ring->arrays[slot];
+            if (!array->enabled || !array->client) continue;
+            size_t size = element_size(array->size, array->type);
+            size_t stride = array->stride ? (size_t)array->stride : size;
+            size_t bytes = (size_t)(hi - lo - 1) * stride + size;
+            if (bytes > MAX_CLIENT_ARRAY)
+            {
+                captured = false;
+                break;
+            }
+            record_array_bytes(TRACE_ClientArray, slot, array, (size_t)lo * stride, array->pointer + (size_t)lo * stride, bytes);
+        }
+    }
+    if (captured && clientIndices && count > 0)
+    {
+        size_t bytes = (size_t)count * type_size(indexType);
+        if (bytes) record_array_bytes(TRACE_ClientIndices, 0, NULL, 0, clientIndices, bytes);
+    }
+
+    Record record;
+    if (!begin(&record, TRACE_ClientDraw, 0)) return;
+    PUT(&record, captured);
+    end(&record);
+}
+
+// Recorded calls that feed the shadow of the client arrays.
+static const bool tracked[TRACE_OP_COUNT] = {
+    [TRACE_OP(BindBuffer)] = true,
+    [TRACE_OP(BindVertexArray)] = true,
+    [TRACE_OP(ClientActiveTexture)] = true,
+    [TRACE_OP(EnableClientState)] = true,
+    [TRACE_OP(DisableClientState)] = true,
+    [TRACE_OP(EnableVertexAttribArray)] = true,
+    [TRACE_OP(DisableVertexAttribArray)] = true,
+    [TRACE_OP(VertexPointer)] = true,
+    [TRACE_OP(NormalPointer)] = true,
+    [TRACE_OP(ColorPointer)] = true,
+    [TRACE_OP(TexCoordPointer)] = true,
+    [TRACE_OP(VertexAttribPointer)] = true,
+    [TRACE_OP(VertexAttribIPointer)] = true,
+    [TRACE_OP(DrawArrays)] = true,
+    [TRACE_OP(DrawArraysInstanced)] = true,
+    [TRACE_OP(DrawElements)] = true,
+    [TRACE_OP(DrawElementsInstanced)] = true,
+};
+
+static void track(TraceOp op, const uint64_t *args) {
+    if (!__atomic_load_n(&traceEnabled, __ATOMIC_RELAXED)) return;
+    TraceRing *ring = ownRing ? ownRing : attach_ring();
+    if (!ring) return;
+
+    switch (op)
+    {
+        case TRACE_OP(BindBuffer):
+            if (args[0] == GL_ARRAY_BUFFER) ring->arrayBuffer = (GLuint)args[1];
+            // The element buffer binding belongs to the vertex array object.
+            else if (args[0] == GL_ELEMENT_ARRAY_BUFFER && !ring->vertexArray) ring->elementBuffer = (GLuint)args[1];
+            return;
+        case TRACE_OP(BindVertexArray):
+            ring->vertexArray = (GLuint)args[0];
+            return;
+        case TRACE_OP(ClientActiveTexture):
+            ring->clientTexture = (GLuint)(args[0] - GL_TEXTURE0);
+            return;
+        case TRACE_OP(DrawArrays):
+        case TRACE_OP(DrawArraysInstanced):
+            capture_draw(ring, (GLint)args[1], (GLint)args[1] + (GLsizei)args[2], (GLsizei)args[2], 0, NULL, false);
+            return;
+        case TRACE_OP(DrawElements):
+        case TRACE_OP(DrawElementsInstanced):
+            capture_draw(ring, 0, 0, (GLsizei)args[1], (GLenum)args[2], (const void*)(uintptr_t)args[3], true);
+            return;
+        default:
+            break;
+    }
+
+    // The rest change the state of the bound vertex array object.
+    if (ring->vertexArray) return;
+    ClientArray *array;
+    switch (op)
+    {
+        case TRACE_OP(EnableClientState):
+        case TRACE_OP(DisableClientState):
+            array = client_state_array(ring, (GLenum)args[0]);
+            if (array) array->enabled = op == TRACE_OP(EnableClientState);
+            break;
+        case TRACE_OP(EnableVertexAttribArray):
+        case TRACE_OP(DisableVertexAttribArray):
+            array = attrib_array(ring, args[0]);
+            if (array) array->enabled = op == TRACE_OP(EnableVertexAttribArray);
+            break;
+        case TRACE_OP(VertexPointer):
+            set_array(ring, &ring->arrays[TRACE_ARRAY_VERTEX], args[0], args[1], args[2], args[3], 0);
+            break;
+        case TRACE_OP(NormalPointer):
+            set_array(ring, &ring->arrays[TRACE_ARRAY_NORMAL], 3, args[0], args[1], args[2], 0);
+            break;
+        case TRACE_OP(ColorPointer):
+            set_array(ring, &ring->arrays[TRACE_ARRAY_COLOR], args[0], args[1], args[2], args[3], 0);
+            break;
+        case TRACE_OP(TexCoordPointer):
+            set_array(ring, client_state_array(ring, GL_TEXTURE_COORD_ARRAY), args[0], args[1], args[2], args[3], 0);
+            break;
+        case TRACE_OP(VertexAttribPointer):
+            set_array(ring, attrib_array(ring, args[0]), args[1], args[2], args[4], args[5], args[3] ? TRACE_ARRAY_NORMALIZED : 0);
+            break;
+        case TRACE_OP(VertexAttribIPointer):
+            set_array(ring, attrib_array(ring, args[0]), args[1], args[2], args[3], args[4], TRACE_ARRAY_INTEGER);
+            break;
+        default:
+            break;
+    }
+}
+
+// Generated recorders for gl_commands.h. Calls that feed the client array
+// shadow pass their arguments to track() first.
+#define CMD(n, params, bits, puts) \
+    void gl_trace_##n params { \
+        if (tracked[TRACE_OP(n)]) track(TRACE_OP(n), (const uint64_t[]){ UNPAREN bits }); \
+        Record record; \
+        if (!begin(&record, TRACE_OP(n), 0)) return; \
+        puts \
+        end(&record); \
+    }
+#define UNPAREN(...) __VA_ARGS__
+#define GL_CMD0(n) \
+    void gl_trace_##n(void) { \
+        Record record; \
+        if (!begin(&record, TRACE_OP(n), 0)) return; \
+        end(&record); \
+    }
+#define GL_CMD1(n, t1)                      CMD(n, (t1 a1), (TRACE_BITS(a1)), PUT(&record, a1);)
+#define GL_CMD2(n, t1, t2)                  CMD(n, (t1 a1, t2 a2), (TRACE_BITS(a1), TRACE_BITS(a2)), PUT(&record, a1); PUT(&record, a2);)
+#define GL_CMD3(n, t1, t2, t3)              CMD(n, (t1 a1, t2 a2, t3 a3), (TRACE_BITS(a1), TRACE_BITS(a2), TRACE_BITS(a3)), PUT(&record, a1); PUT(&record, a2); PUT(&record, a3);)
+#define GL_CMD4(n, t1, t2, t3, t4)          CMD(n, (t1 a1, t2 a2, t3 a3, t4 a4), (TRACE_BITS(a1), TRACE_BITS(a2), TRACE_BITS(a3), TRACE_BITS(a4)), PUT(&record, a1); PUT(&record, a2); PUT(&record, a3); PUT(&record, a4);)
+#define GL_CMD5(n, t1, t2, t3, t4, t5)      CMD(n, (t1 a1, t2 a2, t3 a3, t4 a4, t5 a5), (TRACE_BITS(a1), TRACE_BITS(a2), TRACE_BITS(a3), TRACE_BITS(a4), TRACE_BITS(a5)), PUT(&record, a1); PUT(&record, a2); PUT(&record, a3); PUT(&record, a4); PUT(&record, a5);)
+#define GL_CMD6(n, t1, t2, t3, t4, t5, t6)  CMD(n, (t1 a1, t2 a2, t3 a3, t4 a4, t5 a5, t6 a6), (TRACE_BITS(a1), TRACE_BITS(a2), TRACE_BITS(a3), TRACE_BITS(a4), TRACE_BITS(a5), TRACE_BITS(a6)), PUT(&record, a1); PUT(&record, a2); PUT(&record, a3); PUT(&record, a4); PUT(&record, a5); PUT(&record, a6);)
+#define GL_UNIFORMV(n, type, width) \
+    void gl_trace_##n(GLint location, GLsizei count, const type *value) { \
+        size_t bytes = count > 0 && value ? (size_t)count * (width) * sizeof(type) : 0; \
+        Record record; \
+        if (!begin(&record, TRACE_OP(n), bytes)) return; \
+        PUT(&record, location); \
+        PUT(&record, count); \
+        put_payload(&record, value, bytes); \
+        end(&record); \
+    }
+#define GL_UNIFORM_MATRIX(n, width) \
+    void gl_trace_##n(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) { \
+        size_t bytes = count > 0 && value ? (size_t)count * (width) * sizeof(GLfloat) : 0; \
+        Record record; \
+        if (!begin(&record, TRACE_OP(n), bytes)) return; \
+        PUT(&record, location); \
+        PUT(&record, count); \
+        PUT(&record, transpose); \
+        put_payload(&record, value, bytes); \
+        end(&record); \
+    }
+#define GL_MATRIX(n) \
+    void gl_trace_##n(const GLfloat *m) { \
+        Record record; \
+        if (!begin(&record, TRACE_OP(n), 16 * sizeof(GLfloat))) return; \
+        put_payload(&record, m, m ? 16 * sizeof(GLfloat) : 0); \
+        end(&record); \
+    }
+#include "gl_commands.h"
+#undef CMD
+#undef UNPAREN
+#undef GL_CMD0
+#undef GL_CMD1
+#undef GL_CMD2
+#undef GL_CMD3
+#undef GL_CMD4
+#undef GL_CMD5
+#undef GL_CMD6
+#undef GL_UNIFORMV
+#undef GL_UNIFORM_MATRIX
+#undef GL_MATRIX
+
+// --- Object names, shaders and uploads ---
+
+// Entry points outside gl_commands.h whose arguments the replay needs.
+// Each hook records and calls on through next, which is what the offload
+// handed out for the name: usually a trampoline.
+static struct {
+#define X(n) \
+    void (GLAPIENTRY *Gen##n)(GLsizei, GLuint*); \
+    void (GLAPIENTRY *Delete##n)(GLsizei, const GLuint*);
+    TRACE_NAME_KINDS(X)
+#undef X
+    GLuint (GLAPIENTRY *CreateShader)(GLenum);
+    GLuint (GLAPIENTRY *CreateProgram)(void);
+    void (GLAPIENTRY *ShaderSource)(GLuint, GLsizei, const GLchar *const*, const GLint*);
+    void (GLAPIENTRY *CompileShader)(GLuint);
+    void (GLAPIENTRY *AttachShader)(GLuint, GLuint);
+    void (GLAPIENTRY *DetachShader)(GLuint, GLuint);
+    void (GLAPIENTRY *LinkProgram)(GLuint);
+    void (GLAPIENTRY *DeleteShader)(GLuint);
+    void (GLAPIENTRY *DeleteProgram)(GLuint);
+    void (GLAPIENTRY *BindAttribLocation)(GLuint, GLuint, const GLchar*);
+    void (GLAPIENTRY *BufferData)(GLenum, GLsizeiptr, const void*, GLenum);
+    void (GLAPIENTRY *BufferSubData)(GLenum, GLintptr, GLsizeiptr, const void*);
+    void (GLAPIENTRY *TexImage2D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*);
+    void (GLAPIENTRY *TexSubImage2D)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*);
+    void (GLAPIENTRY *TexImage3D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*);
+    void (GLAPIENTRY *TexSubImage3D)(GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const void*);
+} next;
+
+#define FORWARD(call) do { inHook = true; call; inHook = false; } while (0)
+
+static void trace_kind_names(TraceOp op, TraceNameKind kind, GLsizei n, const GLuint *names) {
+    size_t bytes = n > 0 && names ? (size_t)n * sizeof(GLuint) : 0;
+    Record record;
+    if (!begin(&record, op, bytes)) return;
+    PUT(&record, kind);
+    PUT(&record, n);
+    put_payload(&record, names, bytes);
+    end(&record);
+}
+
+// glDeleteBuffers and glDeleteVertexArrays are traced by the offload's own
+// hooks.
+#define X(n) \
+    static void GLAPIENTRY hook_Gen##n(GLsizei count, GLuint *names) { \
+        FORWARD(next.Gen##n(count, names)); \
+        trace_kind_names(TRACE_GenNames, TRACE_NAMES_##n, count, names); \
+    } \
+    __attribute__((unused)) static void GLAPIENTRY hook_Delete##n(GLsizei count, const GLuint *names) { \
+        trace_kind_names(TRACE_DeleteNames, TRACE_NAMES_##n, count, names); \
+        FORWARD(next.Delete##n(count, names)); \
+    }
+TRACE_NAME_KINDS(X)
+#undef X
+
+static void trace_object(TraceOp op, GLuint a, GLuint b, int fields) {
+    Record record;
+    if (!begin(&record, op, 0)) return;
+    PUT(&record, a);
+    if (fields > 1) PUT(&record, b);
+    end(&record);
+}
+
+static GLuint GLAPIENTRY hook_CreateShader(GLenum type) {
+    GLuint shader;
+    FORWARD(shader = next.CreateShader(type));
+    trace_object(TRACE_CreateShader, type, shader, 2);
+    return shader;
+}
+
+static GLuint GLAPIENTRY hook_CreateProgram(void) {
+    GLuint program;
+    FORWARD(program = next.CreateProgram());
+    trace_object(TRACE_CreateProgram, program, 0, 1);
+    return program;
+}
+
+static void GLAPIENTRY hook_ShaderSource(GLuint shader, GLsizei count, const GLchar *const *strings, const GLint *lengths) {
+    size_t total = 0;
+    for (GLsizei i = 0; strings && i < count; i++)
+    {
+        total += lengths && lengths[i] >= 0 ? (size_t)lengths[i] : strlen(strings[i]);
+    }
+    Record record;
+    if (begin(&record, TRACE_ShaderSource, total))
+    {
+        PUT(&record, shader);
+        record.p = trace_put_varint(record.p, total);
+        for (GLsizei i = 0; strings && i < count; i++)
+        {
+            size_t length = lengths && lengths[i] >= 0 ? (size_t)lengths[i] : strlen(strings[i]);
+            memcpy(record.p, strings[i], length);
+            record.p += length;
+        }
+        end(&record);
+    }
+    FORWARD(next.ShaderSource(shader, count, strings, lengths));
+}
+
+static void GLAPIENTRY hook_CompileShader(GLuint shader) {
+    trace_object(TRACE_CompileShader, shader, 0, 1);
+    FORWARD(next.CompileShader(shader));
+}
+
+static void GLAPIENTRY hook_AttachShader(GLuint program, GLuint shader) {
+    trace_object(TRACE_AttachShader, program, shader, 2);
+    FORWARD(next.AttachShader(program, shader));
+}
+
+static void GLAPIENTRY hook_DetachShader(GLuint program, GLuint shader) {
+    trace_object(TRACE_DetachShader, program, shader, 2);
+    FORWARD(next.DetachShader(program, shader));
+}
+
+static void GLAPIENTRY hook_LinkProgram(GLuint program) {
+    trace_object(TRACE_LinkProgram, program, 0, 1);
+    FORWARD(next.LinkProgram(program));
+}
+
+static void GLAPIENTRY hook_DeleteShader(GLuint shader) {
+    trace_object(TRACE_DeleteShader, shader, 0, 1);
+    FORWARD(next.DeleteShader(shader));
+}
+
+static void GLAPIENTRY hook_DeleteProgram(GLuint program) {
+    trace_object(TRACE_DeleteProgram, program, 0, 1);
+    FORWARD(next.DeleteProgram(program));
+}
+
+static void GLAPIENTRY hook_BindAttribLocation(GLuint program, GLuint index, const GLchar *name) {
+    size_t length = name ? strlen(name) : 0;
+    Record record;
+    if (begin(&record, TRACE_BindAttribLocation, length))
+    {
+        PUT(&record, program);
+        PUT(&record, index);
+        put_payload(&record, name, length);
+        end(&record);
+    }
+    FORWARD(next.BindAttribLocation(program, index, name));
+}
+
+static void trace_buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) {
+    for (GLsizeiptr done = 0; data && done < size; done += MAX_PAYLOAD)
+    {
+        size_t chunk = (size_t)(size - done) < MAX_PAYLOAD ? (size_t)(size - done) : MAX_PAYLOAD;
+        Record record;
+        if (!begin(&record, TRACE_BufferSubData, chunk)) return;
+        PUT(&record, target);
+        PUT(&record, offset + done);
+        put_payload(&record, (const unsigned char*)data + done, chunk);
+        end(&record);
+    }
+}
+
+static void GLAPIENTRY hook_BufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+    size_t bytes = data && size > 0 ? (size_t)size : 0;
+    bool split = bytes > MAX_PAYLOAD;
+    Record record;
+    if (begin(&record, TRACE_BufferData, split ? 0 : bytes))
+    {
+        PUT(&record, target);
+        PUT(&record, size);
+        PUT(&record, usage);
+        put_payload(&record, data, split ? 0 : bytes);
+        end(&record);
+        if (split) trace_buffer_sub_data(target, 0, size, data);
+    }
+    FORWARD(next.BufferData(target, size, data, usage));
+}
+
+static void GLAPIENTRY hook_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) {
+    trace_buffer_sub_data(target, offset, size, data);
+    FORWARD(next.BufferSubData(target, offset, size, data));
+}
+
+typedef struct {
+    TraceOp op;
+    bool is3D;
+    GLenum target;
+    GLint level, internalformat, x, y, z;
+    GLsizei width, height, depth;
+    GLint border;
+    GLenum format, type;
+    const void *pixels;
+} ImageCall;
+
+static void record_image(const ImageCall *call, const void *data, size_t bytes) {
+    Record record;
+    if (!begin(&record, call->op, bytes)) return;
+    bool full = call->op == TRACE_TexImage2D || call->op == TRACE_TexImage3D;
+    PUT(&record, call->target);
+    PUT(&record, call->level);
+    if (full) PUT(&record, call->internalformat);
+    else
+    {
+        PUT(&record, call->x);
+        PUT(&record, call->y);
+        if (call->is3D) PUT(&record, call->z);
+    }
+    PUT(&record, call->width);
+    PUT(&record, call->height);
+    if (call->is3D) PUT(&record, call->depth);
+    if (full) PUT(&record, call->border);
+    PUT(&record, call->format);
+    PUT(&record, call->type);
+    PUT(&record, call->pixels);
+    put_payload(&record, data, bytes);
+    end(&record);
+}
+
+// Record an upload with the bytes GL reads for it: rows of a 2D image or
+// images of a 3D one, laid out by the unpack state. Too large for one
+// record, it goes out as the call without data and SubImage bands.
+static void trace_image(const ImageCall *call) {
+    if (!__atomic_load_n(&traceEnabled, __ATOMIC_RELAXED)) return;
+    size_t pixelBytes = pixel_size(call->format, call->type);
+    // The queries need the context back on this thread.
+    gl_offload_drain();
+    if (!call->pixels || !pixelBytes || get_integer(GL_PIXEL_UNPACK_BUFFER_BINDING) || call->width <= 0 || call->height <= 0 || call->depth <= 0)
+    {
+        record_image(call, NULL, 0);
+        return;
+    }
+
+    GLint alignment = get_integer(GL_UNPACK_ALIGNMENT);
+    GLint rowLength = get_integer(GL_UNPACK_ROW_LENGTH);
+    GLint imageHeight = call->is3D ? get_integer(GL_UNPACK_IMAGE_HEIGHT) : 0;
+    size_t rowBytes = (size_t)(rowLength > 0 ? rowLength : call->width) * pixelBytes;
+    if (alignment > 1) rowBytes = (rowBytes + (size_t)alignment - 1) / (size_t)alignment * (size_t)alignment;
+    size_t skip = (size_t)get_integer(GL_UNPACK_SKIP_ROWS) * rowBytes + (size_t)get_integer(GL_UNPACK_SKIP_PIXELS) * pixelBytes;
+    // A unit is a row of a 2D upload or an image of a 3D one.
+    size_t unitBytes = rowBytes, lastUnitBytes = skip + (size_t)call->width * pixelBytes;
+    GLsizei units = call->height;
+    if (call->is3D)
+    {
+        unitBytes = (size_t)(imageHeight > 0 ? imageHeight : call->height) * rowBytes;
+        skip += (size_t)get_integer(GL_UNPACK_SKIP_IMAGES) * unitBytes;
+        lastUnitBytes = skip + (size_t)(call->height - 1) * rowBytes + (size_t)call->width * pixelBytes;
+        units = call->depth;
+    }
+    // GL starts reading at pixels; the skips are inside lastUnitBytes.
+    size_t bytes = (size_t)(units - 1) * unitBytes + lastUnitBytes;
+    if (bytes <= MAX_PAYLOAD)
+    {
+        record_image(call, call->pixels, bytes);
+        return;
+    }
+
+    if (lastUnitBytes > MAX_PAYLOAD)
+    {
+        __atomic_fetch_add(&droppedCalls, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    GLsizei band = (GLsizei)((MAX_PAYLOAD - lastUnitBytes) / unitBytes) + 1;
+    ImageCall part = *call;
+    if (call->op == TRACE_TexImage2D || call->op == TRACE_TexImage3D)
+    {
+        part.pixels = NULL;
+        record_image(&part, NULL, 0);
+        part.op = call->is3D ? TRACE_TexSubImage3D : TRACE_TexSubImage2D;
+        part.x = part.y = part.z = 0;
+    }
+    for (GLsizei done = 0; done < units; done += band)
+    {
+        GLsizei count = units - done < band ? units - done : band;
+        // Each band keeps the skips, so it starts done units earlier.
+        part.pixels = (const unsigned char*)call->pixels + (size_t)done * unitBytes;
+        if (call->is3D)
+        {
+            part.z = (call->op == TRACE_TexImage3D ? 0 : call->z) + done;
+            part.depth = count;
+        }
+        else
+        {
+            part.y = (call->op == TRACE_TexImage2D ? 0 : call->y) + done;
+            part.height = count;
+        }
+        record_image(&part, part.pixels, (size_t)(count - 1) * unitBytes + lastUnitBytes);
+    }
+}
+
+static void GLAPIENTRY hook_TexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels) {
+    trace_image(&(ImageCall){ TRACE_TexImage2D, false, target, level, internalformat, 0, 0, 0, width, height, 1, border, format, type, pixels });
+    FORWARD(next.TexImage2D(target, level, internalformat, width, height, border, format, type, pixels));
+}
+
+static void GLAPIENTRY hook_TexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) {
+    trace_image(&(ImageCall){ TRACE_TexSubImage2D, false, target, level, 0, xoffset, yoffset, 0, width, height, 1, 0, format, type, pixels });
+    FORWARD(next.TexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels));
+}
+
+static void GLAPIENTRY hook_TexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void *pixels) {
+    trace_image(&(ImageCall){ TRACE_TexImage3D, true, target, level, internalformat, 0, 0, 0, width, height, depth, border, format, type, pixels });
+    FORWARD(next.TexImage3D(target, level, internalformat, width, height, depth, border, format, type, pixels));
+}
+
+static void GLAPIENTRY hook_TexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels) {
+    trace_image(&(ImageCall){ TRACE_TexSubImage3D, true, target, level, 0, xoffset, yoffset, zoffset, width, height, depth, 0, format, type, pixels });
+    FORWARD(next.TexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels));
+}
+
+static const struct {
+    const char *name;
+    void *hook;
+    void *next;
+} traceHooks[] = {
+#define HOOK(n) { "gl" #n, (void*)hook_##n, (void*)&next.n },
+#define X(n) HOOK(Gen##n)
+    TRACE_NAME_KINDS(X)
+#undef X
+    HOOK(DeleteTextures)
+    HOOK(DeleteFramebuffers)
+    HOOK(DeleteRenderbuffers)
+    HOOK(DeleteQueries)
+    HOOK(DeleteSamplers)
+    HOOK(CreateShader)
+    HOOK(CreateProgram)
+    HOOK(ShaderSource)
+    HOOK(CompileShader)
+    HOOK(AttachShader)
+    HOOK(DetachShader)
+    HOOK(LinkProgram)
+    HOOK(DeleteShader)
+    HOOK(DeleteProgram)
+    HOOK(BindAttribLocation)
+    HOOK(BufferData)
+    HOOK(BufferSubData)
+    HOOK(TexImage2D)
+    HOOK(TexSubImage2D)
+    HOOK(TexImage3D)
+    HOOK(TexSubImage3D)
+#undef HOOK
+};
+
+// funcName without its vendor suffix (glGenBuffersARB, glCreateShaderObjectARB
+// aside), as long as that leaves a name such as glTexImage3D whole.
+static bool same_call(const char *hookName, const char *funcName) {
+    size_t length = strlen(hookName);
+    if (strncmp(hookName, funcName, length)) return false;
+    for (const char *p = funcName + length; *p; p++)
+    {
+        if (*p < 'A' || *p > 'Z') return false;
+    }
+    return true;
+}
+
+OSMESAproc gl_trace_wrap_proc(const char *funcName, OSMESAproc proc) {
+    if (!__atomic_load_n(&traceEnabled, __ATOMIC_ACQUIRE) || !proc || !funcName) return proc;
+    for (size_t i = 0; i < sizeof(traceHooks) / sizeof(traceHooks[0]); i++)
+    {
+        if (!same_call(traceHooks[i].name, funcName)) continue;
+        // Aliases such as glGenBuffersARB share the hook and the next of
+        // whichever name was asked for first.
+        void *expected = NULL;
+        __atomic_compare_exchange_n((void**)traceHooks[i].next, &expected, (void*)proc, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        return (OSMESAproc)traceHooks[i].hook;
+    }
+    return proc;
+}
@@ -0,0 +1,63 @@
+#ifndef GL_TRACE_H
+#define GL_TRACE_H
+
+#include <stdbool.h>
+#include <GL/osmesa.h>
+#include <GL/gl.h>
+
+// OSM_TRACE=<file> records the GL calls the bridge intercepts into a
+// compact binary trace (see trace_format.h) for tools/osm-replay.
+// Recording threads encode into their own ring without locking; a task
+// pool worker writes the rings to the file at frame ends. Object names,
+// shaders, buffer and texture uploads and what draws read from client
+// arrays are recorded with their data; other entry points outside
+// gl_commands.h by name only, as they cannot be replayed.
+
+// Checked by every intercepted call; only gl_trace_start() sets it.
+__attribute__((visibility("hidden"))) extern bool traceEnabled;
+
+// Returns false if path is empty or the trace could not be started.
+bool gl_trace_start(const char *path);
+// Flush everything recorded and close the file.
+void gl_trace_stop(void);
+// Wrap an entry point handed out by OSMesaGetProcAddress() whose data the
+// replay needs. Returns proc unless recording.
+OSMESAproc gl_trace_wrap_proc(const char *funcName, OSMESAproc proc);
+
+void gl_trace_CreateContext(GLenum format, OSMesaContext sharelist, OSMesaContext ctx);
+void gl_trace_MakeCurrent(OSMesaContext ctx, GLenum type, GLsizei width, GLsizei height);
+void gl_trace_DestroyContext(OSMesaContext ctx);
+void gl_trace_PixelStore(GLint pname, GLint value);
+void gl_trace_ReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels);
+// End of a frame.
+void gl_trace_Finish(void);
+void gl_trace_FlushFrontbuffer(void);
+// A call through trampoline id, whose arguments are unknown.
+void gl_trace_untraced(unsigned int id, const char *name);
+void gl_trace_DeleteBuffers(GLsizei n, const GLuint *buffers);
+void gl_trace_DeleteVertexArrays(GLsizei n, const GLuint *arrays);
+void gl_trace_VertexArrayElementBuffer(GLuint vaobj, GLuint buffer);
+
+#define GL_CMD0(n) void gl_trace_##n(void);
+#define GL_CMD1(n, ...) void gl_trace_##n(__VA_ARGS__);
+#define GL_CMD2(n, ...) void gl_trace_##n(__VA_ARGS__);
+#define GL_CMD3(n, ...) void gl_trace_##n(__VA_ARGS__);
+#define GL_CMD4(n, ...) void gl_trace_##n(__VA_ARGS__);
+#define GL_CMD5(n, ...) void gl_trace_##n(__VA_ARGS__);
+#define GL_CMD6(n, ...) void gl_trace_##n(__VA_ARGS__);
+#define GL_UNIFORMV(n, type, width) void gl_trace_##n(GLint, GLsizei, const type*);
+#define GL_UNIFORM_MATRIX(n, width) void gl_trace_##n(GLint, GLsizei, GLboolean, const GLfloat*);
+#define GL_MATRIX(n) void gl_trace_##n(const GLfloat*);
+#include "gl_commands.h"
+#undef GL_CMD0
+#undef GL_CMD1
+#undef GL_CMD2
+#undef GL_CMD3
+#undef GL_CMD4
+#undef GL_CMD5
+#undef GL_CMD6
+#undef GL_UNIFORMV
+#undef GL_UNIFORM_MATRIX
+#undef GL_MATRIX
+
+#endif // GL_TRACE_H
@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "bridge.h"
+#include "internal.h"
+#include "gpu_timing.h"
+#include "timeline.h"
+#include "log.h"
+#include <GL/glext.h>
+
+// Readbacks timed per frame; later ones in the same frame are not.
+#define MAX_READBACKS 4
+// Begin and end of the frame, then of each readback.
+#define QUERIES_PER_FRAME (2 + 2 * MAX_READBACKS)
+
+typedef enum {
+    SEGMENT_FRAME,
+    SEGMENT_READBACK,
+    SEGMENT_COUNT
+} Segment;
+
+static const char *const segmentNames[SEGMENT_COUNT] = { "GL work", "Readback" };
+
+typedef struct {
+    long long cpuBeginNs;
+    long long cpuEndNs;
+} Interval;
+
+typedef struct {
+    // 0 is the whole frame, then one per readback.
+    Interval intervals[1 + MAX_READBACKS];
+    int readbacks;
+    bool pending;
+} FrameSlot;
+
+// Query objects belong to a context, so each context has its own timer,
+// used by whichever thread has the context current. The queries are
+// deleted when the context is destroyed or parked in the context pool.
+typedef struct {
+    OSMesaContext ctx;
+    bool supported;
+    bool queryBuffers;
+    // CPU clock minus GPU clock, for the timeline.
+    long long gpuOffsetNs;
+    GLuint names[GPU_TIMING_FRAMES][QUERIES_PER_FRAME];
+    FrameSlot slots[GPU_TIMING_FRAMES];
+    unsigned int frame;
+    bool open;
+    bool readbackOpen;
+} GpuTimer;
+
+typedef struct {
+    unsigned long long samples;
+    unsigned long long cpuNs;
+    unsigned long long gpuNs;
+    unsigned long long maxGpuNs;
+    unsigned long long late;
+} SegmentTotals;
+
+static struct {
+    PFNGLGETQUERYIVPROC GetQueryiv;
+    PFNGLGENQUERIESPROC GenQueries;
+    PFNGLDELETEQUERIESPROC DeleteQueries;
+    PFNGLQUERYCOUNTERPROC QueryCounter;
+    PFNGLGETQUERYOBJECTIVPROC GetQueryObjectiv;
+    PFNGLGETQUERYOBJECTUI64VPROC GetQueryObjectui64v;
+    PFNGLGETINTEGER64VPROC GetInteger64v;
+    void (*GetIntegerv)(GLenum, GLint*);
+} gl;
+
+bool gpuTimingEnabled = false;
+static pthread_once_t resolveOnce = PTHREAD_ONCE_INIT;
+static SegmentTotals totals[SEGMENT_COUNT];
+static bool warnedUnsupported = false;
+
+static pthread_mutex_t timerLock = PTHREAD_MUTEX_INITIALIZER;
+static GpuTimer **timers = NULL;
+static int timerCount = 0;
+static int timerCapacity = 0;
+// Bumped on every destroy, so a thread never follows its cached pointer
+// to a timer that may have been freed since.
+static unsigned int destroyEpoch = 0;
+
+// The timer of the context current on this thread.
+static __thread GpuTimer *timer = NULL;
+static __thread OSMesaContext timerCtx = NULL;
+static __thread unsigned int timerEpoch = 0;
+
+static void resolve_procs(void) {
+    gl.GetQueryiv = (PFNGLGETQUERYIVPROC)bridge_get_proc("glGetQueryiv");
+    gl.GenQueries = (PFNGLGENQUERIESPROC)bridge_get_proc("glGenQueries");
+    gl.DeleteQueries = (PFNGLDELETEQUERIESPROC)bridge_get_proc("glDeleteQueries");
+    gl.QueryCounter = (PFNGLQUERYCOUNTERPROC)bridge_get_proc("glQueryCounter");
+    gl.GetQueryObjectiv = (PFNGLGETQUERYOBJECTIVPROC)bridge_get_proc("glGetQueryObjectiv");
+    gl.GetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)bridge_get_proc("glGetQueryObjectui64v");
+    gl.GetInteger64v = (PFNGLGETINTEGER64VPROC)bridge_get_proc("glGetInteger64v");
+    gl.GetIntegerv = (__typeof__(gl.GetIntegerv))bridge_get_proc("glGetIntegerv");
+}
+
+// Asking a context without timer queries about them would leave a GL
+// error for the game to find, so the version is checked first.
+static bool check_support(GpuTimer *timer) {
+    if (!gl.GetQueryiv || !gl.GenQueries || !gl.DeleteQueries || !gl.QueryCounter || !gl.GetQueryObjectiv ||
+        !gl.GetQueryObjectui64v || !gl.GetInteger64v || !gl.GetIntegerv) return false;
+
+    int version = bridge_gl_version();
+    if (version < 33 && !bridge_has_extension(version, "GL_ARB_timer_query")) return false;
+    timer->queryBuffers = version >= 44 || bridge_has_extension(version, "GL_ARB_query_buffer_object");
+
+    GLint bits = 0;
+    gl.GetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    return bits > 0;
+}
+
+static GpuTimer* find_timer(OSMesaContext ctx) {
+    for (int i = 0; i < timerCount; i++)
+    {
+        if (timers[i]->ctx == ctx) return timers[i];
+    }
+    return NULL;
+}
+
+// Set up the timer of a context the first time it is current.
+static GpuTimer* create_timer(OSMesaContext ctx) {
+    GpuTimer *created = calloc(1, sizeof(GpuTimer));
+    if (!created) return NULL;
+    created->ctx = ctx;
+    pthread_once(&resolveOnce, resolve_procs);
+    if (check_support(created))
+    {
+        gl.GenQueries(GPU_TIMING_FRAMES * QUERIES_PER_FRAME, &created->names[0][0]);
+        GLint64 gpuNow = 0;
+        gl.GetInteger64v(GL_TIMESTAMP, &gpuNow);
+        created->gpuOffsetNs = bridge_now_ns() - (long long)gpuNow;
+        created->supported = true;
+    }
+    else
+    {
+        if (!warnedUnsupported) OSM_LOGW("OSM_GPU_TIMING needs timer queries, which this context does not have");
+        warnedUnsupported = true;
+    }
+
+    pthread_mutex_lock(&timerLock);
+    if (timerCount == timerCapacity)
+    {
+        int capacity = timerCapacity ? timerCapacity * 2 : 8;
+        GpuTimer **grown = realloc(timers, capacity * sizeof(GpuTimer*));
+        if (!grown)
+        {
+            pthread_mutex_unlock(&timerLock);
+            if (created->supported) gl.DeleteQueries(GPU_TIMING_FRAMES * QUERIES_PER_FRAME, &created->names[0][0]);
+            free(created);
+            return NULL;
+        }
+        timers = grown;
+        timerCapacity = capacity;
+    }
+    timers[timerCount++] = created;
+    pthread_mutex_unlock(&timerLock);
+    return created;
+}
+
+static bool ensure_timer(void) {
+    if (!currentContext) return false;
+    unsigned int epoch = __atomic_load_n(&destroyEpoch, __ATOMIC_ACQUIRE);
+    if (timer && timerCtx == currentContext && timerEpoch == epoch) return timer->supported;
+
+    // A context is current on one thread at a time, so only this thread
+    // can be creating its timer.
+    pthread_mutex_lock(&timerLock);
+    GpuTimer *found = find_timer(currentContext);
+    pthread_mutex_unlock(&timerLock);
+    if (!found) found = create_timer(currentContext);
+
+    timer = found;
+    timerCtx = currentContext;
+    timerEpoch = epoch;
+    return timer && timer->supported;
+}
+
+static void add_sample(Segment segment, long long cpuNs, unsigned long long gpuNs) {
+    SegmentTotals *total = &totals[segment];
+    __atomic_fetch_add(&total->samples, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&total->cpuNs, (unsigned long long)(cpuNs > 0 ? cpuNs : 0), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&total->gpuNs, gpuNs, __ATOMIC_RELAXED);
+    unsigned long long maxNs = __atomic_load_n(&total->maxGpuNs, __ATOMIC_RELAXED);
+    while (gpuNs > maxNs && !__atomic_compare_exchange_n(&total->maxGpuNs, &maxNs, gpuNs, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// Read one frame's results if the GPU has produced them. Timestamps
+// complete in order, so the frame end being available covers the rest.
+static bool collect(unsigned int index) {
+    const GLuint *names = timer->names[index];
+    FrameSlot *slot = &timer->slots[index];
+    GLint available = 0;
+    gl.GetQueryObjectiv(names[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return false;
+
+    for (int i = 0; i <= slot->readbacks; i++)
+    {
+        GLuint64 begin = 0, end = 0;
+        gl.GetQueryObjectui64v(names[i * 2], GL_QUERY_RESULT, &begin);
+        gl.GetQueryObjectui64v(names[i * 2 + 1], GL_QUERY_RESULT, &end);
+        Segment segment = i ? SEGMENT_READBACK : SEGMENT_FRAME;
+        const Interval *interval = &slot->intervals[i];
+        unsigned long long gpuNs = end > begin ? end - begin : 0;
+        add_sample(segment, interval->cpuEndNs - interval->cpuBeginNs, gpuNs);
+        if (timelineEnabled) timeline_gpu_span(segmentNames[segment], (long long)begin + timer->gpuOffsetNs, (long long)end + timer->gpuOffsetNs);
+    }
+    slot->pending = false;
+    return true;
+}
+
+static void collect_pending(void) {
+    // With a query buffer bound, reading a result would write into the
+    // game's buffer instead; try again next frame.
+    if (timer->queryBuffers)
+    {
+        GLint queryBuffer = 0;
+        gl.GetIntegerv(GL_QUERY_BUFFER_BINDING, &queryBuffer);
+        if (queryBuffer) return;
+    }
+
+    // Oldest first; stop at the first frame that is not done yet.
+    for (unsigned int age = GPU_TIMING_FRAMES; age > 0; age--)
+    {
+        if (timer->frame < age) continue;
+        unsigned int index = (timer->frame - age) % GPU_TIMING_FRAMES;
+        if (timer->slots[index].pending && !collect(index)) break;
+    }
+}
+
+void gpu_timing_configure(bool enabled) {
+    gpuTimingEnabled = enabled;
+}
+
+void gpu_timing_frame_end(void) {
+    if (!ensure_timer() || !timer->open) return;
+    if (timer->readbackOpen) gpu_timing_readback_end();
+
+    unsigned int index = timer->frame % GPU_TIMING_FRAMES;
+    gl.QueryCounter(timer->names[index][1], GL_TIMESTAMP);
+    timer->slots[index].intervals[0].cpuEndNs = bridge_now_ns();
+    timer->slots[index].pending = true;
+    timer->open = false;
+    timer->frame++;
+}
+
+void gpu_timing_frame_begin(void) {
+    if (!ensure_timer()) return;
+    collect_pending();
+
+    unsigned int index = timer->frame % GPU_TIMING_FRAMES;
+    FrameSlot *slot = &timer->slots[index];
+    if (slot->pending)
+    {
+        // Still not done GPU_TIMING_FRAMES frames later; reusing its
+        // queries drops it rather than waiting.
+        __atomic_fetch_add(&totals[SEGMENT_FRAME].late, 1, __ATOMIC_RELAXED);
+        if (slot->readbacks) __atomic_fetch_add(&totals[SEGMENT_READBACK].late, (unsigned long long)slot->readbacks, __ATOMIC_RELAXED);
+    }
+    memset(slot, 0, sizeof(*slot));
+    slot->intervals[0].cpuBeginNs = bridge_now_ns();
+    gl.QueryCounter(timer->names[index][0], GL_TIMESTAMP);
+    timer->open = true;
+}
+
+void gpu_timing_readback_begin(void) {
+    if (!ensure_timer() || !timer->open || timer->readbackOpen) return;
+    unsigned int index = timer->frame % GPU_TIMING_FRAMES;
+    FrameSlot *slot = &timer->slots[index];
+    if (slot->readbacks == MAX_READBACKS) return;
+
+    slot->intervals[1 + slot->readbacks].cpuBeginNs = bridge_now_ns();
+    gl.QueryCounter(timer->names[index][2 + slot->readbacks * 2], GL_TIMESTAMP);
+    timer->readbackOpen = true;
+}
+
+void gpu_timing_readback_end(void) {
+    if (!ensure_timer() || !timer->readbackOpen) return;
+    unsigned int index = timer->frame % GPU_TIMING_FRAMES;
+    FrameSlot *slot = &timer->slots[index];
+
+    gl.QueryCounter(timer->names[index][3 + slot->readbacks * 2], GL_TIMESTAMP);
+    slot->intervals[1 + slot->readbacks].cpuEndNs = bridge_now_ns();
+    slot->readbacks++;
+    timer->readbackOpen = false;
+}
+
+void gpu_timing_on_destroy(OSMesaContext ctx, bool bound) {
+    if (!ctx) return;
+
+    pthread_mutex_lock(&timerLock);
+    GpuTimer *found = find_timer(ctx);
+    for (int i = 0; found && i < timerCount; i++)
+    {
+        if (timers[i] == found) timers[i] = timers[--timerCount];
+    }
+    __atomic_fetch_add(&destroyEpoch, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&timerLock);
+
+    if (!found) return;
+    if (bound && found->supported) gl.DeleteQueries(GPU_TIMING_FRAMES * QUERIES_PER_FRAME, &found->names[0][0]);
+    if (timer == found) timer = NULL;
+    free(found);
+}
+
+GLuint OSMesaBridgeGetGpuStats(OSMesaBridgeGpuStats *stats, GLuint count) {
+    for (GLuint i = 0; stats && i < count && i < SEGMENT_COUNT; i++)
+    {
+        stats[i].name = segmentNames[i];
+        stats[i].samples = __atomic_load_n(&totals[i].samples, __ATOMIC_RELAXED);
+        stats[i].cpuNs = __atomic_load_n(&totals[i].cpuNs, __ATOMIC_RELAXED);
+        stats[i].gpuNs = __atomic_load_n(&totals[i].gpuNs, __ATOMIC_RELAXED);
+        stats[i].maxGpuNs = __atomic_load_n(&totals[i].maxGpuNs, __ATOMIC_RELAXED);
+        stats[i].late = __atomic_load_n(&totals[i].late, __ATOMIC_RELAXED);
+    }
+    return SEGMENT_COUNT;
+}
+
+void gpu_timing_stop(void) {
+    if (!gpuTimingEnabled || !logOutPut) return;
+    for (int i = 0; i < SEGMENT_COUNT; i++)
+    {
+        unsigned long long samples = __atomic_load_n(&totals[i].samples, __ATOMIC_RELAXED);
+        if (!samples) continue;
+        OSM_LOGI("GPU timing %s: %llu samples, CPU %.3f ms, GPU %.3f ms mean, GPU %.3f ms max, %llu late",
+                segmentNames[i], samples, totals[i].cpuNs / 1e6 / samples, totals[i].gpuNs / 1e6 / samples,
+                totals[i].maxGpuNs / 1e6, totals[i].late);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef GPU_TIMING_H
+#define GPU_TIMING_H
+
+#include <stdbool.h>
+#include <GL/osmesa.h>
+
+// OSM_GPU_TIMING=true brackets the GL work of every frame, and each
+// glReadPixels() in it, with GL_TIMESTAMP queries. Queries rotate through
+// GPU_TIMING_FRAMES frames and are only read once their result is
+// available, so the GPU is never waited on. GPU and CPU time per segment
+// go to OSMesaBridgeGetGpuStats(), the exit log and the timeline.
+
+#define GPU_TIMING_FRAMES 4
+
+// Checked before any query is issued; only gpu_timing_configure() sets it.
+__attribute__((visibility("hidden"))) extern bool gpuTimingEnabled;
+
+void gpu_timing_configure(bool enabled);
+// Around the frame boundary: end is called once the offload queue has
+// drained and before Mesa finishes the frame, begin right after.
+void gpu_timing_frame_end(void);
+void gpu_timing_frame_begin(void);
+// Around the Mesa call of glReadPixels().
+void gpu_timing_readback_begin(void);
+void gpu_timing_readback_end(void);
+// Drop the timer of ctx. With ctx bound on this thread its queries are
+// deleted, which a context that lives on in the pool needs; otherwise they
+// die with the context.
+void gpu_timing_on_destroy(OSMesaContext ctx, bool bound);
+// Log the totals.
+void gpu_timing_stop(void);
+
+#endif // GPU_TIMING_H
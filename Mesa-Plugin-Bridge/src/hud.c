@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "internal.h"
+#include "hud.h"
+#include "log.h"
+
+#define HUD_COLUMNS 30
+#define HUD_LINES 4
+// Frames the statistics are taken over, and how often the text changes.
+#define HUD_HISTORY 128
+#define HUD_REFRESH_NS 500000000LL
+
+// In font pixels: a 5x7 glyph in a 6x9 cell, with a margin around the text.
+#define GLYPH_WIDTH 5
+#define GLYPH_HEIGHT 7
+#define CELL_WIDTH 6
+#define CELL_HEIGHT 9
+#define MARGIN 2
+// Buffers this wide get doubled font pixels.
+#define HUD_SCALE_WIDTH 960
+#define BOX_WIDTH(scale) ((HUD_COLUMNS * CELL_WIDTH + 2 * MARGIN) * (scale))
+#define BOX_HEIGHT(scale) ((HUD_LINES * CELL_HEIGHT + 2 * MARGIN) * (scale))
+
+// Four 32 bit pixels. Compiles to NEON or SSE2 without intrinsics.
+typedef uint8_t PixelVec __attribute__((vector_size(16)));
+
+// Columns of ASCII 0x20 to 0x5f, bit 0 at the top. Lower case is drawn
+// as upper case.
+static const uint8_t font[64][GLYPH_WIDTH] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5f,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7f,0x14,0x7f,0x14},
+    {0x24,0x2a,0x7f,0x2a,0x12}, {0x23,0x13,0x08,0x64,0x62}, {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00},
+    {0x00,0x1c,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1c,0x00}, {0x08,0x2a,0x1c,0x2a,0x08}, {0x08,0x08,0x3e,0x08,0x08},
+    {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02},
+    {0x3e,0x51,0x49,0x45,0x3e}, {0x00,0x42,0x7f,0x40,0x00}, {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4b,0x31},
+    {0x18,0x14,0x12,0x7f,0x10}, {0x27,0x45,0x45,0x45,0x39}, {0x3c,0x4a,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03},
+    {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1e}, {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00},
+    {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14}, {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06},
+    {0x32,0x49,0x79,0x41,0x3e}, {0x7e,0x11,0x11,0x11,0x7e}, {0x7f,0x49,0x49,0x49,0x36}, {0x3e,0x41,0x41,0x41,0x22},
+    {0x7f,0x41,0x41,0x22,0x1c}, {0x7f,0x49,0x49,0x49,0x41}, {0x7f,0x09,0x09,0x01,0x01}, {0x3e,0x41,0x41,0x51,0x32},
+    {0x7f,0x08,0x08,0x08,0x7f}, {0x00,0x41,0x7f,0x41,0x00}, {0x20,0x40,0x41,0x3f,0x01}, {0x7f,0x08,0x14,0x22,0x41},
+    {0x7f,0x40,0x40,0x40,0x40}, {0x7f,0x02,0x04,0x02,0x7f}, {0x7f,0x04,0x08,0x10,0x7f}, {0x3e,0x41,0x41,0x41,0x3e},
+    {0x7f,0x09,0x09,0x09,0x06}, {0x3e,0x41,0x51,0x21,0x5e}, {0x7f,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31},
+    {0x01,0x01,0x7f,0x01,0x01}, {0x3f,0x40,0x40,0x40,0x3f}, {0x1f,0x20,0x40,0x20,0x1f}, {0x7f,0x20,0x18,0x20,0x7f},
+    {0x63,0x14,0x08,0x14,0x63}, {0x03,0x04,0x78,0x04,0x03}, {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7f,0x41,0x41,0x00},
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7f,0x00}, {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40},
+};
+
+// Everything below is only touched by the thread holding hudLock. A
+// second thread presenting at the same time skips its frame.
+static pthread_mutex_t hudLock = PTHREAD_MUTEX_INITIALIZER;
+static long long lastPresentNs = 0;
+static long long frameNs[HUD_HISTORY];
+static long long readbackNs[HUD_HISTORY];
+static unsigned int frames = 0;
+static long long pendingReadbackNs = 0;
+static long long lastRefreshNs = 0;
+static long long windowCostNs = 0;
+static unsigned int windowDraws = 0;
+// Formatted at any length; only HUD_COLUMNS characters are drawn.
+static char text[HUD_LINES][64];
+
+// The text rasterized at inkScale: all ones where a glyph pixel is.
+static uint32_t ink[BOX_HEIGHT(2)][BOX_WIDTH(2)];
+static int inkScale = 0;
+
+static bool resolved = false;
+static void (*real_OSMesaGetIntegerv)(GLint, GLint*);
+static bool warnedFormat = false;
+static unsigned long long draws = 0;
+static long long totalCostNs = 0;
+static long long maxCostNs = 0;
+
+static __thread bool presentsOnFlush = false;
+
+void hud_add_readback(long long ns) {
+    __atomic_add_fetch(&pendingReadbackNs, ns, __ATOMIC_RELAXED);
+}
+
+static int compare_ns(const void *a, const void *b) {
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+static void update_text(long long drawCostNs) {
+    unsigned int count = frames < HUD_HISTORY ? frames : HUD_HISTORY;
+    long long sorted[HUD_HISTORY];
+    long long totalNs = 0, totalReadbackNs = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        sorted[i] = frameNs[i];
+        totalNs += frameNs[i];
+        totalReadbackNs += readbackNs[i];
+    }
+    qsort(sorted, count, sizeof(long long), compare_ns);
+
+    const char *driver = getenv("GALLIUM_DRIVER");
+    const char *glVersion = getenv("MESA_GL_VERSION_OVERRIDE");
+    snprintf(text[0], sizeof(text[0]), "FPS %.1f  FRAME %.2f MS", totalNs ? count * 1e9 / totalNs : 0.0, count ? totalNs / 1e6 / count : 0.0);
+    snprintf(text[1], sizeof(text[1]), "P50 %.1f P95 %.1f P99 %.1f", count ? sorted[count / 2] / 1e6 : 0.0,
+             count ? sorted[count * 95 / 100] / 1e6 : 0.0, count ? sorted[count * 99 / 100] / 1e6 : 0.0);
+    snprintf(text[2], sizeof(text[2]), "%s  GL %s", driver ? driver : "DEFAULT DRIVER", glVersion ? glVersion : "DEFAULT");
+    snprintf(text[3], sizeof(text[3]), "READBACK %.2f MS  HUD %d US", count ? totalReadbackNs / 1e6 / count : 0.0, (int)(drawCostNs / 1000));
+    inkScale = 0;
+}
+
+static void rasterize(int scale) {
+    memset(ink, 0, sizeof(ink));
+    for (int line = 0; line < HUD_LINES; line++)
+    {
+        for (int column = 0; column < HUD_COLUMNS && text[line][column]; column++)
+        {
+            unsigned char c = (unsigned char)text[line][column];
+            if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+            if (c < 0x20 || c > 0x5f) c = '?';
+            const uint8_t *glyph = font[c - 0x20];
+
+            for (int x = 0; x < GLYPH_WIDTH; x++)
+            {
+                for (int y = 0; y < GLYPH_HEIGHT; y++)
+                {
+                    if (!(glyph[x] & (1 << y))) continue;
+                    int left = (MARGIN + column * CELL_WIDTH + x) * scale;
+                    int top = (MARGIN + line * CELL_HEIGHT + y) * scale;
+                    for (int dy = 0; dy < scale; dy++)
+                    {
+                        for (int dx = 0; dx < scale; dx++) ink[top + dy][left + dx] = 0xffffffffu;
+                    }
+                }
+            }
+        }
+    }
+    inkScale = scale;
+}
+
+// Halve the colour channels and set them to white where ink is; alpha
+// is kept. Four pixels per step, then one at a time.
+static void blend_row(unsigned char *row, const uint32_t *inkRow, int pixels, uint32_t colorMask) {
+    PixelVec colors;
+    for (int i = 0; i < 4; i++) memcpy((unsigned char*)&colors + i * 4, &colorMask, 4);
+
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4)
+    {
+        PixelVec pixel, glyph;
+        memcpy(&pixel, row + i * 4, sizeof(pixel));
+        memcpy(&glyph, inkRow + i, sizeof(glyph));
+        PixelVec shaded = (pixel >> 1) | glyph;
+        pixel = (shaded & colors) | (pixel & ~colors);
+        memcpy(row + i * 4, &pixel, sizeof(pixel));
+    }
+    for (; i < pixels; i++)
+    {
+        uint32_t pixel;
+        memcpy(&pixel, row + i * 4, 4);
+        uint32_t shaded = ((pixel >> 1) & 0x7f7f7f7fu) | inkRow[i];
+        pixel = (shaded & colorMask) | (pixel & ~colorMask);
+        memcpy(row + i * 4, &pixel, 4);
+    }
+}
+
+static void draw(unsigned char *buffer, GLsizei width, GLsizei height) {
+    GLint format = OSMESA_RGBA, rowLength = 0, yUp = 1;
+    if (real_OSMesaGetIntegerv)
+    {
+        real_OSMesaGetIntegerv(OSMESA_FORMAT, &format);
+        real_OSMesaGetIntegerv(OSMESA_ROW_LENGTH, &rowLength);
+        real_OSMesaGetIntegerv(OSMESA_Y_UP, &yUp);
+    }
+
+    // Bytes in memory order, whatever the host byte order.
+    uint32_t colorMask;
+    unsigned char bytes[4] = { 0xff, 0xff, 0xff, 0xff };
+    if (format == OSMESA_RGBA || format == OSMESA_BGRA) bytes[3] = 0;
+    else if (format == OSMESA_ARGB) bytes[0] = 0;
+    else
+    {
+        if (!warnedFormat) OSM_LOGW("HUD only draws into 32 bit buffers, not format 0x%x", format);
+        warnedFormat = true;
+        return;
+    }
+    memcpy(&colorMask, bytes, 4);
+
+    int scale = width >= HUD_SCALE_WIDTH ? 2 : 1;
+    if (inkScale != scale) rasterize(scale);
+
+    int boxWidth = BOX_WIDTH(scale) < width ? BOX_WIDTH(scale) : width;
+    int boxHeight = BOX_HEIGHT(scale) < height ? BOX_HEIGHT(scale) : height;
+    size_t stride = (size_t)(rowLength > 0 ? rowLength : width) * 4;
+    for (int y = 0; y < boxHeight; y++)
+    {
+        // y counts from the top of the image.
+        int row = yUp ? height - 1 - y : y;
+        blend_row(buffer + row * stride, ink[y], boxWidth, colorMask);
+    }
+}
+
+bool hud_present(bool fromFlush, void *buffer, GLenum type, GLsizei width, GLsizei height) {
+    if (fromFlush) presentsOnFlush = true;
+    else if (presentsOnFlush) return false;
+    if (!buffer || type != GL_UNSIGNED_BYTE || width <= 0 || height <= 0) return false;
+    if (pthread_mutex_trylock(&hudLock) != 0) return false;
+
+    if (!resolved)
+    {
+        real_OSMesaGetIntegerv = (void (*)(GLint, GLint*))bridge_get_proc("OSMesaGetIntegerv");
+        resolved = true;
+    }
+
+    long long now = bridge_now_ns();
+    long long readback = __atomic_exchange_n(&pendingReadbackNs, 0, __ATOMIC_RELAXED);
+    if (lastPresentNs)
+    {
+        frameNs[frames % HUD_HISTORY] = now - lastPresentNs;
+        readbackNs[frames % HUD_HISTORY] = readback;
+        frames++;
+    }
+    lastPresentNs = now;
+
+    if (now - lastRefreshNs >= HUD_REFRESH_NS)
+    {
+        update_text(windowDraws ? windowCostNs / windowDraws : 0);
+        lastRefreshNs = now;
+        windowCostNs = 0;
+        windowDraws = 0;
+    }
+
+    draw(buffer, width, height);
+
+    long long cost = bridge_now_ns() - now;
+    windowCostNs += cost;
+    windowDraws++;
+    draws++;
+    totalCostNs += cost;
+    if (cost > maxCostNs) maxCostNs = cost;
+    pthread_mutex_unlock(&hudLock);
+    return true;
+}
+
+void hud_stop(void) {
+    pthread_mutex_lock(&hudLock);
+    if (draws)
+    {
+        OSM_LOGI("HUD drawn on %llu frames, %.1f us mean, %.1f us max",
+                draws, totalCostNs / 1e3 / draws, maxCostNs / 1e3);
+    }
+    pthread_mutex_unlock(&hudLock);
+}
@@ -0,0 +1,24 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <stdbool.h>
+#include <GL/osmesa.h>
+#include <GL/gl.h>
+
+// OSM_HUD=true draws frame statistics into the top left corner of the
+// color buffer the client bound with OSMesaMakeCurrent(), at every frame
+// boundary once Mesa has finished writing it. Only client memory is
+// written, never GL state. The box has a fixed size, so it costs about
+// the same every frame, and shows its own cost.
+
+// Time spent in glReadPixels() during the current frame.
+void hud_add_readback(long long ns);
+// End of a frame on this thread. fromFlush is true for
+// OSMesaFlushFrontbuffer(); a thread that presents that way no longer
+// draws on glFinish(), so a frame is not drawn twice. Returns whether
+// the HUD was drawn.
+bool hud_present(bool fromFlush, void *buffer, GLenum type, GLsizei width, GLsizei height);
+// Log what drawing the HUD cost.
+void hud_stop(void);
+
+#endif // HUD_H
@@ -0,0 +1,46 @@
+#ifndef INTERNAL_H
+#define INTERNAL_H
+
+#include <stdbool.h>
+#include <GL/osmesa.h>
+#include <GL/gl.h>
+
+// State owned by bridge.c and shared with the other bridge modules.
+// Nothing in here is exported from libOSMBridge.so.
+
+// Copy of the current config snapshot's logOutPut, kept as a plain flag
+// because every log call tests it. Updated whenever a snapshot is
+// published.
+extern bool logOutPut;
+extern __thread OSMesaContext currentContext;
+
+extern OSMESAproc (*real_OSMesaGetProcAddress)(const char *);
+extern GLboolean (*real_OSMesaMakeCurrent)(OSMesaContext, void*, GLenum, GLsizei, GLsizei);
+extern OSMesaContext (*real_OSMesaCreateContext)(GLenum, OSMesaContext);
+extern void (*real_OSMesaDestroyContext)(OSMesaContext);
+
+// Monotonic clock in nanoseconds.
+long long bridge_now_ns(void);
+void record_env_value(const char *file_path, const char *key, const char *value);
+// The same for the env.txt the bridge loaded, written on the task pool so
+// the caller never waits for the rewrite.
+void record_env_value_async(const char *key, const char *value);
+
+// Resolve a Mesa entry point, bypassing any bridge interception.
+void* bridge_get_proc(const char *funcName);
+
+// Bind ctx on this thread to a 1x1 buffer owned by the bridge, for
+// housekeeping that needs a context but must not touch client memory.
+GLboolean bridge_bind_scratch(OSMesaContext ctx, GLenum type);
+// Rebind whatever the client last made current on this thread.
+void bridge_restore_current(void);
+// Destroy ctx, on the reaper thread when OSM_ASYNC_DESTROY is enabled.
+void bridge_destroy_context(OSMesaContext ctx);
+
+// GL version of the current context as major * 10 + minor, 0 if unknown.
+int bridge_gl_version(void);
+// Whether the current context, of the given version, has an extension.
+// Lets the bridge test for features without leaving GL errors behind.
+bool bridge_has_extension(int version, const char *name);
+
+#endif // INTERNAL_H
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "internal.h"
+#include "cpu_topology.h"
+#include "probe.h"
+#include "llvmpipe_tune.h"
+#include "log.h"
+
+#define CALIBRATION_WIDTH 640
+#define CALIBRATION_HEIGHT 360
+#define CALIBRATION_FRAMES 30
+#define CALIBRATION_TIMEOUT_MS 15000
+
+static const char *envFilePath = NULL;
+static bool pending = false;
+static bool alreadyCalibrated = false;
+static bool tryAllCounts = false;
+
+// llvmpipe splits tiles evenly across its threads, so little cores turn
+// into stragglers. Default to one rasterizer per big core, or leave a core
+// for the render thread on homogeneous SoCs.
+static int default_thread_count(const CpuTopology *topology) {
+    int count = topology->bigCount < topology->onlineCount ? topology->bigCount : topology->onlineCount - 1;
+    return count > 0 ? count : 1;
+}
+
+void llvmpipe_tune_prepare(const char *file_path, bool calibrated, bool allCandidates) {
+    envFilePath = file_path;
+    alreadyCalibrated = calibrated;
+    tryAllCounts = allCandidates;
+
+    const char *driver = getenv("GALLIUM_DRIVER");
+    if (!driver || strcmp(driver, "llvmpipe")) return;
+
+    const CpuTopology *topology = cpu_topology_get();
+    if (!topology) return;
+
+    if (!getenv("LP_NUM_THREADS"))
+    {
+        char value[16];
+        snprintf(value, sizeof(value), "%d", default_thread_count(topology));
+        setenv("LP_NUM_THREADS", value, 1);
+        // Rewriting env.txt here would hold up the game's dlopen().
+        record_env_value_async("LP_NUM_THREADS", value);
+        OSM_LOGN("Set Env LP_NUM_THREADS=%s", value);
+    }
+    __atomic_store_n(&pending, !calibrated, __ATOMIC_RELEASE);
+}
+
+bool llvmpipe_tune_pending(void) {
+    return __atomic_load_n(&pending, __ATOMIC_ACQUIRE);
+}
+
+void llvmpipe_tune_request(void) {
+    if (envFilePath && !alreadyCalibrated) __atomic_store_n(&pending, true, __ATOMIC_RELEASE);
+}
+
+static int add_candidate(int *candidates, int count, int capacity, int value) {
+    if (value < 1 || count == capacity) return count;
+    for (int i = 0; i < count; i++)
+    {
+        if (candidates[i] == value) return count;
+    }
+    candidates[count] = value;
+    return count + 1;
+}
+
+void llvmpipe_tune_calibrate(void) {
+    if (!__atomic_exchange_n(&pending, false, __ATOMIC_ACQ_REL)) return;
+
+    const CpuTopology *topology = cpu_topology_get();
+    if (!topology) return;
+
+    // Every count from 1 to the online cores, or the default's neighbours,
+    // which stay within onlineCount + 1.
+    int capacity = topology->onlineCount + 1;
+    int *candidates = malloc(sizeof(int) * (size_t)capacity);
+    if (!candidates) return;
+    int count = 0;
+    if (tryAllCounts)
+    {
+        for (int threads = 1; threads <= topology->onlineCount; threads++) count = add_candidate(candidates, count, capacity, threads);
+    }
+    else
+    {
+        int base = default_thread_count(topology);
+        count = add_candidate(candidates, count, capacity, base - 1);
+        count = add_candidate(candidates, count, capacity, base);
+        count = add_candidate(candidates, count, capacity, base + 1);
+        count = add_candidate(candidates, count, capacity, topology->onlineCount);
+    }
+
+    int best = 0;
+    double bestMs = 0;
+    for (int i = 0; i < count; i++)
+    {
+        char threads[32];
+        snprintf(threads, sizeof(threads), "LP_NUM_THREADS=%d", candidates[i]);
+        const char *settings[] = { "GALLIUM_DRIVER=llvmpipe", threads };
+        ProbeResult result;
+        if (!probe_run(settings, 2, CALIBRATION_WIDTH, CALIBRATION_HEIGHT, CALIBRATION_FRAMES, CALIBRATION_TIMEOUT_MS, &result))
+        {
+            OSM_LOGW("llvmpipe calibration with %d threads failed", candidates[i]);
+            continue;
+        }
+
+        OSM_LOGI("llvmpipe %d threads: p50 %.2f ms, p95 %.2f ms", candidates[i], result.p50Ms, result.p95Ms);
+        if (!best || result.p50Ms < bestMs)
+        {
+            best = candidates[i];
+            bestMs = result.p50Ms;
+        }
+    }
+    free(candidates);
+    if (!best) return;
+
+    // Mesa has read LP_NUM_THREADS by now, and setenv() would race the
+    // game's getenv() calls anyway.
+    char value[16];
+    snprintf(value, sizeof(value), "%d", best);
+    record_env_value(envFilePath, "LP_NUM_THREADS", value);
+    record_env_value(envFilePath, "OSM_LP_CALIBRATED", "true");
+    OSM_LOGN("Calibrated LP_NUM_THREADS=%s, from the next launch", value);
+}
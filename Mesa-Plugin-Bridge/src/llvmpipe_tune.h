@@ -0,0 +1,21 @@
+#ifndef LLVMPIPE_TUNE_H
+#define LLVMPIPE_TUNE_H
+
+#include <stdbool.h>
+
+// LP_NUM_THREADS tuning for GALLIUM_DRIVER=llvmpipe. prepare() runs while
+// env.txt is parsed and applies a topology-based default right away;
+// calibrate() runs on the task pool while the game starts and times a
+// short render for a few thread counts, each in an osm-bench process (see
+// probe.h). Both store their result in env.txt, the default from the task
+// pool once it is sized: the calibrated count takes effect on the next
+// launch, which then skips the work. llvmpipe's tile
+// size is fixed at build time, so it is not tuned here.
+
+void llvmpipe_tune_prepare(const char *file_path, bool calibrated, bool allCandidates);
+bool llvmpipe_tune_pending(void);
+// The driver probe settled on llvmpipe for later launches; calibrate it too.
+void llvmpipe_tune_request(void);
+void llvmpipe_tune_calibrate(void);
+
+#endif // LLVMPIPE_TUNE_H
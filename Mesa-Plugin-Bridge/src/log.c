@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "log.h"
+#include "task_pool.h"
+
+#define WINDOW_NS 1000000000LL
+#define LOGCAT_TAG "OSMBridge"
+
+typedef enum {
+    SINK_STDERR,
+    SINK_FILE,
+    SINK_LOGCAT
+} Sink;
+
+// A slot at position pos of the ring is free for it while sequence is
+// 2 * lap and holds its message once sequence is 2 * lap + 1, where lap
+// is pos / LOG_SLOTS. Zeroed memory is an empty ring.
+typedef struct {
+    unsigned long long sequence;
+    long long timeNs;
+    int tid;
+    int level;
+    unsigned int suppressed;
+    char text[LOG_TEXT_MAX];
+} LogSlot;
+
+static LogSlot ring[LOG_SLOTS];
+static unsigned long long head = 0;
+static unsigned long long tail = 0;
+static unsigned long long dropped = 0;
+static unsigned long long droppedReported = 0;
+static unsigned long long limited = 0;
+static int minimumLevel = LOG_LEVEL_INFO;
+static __thread int ownTid = 0;
+
+// Serializes readers of the ring: the drain task, and callers of
+// log_write() once there is none.
+static pthread_mutex_t drainLock = PTHREAD_MUTEX_INITIALIZER;
+static bool synchronous = false;
+static Sink sink = SINK_STDERR;
+static int sinkFd = STDERR_FILENO;
+static int (*androidLogWrite)(int, const char*, const char*) = NULL;
+static bool started = false;
+// Set from the first message after a drain until the next drain starts,
+// so a burst raises the drain event once rather than per message.
+static bool drainPending = false;
+
+static const char *const levelNames[] = { "debug", "info", "warning", "error" };
+
+bool log_parse_level(const char *value, int *level) {
+    for (int i = 0; i <= LOG_LEVEL_ERROR; i++)
+    {
+        if (!strcmp(value, levelNames[i]))
+        {
+            *level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* log_level_name(int level) {
+    return level >= 0 && level <= LOG_LEVEL_ERROR ? levelNames[level] : "info";
+}
+
+static const char* prefix(int level) {
+    if (level == LOG_LEVEL_ERROR) return "Error[OSM Plugin Bridge]: ";
+    if (level == LOG_LEVEL_WARN) return "Warning[OSM Plugin Bridge]: ";
+    return "[OSM Plugin Bridge]: ";
+}
+
+static void write_fd(const char *line, size_t length) {
+    while (length)
+    {
+        ssize_t written = write(sinkFd, line, length);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return;
+        line += written;
+        length -= (size_t)written;
+    }
+}
+
+static void emit(int level, long long timeNs, int tid, const char *text, unsigned int suppressed) {
+    if (level < __atomic_load_n(&minimumLevel, __ATOMIC_RELAXED)) return;
+
+    char tail[64] = "";
+    if (suppressed) snprintf(tail, sizeof(tail), " (%u similar messages suppressed)", suppressed);
+
+    char line[LOG_TEXT_MAX + 128];
+    int length;
+    if (sink == SINK_LOGCAT)
+    {
+        // ANDROID_LOG_DEBUG is 3, up to ANDROID_LOG_ERROR at 6.
+        snprintf(line, sizeof(line), "%s%s", text, tail);
+        androidLogWrite(3 + level, LOGCAT_TAG, line);
+        return;
+    }
+    if (sink == SINK_FILE) length = snprintf(line, sizeof(line), "%11.6f %6d %s%s%s\n", timeNs / 1e9, tid, prefix(level), text, tail);
+    else length = snprintf(line, sizeof(line), "%s%s%s\n", prefix(level), text, tail);
+    if (length < 0) return;
+    if ((size_t)length >= sizeof(line))
+    {
+        length = sizeof(line) - 1;
+        line[length - 1] = '\n';
+    }
+    write_fd(line, (size_t)length);
+}
+
+static void drain(void) {
+    pthread_mutex_lock(&drainLock);
+    for (;;)
+    {
+        LogSlot *slot = &ring[tail % LOG_SLOTS];
+        unsigned long long lap = tail / LOG_SLOTS;
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != lap * 2 + 1) break;
+        emit(slot->level, slot->timeNs, slot->tid, slot->text, slot->suppressed);
+        __atomic_store_n(&slot->sequence, (lap + 1) * 2, __ATOMIC_RELEASE);
+        tail++;
+    }
+
+    unsigned long long lost = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+    if (lost != droppedReported)
+    {
+        char text[96];
+        snprintf(text, sizeof(text), "Log ring full, %llu messages dropped", lost - droppedReported);
+        emit(LOG_LEVEL_WARN, bridge_now_ns(), ownTid, text, 0);
+        droppedReported = lost;
+    }
+    pthread_mutex_unlock(&drainLock);
+}
+
+// Claim the next free slot, or NULL when the drain has fallen a whole
+// ring behind.
+static LogSlot* claim(unsigned long long *lap) {
+    unsigned long long pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        LogSlot *slot = &ring[pos % LOG_SLOTS];
+        *lap = pos / LOG_SLOTS;
+        unsigned long long sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence == *lap * 2)
+        {
+            if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return slot;
+        }
+        else if (sequence < *lap * 2)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Whether the site may log now. The first message of a new window picks
+// up the count of those suppressed in the previous one.
+static bool admit(LogSite *site, long long now, unsigned int *suppressed) {
+    long long window = __atomic_load_n(&site->windowNs, __ATOMIC_RELAXED);
+    if (now - window >= WINDOW_NS &&
+        __atomic_compare_exchange_n(&site->windowNs, &window, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+        *suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+    }
+    if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) <= LOG_BURST) return true;
+    __atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&limited, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+// The drain clears drainPending before reading the ring, so either it
+// sees the slot just published or this sees the flag clear and raises it
+// again. Without a pool the message waits for log_stop().
+static void request_drain(void) {
+    if (__atomic_load_n(&drainPending, __ATOMIC_SEQ_CST)) return;
+    if (__atomic_exchange_n(&drainPending, true, __ATOMIC_SEQ_CST)) return;
+    if (!task_pool_raise(TASK_EVENT_LOG)) __atomic_store_n(&drainPending, false, __ATOMIC_RELAXED);
+}
+
+void log_write(LogSite *site, LogLevel level, const char *format, ...) {
+    if ((int)level < __atomic_load_n(&minimumLevel, __ATOMIC_RELAXED)) return;
+
+    long long now = bridge_now_ns();
+    unsigned int suppressed = 0;
+    if (site && !admit(site, now, &suppressed)) return;
+
+    unsigned long long lap;
+    LogSlot *slot = claim(&lap);
+    if (!slot)
+    {
+        __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (!ownTid) ownTid = (int)syscall(SYS_gettid);
+    slot->timeNs = now;
+    slot->tid = ownTid;
+    slot->level = level;
+    slot->suppressed = suppressed;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(slot->text, sizeof(slot->text), format, args);
+    va_end(args);
+    __atomic_store_n(&slot->sequence, lap * 2 + 1, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(&synchronous, __ATOMIC_ACQUIRE)) drain();
+    else if (__atomic_load_n(&started, __ATOMIC_ACQUIRE)) request_drain();
+}
+
+// Runs on a task pool worker. Idle, nothing is scheduled, so a quiet
+// bridge does not wake a core.
+static void drain_task(void *arg) {
+    (void)arg;
+
+    __atomic_store_n(&drainPending, false, __ATOMIC_SEQ_CST);
+    if (!ownTid) ownTid = (int)syscall(SYS_gettid);
+    drain();
+}
+
+static void open_sink(const char *name) {
+    if (!name || !name[0] || !strcmp(name, "stderr")) return;
+
+    if (!strcmp(name, "logcat"))
+    {
+        void *liblog = dlopen("liblog.so", RTLD_NOW);
+        androidLogWrite = liblog ? (__typeof__(androidLogWrite))dlsym(liblog, "__android_log_write") : NULL;
+        if (androidLogWrite) sink = SINK_LOGCAT;
+        else OSM_LOGW("No logcat on this system, logging to stderr");
+        return;
+    }
+
+    int fd = open(name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        OSM_LOGE("Failed to open log %s: %s, logging to stderr", name, strerror(errno));
+        return;
+    }
+    sinkFd = fd;
+    sink = SINK_FILE;
+}
+
+void log_start(const char *name, int level) {
+    if (started || synchronous) return;
+    __atomic_store_n(&minimumLevel, level, __ATOMIC_RELAXED);
+    open_sink(name);
+
+    if (!task_pool_on_event(TASK_EVENT_LOG, drain_task))
+    {
+        __atomic_store_n(&synchronous, true, __ATOMIC_RELEASE);
+        drain();
+        return;
+    }
+    __atomic_store_n(&started, true, __ATOMIC_RELEASE);
+    // Flush what was logged before this.
+    request_drain();
+}
+
+void log_flush(void) {
+    if (!ownTid) ownTid = (int)syscall(SYS_gettid);
+    drain();
+}
+
+// Called after task_pool_stop(), so no drain task runs any more.
+void log_stop(void) {
+    __atomic_store_n(&started, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&synchronous, true, __ATOMIC_RELEASE);
+    drain();
+    // Sites that went quiet never got to report what they suppressed.
+    unsigned long long total = __atomic_load_n(&limited, __ATOMIC_RELAXED);
+    if (total) log_write(NULL, LOG_LEVEL_INFO, "%llu log messages were rate limited", total);
+    // The sink stays open for threads that log after this.
+}
@@ -0,0 +1,67 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+#include "internal.h"
+
+// Bridge logging. A log call formats its message straight into a slot of
+// a lock-free ring shared by all threads and returns; a task pool worker
+// writes the slots out to the sink chosen by OSM_LOG_SINK: stderr (the
+// default), logcat, or a file path. Messages below OSM_LOG_LEVEL are
+// dropped, as is everything once the ring is full, and each call site
+// logs at most LOG_BURST messages a second; the rest are counted and the
+// count goes out with the site's next message.
+
+typedef enum {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR
+} LogLevel;
+
+// Rate limit state of one call site, a static owned by the macros below.
+typedef struct {
+    long long windowNs;
+    unsigned int count;
+    unsigned int suppressed;
+} LogSite;
+
+#define LOG_SLOTS 1024
+#define LOG_TEXT_MAX 224
+#define LOG_BURST 20
+
+// site may be NULL for messages that must not be rate limited.
+void log_write(LogSite *site, LogLevel level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+// Start writing through the task pool. Messages logged before this wait
+// in the ring.
+void log_start(const char *sink, int level);
+// Write out what is queued, on the calling thread. For reports that log
+// more lines at once than the ring has slots.
+void log_flush(void);
+// Write out what is queued and log synchronously from now on. Call it
+// after task_pool_stop().
+void log_stop(void);
+
+// Accepts debug, info, warning and error. Returns false for anything else.
+bool log_parse_level(const char *value, int *level);
+const char* log_level_name(int level);
+
+// Diagnostics, only with OSM_PLUGIN_LOGE=true.
+#define OSM_LOG(level, ...) \
+    do { \
+        if (logOutPut) \
+        { \
+            static LogSite logSite; \
+            log_write(&logSite, level, __VA_ARGS__); \
+        } \
+    } while (0)
+#define OSM_LOGE(...) OSM_LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define OSM_LOGW(...) OSM_LOG(LOG_LEVEL_WARN, __VA_ARGS__)
+#define OSM_LOGI(...) OSM_LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#define OSM_LOGD(...) OSM_LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+// Lines the bridge always prints: the environment it sets up and the
+// reports asked for with OSM_CALL_STATS, OSM_GL_DEBUG and the like.
+#define OSM_LOGN(...) log_write(NULL, LOG_LEVEL_INFO, __VA_ARGS__)
+
+#endif // LOG_H
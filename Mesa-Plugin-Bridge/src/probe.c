@@ -0,0 +1,248 @@
+#include <errno.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "internal.h"
+#include "runtime_config.h"
+#include "probe.h"
+#include "log.h"
+
+#ifdef __ANDROID__
+// Only lib*.so files are installed to the native library directory.
+#define HELPER_NAME "libosmbench.so"
+#else
+#define HELPER_NAME "osm-bench"
+#endif
+#define MAX_PATH 4096
+#define MAX_SETTINGS 16
+// On top of the helper's own per-run timeout, for its startup and exit.
+#define EXIT_GRACE_MS 2000
+
+extern char **environ;
+
+// Keep the helper's copy of the bridge away from the game's trace,
+// timeline, log and report files, and from starting a probe of its own.
+static const char *const helperSettings[] = {
+    "OSM_TRACE=",
+    "OSM_TIMELINE=",
+    "OSM_STARTUP_REPORT=",
+    "OSM_LOG_SINK=",
+    "OSM_CONFIG_RELOAD=false",
+    "OSM_PRECREATE_CONTEXT=false",
+    "OSM_CALL_STATS=false",
+    "OSM_HUD=false",
+    "OSM_LP_CALIBRATED=true",
+};
+#define HELPER_SETTINGS (int)(sizeof(helperSettings) / sizeof(helperSettings[0]))
+
+static pthread_mutex_t runLock = PTHREAD_MUTEX_INITIALIZER;
+// Process group of the running helper, which includes its workload child.
+static pid_t runningGroup = 0;
+static bool cancelled = false;
+
+static bool bridge_directory(char *out, size_t size) {
+    Dl_info info;
+    if (!dladdr((void*)probe_run, &info) || !info.dli_fname) return false;
+    const char *slash = strrchr(info.dli_fname, '/');
+    if (!slash) return false;
+    snprintf(out, size, "%.*s", (int)(slash - info.dli_fname), info.dli_fname);
+    return true;
+}
+
+// The helper writes a per-run env.txt below this; the bridge can write
+// wherever env.txt is. Ours rather than the helper's own, so what a killed
+// helper leaves behind still gets removed.
+static bool make_work_directory(const char *envPath, char *out, size_t size) {
+    const char *tmp = getenv("TMPDIR");
+    const char *slash = strrchr(envPath, '/');
+    if (tmp && tmp[0]) snprintf(out, size, "%s/osm-probe.XXXXXX", tmp);
+    else snprintf(out, size, "%.*s/osm-probe.XXXXXX", slash ? (int)(slash - envPath) : 1, slash ? envPath : ".");
+    return mkdtemp(out) != NULL;
+}
+
+static int remove_entry(const char *path, const struct stat *info, int type, struct FTW *ftw) {
+    (void)info;
+    (void)type;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+static pid_t spawn_helper(char *const *argv, int outFd) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, outFd, STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    // Its own group, so a timeout takes down the workload child too. The
+    // calling thread's mask and the game's ignored SIGPIPE are not the
+    // helper's business.
+    sigset_t mask, defaults;
+    sigemptyset(&mask);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int error = posix_spawn(&pid, argv[0], &actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error)
+    {
+        OSM_LOGW("Failed to run %s: %s", argv[0], strerror(error));
+        return -1;
+    }
+    return pid;
+}
+
+static size_t read_output(int fd, char *out, size_t size, int timeoutMs) {
+    size_t received = 0;
+    long long deadline = bridge_now_ns() + (long long)timeoutMs * 1000000LL;
+    while (received < size - 1)
+    {
+        long long remaining = (deadline - bridge_now_ns()) / 1000000LL;
+        if (remaining <= 0) return 0;
+
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, (int)remaining);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return 0;
+
+        ssize_t count = read(fd, out + received, size - 1 - received);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0) return 0;
+        if (count == 0) break;
+        received += (size_t)count;
+    }
+    out[received] = '\0';
+    return received;
+}
+
+// name, status, p50, p95, p99, load, create, readback, renderer
+static bool parse_result(char *output, ProbeResult *result) {
+    for (char *save = NULL, *line = strtok_r(output, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+    {
+        if (line[0] == '#') continue;
+
+        char *fields[9];
+        int count = 0;
+        for (char *next = line; next && count < 9; count++)
+        {
+            fields[count] = next;
+            next = strchr(next, '\t');
+            if (next) *next++ = '\0';
+        }
+        if (count < 9 || strcmp(fields[1], "ok")) return false;
+
+        result->p50Ms = strtod(fields[2], NULL);
+        result->p95Ms = strtod(fields[3], NULL);
+        result->createMs = strtod(fields[6], NULL);
+        snprintf(result->renderer, sizeof(result->renderer), "%s", fields[8]);
+        return true;
+    }
+    return false;
+}
+
+bool probe_run(const char *const *settings, int count, int width, int height, int frames, int timeoutMs, ProbeResult *result) {
+    memset(result, 0, sizeof(*result));
+    if (count > MAX_SETTINGS) return false;
+
+    char directory[MAX_PATH];
+    if (!bridge_directory(directory, sizeof(directory))) return false;
+    char helper[MAX_PATH + 32], bridge[MAX_PATH + 32], workDir[MAX_PATH];
+    snprintf(helper, sizeof(helper), "%s/" HELPER_NAME, directory);
+    snprintf(bridge, sizeof(bridge), "%s/libOSMBridge.so", directory);
+    if (access(helper, X_OK) != 0)
+    {
+        OSM_LOGW("Cannot probe without %s", helper);
+        return false;
+    }
+    const char *envPath = runtime_config_startup()->path;
+    if (!make_work_directory(envPath, workDir, sizeof(workDir)))
+    {
+        OSM_LOGW("Failed to create a probe directory next to %s", envPath);
+        return false;
+    }
+
+    char framesArg[16], widthArg[16], heightArg[16], timeoutArg[16];
+    snprintf(framesArg, sizeof(framesArg), "%d", frames);
+    snprintf(widthArg, sizeof(widthArg), "%d", width);
+    snprintf(heightArg, sizeof(heightArg), "%d", height);
+    snprintf(timeoutArg, sizeof(timeoutArg), "%d", timeoutMs);
+
+    char *argv[20 + 2 * (HELPER_SETTINGS + MAX_SETTINGS)];
+    int argc = 0;
+    #define ARG(value) argv[argc++] = (char*)(value)
+    ARG(helper);
+    ARG("-e"); ARG(envPath);
+    ARG("-b"); ARG(bridge);
+    ARG("-w"); ARG(workDir);
+    ARG("-f"); ARG(framesArg);
+    ARG("-W"); ARG(widthArg);
+    ARG("-H"); ARG(heightArg);
+    ARG("-t"); ARG(timeoutArg);
+    ARG("-r"); ARG("1");
+    for (int i = 0; i < HELPER_SETTINGS; i++) { ARG("-s"); ARG(helperSettings[i]); }
+    for (int i = 0; i < count; i++) { ARG("-s"); ARG(settings[i]); }
+    #undef ARG
+    argv[argc] = NULL;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+    {
+        rmdir(workDir);
+        return false;
+    }
+
+    pthread_mutex_lock(&runLock);
+    pid_t pid = cancelled ? -1 : spawn_helper(argv, fds[1]);
+    if (pid > 0) runningGroup = pid;
+    pthread_mutex_unlock(&runLock);
+    close(fds[1]);
+    if (pid < 0)
+    {
+        close(fds[0]);
+        rmdir(workDir);
+        return false;
+    }
+
+    char output[1024];
+    size_t received = read_output(fds[0], output, sizeof(output), timeoutMs + EXIT_GRACE_MS);
+    close(fds[0]);
+
+    pthread_mutex_lock(&runLock);
+    if (!received) kill(-pid, SIGKILL);
+    runningGroup = 0;
+    pthread_mutex_unlock(&runLock);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    nftw(workDir, remove_entry, 4, FTW_DEPTH | FTW_PHYS);
+
+    bool ok = received && WIFEXITED(status) && WEXITSTATUS(status) == 0 && parse_result(output, result);
+    if (!ok) memset(result, 0, sizeof(*result));
+    return ok;
+}
+
+void probe_cancel(void) {
+    pthread_mutex_lock(&runLock);
+    cancelled = true;
+    if (runningGroup > 0) kill(-runningGroup, SIGKILL);
+    pthread_mutex_unlock(&runLock);
+}
@@ -0,0 +1,27 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdbool.h>
+
+// Runs the reference workload through the osm-bench helper installed next
+// to the bridge, with settings (env.txt lines such as "LP_NUM_THREADS=4")
+// applied on top of the bridge's env.txt. Mesa reads most knobs
+// (GALLIUM_DRIVER, LP_NUM_THREADS, ...) once per process, so a fresh
+// process per configuration is the only way to compare them. The helper
+// is spawned and exec'd rather than forked from the game, whose other
+// threads may hold locks a forked child would wait on forever. It blocks
+// for up to timeoutMs, so call it from the task pool, never from a thread
+// that renders.
+
+typedef struct {
+    double p50Ms;
+    double p95Ms;
+    double createMs;
+    char renderer[64];
+} ProbeResult;
+
+bool probe_run(const char *const *settings, int count, int width, int height, int frames, int timeoutMs, ProbeResult *result);
+// Kill the helper if one is running and refuse to start more; at unload.
+void probe_cancel(void);
+
+#endif // PROBE_H
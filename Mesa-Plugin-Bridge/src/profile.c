@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "internal.h"
+#include "profile.h"
+#include "log.h"
+
+#define PROFILE_PREFIX "[profile "
+
+static pthread_once_t identityOnce = PTHREAD_ONCE_INIT;
+static char processName[256];
+static char workingDirectory[512];
+
+static void load_identity(void) {
+    FILE *file = fopen("/proc/self/cmdline", "r");
+    if (file)
+    {
+        // argv[0] is NUL terminated; on Android it is the package name.
+        size_t length = fread(processName, 1, sizeof(processName) - 1, file);
+        processName[length] = '\0';
+        fclose(file);
+    }
+    if (!getcwd(workingDirectory, sizeof(workingDirectory))) workingDirectory[0] = '\0';
+}
+
+void profile_filter_init(ProfileFilter *filter) {
+    filter->state = PROFILE_GLOBAL;
+    filter->chosen = false;
+    filter->name[0] = '\0';
+}
+
+static bool selector_matches(const char *selector) {
+    pthread_once(&identityOnce, load_identity);
+
+    if (!strncmp(selector, "process:", 8)) return !fnmatch(selector + 8, processName, 0);
+    if (!strncmp(selector, "cwd:", 4)) return !fnmatch(selector + 4, workingDirectory, 0);
+
+    const char *profile = getenv("OSM_PROFILE");
+    return profile && !fnmatch(selector, profile, 0);
+}
+
+bool profile_filter_accept(ProfileFilter *filter, const char *key) {
+    if (key[0] != '[') return filter->state != PROFILE_SKIPPED;
+
+    size_t length = strlen(key);
+    size_t prefix = strlen(PROFILE_PREFIX);
+    if (length <= prefix + 1 || strncmp(key, PROFILE_PREFIX, prefix) != 0 || key[length - 1] != ']')
+    {
+        OSM_LOGW("Ignoring unknown section %s", key);
+        filter->state = PROFILE_SKIPPED;
+        return false;
+    }
+
+    char selector[sizeof(filter->name)];
+    snprintf(selector, sizeof(selector), "%.*s", (int)(length - prefix - 1), key + prefix);
+
+    if (!filter->chosen && selector_matches(selector))
+    {
+        filter->chosen = true;
+        filter->state = PROFILE_ACTIVE;
+        strcpy(filter->name, selector);
+    }
+    else
+    {
+        filter->state = PROFILE_SKIPPED;
+    }
+    return false;
+}
@@ -0,0 +1,34 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+
+// env.txt may end with profile sections, one per game setup:
+//
+//   [profile 1.20*]              OSM_PROFILE from the launcher env
+//   [profile process:com.*]      process name
+//   [profile cwd:*/1.20.1*]      working directory (the game directory)
+//
+// Selectors are fnmatch() patterns. Entries before the first section
+// apply to every game. The first section that matches is applied on top
+// of them and every other section is skipped, so the file resolves in a
+// single pass. Section headers reach the parser as a key starting with
+// '[' and an empty value, in env.bin as well as env.txt.
+
+typedef enum {
+    PROFILE_GLOBAL,
+    PROFILE_ACTIVE,
+    PROFILE_SKIPPED,
+} ProfileState;
+
+typedef struct {
+    ProfileState state;
+    bool chosen;
+    char name[128];
+} ProfileFilter;
+
+void profile_filter_init(ProfileFilter *filter);
+// Track section headers and report whether key=value applies here.
+bool profile_filter_accept(ProfileFilter *filter, const char *key);
+
+#endif // PROFILE_H
@@ -0,0 +1,695 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include "bridge.h"
+#include "internal.h"
+#include "runtime_config.h"
+#include "profile.h"
+#include "env_bin.h"
+#include "call_stats.h"
+#include "log.h"
+
+#define MAX_LINE 256
+// How often the watcher retries freeing replaced snapshots while readers
+// still pin them.
+#define RECLAIM_INTERVAL_MS 100
+
+static RuntimeConfig defaultConfig = {
+    .contextPoolBytes = (size_t)64 << 20,
+    .uploadMinBytes = (size_t)64 << 10,
+    .uploadQueueBytes = (size_t)64 << 20,
+    .startup = {
+        .workerPlacement = PLACEMENT_ALL,
+        .renderNice = -4,
+        .logLevel = LOG_LEVEL_INFO,
+        .source = "defaults",
+    },
+};
+static RuntimeConfig *currentConfig = &defaultConfig;
+static StartupConfig publishedStartup;
+static const StartupConfig *startupConfig = &defaultConfig.startup;
+static pthread_mutex_t publishLock = PTHREAD_MUTEX_INITIALIZER;
+// Newest first, so freeAfter never increases along the list.
+static RuntimeConfig *retiredConfigs = NULL;
+
+// Readers count themselves in one of two counters, picked by the parity
+// of readerPhase when they pin. A grace period step flips the phase and
+// waits for the counter readers used before the flip to drain. A snapshot
+// is freed two whole steps after it was replaced: the second catches a
+// reader that read the parity just before the first flip but only counted
+// itself after it, by which time it may already hold the old pointer.
+static unsigned int readerCounts[2];
+static unsigned int readerPhase = 0;
+static unsigned int stepsDone = 0;
+static int drainingCounter = -1;
+static __thread unsigned int pinDepth = 0;
+static __thread unsigned int pinCounter = 0;
+static unsigned int generation = 0;
+static uint32_t startupRestartHash = 0;
+
+static char watchPath[MAX_LINE];
+static const char *watchName = NULL;
+static char watchBinPath[MAX_LINE];
+static EnvBinStamp lastStamp;
+static bool haveStamp = false;
+static pthread_t watchThread;
+static bool watchRunning = false;
+static int stopPipe[2] = { -1, -1 };
+
+void runtime_config_defaults(RuntimeConfig *config) {
+    *config = defaultConfig;
+    config->restartHash = 2166136261u;
+}
+
+static size_t parse_size(const char *value, int shift) {
+    int number = atoi(value);
+    return (size_t)(number > 0 ? number : 0) << shift;
+}
+
+static void hash_entry(uint32_t *hash, const char *key, const char *value) {
+    for (const char *p = key; *p; p++) *hash = (*hash ^ (unsigned char)*p) * 16777619u;
+    *hash = (*hash ^ '=') * 16777619u;
+    for (const char *p = value; *p; p++) *hash = (*hash ^ (unsigned char)*p) * 16777619u;
+    *hash = (*hash ^ '\n') * 16777619u;
+}
+
+// Keys the bridge writes back itself after probing or the first context.
+static bool recorded_by_bridge(const char *key) {
+    static const char *const keys[] = {
+        "OSM_LAST_CONTEXT_FORMAT", "LP_NUM_THREADS", "OSM_LP_CALIBRATED",
+        "OSM_AUTO_DRIVER", "OSM_AUTO_DRIVER_TIMINGS",
+    };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+    {
+        if (!strcmp(key, keys[i])) return true;
+    }
+    return false;
+}
+
+static bool startup_entry(StartupConfig *startup, const char *key, const char *value) {
+    if (!strcmp(key, "CUSTOM_GL_GLSL"))
+    {
+        startup->customGLVersion = (value[0] >= '1' && value[0] <= '3' && !value[1]) ? value[0] - '0' : 0;
+        return true;
+    }
+
+    if (!strcmp(key, "MESA_GL_VERSION_OVERRIDE"))
+    {
+        // Only exported by the bridge itself, see setGLversion().
+        snprintf(startup->glVersion, sizeof(startup->glVersion), "%s", value);
+        return true;
+    }
+
+    if (!strcmp(key, "MESA_GLSL_VERSION_OVERRIDE"))
+    {
+        snprintf(startup->glslVersion, sizeof(startup->glslVersion), "%s", value);
+        return true;
+    }
+
+    if (!strcmp(key, "ONLY_GET_PROC_ADDRESS"))
+    {
+        startup->onlyGetProcAddress = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_PRECREATE_CONTEXT"))
+    {
+        startup->precreateContext = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_LAST_CONTEXT_FORMAT"))
+    {
+        startup->lastContextFormat = (unsigned int)strtoul(value, NULL, 0);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_THREAD_PLACEMENT"))
+    {
+        startup->threadPlacement = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_WORKER_CORES"))
+    {
+        if (!thread_placement_parse_policy(value, &startup->workerPlacement)) OSM_LOGW("Unknown OSM_WORKER_CORES=%s", value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_WORKER_THREADS"))
+    {
+        snprintf(startup->workerThreads, sizeof(startup->workerThreads), "%s", value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_RENDER_NICE"))
+    {
+        startup->renderNice = atoi(value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_LP_TUNE"))
+    {
+        startup->llvmpipeTune = !strcmp(value, "true") || !strcmp(value, "all");
+        startup->llvmpipeTuneAll = !strcmp(value, "all");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_LP_CALIBRATED"))
+    {
+        startup->llvmpipeCalibrated = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_AUTO_DRIVER"))
+    {
+        snprintf(startup->autoDriver, sizeof(startup->autoDriver), "%s", value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_AUTO_DRIVER_CANDIDATES"))
+    {
+        snprintf(startup->autoDriverCandidates, sizeof(startup->autoDriverCandidates), "%s", value);
+        return true;
+    }
+
+    // Written by the auto driver probe for the app to show.
+    if (!strcmp(key, "OSM_AUTO_DRIVER_TIMINGS")) return true;
+
+    if (!strcmp(key, "OSM_GL_OFFLOAD"))
+    {
+        startup->glOffload = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_CONFIG_RELOAD"))
+    {
+        startup->configReload = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_TASK_THREADS"))
+    {
+        startup->taskThreads = atoi(value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_TRACE"))
+    {
+        snprintf(startup->traceFile, sizeof(startup->traceFile), "%s", value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_TIMELINE"))
+    {
+        snprintf(startup->timelineFile, sizeof(startup->timelineFile), "%s", value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_TIMELINE_SECONDS"))
+    {
+        startup->timelineSeconds = atoi(value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_GPU_TIMING"))
+    {
+        startup->gpuTiming = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_GL_DEBUG"))
+    {
+        startup->glDebug = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_LOG_SINK"))
+    {
+        snprintf(startup->logSink, sizeof(startup->logSink), "%s", value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_LOG_LEVEL"))
+    {
+        if (!log_parse_level(value, &startup->logLevel)) OSM_LOGW("Unknown OSM_LOG_LEVEL=%s", value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_STARTUP_REPORT"))
+    {
+        snprintf(startup->startupReport, sizeof(startup->startupReport), "%s", value);
+        return true;
+    }
+
+    return false;
+}
+
+bool runtime_config_entry(RuntimeConfig *config, const char *key, const char *value) {
+    if (!strcmp(key, "OSM_PLUGIN_LOGE"))
+    {
+        config->logOutPut = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_CHECK_CURRENT_CONTEXT"))
+    {
+        config->checkCurrentContext = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_ASYNC_DESTROY"))
+    {
+        config->asyncDestroy = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_CONTEXT_POOL_SIZE"))
+    {
+        config->contextPoolSize = atoi(value);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_CONTEXT_POOL_MEMORY_MB"))
+    {
+        config->contextPoolBytes = parse_size(value, 20);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_UPLOAD_MIN_KB"))
+    {
+        config->uploadMinBytes = parse_size(value, 10);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_UPLOAD_QUEUE_MB"))
+    {
+        config->uploadQueueBytes = parse_size(value, 20);
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_CALL_STATS"))
+    {
+        config->callStats = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!strcmp(key, "OSM_HUD"))
+    {
+        config->hud = !strcmp(value, "true");
+        return true;
+    }
+
+    if (!recorded_by_bridge(key)) hash_entry(&config->restartHash, key, value);
+    return startup_entry(&config->startup, key, value);
+}
+
+const RuntimeConfig* runtime_config_acquire(void) {
+    if (pinDepth++ == 0)
+    {
+        pinCounter = __atomic_load_n(&readerPhase, __ATOMIC_SEQ_CST) & 1;
+        __atomic_fetch_add(&readerCounts[pinCounter], 1, __ATOMIC_SEQ_CST);
+    }
+    return __atomic_load_n(&currentConfig, __ATOMIC_SEQ_CST);
+}
+
+void runtime_config_release(void) {
+    if (pinDepth == 0) return;
+    if (--pinDepth == 0) __atomic_fetch_sub(&readerCounts[pinCounter], 1, __ATOMIC_RELEASE);
+}
+
+const StartupConfig* runtime_config_startup(void) {
+    return __atomic_load_n(&startupConfig, __ATOMIC_ACQUIRE);
+}
+
+// Advance the grace period as far as the readers allow and free every
+// snapshot it covers. Never waits; the watcher calls it again later.
+static void reclaim_locked(void) {
+    for (;;)
+    {
+        RuntimeConfig **link = &retiredConfigs;
+        while (*link && (*link)->freeAfter > stepsDone) link = &(*link)->retired;
+        while (*link)
+        {
+            RuntimeConfig *next = (*link)->retired;
+            free(*link);
+            *link = next;
+        }
+        if (!retiredConfigs) return;
+
+        if (drainingCounter < 0) drainingCounter = (int)(__atomic_fetch_add(&readerPhase, 1, __ATOMIC_SEQ_CST) & 1);
+        if (__atomic_load_n(&readerCounts[drainingCounter], __ATOMIC_SEQ_CST)) return;
+        drainingCounter = -1;
+        stepsDone++;
+    }
+}
+
+static bool reclaim_pending(void) {
+    pthread_mutex_lock(&publishLock);
+    bool pending = retiredConfigs != NULL;
+    pthread_mutex_unlock(&publishLock);
+    return pending;
+}
+
+static void reclaim(void) {
+    pthread_mutex_lock(&publishLock);
+    reclaim_locked();
+    pthread_mutex_unlock(&publishLock);
+}
+
+static bool same_tunables(const RuntimeConfig *a, const RuntimeConfig *b) {
+    return a->logOutPut == b->logOutPut &&
+           a->checkCurrentContext == b->checkCurrentContext &&
+           a->asyncDestroy == b->asyncDestroy &&
+           a->contextPoolSize == b->contextPoolSize &&
+           a->contextPoolBytes == b->contextPoolBytes &&
+           a->uploadMinBytes == b->uploadMinBytes &&
+           a->uploadQueueBytes == b->uploadQueueBytes &&
+           a->callStats == b->callStats &&
+           a->hud == b->hud;
+}
+
+static void log_reload(const RuntimeConfig *previous, const RuntimeConfig *snapshot) {
+    if (!same_tunables(previous, snapshot))
+    {
+        OSM_LOGI("Reloaded config (generation %u): pool %d contexts / %zu MB, upload min %zu KB / queue %zu MB, async destroy %s, check context %s, call stats %s, HUD %s",
+                snapshot->generation, snapshot->contextPoolSize, snapshot->contextPoolBytes >> 20,
+                snapshot->uploadMinBytes >> 10, snapshot->uploadQueueBytes >> 20,
+                snapshot->asyncDestroy ? "on" : "off", snapshot->checkCurrentContext ? "on" : "off", snapshot->callStats ? "on" : "off",
+                snapshot->hud ? "on" : "off");
+    }
+    if (snapshot->restartHash != startupRestartHash && snapshot->restartHash != previous->restartHash)
+    {
+        OSM_LOGW("Mesa variables and load-time settings changed in %s only apply after restarting the game", watchPath);
+    }
+}
+
+void runtime_config_publish(const RuntimeConfig *config) {
+    RuntimeConfig *snapshot = malloc(sizeof(RuntimeConfig));
+    if (!snapshot) return;
+    *snapshot = *config;
+    snapshot->retired = NULL;
+
+    pthread_mutex_lock(&publishLock);
+    bool first = generation == 0;
+    snapshot->generation = ++generation;
+    if (first)
+    {
+        startupRestartHash = snapshot->restartHash;
+        publishedStartup = snapshot->startup;
+        __atomic_store_n(&startupConfig, &publishedStartup, __ATOMIC_RELEASE);
+    }
+
+    // Only the publisher frees snapshots, so previous stays valid below.
+    RuntimeConfig *previous = __atomic_exchange_n(&currentConfig, snapshot, __ATOMIC_SEQ_CST);
+    if (previous != &defaultConfig)
+    {
+        // Two steps begun after the exchange, not counting one under way.
+        previous->freeAfter = stepsDone + (drainingCounter < 0 ? 2 : 3);
+        previous->retired = retiredConfigs;
+        retiredConfigs = previous;
+    }
+    __atomic_store_n(&logOutPut, snapshot->logOutPut, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&publishLock);
+    call_stats_enable(snapshot->callStats);
+
+    if (!first && logOutPut) log_reload(previous, snapshot);
+    reclaim();
+}
+
+static void copy_env(char *buffer, size_t size, const char *name) {
+    const char *value = getenv(name);
+    snprintf(buffer, size, "%s", value ? value : "");
+}
+
+void OSMesaBridgeGetConfig(OSMesaBridgeConfig *config) {
+    if (!config) return;
+    memset(config, 0, sizeof(*config));
+
+    const RuntimeConfig *current = runtime_config_acquire();
+    const StartupConfig *startup = runtime_config_startup();
+    config->generation = current->generation;
+    snprintf(config->source, sizeof(config->source), "%s", startup->source);
+    snprintf(config->path, sizeof(config->path), "%s", startup->path);
+    snprintf(config->profile, sizeof(config->profile), "%s", startup->profile);
+
+    // GALLIUM_DRIVER=auto and the GL version options resolve to these.
+    copy_env(config->galliumDriver, sizeof(config->galliumDriver), "GALLIUM_DRIVER");
+    copy_env(config->glVersion, sizeof(config->glVersion), "MESA_GL_VERSION_OVERRIDE");
+    copy_env(config->glslVersion, sizeof(config->glslVersion), "MESA_GLSL_VERSION_OVERRIDE");
+    const char *glthread = getenv("mesa_glthread");
+    config->glthread = glthread && !strcmp(glthread, "true");
+
+    config->logOutput = current->logOutPut;
+    config->checkCurrentContext = current->checkCurrentContext;
+    config->asyncDestroy = current->asyncDestroy;
+    config->contextPoolSize = current->contextPoolSize;
+    config->contextPoolBytes = current->contextPoolBytes;
+    config->uploadMinBytes = current->uploadMinBytes;
+    config->uploadQueueBytes = current->uploadQueueBytes;
+    config->callStats = current->callStats;
+    config->hud = current->hud;
+    runtime_config_release();
+
+    config->onlyGetProcAddress = startup->onlyGetProcAddress;
+    config->precreateContext = startup->precreateContext;
+    config->lastContextFormat = startup->lastContextFormat;
+    config->threadPlacement = startup->threadPlacement;
+    config->llvmpipeTune = startup->llvmpipeTune;
+    config->glOffload = startup->glOffload;
+    config->configReload = startup->configReload;
+    config->taskThreads = startup->taskThreads;
+    snprintf(config->traceFile, sizeof(config->traceFile), "%s", startup->traceFile);
+    snprintf(config->timelineFile, sizeof(config->timelineFile), "%s", startup->timelineFile);
+    config->timelineSeconds = startup->timelineSeconds;
+    config->gpuTiming = startup->gpuTiming;
+    config->glDebug = startup->glDebug;
+    snprintf(config->logSink, sizeof(config->logSink), "%s", startup->logSink);
+    config->logLevel = startup->logLevel;
+    snprintf(config->startupReport, sizeof(config->startupReport), "%s", startup->startupReport);
+}
+
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+} Dump;
+
+__attribute__((format(printf, 2, 3)))
+static void dump_line(Dump *dump, const char *format, ...) {
+    char *out = dump->length < dump->size ? dump->buffer + dump->length : NULL;
+    size_t room = out ? dump->size - dump->length : 0;
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(out, room, format, args);
+    va_end(args);
+    if (written > 0) dump->length += (size_t)written;
+}
+
+static const char* bool_value(GLboolean value) {
+    return value ? "true" : "false";
+}
+
+GLsizei OSMesaBridgeDumpConfig(char *buffer, GLsizei size) {
+    OSMesaBridgeConfig config;
+    OSMesaBridgeGetConfig(&config);
+    const StartupConfig *startup = runtime_config_startup();
+    static const char *const placements[] = { "all", "big", "little" };
+
+    Dump dump = { buffer, buffer && size > 0 ? (size_t)size : 0, 0 };
+    if (dump.size) buffer[0] = '\0';
+
+    dump_line(&dump, "# generation %u from %s %s%s%s\n", config.generation, config.source, config.path,
+              config.profile[0] ? ", profile " : "", config.profile);
+    if (config.galliumDriver[0]) dump_line(&dump, "GALLIUM_DRIVER=%s\n", config.galliumDriver);
+    if (config.glVersion[0]) dump_line(&dump, "MESA_GL_VERSION_OVERRIDE=%s\n", config.glVersion);
+    if (config.glslVersion[0]) dump_line(&dump, "MESA_GLSL_VERSION_OVERRIDE=%s\n", config.glslVersion);
+    dump_line(&dump, "mesa_glthread=%s\n", bool_value(config.glthread));
+
+    dump_line(&dump, "OSM_PLUGIN_LOGE=%s\n", bool_value(config.logOutput));
+    dump_line(&dump, "OSM_CHECK_CURRENT_CONTEXT=%s\n", bool_value(config.checkCurrentContext));
+    dump_line(&dump, "OSM_ASYNC_DESTROY=%s\n", bool_value(config.asyncDestroy));
+    dump_line(&dump, "OSM_CONTEXT_POOL_SIZE=%d\n", config.contextPoolSize);
+    dump_line(&dump, "OSM_CONTEXT_POOL_MEMORY_MB=%llu\n", (unsigned long long)(config.contextPoolBytes >> 20));
+    dump_line(&dump, "OSM_UPLOAD_MIN_KB=%llu\n", (unsigned long long)(config.uploadMinBytes >> 10));
+    dump_line(&dump, "OSM_UPLOAD_QUEUE_MB=%llu\n", (unsigned long long)(config.uploadQueueBytes >> 20));
+    dump_line(&dump, "OSM_CALL_STATS=%s\n", bool_value(config.callStats));
+    dump_line(&dump, "OSM_HUD=%s\n", bool_value(config.hud));
+
+    dump_line(&dump, "ONLY_GET_PROC_ADDRESS=%s\n", bool_value(config.onlyGetProcAddress));
+    dump_line(&dump, "OSM_PRECREATE_CONTEXT=%s\n", bool_value(config.precreateContext));
+    if (config.lastContextFormat) dump_line(&dump, "OSM_LAST_CONTEXT_FORMAT=0x%x\n", config.lastContextFormat);
+    dump_line(&dump, "OSM_THREAD_PLACEMENT=%s\n", bool_value(config.threadPlacement));
+    dump_line(&dump, "OSM_WORKER_CORES=%s\n", placements[startup->workerPlacement]);
+    if (startup->workerThreads[0]) dump_line(&dump, "OSM_WORKER_THREADS=%s\n", startup->workerThreads);
+    dump_line(&dump, "OSM_RENDER_NICE=%d\n", startup->renderNice);
+    dump_line(&dump, "OSM_LP_TUNE=%s\n", startup->llvmpipeTuneAll ? "all" : bool_value(config.llvmpipeTune));
+    dump_line(&dump, "OSM_GL_OFFLOAD=%s\n", bool_value(config.glOffload));
+    dump_line(&dump, "OSM_CONFIG_RELOAD=%s\n", bool_value(config.configReload));
+    dump_line(&dump, "OSM_TASK_THREADS=%d\n", config.taskThreads);
+    dump_line(&dump, "OSM_GPU_TIMING=%s\n", bool_value(config.gpuTiming));
+    dump_line(&dump, "OSM_GL_DEBUG=%s\n", bool_value(config.glDebug));
+    if (config.logSink[0]) dump_line(&dump, "OSM_LOG_SINK=%s\n", config.logSink);
+    dump_line(&dump, "OSM_LOG_LEVEL=%s\n", log_level_name(config.logLevel));
+    if (config.startupReport[0]) dump_line(&dump, "OSM_STARTUP_REPORT=%s\n", config.startupReport);
+    if (config.traceFile[0]) dump_line(&dump, "OSM_TRACE=%s\n", config.traceFile);
+    if (config.timelineFile[0])
+    {
+        dump_line(&dump, "OSM_TIMELINE=%s\n", config.timelineFile);
+        dump_line(&dump, "OSM_TIMELINE_SECONDS=%d\n", config.timelineSeconds);
+    }
+
+    return (GLsizei)dump.length;
+}
+
+// Only the watcher thread reloads, so the entry callback can use statics.
+static RuntimeConfig reloadConfig;
+static ProfileFilter reloadProfile;
+
+static void reload_entry(const char *key, const char *value) {
+    if (profile_filter_accept(&reloadProfile, key)) runtime_config_entry(&reloadConfig, key, value);
+}
+
+static bool reload_text(void) {
+    FILE *file = fopen(watchPath, "r");
+    if (!file) return false;
+
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '[')
+        {
+            reload_entry(line, "");
+            continue;
+        }
+
+        char *delimiter = strchr(line, '=');
+        if (delimiter)
+        {
+            *delimiter = '\0';
+            reload_entry(line, delimiter + 1);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static void reload(void) {
+    // The app writes env.bin before env.txt, so when the header is current
+    // it says whether anything changed without touching the entries.
+    EnvBinStamp stamp;
+    bool binCurrent = env_bin_stamp(watchBinPath, watchPath, &stamp);
+    if (binCurrent && haveStamp && stamp.generation == lastStamp.generation && stamp.checksum == lastStamp.checksum) return;
+
+    runtime_config_defaults(&reloadConfig);
+    profile_filter_init(&reloadProfile);
+    if (!(binCurrent && env_bin_apply(watchBinPath, watchPath, reload_entry)) && !reload_text()) return;
+    haveStamp = binCurrent;
+    lastStamp = stamp;
+
+    reloadConfig.startup = *runtime_config_startup();
+    runtime_config_publish(&reloadConfig);
+}
+
+static void* watch_main(void *arg) {
+    int fd = (int)(long)arg;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;)
+    {
+        struct pollfd fds[2] = {
+            { .fd = fd, .events = POLLIN },
+            { .fd = stopPipe[0], .events = POLLIN },
+        };
+        int ready = poll(fds, 2, reclaim_pending() ? RECLAIM_INTERVAL_MS : -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        reclaim();
+        if (!ready) continue;
+
+        ssize_t length = read(fd, events, sizeof(events));
+        if (length <= 0) continue;
+
+        // The app writes env.txt in place and the bridge renames over it,
+        // so a batch may hold both kinds of event; one reload covers it.
+        bool changed = false;
+        for (char *p = events; p < events + length;)
+        {
+            struct inotify_event *event = (struct inotify_event*)p;
+            if (event->len && !strcmp(event->name, watchName)) changed = true;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+        if (changed) reload();
+    }
+
+    close(fd);
+    return NULL;
+}
+
+void runtime_config_watch(const char *filePath) {
+    if (watchRunning) return;
+
+    strncpy(watchPath, filePath, sizeof(watchPath) - 1);
+    char *slash = strrchr(watchPath, '/');
+    if (!slash) return;
+    watchName = slash + 1;
+    env_bin_path(watchPath, watchBinPath, sizeof(watchBinPath));
+    haveStamp = env_bin_stamp(watchBinPath, watchPath, &lastStamp);
+
+    // Watch the directory: a rename replaces the file's inode.
+    char directory[MAX_LINE];
+    snprintf(directory, sizeof(directory), "%.*s", (int)(slash - watchPath), watchPath);
+
+    int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd < 0 || inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0 || pipe2(stopPipe, O_CLOEXEC) != 0)
+    {
+        OSM_LOGW("Failed to watch %s: %s", directory, strerror(errno));
+        if (fd >= 0) close(fd);
+        return;
+    }
+
+    if (pthread_create(&watchThread, NULL, watch_main, (void*)(long)fd) != 0)
+    {
+        OSM_LOGW("Failed to start config watcher thread");
+        close(fd);
+        close(stopPipe[0]);
+        close(stopPipe[1]);
+        return;
+    }
+    pthread_setname_np(watchThread, "OSMConfig");
+    watchRunning = true;
+}
+
+void runtime_config_stop(void) {
+    if (watchRunning)
+    {
+        char wake = 0;
+        if (write(stopPipe[1], &wake, 1) == 1) pthread_join(watchThread, NULL);
+        close(stopPipe[0]);
+        close(stopPipe[1]);
+        watchRunning = false;
+    }
+
+    // The library is unloading, so no reader can still hold a snapshot.
+    pthread_mutex_lock(&publishLock);
+    while (retiredConfigs)
+    {
+        RuntimeConfig *next = retiredConfigs->retired;
+        free(retiredConfigs);
+        retiredConfigs = next;
+    }
+    pthread_mutex_unlock(&publishLock);
+}
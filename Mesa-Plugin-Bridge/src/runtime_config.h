@@ -0,0 +1,103 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "thread_placement.h"
+
+// Every bridge setting from env.txt, typed. A snapshot is never modified
+// once published: readers pin the current one without locking, and a
+// reload publishes a fresh copy in its place. A replaced snapshot is freed
+// once every reader that could have pinned it has let go.
+//
+// Only the tunables at the top can change while the game runs. The
+// startup part is read once at load time, because those keys pick
+// threads, trampolines or an initial context up front, and a reload
+// carries it over unchanged. Mesa variables are exported with setenv()
+// instead, since Mesa only consults them when it creates its screen.
+
+#define CONFIG_VALUE_MAX 256
+
+typedef struct {
+    // CUSTOM_GL_GLSL: 1 follows the system, 2 forces 4.6, 3 uses the
+    // two overrides below; anything else leaves Mesa alone.
+    int customGLVersion;
+    char glVersion[32];
+    char glslVersion[32];
+    bool onlyGetProcAddress;
+    bool precreateContext;
+    unsigned int lastContextFormat;
+    bool threadPlacement;
+    PlacementPolicy workerPlacement;
+    char workerThreads[CONFIG_VALUE_MAX];
+    // Applied to the render thread with OSM_THREAD_PLACEMENT; 0 leaves it.
+    int renderNice;
+    bool llvmpipeTune;
+    bool llvmpipeTuneAll;
+    bool llvmpipeCalibrated;
+    char autoDriver[32];
+    char autoDriverCandidates[CONFIG_VALUE_MAX];
+    bool glOffload;
+    bool configReload;
+    int taskThreads;
+    char traceFile[CONFIG_VALUE_MAX];
+    char timelineFile[CONFIG_VALUE_MAX];
+    int timelineSeconds;
+    bool gpuTiming;
+    bool glDebug;
+    char logSink[CONFIG_VALUE_MAX];
+    int logLevel;
+    char startupReport[CONFIG_VALUE_MAX];
+    // Where the settings came from.
+    const char *source;
+    char path[CONFIG_VALUE_MAX];
+    char profile[128];
+} StartupConfig;
+
+typedef struct RuntimeConfig {
+    unsigned int generation;
+    bool logOutPut;
+    bool checkCurrentContext;
+    bool asyncDestroy;
+    int contextPoolSize;
+    size_t contextPoolBytes;
+    size_t uploadMinBytes;
+    size_t uploadQueueBytes;
+    bool callStats;
+    bool hud;
+    StartupConfig startup;
+    // Hash of every load-time entry, to tell when a reload missed one.
+    uint32_t restartHash;
+    struct RuntimeConfig *retired;
+    // Grace period steps that must complete before it is freed.
+    unsigned int freeAfter;
+} RuntimeConfig;
+
+void runtime_config_defaults(RuntimeConfig *config);
+// Store key in config if it is a bridge setting. Returns false for Mesa
+// variables. Everything but the tunables is folded into
+// config->restartHash as well.
+bool runtime_config_entry(RuntimeConfig *config, const char *key, const char *value);
+void runtime_config_publish(const RuntimeConfig *config);
+// Pin the current snapshot, never NULL, until runtime_config_release() on
+// the same thread. Pins nest. Keep them short: a reload cannot free the
+// snapshot it replaced while any thread holds a pin taken before it.
+const RuntimeConfig* runtime_config_acquire(void);
+void runtime_config_release(void);
+// One field of the current snapshot.
+#define RUNTIME_CONFIG_GET(field) ({ \
+        const RuntimeConfig *config_ = runtime_config_acquire(); \
+        __typeof__(config_->field) value_ = config_->field; \
+        runtime_config_release(); \
+        value_; \
+    })
+// The load-time settings, which no reload changes. Needs no pin.
+const StartupConfig* runtime_config_startup(void);
+
+// Re-read filePath whenever it is rewritten and publish the result.
+void runtime_config_watch(const char *filePath);
+// Join the watcher and free every retired snapshot.
+void runtime_config_stop(void);
+
+#endif // RUNTIME_CONFIG_H
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "bridge.h"
+#include "internal.h"
+#include "startup_timing.h"
+#include "timeline.h"
+#include "log.h"
+
+typedef struct {
+    const char *name;
+    long long startNs;
+    long long endNs;
+} Stage;
+
+static pthread_mutex_t stageLock = PTHREAD_MUTEX_INITIALIZER;
+static Stage stages[STARTUP_STAGES];
+static unsigned int stageCount = 0;
+static unsigned int droppedStages = 0;
+static long long originNs = 0;
+static char reportPath[256];
+static bool reported = false;
+
+void startup_stage(const char *name, long long startNs, long long endNs) {
+    pthread_mutex_lock(&stageLock);
+    if (stageCount < STARTUP_STAGES) stages[stageCount++] = (Stage){ name, startNs, endNs };
+    else droppedStages++;
+    pthread_mutex_unlock(&stageLock);
+
+    if (timelineEnabled) timeline_span(name, startNs, endNs);
+}
+
+void startup_timing_configure(const char *path, long long loadNs) {
+    pthread_mutex_lock(&stageLock);
+    originNs = loadNs;
+    snprintf(reportPath, sizeof(reportPath), "%s", path ? path : "");
+    if (timelineEnabled)
+    {
+        for (unsigned int i = 0; i < stageCount; i++) timeline_span(stages[i].name, stages[i].startNs, stages[i].endNs);
+    }
+    pthread_mutex_unlock(&stageLock);
+}
+
+void startup_timing_report(void) {
+    pthread_mutex_lock(&stageLock);
+    if (reported || !reportPath[0])
+    {
+        pthread_mutex_unlock(&stageLock);
+        return;
+    }
+    reported = true;
+
+    FILE *out = fopen(reportPath, "w");
+    if (!out)
+    {
+        OSM_LOGE("Failed to create startup report %s: %s", reportPath, strerror(errno));
+        pthread_mutex_unlock(&stageLock);
+        return;
+    }
+    fprintf(out, "# OSM Plugin Bridge startup, ms since the library was loaded\n");
+    fprintf(out, "stage\tstart_ms\tduration_ms\n");
+    for (unsigned int i = 0; i < stageCount; i++)
+    {
+        fprintf(out, "%s\t%.3f\t%.3f\n", stages[i].name,
+                (stages[i].startNs - originNs) / 1e6, (stages[i].endNs - stages[i].startNs) / 1e6);
+    }
+    if (droppedStages) fprintf(out, "# %u more stages not recorded\n", droppedStages);
+
+    bool failed = ferror(out) != 0;
+    if (fclose(out) != 0) failed = true;
+    if (failed) OSM_LOGE("Failed to write startup report %s", reportPath);
+    else OSM_LOGI("Wrote startup report %s", reportPath);
+    pthread_mutex_unlock(&stageLock);
+}
+
+GLuint OSMesaBridgeGetStartupStages(OSMesaBridgeStartupStage *out, GLuint count) {
+    pthread_mutex_lock(&stageLock);
+    GLuint total = stageCount;
+    for (GLuint i = 0; out && i < count && i < total; i++)
+    {
+        out[i].name = stages[i].name;
+        out[i].startNs = (GLuint64)stages[i].startNs;
+        out[i].endNs = (GLuint64)stages[i].endNs;
+    }
+    pthread_mutex_unlock(&stageLock);
+    return total;
+}
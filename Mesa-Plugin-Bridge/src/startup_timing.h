@@ -0,0 +1,26 @@
+#ifndef STARTUP_TIMING_H
+#define STARTUP_TIMING_H
+
+// How long each stage of bringing the bridge up took: reading env.txt,
+// the GL version override, the dlopen() calls and every symbol lookup in
+// the constructor, then the first OSMesaCreateContext() and the first
+// OSMesaMakeCurrent(), and "First frame" from library load to the first
+// glFinish() with a context current. With OSM_PRECREATE_CONTEXT the
+// speculative create and whether it was adopted or discarded are stages
+// too. Always recorded, and readable through
+// OSMesaBridgeGetStartupStages(). With OSM_STARTUP_REPORT=<file> they are
+// also written there after the first frame, and with OSM_TIMELINE they
+// show up in the timeline.
+
+#define STARTUP_STAGES 48
+
+// name must outlive the library, a string literal in practice.
+void startup_stage(const char *name, long long startNs, long long endNs);
+// Called once from the constructor, after the timeline started: stages
+// from before that are passed on to it then.
+void startup_timing_configure(const char *reportPath, long long loadNs);
+// Write the report, once: after the first frame, or at exit
+// if startup never got that far.
+void startup_timing_report(void);
+
+#endif // STARTUP_TIMING_H
@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "bridge.h"
+#include "internal.h"
+#include "cpu_topology.h"
+#include "task_pool.h"
+#include "log.h"
+
+#define MAX_WORKERS 8
+// workers[0] only runs events; tasks go to the rest.
+#define EVENT_WORKER 0
+#define INITIAL_CAPACITY 64
+
+typedef struct {
+    TaskFn fn;
+    void *arg;
+} Task;
+
+// Ring buffer; the owner pushes and pops at the tail, thieves take the head.
+typedef struct {
+    pthread_mutex_t lock;
+    Task *tasks;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    pthread_t thread;
+    unsigned long long executed;
+    unsigned long long steals;
+} Worker;
+
+static Worker workers[MAX_WORKERS + 1];
+static int configuredThreads = 0;
+static int workerCount = 0;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static bool poolStarted = false;
+static bool poolStopping = false;
+// Set once the task workers are joined; the event worker stays until then.
+static bool tasksJoined = false;
+// Set while workers are there to run events; cleared once they are joined.
+static bool poolRunning = false;
+// Idle workers sleep on wakeSequence, the event worker on eventSequence.
+// Anything that gives them work bumps the word after publishing the work,
+// so a worker that checked just before sleeping is not missed.
+static unsigned int wakeSequence = 0;
+static unsigned int eventSequence = 0;
+static unsigned int pendingEvents = 0;
+static TaskFn eventHandlers[TASK_EVENT_COUNT];
+static unsigned int nextWorker = 0;
+static unsigned int queuedTasks = 0;
+static unsigned int peakQueued = 0;
+static unsigned long long submittedTasks = 0;
+static __thread int selfIndex = -1;
+
+void task_pool_configure(int threads) {
+    configuredThreads = threads;
+}
+
+static bool push_task(Worker *worker, TaskFn fn, void *arg) {
+    pthread_mutex_lock(&worker->lock);
+    if (worker->count == worker->capacity)
+    {
+        size_t capacity = worker->capacity ? worker->capacity * 2 : INITIAL_CAPACITY;
+        Task *tasks = malloc(capacity * sizeof(Task));
+        if (!tasks)
+        {
+            pthread_mutex_unlock(&worker->lock);
+            return false;
+        }
+        for (size_t i = 0; i < worker->count; i++) tasks[i] = worker->tasks[(worker->head + i) % worker->capacity];
+        free(worker->tasks);
+        worker->tasks = tasks;
+        worker->capacity = capacity;
+        worker->head = 0;
+    }
+    worker->tasks[(worker->head + worker->count) % worker->capacity] = (Task){ fn, arg };
+    worker->count++;
+    pthread_mutex_unlock(&worker->lock);
+    return true;
+}
+
+static bool pop_task(Worker *worker, Task *task) {
+    pthread_mutex_lock(&worker->lock);
+    bool found = worker->count > 0;
+    if (found)
+    {
+        worker->count--;
+        *task = worker->tasks[(worker->head + worker->count) % worker->capacity];
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return found;
+}
+
+static bool steal_task(Worker *victim, Task *task) {
+    if (!__atomic_load_n(&victim->count, __ATOMIC_RELAXED)) return false;
+    if (pthread_mutex_trylock(&victim->lock) != 0) return false;
+    bool found = victim->count > 0;
+    if (found)
+    {
+        *task = victim->tasks[victim->head];
+        victim->head = (victim->head + 1) % victim->capacity;
+        victim->count--;
+    }
+    pthread_mutex_unlock(&victim->lock);
+    return found;
+}
+
+static bool find_task(int index, Task *task) {
+    if (pop_task(&workers[index], task)) return true;
+    int taskWorkers = workerCount - 1;
+    for (int i = 1; i < taskWorkers; i++)
+    {
+        if (steal_task(&workers[1 + (index - 1 + i) % taskWorkers], task))
+        {
+            __atomic_fetch_add(&workers[index].steals, 1, __ATOMIC_RELAXED);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void wake(unsigned int *sequence, int count) {
+    __atomic_add_fetch(sequence, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, sequence, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static bool run_events(void) {
+    unsigned int events = __atomic_exchange_n(&pendingEvents, 0, __ATOMIC_ACQUIRE);
+    for (int event = 0; events && event < TASK_EVENT_COUNT; event++)
+    {
+        TaskFn handler = __atomic_load_n(&eventHandlers[event], __ATOMIC_ACQUIRE);
+        if (handler && (events & (1u << event))) handler(NULL);
+    }
+    return events != 0;
+}
+
+// Events (the log drain, the trace flush, stats dumps) get a worker of
+// their own, so a task that blocks for long, such as the driver probe,
+// does not hold them up. It sleeps unless one is raised.
+static void* event_main(void *arg) {
+    (void)arg;
+    selfIndex = EVENT_WORKER;
+
+    for (;;)
+    {
+        if (run_events()) continue;
+
+        unsigned int sequence = __atomic_load_n(&eventSequence, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&pendingEvents, __ATOMIC_SEQ_CST)) continue;
+        if (__atomic_load_n(&tasksJoined, __ATOMIC_ACQUIRE)) break;
+        syscall(SYS_futex, &eventSequence, FUTEX_WAIT_PRIVATE, sequence, NULL, NULL, 0);
+    }
+    return NULL;
+}
+
+static void* worker_main(void *arg) {
+    int index = (int)(long)arg;
+    selfIndex = index;
+
+    for (;;)
+    {
+        Task task;
+        if (find_task(index, &task))
+        {
+            __atomic_fetch_sub(&queuedTasks, 1, __ATOMIC_RELAXED);
+            task.fn(task.arg);
+            __atomic_fetch_add(&workers[index].executed, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        unsigned int sequence = __atomic_load_n(&wakeSequence, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&queuedTasks, __ATOMIC_SEQ_CST)) continue;
+        if (__atomic_load_n(&poolStopping, __ATOMIC_ACQUIRE)) break;
+        syscall(SYS_futex, &wakeSequence, FUTEX_WAIT_PRIVATE, sequence, NULL, NULL, 0);
+    }
+    return NULL;
+}
+
+static bool start_worker(void *(*main)(void*)) {
+    Worker *worker = &workers[workerCount];
+    memset(worker, 0, sizeof(Worker));
+    pthread_mutex_init(&worker->lock, NULL);
+    if (pthread_create(&worker->thread, NULL, main, (void*)(long)workerCount) != 0)
+    {
+        pthread_mutex_destroy(&worker->lock);
+        return false;
+    }
+    char name[32];
+    if (workerCount == EVENT_WORKER) snprintf(name, sizeof(name), "OSMTaskEvents");
+    else snprintf(name, sizeof(name), "OSMTask%d", workerCount - 1);
+    pthread_setname_np(worker->thread, name);
+    workerCount++;
+    return true;
+}
+
+// Called with poolLock held.
+static bool start_pool(void) {
+    if (poolStarted) return workerCount > 0;
+    poolStarted = true;
+
+    int threads = configuredThreads;
+    if (threads <= 0)
+    {
+        // Leave one core to the render thread.
+        const CpuTopology *topology = cpu_topology_get();
+        threads = topology ? topology->onlineCount - 1 : 1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAX_WORKERS) threads = MAX_WORKERS;
+
+    // The event worker is asleep between events, so it is not counted
+    // against the cores.
+    if (start_worker(event_main))
+    {
+        for (int i = 0; i < threads; i++)
+        {
+            if (!start_worker(worker_main)) break;
+        }
+    }
+
+    __atomic_store_n(&poolRunning, workerCount > 0, __ATOMIC_RELEASE);
+    if (!workerCount) OSM_LOGW("Failed to start task pool");
+    else if (workerCount == 1) OSM_LOGW("Task pool started without task workers, only events run on it");
+    else OSM_LOGI("Task pool started with %d workers and an event worker", workerCount - 1);
+    return workerCount > 0;
+}
+
+bool task_pool_submit(TaskFn fn, void *arg) {
+    if (!fn) return false;
+
+    // Holding poolLock keeps task_pool_stop() from letting the workers exit
+    // between the push and the wakeup.
+    pthread_mutex_lock(&poolLock);
+    if (poolStopping || !start_pool() || workerCount < 2)
+    {
+        pthread_mutex_unlock(&poolLock);
+        return false;
+    }
+    int target = selfIndex > EVENT_WORKER ? selfIndex : 1 + (int)(nextWorker++ % (unsigned int)(workerCount - 1));
+    if (!push_task(&workers[target], fn, arg))
+    {
+        pthread_mutex_unlock(&poolLock);
+        return false;
+    }
+
+    unsigned int queued = __atomic_add_fetch(&queuedTasks, 1, __ATOMIC_RELAXED);
+    if (queued > peakQueued) __atomic_store_n(&peakQueued, queued, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&submittedTasks, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&poolLock);
+    wake(&wakeSequence, 1);
+    return true;
+}
+
+bool task_pool_on_event(TaskEvent event, TaskFn fn) {
+    __atomic_store_n(&eventHandlers[event], fn, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&poolLock);
+    bool running = !poolStopping && start_pool();
+    pthread_mutex_unlock(&poolLock);
+    return running;
+}
+
+bool task_pool_raise(TaskEvent event) {
+    if (!__atomic_load_n(&poolRunning, __ATOMIC_ACQUIRE)) return false;
+    __atomic_fetch_or(&pendingEvents, 1u << event, __ATOMIC_SEQ_CST);
+    wake(&eventSequence, 1);
+    return true;
+}
+
+EXPORT
+void OSMesaBridgeGetTaskPoolStats(OSMesaBridgeTaskPoolStats *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+
+    pthread_mutex_lock(&poolLock);
+    stats->workers = workerCount > 1 ? (GLuint)workerCount - 1 : 0;
+    for (int i = 1; i < workerCount; i++)
+    {
+        stats->executed += __atomic_load_n(&workers[i].executed, __ATOMIC_RELAXED);
+        stats->steals += __atomic_load_n(&workers[i].steals, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&poolLock);
+
+    stats->queued = __atomic_load_n(&queuedTasks, __ATOMIC_RELAXED);
+    stats->peakQueued = __atomic_load_n(&peakQueued, __ATOMIC_RELAXED);
+    stats->submitted = __atomic_load_n(&submittedTasks, __ATOMIC_RELAXED);
+}
+
+void task_pool_stop(void) {
+    pthread_mutex_lock(&poolLock);
+    __atomic_store_n(&poolStopping, true, __ATOMIC_RELEASE);
+    int count = workerCount;
+    pthread_mutex_unlock(&poolLock);
+    wake(&wakeSequence, INT_MAX);
+
+    // The event worker last, so it still drains the log while the tasks
+    // finish.
+    for (int i = 1; i < count; i++) pthread_join(workers[i].thread, NULL);
+    __atomic_store_n(&tasksJoined, true, __ATOMIC_RELEASE);
+    wake(&eventSequence, 1);
+    if (count) pthread_join(workers[EVENT_WORKER].thread, NULL);
+    __atomic_store_n(&poolRunning, false, __ATOMIC_RELEASE);
+    // An event raised while the last worker was on its way out.
+    run_events();
+
+    if (count && logOutPut)
+    {
+        OSMesaBridgeTaskPoolStats stats;
+        OSMesaBridgeGetTaskPoolStats(&stats);
+        OSM_LOGI("Task pool ran %llu of %llu tasks, %llu stolen, peak queue %u",
+                (unsigned long long)stats.executed, (unsigned long long)stats.submitted,
+                (unsigned long long)stats.steals, stats.peakQueued);
+    }
+
+    pthread_mutex_lock(&poolLock);
+    for (int i = 0; i < count; i++)
+    {
+        free(workers[i].tasks);
+        workers[i].tasks = NULL;
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+    workerCount = 0;
+    pthread_mutex_unlock(&poolLock);
+}
@@ -0,0 +1,42 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <stdbool.h>
+
+// Shared pool for the background work of the bridge: log and trace
+// writing, call stats reports, background context destruction and the
+// like. Only threads that keep a GL context current (the offload and
+// upload workers) or block in a system call for good (the env.txt
+// watcher) are separate. Each worker owns a deque: it runs its own tasks
+// newest first and steals the oldest ones from other workers when idle.
+// Tasks submitted from a worker stay on that worker's deque. Events run
+// on a worker of their own, so a long task never delays them.
+
+typedef void (*TaskFn)(void *arg);
+
+// Requests that come from places which must not take a lock: signal
+// handlers, and the logger, which the pool itself calls. Raising an event
+// is lock-free and async-signal-safe; a worker then runs its handler
+// (with a NULL argument) once, however often it was raised in between.
+// Handlers run one at a time on the event worker and should be short.
+typedef enum {
+    TASK_EVENT_LOG,
+    TASK_EVENT_CALL_STATS,
+    TASK_EVENT_TRACE,
+    TASK_EVENT_COUNT
+} TaskEvent;
+
+// Task workers; 0 sizes the pool from the online core count. The event
+// worker comes on top.
+void task_pool_configure(int threads);
+// Returns false if the task was not queued and the caller must handle it.
+bool task_pool_submit(TaskFn fn, void *arg);
+// Install the handler for event and start the pool. Returns false when
+// there are no workers to run it.
+bool task_pool_on_event(TaskEvent event, TaskFn fn);
+// Returns false once the pool is stopped or before it was started.
+bool task_pool_raise(TaskEvent event);
+// Run everything still queued and join the workers.
+void task_pool_stop(void);
+
+#endif // TASK_POOL_H
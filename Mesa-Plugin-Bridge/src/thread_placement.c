@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "internal.h"
+#include "cpu_topology.h"
+#include "thread_placement.h"
+#include "task_pool.h"
+#include "log.h"
+
+#define TASK_DIR "/proc/self/task"
+#define RESCAN_INTERVAL_NS 1000000000LL
+
+bool threadPlacementEnabled = false;
+static PlacementPolicy workerPolicy = PLACEMENT_ALL;
+// Mesa names util_queue threads "<process>:<queue><n>", llvmpipe names its
+// rasterizers "llvmpipe-<n>". Entries match the part after the colon.
+static char workerNames[256] = "gl,llvmpipe-,zs,sh";
+static int renderNice = 0;
+
+static pid_t renderThread = 0;
+static pthread_mutex_t scanLock = PTHREAD_MUTEX_INITIALIZER;
+static long long lastScanNs = 0;
+static nlink_t lastTaskLinks = 0;
+// What the render thread and the workers were last placed on, so a rescan
+// notices cores going offline or coming back.
+static CpuTopology placedTopology;
+
+void thread_placement_configure(bool enabled, PlacementPolicy policy, const char *names, int nice) {
+    threadPlacementEnabled = enabled;
+    workerPolicy = policy;
+    renderNice = nice;
+    if (names && *names)
+    {
+        strncpy(workerNames, names, sizeof(workerNames) - 1);
+        workerNames[sizeof(workerNames) - 1] = '\0';
+    }
+}
+
+bool thread_placement_parse_policy(const char *value, PlacementPolicy *policy) {
+    if (!strcmp(value, "all")) *policy = PLACEMENT_ALL;
+    else if (!strcmp(value, "big")) *policy = PLACEMENT_BIG;
+    else if (!strcmp(value, "little")) *policy = PLACEMENT_LITTLE;
+    else return false;
+    return true;
+}
+
+static pid_t current_tid(void) {
+    return (pid_t)syscall(SYS_gettid);
+}
+
+static bool is_worker_name(const char *comm) {
+    const char *queue = strrchr(comm, ':');
+    queue = queue ? queue + 1 : comm;
+
+    const char *entry = workerNames;
+    while (*entry)
+    {
+        size_t length = strcspn(entry, ",");
+        if (length && !strncmp(queue, entry, length)) return true;
+        entry += length;
+        if (*entry == ',') entry++;
+    }
+    return false;
+}
+
+static void place_workers(const CpuTopology *topology) {
+    const cpu_set_t *set = &topology->online;
+    if (workerPolicy == PLACEMENT_BIG) set = &topology->big;
+    if (workerPolicy == PLACEMENT_LITTLE) set = &topology->little;
+
+    DIR *dir = opendir(TASK_DIR);
+    if (!dir) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)))
+    {
+        pid_t tid = (pid_t)atoi(entry->d_name);
+        if (tid <= 0 || tid == renderThread) continue;
+
+        char path[64];
+        char comm[32] = {0};
+        snprintf(path, sizeof(path), TASK_DIR "/%d/comm", tid);
+        FILE *file = fopen(path, "r");
+        if (!file) continue;
+        if (!fgets(comm, sizeof(comm), file)) comm[0] = '\0';
+        fclose(file);
+        comm[strcspn(comm, "\n")] = '\0';
+
+        if (!is_worker_name(comm)) continue;
+        if (sched_setaffinity(tid, sizeof(cpu_set_t), set) != 0)
+        {
+            OSM_LOGW("Failed to place thread %d (%s)", tid, comm);
+            continue;
+        }
+        OSM_LOGI("Placed Mesa worker %d (%s)", tid, comm);
+    }
+    closedir(dir);
+}
+
+static void rescan_task(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&scanLock);
+
+    CpuTopology topology;
+    bool replace = false;
+    if (cpu_topology_detect_current(&topology) && !CPU_EQUAL(&topology.online, &placedTopology.online))
+    {
+        OSM_LOGI("Online cores changed from %d to %d, placing threads again",
+                placedTopology.onlineCount, topology.onlineCount);
+        if (sched_setaffinity(renderThread, sizeof(cpu_set_t), &topology.big) != 0)
+        {
+            OSM_LOGW("Failed to pin render thread %d", renderThread);
+        }
+        placedTopology = topology;
+        replace = true;
+    }
+
+    struct stat st;
+    if (stat(TASK_DIR, &st) == 0 && st.st_nlink != lastTaskLinks)
+    {
+        lastTaskLinks = st.st_nlink;
+        replace = true;
+    }
+    if (replace) place_workers(&placedTopology);
+    pthread_mutex_unlock(&scanLock);
+}
+
+// Mesa spawns its workers lazily and cores can go offline or come back at
+// any time, so look again at most once per second.
+static void maybe_rescan(void) {
+    long long now = bridge_now_ns();
+    long long last = __atomic_load_n(&lastScanNs, __ATOMIC_RELAXED);
+    if (now - last < RESCAN_INTERVAL_NS) return;
+    if (!__atomic_compare_exchange_n(&lastScanNs, &last, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return;
+    if (!task_pool_submit(rescan_task, NULL)) rescan_task(NULL);
+}
+
+void thread_placement_on_make_current(void) {
+    if (!threadPlacementEnabled) return;
+
+    const CpuTopology *topology = cpu_topology_get();
+    if (!topology) return;
+
+    pid_t self = current_tid();
+    if (__sync_bool_compare_and_swap(&renderThread, 0, self))
+    {
+        pthread_mutex_lock(&scanLock);
+        placedTopology = *topology;
+        pthread_mutex_unlock(&scanLock);
+
+        if (sched_setaffinity(0, sizeof(cpu_set_t), &topology->big) == 0)
+        {
+            OSM_LOGI("Pinned render thread %d to %d big cores", self, topology->bigCount);
+        }
+        else
+        {
+            OSM_LOGW("Failed to pin render thread %d", self);
+        }
+        // Takes effect for this thread only; Mesa's workers keep theirs.
+        if (renderNice && setpriority(PRIO_PROCESS, (id_t)self, renderNice) != 0)
+        {
+            OSM_LOGW("Failed to set render thread %d to nice %d", self, renderNice);
+        }
+        else if (renderNice)
+        {
+            OSM_LOGI("Render thread %d runs at nice %d", self, renderNice);
+        }
+    }
+    if (self == renderThread) maybe_rescan();
+}
+
+void thread_placement_on_frame(void) {
+    if (renderThread && current_tid() == renderThread) maybe_rescan();
+}
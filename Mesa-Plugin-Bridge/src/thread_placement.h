@@ -0,0 +1,29 @@
+#ifndef THREAD_PLACEMENT_H
+#define THREAD_PLACEMENT_H
+
+#include <stdbool.h>
+
+// Keeps the render thread on big cores and moves Mesa's own workers
+// (glthread, llvmpipe rasterizers, shader compilers) according to
+// OSM_WORKER_CORES, so the scheduler stops migrating the GL thread. The
+// render thread also gets OSM_RENDER_NICE. Both are redone when cores go
+// offline or come back.
+
+typedef enum {
+    PLACEMENT_ALL,
+    PLACEMENT_BIG,
+    PLACEMENT_LITTLE,
+} PlacementPolicy;
+
+__attribute__((visibility("hidden"))) extern bool threadPlacementEnabled;
+
+void thread_placement_configure(bool enabled, PlacementPolicy workerPolicy, const char *workerNames, int renderNice);
+bool thread_placement_parse_policy(const char *value, PlacementPolicy *policy);
+// Called after every successful OSMesaMakeCurrent. The first caller
+// becomes the render thread.
+void thread_placement_on_make_current(void);
+// Called at the end of every frame, so a hotplug is noticed without a
+// MakeCurrent. The rescan itself runs on the task pool.
+void thread_placement_on_frame(void);
+
+#endif // THREAD_PLACEMENT_H
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "internal.h"
+#include "timeline.h"
+#include "task_pool.h"
+#include "log.h"
+
+// GPU spans of a thread go on a track of their own, next to it.
+#define GPU_TRACK (1 << 30)
+
+typedef struct {
+    const char *name;
+    long long startNs;
+    long long endNs;
+    bool gpu;
+} Span;
+
+// One per recording thread, written by that thread only. The writer
+// reads count to find the latest TIMELINE_SPANS spans.
+typedef struct TimelineRing {
+    Span spans[TIMELINE_SPANS];
+    unsigned long long count;
+    long long lastFrameNs;
+    bool hasGpu;
+    int tid;
+    char threadName[16];
+    struct TimelineRing *next;
+} TimelineRing;
+
+bool timelineEnabled = false;
+static TimelineRing *rings = NULL;
+static __thread TimelineRing *ownRing = NULL;
+static char timelinePath[256];
+static long long originNs = 0;
+static long long deadlineNs = 0;
+static bool written = true;
+
+static TimelineRing* attach_ring(void) {
+    TimelineRing *ring = calloc(1, sizeof(TimelineRing));
+    if (!ring)
+    {
+        timelineEnabled = false;
+        OSM_LOGE("Out of memory for the timeline, recording stopped");
+        return NULL;
+    }
+    ring->tid = (int)syscall(SYS_gettid);
+    pthread_getname_np(pthread_self(), ring->threadName, sizeof(ring->threadName));
+
+    ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    ownRing = ring;
+    return ring;
+}
+
+static void write_json_string(FILE *out, const char *value) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char*)value; *p; p++)
+    {
+        if (*p == '"' || *p == '\\') fprintf(out, "\\%c", *p);
+        else if (*p < 0x20) fprintf(out, "\\u%04x", *p);
+        else fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+static void write_file(void) {
+    if (__atomic_exchange_n(&written, true, __ATOMIC_ACQ_REL)) return;
+    __atomic_store_n(&timelineEnabled, false, __ATOMIC_RELAXED);
+
+    FILE *out = fopen(timelinePath, "w");
+    if (!out)
+    {
+        OSM_LOGE("Failed to create timeline %s: %s", timelinePath, strerror(errno));
+        return;
+    }
+
+    int pid = (int)getpid();
+    unsigned long long spans = 0;
+    unsigned int threads = 0;
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"OSM Plugin Bridge\"}}", pid);
+    for (TimelineRing *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+    {
+        threads++;
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", pid, ring->tid);
+        write_json_string(out, ring->threadName[0] ? ring->threadName : "thread");
+        fprintf(out, "}}");
+        if (__atomic_load_n(&ring->hasGpu, __ATOMIC_ACQUIRE))
+        {
+            fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"GPU of %d\"}}",
+                    pid, ring->tid | GPU_TRACK, ring->tid);
+        }
+
+        // A thread still inside timeline_span() may be overwriting the
+        // oldest slot, so that one is left out once the ring wrapped.
+        unsigned long long count = __atomic_load_n(&ring->count, __ATOMIC_ACQUIRE);
+        unsigned long long first = count > TIMELINE_SPANS ? count - TIMELINE_SPANS + 1 : 0;
+        for (unsigned long long i = first; i < count; i++)
+        {
+            const Span *span = &ring->spans[i % TIMELINE_SPANS];
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    span->name, pid, span->gpu ? ring->tid | GPU_TRACK : ring->tid, (span->startNs - originNs) / 1e3, (span->endNs - span->startNs) / 1e3);
+            spans++;
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    bool failed = ferror(out) != 0;
+    if (fclose(out) != 0) failed = true;
+    if (failed)
+    {
+        OSM_LOGE("Failed to write timeline %s", timelinePath);
+        return;
+    }
+    OSM_LOGI("Wrote timeline %s: %llu spans from %u threads", timelinePath, spans, threads);
+}
+
+static void write_task(void *arg) {
+    (void)arg;
+    write_file();
+}
+
+bool timeline_start(const char *path, int seconds, long long loadNs) {
+    if (!path || !path[0] || !written) return false;
+    snprintf(timelinePath, sizeof(timelinePath), "%s", path);
+
+    originNs = loadNs;
+    deadlineNs = seconds > 0 ? originNs + seconds * 1000000000LL : 0;
+    __atomic_store_n(&written, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&timelineEnabled, true, __ATOMIC_RELEASE);
+    if (logOutPut)
+    {
+        if (seconds > 0) OSM_LOGI("Recording a %d s timeline to %s", seconds, timelinePath);
+        else OSM_LOGI("Recording a timeline to %s until exit", timelinePath);
+    }
+    return true;
+}
+
+void timeline_stop(void) {
+    write_file();
+    // Rings stay allocated: a game thread may still be inside a span.
+}
+
+static void record(const char *name, long long startNs, long long endNs, bool gpu) {
+    if (!__atomic_load_n(&timelineEnabled, __ATOMIC_RELAXED)) return;
+    if (deadlineNs && endNs > deadlineNs)
+    {
+        // Whichever thread crosses the deadline first stops recording and
+        // hands the write to the task pool, so no frame pays for it.
+        if (__atomic_exchange_n(&timelineEnabled, false, __ATOMIC_RELAXED) && !task_pool_submit(write_task, NULL)) write_file();
+        return;
+    }
+    TimelineRing *ring = ownRing ? ownRing : attach_ring();
+    if (!ring) return;
+
+    unsigned long long count = ring->count;
+    ring->spans[count % TIMELINE_SPANS] = (Span){ name, startNs, endNs, gpu };
+    if (gpu && !ring->hasGpu) __atomic_store_n(&ring->hasGpu, true, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->count, count + 1, __ATOMIC_RELEASE);
+}
+
+void timeline_span(const char *name, long long startNs, long long endNs) {
+    record(name, startNs, endNs, false);
+}
+
+void timeline_gpu_span(const char *name, long long startNs, long long endNs) {
+    record(name, startNs, endNs, true);
+}
+
+void timeline_frame(const char *name, long long startNs, long long endNs) {
+    TimelineRing *ring = ownRing;
+    if (ring && ring->lastFrameNs) timeline_span("GL work", ring->lastFrameNs, startNs);
+    timeline_span(name, startNs, endNs);
+    if (ownRing) ownRing->lastFrameNs = endNs;
+}
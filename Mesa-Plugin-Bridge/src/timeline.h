@@ -0,0 +1,35 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdbool.h>
+
+// OSM_TIMELINE=<file> records named spans for the stages of starting up
+// and the phases of every frame (make current, GL work, glFinish,
+// readback, HUD, present), plus their GPU time with OSM_GPU_TIMING, and
+// writes them as Chrome trace event JSON, which chrome://tracing and
+// ui.perfetto.dev open directly. Times count from library load. Each
+// thread keeps its latest TIMELINE_SPANS spans in its own ring. With
+// OSM_TIMELINE_SECONDS=<n> recording stops n seconds after loading and
+// the file is written on the task pool; otherwise it is written at exit.
+
+#define TIMELINE_SPANS 32768
+
+// Checked before taking any timestamp; only timeline_start() sets it.
+__attribute__((visibility("hidden"))) extern bool timelineEnabled;
+
+// Times in the file count from loadNs, when the library was loaded.
+// Returns false if path is empty or recording could not start.
+bool timeline_start(const char *path, int seconds, long long loadNs);
+// Write the file if that has not happened yet.
+void timeline_stop(void);
+
+// A span on the calling thread. name must outlive the library, a string
+// literal in practice.
+void timeline_span(const char *name, long long startNs, long long endNs);
+// A span measured on the GPU for work this thread submitted, in CPU clock.
+void timeline_gpu_span(const char *name, long long startNs, long long endNs);
+// A frame boundary named name on this thread, also recording the GL work
+// since the previous boundary.
+void timeline_frame(const char *name, long long startNs, long long endNs);
+
+#endif // TIMELINE_H
@@ -0,0 +1,242 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <GL/gl.h>
+
+// File format of OSM_TRACE, shared by the recorder in gl_trace.c and
+// tools/osm-replay.c.
+//
+// A 24 byte header (magic, version, number of opcodes and a hash of the
+// gl_commands.h names, all u32 little endian after the magic) is followed
+// by chunks: varint thread, varint length, then that many bytes of
+// records from one recording thread. Records are a varint opcode and its
+// fields. Every field is coded against the same field of the previous
+// record with that opcode on that thread: integers and pointers as a
+// zigzag varint of the difference, floats as a varint of the XOR of
+// their bits. Array payloads follow as a varint byte count and raw bytes.
+//
+// Uploads too large for one record are split: a BufferData or TexImage
+// without data followed by SubData or SubImage records, and client arrays
+// in several ClientArray records at increasing offsets.
+
+#define TRACE_MAGIC "OSMTRACE"
+#define TRACE_VERSION 2
+#define TRACE_HEADER_SIZE 24
+#define TRACE_MAX_ARGS 11
+
+// Object kinds of TRACE_GenNames and TRACE_DeleteNames, by the suffix of
+// their glGen* and glDelete* calls.
+#define TRACE_NAME_KINDS(X) \
+    X(Textures) \
+    X(Buffers) \
+    X(VertexArrays) \
+    X(Framebuffers) \
+    X(Renderbuffers) \
+    X(Queries) \
+    X(Samplers)
+
+typedef enum {
+#define X(n) TRACE_NAMES_##n,
+    TRACE_NAME_KINDS(X)
+#undef X
+    TRACE_NAME_KIND_COUNT
+} TraceNameKind;
+
+// Client array slots of TRACE_ClientArray.
+#define TRACE_ARRAY_VERTEX 0
+#define TRACE_ARRAY_NORMAL 1
+#define TRACE_ARRAY_COLOR 2
+#define TRACE_ARRAY_TEXCOORD 3      // + texture unit
+#define TRACE_TEXCOORD_UNITS 8
+#define TRACE_ARRAY_ATTRIB (TRACE_ARRAY_TEXCOORD + TRACE_TEXCOORD_UNITS) // + attribute index
+#define TRACE_ATTRIBS 16
+#define TRACE_ARRAY_SLOTS (TRACE_ARRAY_ATTRIB + TRACE_ATTRIBS)
+
+// TRACE_ClientArray flags of generic attributes.
+#define TRACE_ARRAY_NORMALIZED 1
+#define TRACE_ARRAY_INTEGER 2
+
+#define TRACE_OP(n) TRACE_##n
+
+typedef enum {
+    TRACE_CreateContext,        // format, sharelist, context
+    TRACE_MakeCurrent,          // context, type, width, height
+    TRACE_DestroyContext,       // context
+    TRACE_PixelStore,           // pname, value
+    TRACE_ReadPixels,           // x, y, width, height, format, type, pixels
+    TRACE_Finish,               // ns since the previous frame on this thread
+    TRACE_FlushFrontbuffer,     // same
+    TRACE_Name,                 // id, name as payload
+    TRACE_Untraced,             // id of a TRACE_Name: a call with unknown arguments
+    TRACE_DeleteBuffers,        // n, names as payload
+    TRACE_DeleteVertexArrays,   // n, names as payload
+    TRACE_VertexArrayElementBuffer, // vaobj, buffer
+    TRACE_GenNames,             // kind, n, names as payload
+    TRACE_DeleteNames,          // kind, n, names as payload
+    TRACE_CreateShader,         // type, shader
+    TRACE_CreateProgram,        // program
+    TRACE_ShaderSource,         // shader, the strings joined as payload
+    TRACE_CompileShader,        // shader
+    TRACE_AttachShader,         // program, shader
+    TRACE_DetachShader,         // program, shader
+    TRACE_LinkProgram,          // program
+    TRACE_DeleteShader,         // shader
+    TRACE_DeleteProgram,        // program
+    TRACE_BindAttribLocation,   // program, index, name as payload
+    TRACE_BufferData,           // target, size, usage, data as payload (empty for NULL)
+    TRACE_BufferSubData,        // target, offset, data as payload
+    // The pixels field is an unpack buffer offset when one is bound;
+    // otherwise the payload holds everything GL read from client memory
+    // under the unpack state of the time, or nothing for NULL.
+    TRACE_TexImage2D,           // target, level, internalformat, width, height, border, format, type, pixels
+    TRACE_TexSubImage2D,        // target, level, xoffset, yoffset, width, height, format, type, pixels
+    TRACE_TexImage3D,           // target, level, internalformat, width, height, depth, border, format, type, pixels
+    TRACE_TexSubImage3D,        // target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels
+    // Ahead of every draw: the client arrays it reads, from start bytes
+    // past their pointer on, then ClientIndices for client memory indices,
+    // then ClientDraw.
+    TRACE_ClientArray,          // slot, size, type, stride, flags, start, offset; bytes as payload
+    TRACE_ClientIndices,        // offset; bytes as payload
+    TRACE_ClientDraw,           // captured: whether replaying the draw reads only what the trace holds
+#define GL_CMD0(n) TRACE_OP(n),
+#define GL_CMD1(n, ...) TRACE_OP(n),
+#define GL_CMD2(n, ...) TRACE_OP(n),
+#define GL_CMD3(n, ...) TRACE_OP(n),
+#define GL_CMD4(n, ...) TRACE_OP(n),
+#define GL_CMD5(n, ...) TRACE_OP(n),
+#define GL_CMD6(n, ...) TRACE_OP(n),
+#define GL_UNIFORMV(n, ...) TRACE_OP(n),       // location, count, values as payload
+#define GL_UNIFORM_MATRIX(n, ...) TRACE_OP(n), // location, count, transpose, values as payload
+#define GL_MATRIX(n) TRACE_OP(n),              // 16 floats as payload
+#include "gl_commands.h"
+#undef GL_CMD0
+#undef GL_CMD1
+#undef GL_CMD2
+#undef GL_CMD3
+#undef GL_CMD4
+#undef GL_CMD5
+#undef GL_CMD6
+#undef GL_UNIFORMV
+#undef GL_UNIFORM_MATRIX
+#undef GL_MATRIX
+    TRACE_OP_COUNT
+} TraceOp;
+
+// Coding state of one thread's stream, the same on both sides.
+typedef struct {
+    uint64_t last[TRACE_OP_COUNT][TRACE_MAX_ARGS];
+} TraceDelta;
+
+static inline uint32_t trace_table_hash(void) {
+    static const char *const names[] = {
+#define GL_CMD0(n) #n,
+#define GL_CMD1(n, ...) #n,
+#define GL_CMD2(n, ...) #n,
+#define GL_CMD3(n, ...) #n,
+#define GL_CMD4(n, ...) #n,
+#define GL_CMD5(n, ...) #n,
+#define GL_CMD6(n, ...) #n,
+#define GL_UNIFORMV(n, ...) #n,
+#define GL_UNIFORM_MATRIX(n, ...) #n,
+#define GL_MATRIX(n) #n,
+#include "gl_commands.h"
+#undef GL_CMD0
+#undef GL_CMD1
+#undef GL_CMD2
+#undef GL_CMD3
+#undef GL_CMD4
+#undef GL_CMD5
+#undef GL_CMD6
+#undef GL_UNIFORMV
+#undef GL_UNIFORM_MATRIX
+#undef GL_MATRIX
+    };
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        for (const char *p = names[i]; *p; p++) hash = (hash ^ (unsigned char)*p) * 16777619u;
+        hash = (hash ^ ',') * 16777619u;
+    }
+    return hash;
+}
+
+static inline unsigned char* trace_put_varint(unsigned char *p, uint64_t value) {
+    while (value >= 0x80)
+    {
+        *p++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+    return p;
+}
+
+// Returns NULL when the varint runs past end.
+static inline const unsigned char* trace_get_varint(const unsigned char *p, const unsigned char *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        unsigned char byte = *p++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// A field's bits and whether it is coded as a float.
+static inline uint64_t trace_int_bits(int64_t value) { return (uint64_t)value; }
+static inline uint64_t trace_pointer_bits(const void *value) { return (uint64_t)(uintptr_t)value; }
+static inline uint64_t trace_float_bits(float value) { uint32_t bits; memcpy(&bits, &value, 4); return bits; }
+static inline uint64_t trace_double_bits(double value) { uint64_t bits; memcpy(&bits, &value, 8); return bits; }
+
+#define TRACE_BITS(x) _Generic((x), \
+    float: trace_float_bits, \
+    double: trace_double_bits, \
+    const void*: trace_pointer_bits, \
+    default: trace_int_bits)(x)
+#define TRACE_IS_FLOAT(x) _Generic((x), float: true, double: true, default: false)
+
+static inline uint64_t trace_encode(uint64_t *last, uint64_t bits, bool isFloat) {
+    uint64_t delta = bits - *last;
+    uint64_t coded = isFloat ? bits ^ *last : (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+    *last = bits;
+    return coded;
+}
+
+static inline uint64_t trace_decode(uint64_t *last, uint64_t coded, bool isFloat) {
+    uint64_t bits = isFloat ? coded ^ *last : *last + ((coded >> 1) ^ (0 - (coded & 1)));
+    *last = bits;
+    return bits;
+}
+
+static inline void trace_int_from_bits(uint64_t bits, void *out, size_t size) {
+    // Integer fields are stored sign extended; keep the low bytes.
+    switch (size)
+    {
+        case 1: { uint8_t v = (uint8_t)bits; memcpy(out, &v, 1); break; }
+        case 2: { uint16_t v = (uint16_t)bits; memcpy(out, &v, 2); break; }
+        case 4: { uint32_t v = (uint32_t)bits; memcpy(out, &v, 4); break; }
+        default: memcpy(out, &bits, 8); break;
+    }
+}
+
+// Decode into *out, whose type picks the coding.
+#define TRACE_FROM_BITS(bits, out) _Generic(*(out), \
+    float: trace_float_from_bits, \
+    double: trace_double_from_bits, \
+    const void*: trace_pointer_from_bits, \
+    default: trace_any_from_bits)(bits, out, sizeof(*(out)))
+
+static inline void trace_float_from_bits(uint64_t bits, float *out, size_t size) { (void)size; uint32_t v = (uint32_t)bits; memcpy(out, &v, 4); }
+static inline void trace_double_from_bits(uint64_t bits, double *out, size_t size) { (void)size; memcpy(out, &bits, 8); }
+static inline void trace_pointer_from_bits(uint64_t bits, const void **out, size_t size) { (void)size; *out = (const void*)(uintptr_t)bits; }
+static inline void trace_any_from_bits(uint64_t bits, void *out, size_t size) { trace_int_from_bits(bits, out, size); }
+
+#endif // TRACE_FORMAT_H
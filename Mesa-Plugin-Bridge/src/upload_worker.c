@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "bridge.h"
+#include "internal.h"
+#include "upload_worker.h"
+#include "gl_offload.h"
+#include "context_pool.h"
+#include "runtime_config.h"
+#include "log.h"
+
+typedef enum {
+    UPLOAD_BUFFER_DATA,
+    UPLOAD_TEX_SUB_IMAGE_2D,
+} UploadKind;
+
+typedef struct UploadJob {
+    UploadKind kind;
+    GLuint name;
+    GLenum usage;
+    GLint level, xoffset, yoffset;
+    GLsizei width, height;
+    GLenum format, type;
+    size_t size;
+    bool hasData;
+    struct UploadJob *next;
+    unsigned char data[];
+} UploadJob;
+
+static struct {
+    void (*BindBuffer)(GLenum, GLuint);
+    void (*BufferData)(GLenum, GLsizeiptr, const void*, GLenum);
+    void (*BindTexture)(GLenum, GLuint);
+    void (*TexSubImage2D)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*);
+    void (*PixelStorei)(GLenum, GLint);
+    void (*GetIntegerv)(GLenum, GLint*);
+    GLsync (*FenceSync)(GLenum, GLbitfield);
+    void (*WaitSync)(GLsync, GLbitfield, GLuint64);
+    void (*DeleteSync)(GLsync);
+    void (*Flush)(void);
+    void (*Finish)(void);
+} gl;
+
+static pthread_mutex_t uploadLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uploadCond = PTHREAD_COND_INITIALIZER;
+static pthread_t workerThread;
+static bool workerRunning = false;
+static bool workerStopping = false;
+static bool workerFailed = false;
+static bool workerReady = false;
+static OSMesaContext workerParent = NULL;
+static UploadJob *queueHead = NULL;
+static UploadJob *queueTail = NULL;
+static size_t queuedBytes = 0;
+static unsigned long long submittedSeq = 0;
+static unsigned long long completedSeq = 0;
+static GLsync completedFence = NULL;
+static pthread_once_t loadOnce = PTHREAD_ONCE_INIT;
+static bool procsLoaded = false;
+
+static void load_once(void) {
+    #define LOAD_PROC(name) gl.name = (__typeof__(gl.name))bridge_get_proc("gl" #name); if (!gl.name) return;
+    LOAD_PROC(BindBuffer);
+    LOAD_PROC(BufferData);
+    LOAD_PROC(BindTexture);
+    LOAD_PROC(TexSubImage2D);
+    LOAD_PROC(PixelStorei);
+    LOAD_PROC(GetIntegerv);
+    LOAD_PROC(WaitSync);
+    LOAD_PROC(DeleteSync);
+    LOAD_PROC(Flush);
+    LOAD_PROC(Finish);
+    LOAD_PROC(FenceSync);
+    #undef LOAD_PROC
+    procsLoaded = true;
+}
+
+static bool load_procs(void) {
+    pthread_once(&loadOnce, load_once);
+    return procsLoaded;
+}
+
+static void run_job(const UploadJob *job) {
+    const void *data = job->hasData ? job->data : NULL;
+    switch (job->kind)
+    {
+        case UPLOAD_BUFFER_DATA:
+            gl.BindBuffer(GL_ARRAY_BUFFER, job->name);
+            gl.BufferData(GL_ARRAY_BUFFER, (GLsizeiptr)job->size, data, job->usage);
+            break;
+        case UPLOAD_TEX_SUB_IMAGE_2D:
+            gl.BindTexture(GL_TEXTURE_2D, job->name);
+            gl.TexSubImage2D(GL_TEXTURE_2D, job->level, job->xoffset, job->yoffset, job->width, job->height, job->format, job->type, data);
+            break;
+    }
+}
+
+static void* worker_main(void *arg) {
+    OSMesaContext parent = (OSMesaContext)arg;
+    OSMesaContext ctx = real_OSMesaCreateContext(OSMESA_RGBA, parent);
+    // Marks the parent as sharing, so the pool never resets it under us.
+    context_pool_on_create(ctx, OSMESA_RGBA, parent);
+    if (!ctx || !bridge_bind_scratch(ctx, GL_UNSIGNED_BYTE))
+    {
+        OSM_LOGE("Failed to create upload worker context");
+        if (ctx)
+        {
+            context_pool_forget(ctx);
+            real_OSMesaDestroyContext(ctx);
+        }
+        pthread_mutex_lock(&uploadLock);
+        workerFailed = true;
+        pthread_cond_broadcast(&uploadCond);
+        pthread_mutex_unlock(&uploadLock);
+        return NULL;
+    }
+    // Texture jobs hold their rows tightly packed.
+    gl.PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    pthread_mutex_lock(&uploadLock);
+    workerReady = true;
+    for (;;)
+    {
+        while (!queueHead && !workerStopping) pthread_cond_wait(&uploadCond, &uploadLock);
+        if (!queueHead) break;
+
+        UploadJob *batch = queueHead;
+        unsigned long long batchSeq = submittedSeq;
+        queueHead = queueTail = NULL;
+        pthread_mutex_unlock(&uploadLock);
+
+        size_t batchBytes = 0;
+        while (batch)
+        {
+            UploadJob *next = batch->next;
+            run_job(batch);
+            batchBytes += batch->size;
+            free(batch);
+            batch = next;
+        }
+        GLsync fence = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        gl.Flush();
+
+        pthread_mutex_lock(&uploadLock);
+        if (completedFence) gl.DeleteSync(completedFence);
+        completedFence = fence;
+        completedSeq = batchSeq;
+        queuedBytes -= batchBytes;
+        pthread_cond_broadcast(&uploadCond);
+    }
+
+    // Without a fence left to wait on, the uploads must be complete
+    // before the parent carries on.
+    gl.Finish();
+    if (completedFence) gl.DeleteSync(completedFence);
+    completedFence = NULL;
+    pthread_mutex_unlock(&uploadLock);
+
+    real_OSMesaMakeCurrent(NULL, NULL, 0, 0, 0);
+    context_pool_forget(ctx);
+    real_OSMesaDestroyContext(ctx);
+    return NULL;
+}
+
+// Called with uploadLock held. Waits for queued work, then stops the
+// worker. The lock is dropped while joining, so a second caller coming in
+// meanwhile waits for the first to finish instead of joining as well.
+static void stop_worker_locked(void) {
+    if (!workerRunning) return;
+    if (workerStopping)
+    {
+        while (workerRunning) pthread_cond_wait(&uploadCond, &uploadLock);
+        return;
+    }
+
+    workerStopping = true;
+    pthread_cond_broadcast(&uploadCond);
+    pthread_mutex_unlock(&uploadLock);
+    pthread_join(workerThread, NULL);
+    pthread_mutex_lock(&uploadLock);
+
+    workerRunning = false;
+    workerStopping = false;
+    workerFailed = false;
+    workerReady = false;
+    workerParent = NULL;
+    pthread_cond_broadcast(&uploadCond);
+}
+
+// Called with uploadLock held.
+static bool ensure_worker_locked(void) {
+    if (!currentContext || !real_OSMesaCreateContext || !load_procs() || workerStopping) return false;
+
+    // Objects named by the caller only resolve in its share group, so a
+    // different current context needs a worker sharing with that one.
+    if (workerRunning && workerParent != currentContext) stop_worker_locked();
+    if (workerRunning) return workerReady && !workerFailed;
+
+    // Creating the worker context can take as long as the game's own did,
+    // so uploads stay on the caller until the worker reports ready.
+    workerParent = currentContext;
+    if (pthread_create(&workerThread, NULL, worker_main, workerParent) != 0)
+    {
+        workerParent = NULL;
+        return false;
+    }
+    workerRunning = true;
+    return false;
+}
+
+static GLboolean submit(UploadJob *job) {
+    pthread_mutex_lock(&uploadLock);
+    if (queuedBytes + job->size > RUNTIME_CONFIG_GET(uploadQueueBytes) || !ensure_worker_locked())
+    {
+        pthread_mutex_unlock(&uploadLock);
+        free(job);
+        return GL_FALSE;
+    }
+
+    if (queueTail)
+    {
+        queueTail->next = job;
+    }
+    else
+    {
+        queueHead = job;
+    }
+    queueTail = job;
+    queuedBytes += job->size;
+    submittedSeq++;
+    pthread_cond_broadcast(&uploadCond);
+    pthread_mutex_unlock(&uploadLock);
+    return GL_TRUE;
+}
+
+// The caller copies the data into job->data when hasData is set.
+static UploadJob* new_job(UploadKind kind, size_t size, bool hasData) {
+    UploadJob *job = malloc(sizeof(UploadJob) + (hasData ? size : 0));
+    if (!job) return NULL;
+    memset(job, 0, sizeof(UploadJob));
+    job->kind = kind;
+    job->size = size;
+    job->hasData = hasData;
+    return job;
+}
+
+static size_t pixel_size(GLenum format, GLenum type) {
+    size_t components;
+    switch (format)
+    {
+        case GL_RED: case GL_ALPHA: case GL_LUMINANCE: case GL_RED_INTEGER: components = 1; break;
+        case GL_RG: case GL_LUMINANCE_ALPHA: case GL_RG_INTEGER: components = 2; break;
+        case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: components = 3; break;
+        case GL_RGBA: case GL_BGRA: case GL_RGBA_INTEGER: components = 4; break;
+        default: return 0;
+    }
+    switch (type)
+    {
+        case GL_UNSIGNED_BYTE: case GL_BYTE: return components;
+        case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: return components * 2;
+        case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT: return components * 4;
+        case GL_UNSIGNED_SHORT_5_6_5: case GL_UNSIGNED_SHORT_4_4_4_4: case GL_UNSIGNED_SHORT_5_5_5_1: return 2;
+        case GL_UNSIGNED_INT_8_8_8_8: case GL_UNSIGNED_INT_8_8_8_8_REV: case GL_UNSIGNED_INT_2_10_10_10_REV: return 4;
+        default: return 0;
+    }
+}
+
+EXPORT
+GLboolean OSMesaBridgeBufferDataAsync(GLuint buffer, GLsizeiptr size, const void *data, GLenum usage) {
+    if (!buffer || size < 0 || (size_t)size < RUNTIME_CONFIG_GET(uploadMinBytes)) return GL_FALSE;
+
+    UploadJob *job = new_job(UPLOAD_BUFFER_DATA, (size_t)size, data != NULL);
+    if (!job) return GL_FALSE;
+    if (data) memcpy(job->data, data, (size_t)size);
+    job->name = buffer;
+    job->usage = usage;
+    return submit(job);
+}
+
+EXPORT
+GLboolean OSMesaBridgeTexSubImage2DAsync(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) {
+    size_t pixelSize = pixel_size(format, type);
+    if (!texture || !pixels || !pixelSize || width <= 0 || height <= 0) return GL_FALSE;
+
+    size_t rowBytes = (size_t)width * pixelSize;
+    size_t size = rowBytes * (size_t)height;
+    if (size < RUNTIME_CONFIG_GET(uploadMinBytes) || !currentContext || !load_procs()) return GL_FALSE;
+
+    // Read pixels the way TexSubImage2D would with the caller's unpack
+    // state, so the game's own alignment and row length apply. With a
+    // pixel unpack buffer bound, pixels is an offset into it instead.
+    gl_offload_drain();
+    GLint unpackBuffer = 0, alignment = 4, rowLength = 0, skipRows = 0, skipPixels = 0;
+    gl.GetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpackBuffer);
+    if (unpackBuffer) return GL_FALSE;
+    gl.GetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    gl.GetIntegerv(GL_UNPACK_ROW_LENGTH, &rowLength);
+    gl.GetIntegerv(GL_UNPACK_SKIP_ROWS, &skipRows);
+    gl.GetIntegerv(GL_UNPACK_SKIP_PIXELS, &skipPixels);
+    if (alignment < 1) alignment = 1;
+
+    size_t rowStride = (size_t)(rowLength > 0 ? rowLength : width) * pixelSize;
+    rowStride = (rowStride + (size_t)alignment - 1) / (size_t)alignment * (size_t)alignment;
+    const unsigned char *source = (const unsigned char*)pixels + (size_t)skipRows * rowStride + (size_t)skipPixels * pixelSize;
+
+    UploadJob *job = new_job(UPLOAD_TEX_SUB_IMAGE_2D, size, true);
+    if (!job) return GL_FALSE;
+    for (GLsizei row = 0; row < height; row++)
+    {
+        memcpy(job->data + (size_t)row * rowBytes, source + (size_t)row * rowStride, rowBytes);
+    }
+    job->name = texture;
+    job->level = level;
+    job->xoffset = xoffset;
+    job->yoffset = yoffset;
+    job->width = width;
+    job->height = height;
+    job->format = format;
+    job->type = type;
+    return submit(job);
+}
+
+EXPORT
+void OSMesaBridgeUploadBarrier(void) {
+    gl_offload_drain();
+    pthread_mutex_lock(&uploadLock);
+    if (!workerRunning || workerParent != currentContext)
+    {
+        pthread_mutex_unlock(&uploadLock);
+        return;
+    }
+
+    unsigned long long target = submittedSeq;
+    while (completedSeq < target) pthread_cond_wait(&uploadCond, &uploadLock);
+    // A server-side wait: later commands of this context are ordered after
+    // the uploads without stalling the CPU on the GPU.
+    if (completedFence) gl.WaitSync(completedFence, 0, GL_TIMEOUT_IGNORED);
+    pthread_mutex_unlock(&uploadLock);
+}
+
+void upload_worker_on_destroy(OSMesaContext ctx) {
+    if (!ctx) return;
+    pthread_mutex_lock(&uploadLock);
+    if (workerRunning && workerParent == ctx) stop_worker_locked();
+    pthread_mutex_unlock(&uploadLock);
+}
+
+void upload_worker_stop(void) {
+    pthread_mutex_lock(&uploadLock);
+    stop_worker_locked();
+    pthread_mutex_unlock(&uploadLock);
+}
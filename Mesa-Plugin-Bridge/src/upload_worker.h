@@ -0,0 +1,18 @@
+#ifndef UPLOAD_WORKER_H
+#define UPLOAD_WORKER_H
+
+#include <stddef.h>
+#include <GL/osmesa.h>
+
+// A worker thread owning a context that shares lists with the caller's
+// context. Large buffer and texture uploads are copied, queued and run
+// there; OSMesaBridgeUploadBarrier() orders them before later commands of
+// the calling context with a fence. The size thresholds are read from
+// the current RuntimeConfig. See bridge.h for the exported API.
+
+// Before ctx is destroyed: a worker sharing with it finishes the queued
+// uploads and stops, so it never outlives its parent.
+void upload_worker_on_destroy(OSMesaContext ctx);
+void upload_worker_stop(void);
+
+#endif // UPLOAD_WORKER_H
@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "workload.h"
+
+#define GRID 32
+#define LAYERS 8
+#define READBACK_PASSES 4
+
+static struct {
+    void (*Viewport)(GLint, GLint, GLsizei, GLsizei);
+    void (*MatrixMode)(GLenum);
+    void (*LoadIdentity)(void);
+    void (*Ortho)(GLdouble, GLdouble, GLdouble, GLdouble, GLdouble, GLdouble);
+    void (*Enable)(GLenum);
+    void (*BlendFunc)(GLenum, GLenum);
+    void (*ClearColor)(GLclampf, GLclampf, GLclampf, GLclampf);
+    void (*Clear)(GLbitfield);
+    void (*Begin)(GLenum);
+    void (*End)(void);
+    void (*Color4f)(GLfloat, GLfloat, GLfloat, GLfloat);
+    void (*Vertex2f)(GLfloat, GLfloat);
+    void (*Finish)(void);
+    void (*ReadPixels)(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void*);
+    GLenum (*GetError)(void);
+    const GLubyte* (*GetString)(GLenum);
+    void (*GenTextures)(GLsizei, GLuint*);
+    void (*BindTexture)(GLenum, GLuint);
+    void (*TexImage2D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*);
+} gl;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool load_procs(const WorkloadApi *api) {
+    #define LOAD_PROC(name) gl.name = (__typeof__(gl.name))(void*)api->GetProcAddress("gl" #name); if (!gl.name) return false;
+    LOAD_PROC(Viewport);
+    LOAD_PROC(MatrixMode);
+    LOAD_PROC(LoadIdentity);
+    LOAD_PROC(Ortho);
+    LOAD_PROC(Enable);
+    LOAD_PROC(BlendFunc);
+    LOAD_PROC(ClearColor);
+    LOAD_PROC(Clear);
+    LOAD_PROC(Begin);
+    LOAD_PROC(End);
+    LOAD_PROC(Color4f);
+    LOAD_PROC(Vertex2f);
+    LOAD_PROC(Finish);
+    LOAD_PROC(ReadPixels);
+    LOAD_PROC(GetError);
+    LOAD_PROC(GetString);
+    LOAD_PROC(GenTextures);
+    LOAD_PROC(BindTexture);
+    LOAD_PROC(TexImage2D);
+    #undef LOAD_PROC
+    return true;
+}
+
+static void draw_frame(int frame) {
+    float phase = (frame % 60) / 60.0f;
+
+    gl.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    gl.Begin(GL_QUADS);
+    for (int layer = 0; layer < LAYERS; layer++)
+    {
+        float shade = (float)layer / LAYERS;
+        gl.Color4f(shade, phase, 1.0f - shade, 0.25f);
+        gl.Vertex2f(0.0f, 0.0f);
+        gl.Vertex2f(1.0f, 0.0f);
+        gl.Vertex2f(1.0f, 1.0f);
+        gl.Vertex2f(0.0f, 1.0f);
+    }
+    gl.End();
+
+    gl.Begin(GL_TRIANGLES);
+    for (int y = 0; y < GRID; y++)
+    {
+        for (int x = 0; x < GRID; x++)
+        {
+            float x0 = (float)x / GRID, y0 = (float)y / GRID, step = 1.0f / GRID;
+            gl.Color4f(x0, y0, phase, 0.5f);
+            gl.Vertex2f(x0, y0);
+            gl.Vertex2f(x0 + step, y0);
+            gl.Vertex2f(x0 + step * phase, y0 + step);
+        }
+    }
+    gl.End();
+
+    gl.Finish();
+}
+
+static void setup_scene(int width, int height) {
+    gl.Viewport(0, 0, width, height);
+    gl.MatrixMode(GL_PROJECTION);
+    gl.LoadIdentity();
+    gl.Ortho(0.0, 1.0, 0.0, 1.0, -1.0, 1.0);
+    gl.MatrixMode(GL_MODELVIEW);
+    gl.LoadIdentity();
+    gl.Enable(GL_BLEND);
+    gl.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl.ClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+}
+
+bool workload_run(const WorkloadApi *api, int width, int height, int frames, WorkloadResult *result) {
+    memset(result, 0, sizeof(*result));
+    if (frames > WORKLOAD_MAX_FRAMES) frames = WORKLOAD_MAX_FRAMES;
+
+    size_t bufferSize = (size_t)width * (size_t)height * 4;
+    unsigned char *buffer = calloc(1, bufferSize);
+    unsigned char *readback = malloc(bufferSize);
+    if (!buffer || !readback)
+    {
+        free(buffer);
+        free(readback);
+        return false;
+    }
+
+    double start = now_ms();
+    OSMesaContext ctx = api->CreateContext(OSMESA_RGBA, NULL);
+    if (!ctx || !api->MakeCurrent(ctx, buffer, GL_UNSIGNED_BYTE, width, height) || !load_procs(api))
+    {
+        if (ctx) api->DestroyContext(ctx);
+        free(buffer);
+        free(readback);
+        return false;
+    }
+    result->createMs = now_ms() - start;
+
+    const GLubyte *renderer = gl.GetString(GL_RENDERER);
+    if (renderer) strncpy(result->renderer, (const char*)renderer, sizeof(result->renderer) - 1);
+
+    setup_scene(width, height);
+
+    for (int frame = 0; frame < frames; frame++)
+    {
+        double frameStart = now_ms();
+        draw_frame(frame);
+        result->frameMs[frame] = now_ms() - frameStart;
+        result->frames++;
+    }
+
+    start = now_ms();
+    for (int pass = 0; pass < READBACK_PASSES; pass++)
+    {
+        gl.ReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, readback);
+    }
+    double readbackMs = now_ms() - start;
+    if (readbackMs > 0) result->readbackMBps = (bufferSize * (double)READBACK_PASSES / (1024.0 * 1024.0)) / (readbackMs / 1e3);
+
+    // A driver that silently drew nothing is not a stable driver.
+    size_t center = ((size_t)(height / 2) * width + width / 2) * 4;
+    result->ok = gl.GetError() == GL_NO_ERROR && (readback[center] || readback[center + 1] || readback[center + 2]);
+
+    api->MakeCurrent(NULL, NULL, 0, 0, 0);
+    api->DestroyContext(ctx);
+    free(buffer);
+    free(readback);
+    return result->ok;
+}
+
+bool workload_recreate(const WorkloadApi *api, int width, int height, int cycles, WorkloadResult *result) {
+    memset(result, 0, sizeof(*result));
+    if (cycles > WORKLOAD_MAX_FRAMES) cycles = WORKLOAD_MAX_FRAMES;
+
+    unsigned char *buffer = calloc(1, (size_t)width * (size_t)height * 4);
+    if (!buffer) return false;
+
+    static const unsigned char texels[16 * 16 * 4];
+    for (int cycle = 0; cycle < cycles; cycle++)
+    {
+        double start = now_ms();
+        OSMesaContext ctx = api->CreateContext(OSMESA_RGBA, NULL);
+        if (!ctx || !api->MakeCurrent(ctx, buffer, GL_UNSIGNED_BYTE, width, height) || !load_procs(api))
+        {
+            if (ctx) api->DestroyContext(ctx);
+            free(buffer);
+            return false;
+        }
+        double cycleMs = now_ms() - start;
+        if (!cycle)
+        {
+            result->createMs = cycleMs;
+            const GLubyte *renderer = gl.GetString(GL_RENDERER);
+            if (renderer) strncpy(result->renderer, (const char*)renderer, sizeof(result->renderer) - 1);
+        }
+
+        // Leave objects behind the way a game tearing down its context
+        // does, so a pooled context has something to reset.
+        GLuint textures[4];
+        gl.GenTextures(4, textures);
+        for (int i = 0; i < 4; i++)
+        {
+            gl.BindTexture(GL_TEXTURE_2D, textures[i]);
+            gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 16, 16, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+        }
+        gl.BindTexture(GL_TEXTURE_2D, 0);
+        setup_scene(width, height);
+        draw_frame(cycle);
+        bool drew = gl.GetError() == GL_NO_ERROR;
+
+        start = now_ms();
+        api->MakeCurrent(NULL, NULL, 0, 0, 0);
+        api->DestroyContext(ctx);
+        result->frameMs[cycle] = cycleMs + now_ms() - start;
+        result->frames++;
+        if (!drew)
+        {
+            free(buffer);
+            return false;
+        }
+    }
+
+    free(buffer);
+    result->ok = true;
+    return true;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+double workload_percentile(const WorkloadResult *result, double p) {
+    if (result->frames <= 0) return 0;
+
+    double sorted[WORKLOAD_MAX_FRAMES];
+    memcpy(sorted, result->frameMs, result->frames * sizeof(double));
+    qsort(sorted, result->frames, sizeof(double), compare_double);
+
+    int index = (int)(p / 100.0 * (result->frames - 1) + 0.5);
+    if (index < 0) index = 0;
+    if (index >= result->frames) index = result->frames - 1;
+    return sorted[index];
+}
@@ -0,0 +1,40 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdbool.h>
+#include <GL/osmesa.h>
+#include <GL/gl.h>
+
+// A fixed, fill-rate heavy reference scene (blended full-screen layers
+// plus a triangle grid, compatibility profile) used to compare drivers
+// and settings. It only needs the OSMesa entry points below, so it runs
+// either against Mesa directly or through libOSMBridge.so.
+
+#define WORKLOAD_MAX_FRAMES 256
+
+typedef struct {
+    OSMesaContext (*CreateContext)(GLenum, OSMesaContext);
+    GLboolean (*MakeCurrent)(OSMesaContext, void*, GLenum, GLsizei, GLsizei);
+    void (*DestroyContext)(OSMesaContext);
+    OSMESAproc (*GetProcAddress)(const char*);
+} WorkloadApi;
+
+typedef struct {
+    bool ok;
+    int frames;
+    double createMs;
+    double frameMs[WORKLOAD_MAX_FRAMES];
+    double readbackMBps;
+    char renderer[64];
+} WorkloadResult;
+
+bool workload_run(const WorkloadApi *api, int width, int height, int frames, WorkloadResult *result);
+// Create, use and destroy a context cycles times, the way a game
+// recreating its context on a resize or world change does. frameMs holds
+// each cycle's create, make current and destroy time, which is what the
+// context pool trades against; createMs is the first, cold, cycle.
+bool workload_recreate(const WorkloadApi *api, int width, int height, int cycles, WorkloadResult *result);
+// p in [0, 100]; 0 when there are no frames.
+double workload_percentile(const WorkloadResult *result, double p);
+
+#endif // WORKLOAD_H
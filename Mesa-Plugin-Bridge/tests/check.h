@@ -0,0 +1,41 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+// Host unit checks of the bridge's self-contained modules, built and run
+// by `make -C Mesa-Plugin-Bridge/tools check`. Each test_*.c is its own
+// program that links only the sources it checks, plus stubs.c in place of
+// bridge.c and the task pool.
+
+extern int checkFailures;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            checkFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ_U64(actual, expected) \
+    do { \
+        unsigned long long actual_ = (unsigned long long)(actual), expected_ = (unsigned long long)(expected); \
+        if (actual_ != expected_) \
+        { \
+            fprintf(stderr, "%s:%d: %s is %llu, expected %llu\n", __FILE__, __LINE__, #actual, actual_, expected_); \
+            checkFailures++; \
+        } \
+    } while (0)
+
+// Print the outcome; the exit status of the test program.
+int check_report(const char *name);
+
+// Test hooks of stubs.c.
+// bridge_now_ns() returns this when it is not 0.
+extern long long stubNowNs;
+// What task_pool_on_event() returns: false runs the logger synchronously.
+extern bool stubTaskPool;
+
+#endif // CHECK_H
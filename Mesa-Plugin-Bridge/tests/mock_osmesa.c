@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <GL/osmesa.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+// A stand-in libOSMesa.so for hosts without Mesa, built by `make -C
+// tools check` as tests/libOSMesa.so. It keeps just enough state for the
+// bridge and the tools to run end to end: contexts, the renderer string,
+// unpack state, and a frame time that depends on the driver settings the
+// way llvmpipe's does, so osm-sweep and osm-bench have something to rank.
+//
+//   MOCK_CREATE_DELAY_MS   sleep in OSMesaCreateContext, like a cold driver
+//   MOCK_GL_VERSION        GL_VERSION string, "1.4 (mock)" by default
+//
+// The mock_* functions let tests look inside.
+
+struct osmesa_context {
+    GLenum format;
+    OSMesaContext share;
+};
+
+static __thread OSMesaContext current = NULL;
+static __thread GLint unpackAlignment = 4;
+static __thread GLint unpackRowLength = 0;
+static int liveContexts = 0;
+static unsigned int textureSum = 0;
+static GLuint nextTexture = 1;
+static GLuint nextSync = 1;
+static char renderer[64];
+
+int mock_live_contexts(void) {
+    return __atomic_load_n(&liveContexts, __ATOMIC_ACQUIRE);
+}
+
+// FNV-1a over the texels of the last glTexSubImage2D, read with the
+// calling thread's unpack state.
+unsigned int mock_texture_sum(void) {
+    return __atomic_load_n(&textureSum, __ATOMIC_ACQUIRE);
+}
+
+OSMesaContext OSMesaCreateContext(GLenum format, OSMesaContext sharelist) {
+    const char *delay = getenv("MOCK_CREATE_DELAY_MS");
+    if (delay) usleep((useconds_t)atoi(delay) * 1000);
+
+    OSMesaContext ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) return NULL;
+    ctx->format = format;
+    ctx->share = sharelist;
+    __atomic_add_fetch(&liveContexts, 1, __ATOMIC_RELEASE);
+    return ctx;
+}
+
+OSMesaContext OSMesaCreateContextExt(GLenum format, GLint depthBits, GLint stencilBits, GLint accumBits, OSMesaContext sharelist) {
+    (void)depthBits;
+    (void)stencilBits;
+    (void)accumBits;
+    return OSMesaCreateContext(format, sharelist);
+}
+
+void OSMesaDestroyContext(OSMesaContext ctx) {
+    if (!ctx) return;
+    if (current == ctx) current = NULL;
+    free(ctx);
+    __atomic_sub_fetch(&liveContexts, 1, __ATOMIC_RELEASE);
+}
+
+GLboolean OSMesaMakeCurrent(OSMesaContext ctx, void *buffer, GLenum type, GLsizei width, GLsizei height) {
+    (void)type;
+    if (ctx && (!buffer || width <= 0 || height <= 0)) return GL_FALSE;
+    current = ctx;
+    return GL_TRUE;
+}
+
+OSMesaContext OSMesaGetCurrentContext(void) {
+    return current;
+}
+
+void OSMesaFlushFrontbuffer(void) {
+}
+
+void OSMesaPixelStore(GLint pname, GLint value) {
+    (void)pname;
+    (void)value;
+}
+
+void OSMesaGetIntegerv(GLint pname, GLint *value) {
+    *value = pname == OSMESA_FORMAT && current ? (GLint)current->format : 0;
+}
+
+const GLubyte* glGetString(GLenum name) {
+    if (name == GL_RENDERER)
+    {
+        const char *driver = getenv("GALLIUM_DRIVER");
+        snprintf(renderer, sizeof(renderer), "%s (mock)", driver ? driver : "llvmpipe");
+        return (const GLubyte*)renderer;
+    }
+    if (name == GL_VERSION)
+    {
+        const char *version = getenv("MOCK_GL_VERSION");
+        return (const GLubyte*)(version ? version : "1.4 (mock)");
+    }
+    if (name == GL_VENDOR) return (const GLubyte*)"mock";
+    if (name == GL_EXTENSIONS) return (const GLubyte*)"";
+    return NULL;
+}
+
+// llvmpipe splits a frame across LP_NUM_THREADS rasterizers, each of
+// which adds some overhead; softpipe is slower and zink faster.
+void glFinish(void) {
+    const char *threads = getenv("LP_NUM_THREADS");
+    int count = threads ? atoi(threads) : 1;
+    if (count < 1) count = 1;
+    const char *driver = getenv("GALLIUM_DRIVER");
+    int extra = 2;
+    if (driver && !strcmp(driver, "softpipe")) extra = 6;
+    if (driver && !strcmp(driver, "zink")) extra = 0;
+    usleep((useconds_t)(1000 * (8 / count + count + extra)));
+}
+
+void glFlush(void) {
+}
+
+GLenum glGetError(void) {
+    return GL_NO_ERROR;
+}
+
+void glGetIntegerv(GLenum pname, GLint *value) {
+    switch (pname)
+    {
+        case GL_UNPACK_ALIGNMENT: *value = unpackAlignment; break;
+        case GL_UNPACK_ROW_LENGTH: *value = unpackRowLength; break;
+        case GL_MAJOR_VERSION: *value = 1; break;
+        case GL_MINOR_VERSION: *value = 4; break;
+        default: *value = 0; break;
+    }
+}
+
+void glPixelStorei(GLenum pname, GLint value) {
+    if (pname == GL_UNPACK_ALIGNMENT) unpackAlignment = value;
+    if (pname == GL_UNPACK_ROW_LENGTH) unpackRowLength = value;
+}
+
+void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels) {
+    (void)x;
+    (void)y;
+    (void)format;
+    (void)type;
+    memset(pixels, 0x80, (size_t)width * (size_t)height * 4);
+}
+
+void glGenTextures(GLsizei count, GLuint *textures) {
+    for (GLsizei i = 0; i < count; i++) textures[i] = __atomic_fetch_add(&nextTexture, 1, __ATOMIC_RELAXED);
+}
+
+static size_t pixel_size(GLenum format, GLenum type) {
+    size_t components = format == GL_RGBA || format == GL_BGRA ? 4 : format == GL_RGB ? 3 : 1;
+    return type == GL_UNSIGNED_BYTE ? components : components * 4;
+}
+
+void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) {
+    (void)target;
+    (void)level;
+    (void)xoffset;
+    (void)yoffset;
+    if (!pixels) return;
+
+    size_t rowBytes = (size_t)width * pixel_size(format, type);
+    size_t rowStride = (size_t)(unpackRowLength > 0 ? unpackRowLength : width) * pixel_size(format, type);
+    rowStride = (rowStride + (size_t)unpackAlignment - 1) / (size_t)unpackAlignment * (size_t)unpackAlignment;
+    unsigned int sum = 2166136261u;
+    for (GLsizei row = 0; row < height; row++)
+    {
+        const unsigned char *texels = (const unsigned char*)pixels + (size_t)row * rowStride;
+        for (size_t i = 0; i < rowBytes; i++) sum = (sum ^ texels[i]) * 16777619u;
+    }
+    __atomic_store_n(&textureSum, sum, __ATOMIC_RELEASE);
+}
+
+void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels) {
+    (void)internalFormat;
+    (void)border;
+    glTexSubImage2D(target, level, 0, 0, width, height, format, type, pixels);
+}
+
+GLsync glFenceSync(GLenum condition, GLbitfield flags) {
+    (void)condition;
+    (void)flags;
+    return (GLsync)(uintptr_t)__atomic_fetch_add(&nextSync, 1, __ATOMIC_RELAXED);
+}
+
+GLenum glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout) {
+    (void)sync;
+    (void)flags;
+    (void)timeout;
+    return GL_ALREADY_SIGNALED;
+}
+
+// Calls that only change state the mock does not keep.
+void glWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout) { (void)sync; (void)flags; (void)timeout; }
+void glDeleteSync(GLsync sync) { (void)sync; }
+void glBindTexture(GLenum target, GLuint texture) { (void)target; (void)texture; }
+void glBindBuffer(GLenum target, GLuint buffer) { (void)target; (void)buffer; }
+void glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) { (void)target; (void)size; (void)data; (void)usage; }
+void glReadBuffer(GLenum mode) { (void)mode; }
+void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) { (void)red; (void)green; (void)blue; (void)alpha; }
+void glClear(GLbitfield mask) { (void)mask; }
+void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) { (void)x; (void)y; (void)width; (void)height; }
+void glMatrixMode(GLenum mode) { (void)mode; }
+void glLoadIdentity(void) { }
+void glOrtho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble zNear, GLdouble zFar) { (void)left; (void)right; (void)bottom; (void)top; (void)zNear; (void)zFar; }
+void glEnable(GLenum cap) { (void)cap; }
+void glDisable(GLenum cap) { (void)cap; }
+void glBlendFunc(GLenum sfactor, GLenum dfactor) { (void)sfactor; (void)dfactor; }
+void glBegin(GLenum mode) { (void)mode; }
+void glEnd(void) { }
+void glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) { (void)red; (void)green; (void)blue; (void)alpha; }
+void glVertex2f(GLfloat x, GLfloat y) { (void)x; (void)y; }
+
+#define MOCK_PROCS(X) \
+    X(glGetString) X(glFinish) X(glFlush) X(glGetError) X(glGetIntegerv) X(glPixelStorei) \
+    X(glReadPixels) X(glGenTextures) X(glTexSubImage2D) X(glTexImage2D) X(glFenceSync) \
+    X(glClientWaitSync) X(glWaitSync) X(glDeleteSync) X(glBindTexture) X(glBindBuffer) \
+    X(glBufferData) X(glReadBuffer) X(glClearColor) X(glClear) X(glViewport) X(glMatrixMode) \
+    X(glLoadIdentity) X(glOrtho) X(glEnable) X(glDisable) X(glBlendFunc) X(glBegin) X(glEnd) \
+    X(glColor4f) X(glVertex2f)
+
+OSMESAproc OSMesaGetProcAddress(const char *funcName) {
+    static const struct {
+        const char *name;
+        void *proc;
+    } procs[] = {
+#define X(n) { #n, (void*)n },
+        MOCK_PROCS(X)
+#undef X
+    };
+    for (size_t i = 0; i < sizeof(procs) / sizeof(procs[0]); i++)
+    {
+        if (!strcmp(procs[i].name, funcName)) return (OSMESAproc)procs[i].proc;
+    }
+    return NULL;
+}
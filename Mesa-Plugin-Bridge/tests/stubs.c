@@ -0,0 +1,36 @@
+#include <stdbool.h>
+#include <time.h>
+#include "internal.h"
+#include "task_pool.h"
+#include "check.h"
+
+// What the modules under test need from bridge.c and task_pool.c.
+
+bool logOutPut = false;
+long long stubNowNs = 0;
+bool stubTaskPool = false;
+int checkFailures = 0;
+
+long long bridge_now_ns(void) {
+    if (stubNowNs) return stubNowNs;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+bool task_pool_on_event(TaskEvent event, TaskFn fn) {
+    (void)event;
+    (void)fn;
+    return stubTaskPool;
+}
+
+bool task_pool_raise(TaskEvent event) {
+    (void)event;
+    return false;
+}
+
+int check_report(const char *name) {
+    if (checkFailures) fprintf(stderr, "%s: %d checks failed\n", name, checkFailures);
+    else printf("%s: ok\n", name);
+    return checkFailures ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <GL/osmesa.h>
+#include <GL/gl.h>
+#include "check.h"
+
+// End to end run of libOSMBridge.so against tests/libOSMesa.so (see
+// mock_osmesa.c). BRIDGE_PATH and MOCK_PATH come from the Makefile.
+
+#define WIDTH 64
+#define HEIGHT 64
+#define TEXTURE_WIDTH 333
+#define TEXTURE_HEIGHT 200
+
+static struct {
+    OSMesaContext (*CreateContext)(GLenum, OSMesaContext);
+    GLboolean (*MakeCurrent)(OSMesaContext, void*, GLenum, GLsizei, GLsizei);
+    void (*DestroyContext)(OSMesaContext);
+    OSMESAproc (*GetProcAddress)(const char*);
+    GLsizei (*DumpConfig)(char*, GLsizei);
+    GLboolean (*TexSubImage2DAsync)(GLuint, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*);
+    void (*UploadBarrier)(void);
+    const GLubyte* (*GetString)(GLenum);
+    void (*Finish)(void);
+    void (*PixelStorei)(GLenum, GLint);
+    void (*TexSubImage2D)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*);
+} bridge;
+
+static struct {
+    int (*LiveContexts)(void);
+    unsigned int (*TextureSum)(void);
+} mock;
+
+static unsigned char frame[WIDTH * HEIGHT * 4];
+
+static bool load(void) {
+    void *handle = dlopen(BRIDGE_PATH, RTLD_NOW);
+    if (!handle)
+    {
+        fprintf(stderr, "%s\n", dlerror());
+        return false;
+    }
+    #define LOAD(name, symbol) bridge.name = (__typeof__(bridge.name))dlsym(handle, symbol); CHECK(bridge.name != NULL);
+    LOAD(CreateContext, "OSMesaCreateContext");
+    LOAD(MakeCurrent, "OSMesaMakeCurrent");
+    LOAD(DestroyContext, "OSMesaDestroyContext");
+    LOAD(GetProcAddress, "OSMesaGetProcAddress");
+    LOAD(DumpConfig, "OSMesaBridgeDumpConfig");
+    LOAD(TexSubImage2DAsync, "OSMesaBridgeTexSubImage2DAsync");
+    LOAD(UploadBarrier, "OSMesaBridgeUploadBarrier");
+    LOAD(GetString, "glGetString");
+    LOAD(Finish, "glFinish");
+    #undef LOAD
+
+    // The bridge loaded the mock already; this only finds it.
+    void *mesa = dlopen(MOCK_PATH, RTLD_NOW | RTLD_NOLOAD);
+    CHECK(mesa != NULL);
+    if (!mesa) return false;
+    mock.LiveContexts = (__typeof__(mock.LiveContexts))dlsym(mesa, "mock_live_contexts");
+    mock.TextureSum = (__typeof__(mock.TextureSum))dlsym(mesa, "mock_texture_sum");
+    return checkFailures == 0 && mock.LiveContexts && mock.TextureSum;
+}
+
+static void check_config(void) {
+    char dump[4096];
+    GLsizei length = bridge.DumpConfig(dump, sizeof(dump));
+    CHECK(length > 0 && length < (GLsizei)sizeof(dump));
+    CHECK(strstr(dump, "GALLIUM_DRIVER=llvmpipe\n") != NULL);
+    CHECK(strstr(dump, "OSM_ASYNC_DESTROY=true\n") != NULL);
+    CHECK(strstr(dump, "OSM_UPLOAD_MIN_KB=1\n") != NULL);
+}
+
+static void check_render(void) {
+    const char *renderer = (const char*)bridge.GetString(GL_RENDERER);
+    CHECK(renderer && !strcmp(renderer, "llvmpipe (mock)"));
+    bridge.Finish();
+
+    bridge.PixelStorei = (__typeof__(bridge.PixelStorei))bridge.GetProcAddress("glPixelStorei");
+    bridge.TexSubImage2D = (__typeof__(bridge.TexSubImage2D))bridge.GetProcAddress("glTexSubImage2D");
+    CHECK(bridge.PixelStorei && bridge.TexSubImage2D);
+}
+
+// A tightly packed RGB upload must read the same texels on the upload
+// worker as it does on the caller, without running past the buffer.
+static void check_async_upload(void) {
+    if (!bridge.PixelStorei || !bridge.TexSubImage2D) return;
+
+    size_t size = (size_t)TEXTURE_WIDTH * 3 * TEXTURE_HEIGHT;
+    unsigned char *pixels = malloc(size);
+    CHECK(pixels != NULL);
+    if (!pixels) return;
+    for (size_t i = 0; i < size; i++) pixels[i] = (unsigned char)(i * 7 + 3);
+
+    bridge.PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    bridge.TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TEXTURE_WIDTH, TEXTURE_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    unsigned int expected = mock.TextureSum();
+
+    // Uploads stay on the caller until the worker's context is ready.
+    GLboolean queued = GL_FALSE;
+    for (int attempt = 0; attempt < 100 && !queued; attempt++)
+    {
+        queued = bridge.TexSubImage2DAsync(1, 0, 0, 0, TEXTURE_WIDTH, TEXTURE_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        if (!queued) usleep(10000);
+    }
+    CHECK(queued);
+    // The job holds a copy.
+    memset(pixels, 0, size);
+    bridge.UploadBarrier();
+    CHECK_EQ_U64(mock.TextureSum(), expected);
+
+    bridge.PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    free(pixels);
+}
+
+static void check_destroy(OSMesaContext ctx, OSMesaContext shared) {
+    bridge.MakeCurrent(NULL, NULL, 0, 0, 0);
+    bridge.DestroyContext(shared);
+    bridge.DestroyContext(ctx);
+
+    // Destroyed on the task pool; the upload worker's context goes with ctx.
+    for (int attempt = 0; attempt < 200 && mock.LiveContexts(); attempt++) usleep(10000);
+    CHECK_EQ_U64(mock.LiveContexts(), 0);
+}
+
+int main(void) {
+    char dir[] = "/tmp/osm-test-bridge.XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    char envPath[64], binPath[64];
+    snprintf(envPath, sizeof(envPath), "%s/env.txt", dir);
+    snprintf(binPath, sizeof(binPath), "%s/env.bin", dir);
+    FILE *env = fopen(envPath, "w");
+    if (!env)
+    {
+        perror(envPath);
+        return 1;
+    }
+    fputs("GALLIUM_DRIVER=llvmpipe\nOSM_ASYNC_DESTROY=true\nOSM_UPLOAD_MIN_KB=1\nOSM_LOG_LEVEL=warning\n", env);
+    fclose(env);
+    setenv("OSM_ENV_FILE", envPath, 1);
+    setenv("MESA_LIBRARY", MOCK_PATH, 1);
+
+    if (load())
+    {
+        check_config();
+        OSMesaContext ctx = bridge.CreateContext(OSMESA_RGBA, NULL);
+        OSMesaContext shared = bridge.CreateContext(OSMESA_RGBA, ctx);
+        CHECK(ctx && shared);
+        CHECK(bridge.MakeCurrent(ctx, frame, GL_UNSIGNED_BYTE, WIDTH, HEIGHT));
+        check_render();
+        check_async_upload();
+        check_destroy(ctx, shared);
+    }
+    else
+    {
+        checkFailures++;
+    }
+
+    unlink(envPath);
+    unlink(binPath);
+    rmdir(dir);
+    return check_report("bridge");
+}
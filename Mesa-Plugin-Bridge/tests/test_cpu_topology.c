@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cpu_topology.h"
+#include "check.h"
+
+#define CPU_DIR "devices/system/cpu"
+
+static char root[64];
+
+// Write text to <root>/<scenario>/<file>, creating the directories on the way.
+static void put(const char *scenario, const char *file, const char *text) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s/%s", root, scenario, file);
+    for (char *slash = strchr(path + strlen(root) + 1, '/'); slash; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+    FILE *out = fopen(path, "w");
+    CHECK(out != NULL);
+    if (!out) return;
+    fputs(text, out);
+    fclose(out);
+}
+
+static void put_cpu(const char *scenario, int cpu, const char *file, long value) {
+    char name[128], text[32];
+    snprintf(name, sizeof(name), CPU_DIR "/cpu%d/%s", cpu, file);
+    snprintf(text, sizeof(text), "%ld\n", value);
+    put(scenario, name, text);
+}
+
+static bool detect(const char *scenario, CpuTopology *topology) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", root, scenario);
+    return cpu_topology_detect(path, topology);
+}
+
+static bool is_set(const cpu_set_t *set, int first, int last) {
+    for (int cpu = first; cpu <= last; cpu++)
+    {
+        if (!CPU_ISSET(cpu, set)) return false;
+    }
+    return true;
+}
+
+static void check_big_little(void) {
+    put("big_little", CPU_DIR "/possible", "0-7\n");
+    for (int cpu = 0; cpu < 8; cpu++) put_cpu("big_little", cpu, "cpu_capacity", cpu < 4 ? 383 : 1024);
+
+    CpuTopology topology;
+    CHECK(detect("big_little", &topology));
+    CHECK_EQ_U64(topology.cpuCount, 8);
+    CHECK_EQ_U64(topology.onlineCount, 8);
+    CHECK_EQ_U64(topology.bigCount, 4);
+    CHECK_EQ_U64(topology.littleCount, 4);
+    CHECK(is_set(&topology.big, 4, 7) && CPU_COUNT(&topology.big) == 4);
+    CHECK(is_set(&topology.little, 0, 3) && CPU_COUNT(&topology.little) == 4);
+    CHECK_EQ_U64(topology.capacity[0], 383);
+    CHECK_EQ_U64(topology.capacity[7], 1024);
+}
+
+static void check_three_clusters(void) {
+    // Mid cores within 80% of the prime core count as big.
+    put("prime", CPU_DIR "/possible", "0-7\n");
+    for (int cpu = 0; cpu < 8; cpu++) put_cpu("prime", cpu, "cpu_capacity", cpu < 4 ? 400 : cpu < 7 ? 870 : 1024);
+
+    CpuTopology topology;
+    CHECK(detect("prime", &topology));
+    CHECK_EQ_U64(topology.bigCount, 4);
+    CHECK(is_set(&topology.big, 4, 7));
+    CHECK(is_set(&topology.little, 0, 3) && CPU_COUNT(&topology.little) == 4);
+}
+
+static void check_cpufreq_fallback(void) {
+    // No cpu_capacity: the maximum clock decides.
+    put("cpufreq", CPU_DIR "/possible", "0-5\n");
+    for (int cpu = 0; cpu < 6; cpu++) put_cpu("cpufreq", cpu, "cpufreq/cpuinfo_max_freq", cpu < 4 ? 1800000 : 2400000);
+
+    CpuTopology topology;
+    CHECK(detect("cpufreq", &topology));
+    CHECK_EQ_U64(topology.onlineCount, 6);
+    CHECK_EQ_U64(topology.bigCount, 2);
+    CHECK(is_set(&topology.big, 4, 5));
+    CHECK(is_set(&topology.little, 0, 3));
+
+    // Neither cpu_capacity nor cpufreq: every core is alike, and little
+    // falls back to the big set.
+    put("no_cpufreq", CPU_DIR "/possible", "0-3\n");
+    put("no_cpufreq", CPU_DIR "/cpu0/online", "1\n");
+    CHECK(detect("no_cpufreq", &topology));
+    CHECK_EQ_U64(topology.onlineCount, 4);
+    CHECK_EQ_U64(topology.bigCount, 4);
+    CHECK_EQ_U64(topology.littleCount, 4);
+    CHECK(CPU_EQUAL(&topology.big, &topology.little));
+    CHECK(CPU_EQUAL(&topology.big, &topology.online));
+}
+
+static void check_offline(void) {
+    // cpu0 usually has no online file at all; it counts as online.
+    put("offline", CPU_DIR "/possible", "0-7\n");
+    for (int cpu = 0; cpu < 8; cpu++)
+    {
+        put_cpu("offline", cpu, "cpu_capacity", cpu < 4 ? 383 : 1024);
+        if (cpu) put_cpu("offline", cpu, "online", cpu != 2 && cpu != 6);
+    }
+
+    CpuTopology topology;
+    CHECK(detect("offline", &topology));
+    CHECK_EQ_U64(topology.cpuCount, 8);
+    CHECK_EQ_U64(topology.onlineCount, 6);
+    CHECK(!CPU_ISSET(2, &topology.online) && !CPU_ISSET(6, &topology.online));
+    CHECK(CPU_ISSET(0, &topology.online));
+    CHECK_EQ_U64(topology.bigCount, 3);
+    CHECK_EQ_U64(topology.littleCount, 3);
+    CHECK(!CPU_ISSET(6, &topology.big) && !CPU_ISSET(2, &topology.little));
+    CHECK_EQ_U64(topology.capacity[6], 0);
+
+    // With the big cluster gone, the fastest remaining cores are big.
+    for (int cpu = 4; cpu < 8; cpu++) put_cpu("offline", cpu, "online", 0);
+    CHECK(detect("offline", &topology));
+    CHECK_EQ_U64(topology.onlineCount, 3);
+    CHECK_EQ_U64(topology.bigCount, 3);
+    CHECK(CPU_EQUAL(&topology.big, &topology.little));
+}
+
+static void check_sparse(void) {
+    put("sparse", CPU_DIR "/possible", "0-3,6\n");
+    for (int cpu = 0; cpu < 8; cpu++) put_cpu("sparse", cpu, "cpu_capacity", 1024);
+
+    CpuTopology topology;
+    CHECK(detect("sparse", &topology));
+    CHECK_EQ_U64(topology.cpuCount, 7);
+    CHECK_EQ_U64(topology.onlineCount, 5);
+    CHECK(!CPU_ISSET(4, &topology.online) && !CPU_ISSET(5, &topology.online) && !CPU_ISSET(7, &topology.online));
+    CHECK(CPU_ISSET(6, &topology.online));
+}
+
+static void check_unusable(void) {
+    CpuTopology topology;
+    CHECK(!detect("missing", &topology));
+
+    put("empty", CPU_DIR "/possible", "\n");
+    CHECK(!detect("empty", &topology));
+
+    put("all_offline", CPU_DIR "/possible", "0-1\n");
+    put_cpu("all_offline", 0, "online", 0);
+    put_cpu("all_offline", 1, "online", 0);
+    CHECK(!detect("all_offline", &topology));
+}
+
+static void check_sysfs_root(void) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/big_little", root);
+    setenv("OSM_SYSFS_ROOT", path, 1);
+
+    const CpuTopology *cached = cpu_topology_get();
+    CHECK(cached != NULL);
+    if (cached) CHECK_EQ_U64(cached->bigCount, 4);
+
+    // The cached copy stays as it was, a fresh detection follows hotplug.
+    put_cpu("big_little", 7, "online", 0);
+    CpuTopology current;
+    CHECK(cpu_topology_detect_current(&current));
+    CHECK_EQ_U64(current.onlineCount, 7);
+    CHECK(cached == cpu_topology_get());
+    if (cached) CHECK_EQ_U64(cached->onlineCount, 8);
+}
+
+static int remove_entry(const char *path, const struct stat *info, int type, struct FTW *ftw) {
+    (void)info;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+int main(void) {
+    snprintf(root, sizeof(root), "/tmp/osm-test-cpu-topology.XXXXXX");
+    if (!mkdtemp(root))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    check_big_little();
+    check_three_clusters();
+    check_cpufreq_fallback();
+    check_offline();
+    check_sparse();
+    check_unusable();
+    check_sysfs_root();
+
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return check_report("cpu_topology");
+}
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "env_bin.h"
+#include "check.h"
+
+#define MAX_ENTRIES 16
+
+static const char *const keys[] = { "GALLIUM_DRIVER", "OSM_LOG_SINK", "EMPTY", "[profile 1.20*]", "LP_NUM_THREADS" };
+static const char *const values[] = { "zink", "/sdcard/Mesa/log=1.txt", "", "", " 4 " };
+#define ENTRY_COUNT (int)(sizeof(keys) / sizeof(keys[0]))
+
+static char seenKeys[MAX_ENTRIES][64];
+static char seenValues[MAX_ENTRIES][64];
+static int seen = 0;
+
+static void collect(const char *key, const char *value) {
+    if (seen < MAX_ENTRIES)
+    {
+        snprintf(seenKeys[seen], sizeof(seenKeys[seen]), "%s", key);
+        snprintf(seenValues[seen], sizeof(seenValues[seen]), "%s", value);
+    }
+    seen++;
+}
+
+static void write_text(const char *path, const char *text) {
+    FILE *file = fopen(path, "w");
+    CHECK(file != NULL);
+    if (!file) return;
+    fputs(text, file);
+    fclose(file);
+}
+
+// Build env.bin for textPath from the entries above, as the parser would.
+static void build(const char *textPath, const char *binPath) {
+    int fd = open(textPath, O_RDONLY);
+    CHECK(fd >= 0);
+    EnvBinBuilder builder;
+    env_bin_begin(&builder, fd);
+    for (int i = 0; i < ENTRY_COUNT; i++) env_bin_add(&builder, keys[i], values[i]);
+    env_bin_commit(&builder, binPath);
+    close(fd);
+}
+
+static void set_mtime(const char *path, time_t seconds) {
+    struct timespec times[2] = { { seconds, 0 }, { seconds, 0 } };
+    CHECK(utimensat(AT_FDCWD, path, times, 0) == 0);
+}
+
+static void check_path(void) {
+    char bin[256];
+    env_bin_path("/sdcard/Mesa/env.txt", bin, sizeof(bin));
+    CHECK(!strcmp(bin, "/sdcard/Mesa/env.bin"));
+    env_bin_path("/data/v1.2/env", bin, sizeof(bin));
+    CHECK(!strcmp(bin, "/data/v1.2/env.bin"));
+    env_bin_path("env.backup.txt", bin, sizeof(bin));
+    CHECK(!strcmp(bin, "env.backup.bin"));
+}
+
+static void check_round_trip(const char *textPath, const char *binPath) {
+    write_text(textPath, "GALLIUM_DRIVER=zink\n");
+    build(textPath, binPath);
+
+    seen = 0;
+    CHECK(env_bin_apply(binPath, textPath, collect));
+    CHECK_EQ_U64(seen, ENTRY_COUNT);
+    for (int i = 0; i < ENTRY_COUNT && i < seen; i++)
+    {
+        CHECK(!strcmp(seenKeys[i], keys[i]));
+        CHECK(!strcmp(seenValues[i], values[i]));
+    }
+
+    EnvBinStamp first, second;
+    CHECK(env_bin_stamp(binPath, textPath, &first));
+    CHECK_EQ_U64(first.generation, 1);
+    // Every commit is a new generation, even with the same entries.
+    build(textPath, binPath);
+    CHECK(env_bin_stamp(binPath, textPath, &second));
+    CHECK_EQ_U64(second.generation, 2);
+    CHECK_EQ_U64(second.checksum, first.checksum);
+}
+
+static void check_stale(const char *textPath, const char *binPath) {
+    write_text(textPath, "GALLIUM_DRIVER=zink\n");
+    set_mtime(textPath, 1700000000);
+    build(textPath, binPath);
+    seen = 0;
+    CHECK(env_bin_apply(binPath, textPath, collect));
+
+    // A rewrite of the same size only shows in the mtime.
+    write_text(textPath, "GALLIUM_DRIVER=virp\n");
+    set_mtime(textPath, 1700000001);
+    seen = 0;
+    EnvBinStamp stamp;
+    CHECK(!env_bin_apply(binPath, textPath, collect));
+    CHECK(!env_bin_stamp(binPath, textPath, &stamp));
+    CHECK_EQ_U64(seen, 0);
+
+    // And a different size shows even with the old mtime.
+    write_text(textPath, "GALLIUM_DRIVER=llvmpipe\n");
+    set_mtime(textPath, 1700000000);
+    CHECK(!env_bin_apply(binPath, textPath, collect));
+
+    unlink(textPath);
+    CHECK(!env_bin_apply(binPath, textPath, collect));
+}
+
+static void check_corrupt(const char *textPath, const char *binPath) {
+    write_text(textPath, "GALLIUM_DRIVER=zink\n");
+    build(textPath, binPath);
+
+    // Flip a byte of the payload: the header still matches env.txt.
+    int fd = open(binPath, O_RDWR);
+    CHECK(fd >= 0);
+    unsigned char byte;
+    CHECK(pread(fd, &byte, 1, 44) == 1);
+    byte ^= 0x20;
+    CHECK(pwrite(fd, &byte, 1, 44) == 1);
+    close(fd);
+
+    seen = 0;
+    EnvBinStamp stamp;
+    CHECK(env_bin_stamp(binPath, textPath, &stamp));
+    CHECK(!env_bin_apply(binPath, textPath, collect));
+    CHECK_EQ_U64(seen, 0);
+
+    // Cut short.
+    build(textPath, binPath);
+    CHECK(truncate(binPath, 50) == 0);
+    CHECK(!env_bin_apply(binPath, textPath, collect));
+    CHECK(truncate(binPath, 20) == 0);
+    CHECK(!env_bin_apply(binPath, textPath, collect));
+}
+
+static void check_oversized(const char *textPath, const char *binPath) {
+    write_text(textPath, "GALLIUM_DRIVER=zink\n");
+    unlink(binPath);
+
+    char *value = malloc(0x10001);
+    CHECK(value != NULL);
+    if (!value) return;
+    memset(value, 'x', 0x10000);
+    value[0x10000] = '\0';
+
+    int fd = open(textPath, O_RDONLY);
+    EnvBinBuilder builder;
+    env_bin_begin(&builder, fd);
+    env_bin_add(&builder, "GALLIUM_DRIVER", "zink");
+    env_bin_add(&builder, "HUGE", value);
+    env_bin_commit(&builder, binPath);
+    close(fd);
+    free(value);
+
+    // Nothing rather than a blob missing an entry.
+    CHECK(access(binPath, F_OK) != 0);
+}
+
+int main(void) {
+    char dir[] = "/tmp/osm-test-env-bin.XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    char textPath[64], binPath[64];
+    snprintf(textPath, sizeof(textPath), "%s/env.txt", dir);
+    env_bin_path(textPath, binPath, sizeof(binPath));
+
+    check_path();
+    check_round_trip(textPath, binPath);
+    check_stale(textPath, binPath);
+    check_corrupt(textPath, binPath);
+    check_oversized(textPath, binPath);
+
+    unlink(textPath);
+    unlink(binPath);
+    rmdir(dir);
+    return check_report("env_bin");
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "log.h"
+#include "check.h"
+
+#define PREFIX "[OSM Plugin Bridge]: "
+#define WARN_PREFIX "Warning[OSM Plugin Bridge]: "
+
+static char logPath[64];
+static long readOffset = 0;
+
+// The text of the next line of the file sink after its time and tid, or
+// NULL at the end.
+static const char* next_line(void) {
+    static char line[512];
+    FILE *file = fopen(logPath, "r");
+    if (!file) return NULL;
+    fseek(file, readOffset, SEEK_SET);
+    const char *text = NULL;
+    if (fgets(line, sizeof(line), file))
+    {
+        readOffset = ftell(file);
+        line[strcspn(line, "\n")] = '\0';
+        double seconds;
+        int tid, consumed = 0;
+        if (sscanf(line, "%lf %d %n", &seconds, &tid, &consumed) == 2 && consumed) text = line + consumed;
+        else text = line;
+    }
+    fclose(file);
+    return text;
+}
+
+static void check_line(const char *expected) {
+    const char *text = next_line();
+    CHECK(text != NULL);
+    if (text && strcmp(text, expected))
+    {
+        fprintf(stderr, "log line \"%s\", expected \"%s\"\n", text, expected);
+        checkFailures++;
+    }
+}
+
+static void check_levels(void) {
+    int level = -1;
+    CHECK(log_parse_level("debug", &level) && level == LOG_LEVEL_DEBUG);
+    CHECK(log_parse_level("warning", &level) && level == LOG_LEVEL_WARN);
+    CHECK(!log_parse_level("warn", &level));
+    CHECK(!log_parse_level("", &level));
+    CHECK(!strcmp(log_level_name(LOG_LEVEL_ERROR), "error"));
+    CHECK(!strcmp(log_level_name(42), "info"));
+}
+
+// Before log_start everything waits in the ring; what does not fit is
+// counted and reported after the rest.
+static void check_ring(void) {
+    log_write(NULL, LOG_LEVEL_DEBUG, "below the default level");
+    for (int i = 0; i < LOG_SLOTS + 5; i++) log_write(NULL, LOG_LEVEL_INFO, "queued %d", i);
+    CHECK(next_line() == NULL);
+
+    // No pool: the logger drains now and then writes synchronously.
+    log_start(logPath, LOG_LEVEL_INFO);
+    char expected[64];
+    for (int i = 0; i < LOG_SLOTS; i++)
+    {
+        snprintf(expected, sizeof(expected), PREFIX "queued %d", i);
+        check_line(expected);
+    }
+    check_line(WARN_PREFIX "Log ring full, 5 messages dropped");
+    CHECK(next_line() == NULL);
+
+    log_write(NULL, LOG_LEVEL_DEBUG, "still below the level");
+    log_write(NULL, LOG_LEVEL_WARN, "synchronous");
+    check_line(WARN_PREFIX "synchronous");
+    CHECK(next_line() == NULL);
+}
+
+static void check_rate_limit(void) {
+    static LogSite site;
+    for (int i = 0; i < LOG_BURST + 5; i++) log_write(&site, LOG_LEVEL_INFO, "burst %d", i);
+    char expected[96];
+    for (int i = 0; i < LOG_BURST; i++)
+    {
+        snprintf(expected, sizeof(expected), PREFIX "burst %d", i);
+        check_line(expected);
+    }
+    CHECK(next_line() == NULL);
+
+    // Other sites have their own budget.
+    static LogSite other;
+    log_write(&other, LOG_LEVEL_INFO, "other site");
+    check_line(PREFIX "other site");
+
+    // Still the same window.
+    stubNowNs += 999999999LL;
+    log_write(&site, LOG_LEVEL_INFO, "late");
+    CHECK(next_line() == NULL);
+
+    stubNowNs += 1;
+    log_write(&site, LOG_LEVEL_INFO, "next window");
+    check_line(PREFIX "next window (6 similar messages suppressed)");
+    log_write(&site, LOG_LEVEL_INFO, "again");
+    check_line(PREFIX "again");
+
+    log_stop();
+    check_line(PREFIX "6 log messages were rate limited");
+    CHECK(next_line() == NULL);
+}
+
+int main(void) {
+    char dir[] = "/tmp/osm-test-log.XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(logPath, sizeof(logPath), "%s/log.txt", dir);
+    stubNowNs = 5000000000LL;
+    stubTaskPool = false;
+
+    check_levels();
+    check_ring();
+    check_rate_limit();
+
+    unlink(logPath);
+    rmdir(dir);
+    return check_report("log");
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "profile.h"
+#include "check.h"
+
+// Feed section headers and one setting after each; returns a bit per
+// setting that applied.
+static unsigned int run(const char *const *sections, int count, ProfileFilter *filter) {
+    profile_filter_init(filter);
+    unsigned int applied = profile_filter_accept(filter, "GALLIUM_DRIVER") ? 1 : 0;
+    for (int i = 0; i < count; i++)
+    {
+        CHECK(!profile_filter_accept(filter, sections[i]));
+        if (profile_filter_accept(filter, "LP_NUM_THREADS")) applied |= 2u << i;
+    }
+    return applied;
+}
+
+static void check_global(void) {
+    ProfileFilter filter;
+    CHECK_EQ_U64(run(NULL, 0, &filter), 1);
+    CHECK(!filter.chosen);
+    CHECK(!strcmp(filter.name, ""));
+}
+
+static void check_launcher_profile(void) {
+    ProfileFilter filter;
+    setenv("OSM_PROFILE", "1.20.1", 1);
+
+    // The first match wins; a later, broader one is skipped.
+    const char *const sections[] = { "[profile 1.19*]", "[profile 1.20*]", "[profile *]" };
+    CHECK_EQ_U64(run(sections, 3, &filter), 1 | 4);
+    CHECK(filter.chosen);
+    CHECK(!strcmp(filter.name, "1.20*"));
+
+    const char *const brackets[] = { "[profile 1.2[!0]*]", "[profile 1.2[01].?]" };
+    CHECK_EQ_U64(run(brackets, 2, &filter), 1 | 4);
+    CHECK(!strcmp(filter.name, "1.2[01].?"));
+
+    // fnmatch without flags: the pattern has to cover the whole name.
+    const char *const partial[] = { "[profile 1.20]", "[profile 20.1]" };
+    CHECK_EQ_U64(run(partial, 2, &filter), 1);
+    CHECK(!filter.chosen);
+
+    unsetenv("OSM_PROFILE");
+    const char *const any[] = { "[profile *]" };
+    CHECK_EQ_U64(run(any, 1, &filter), 1);
+}
+
+static void check_malformed(void) {
+    ProfileFilter filter;
+    setenv("OSM_PROFILE", "vulkan", 1);
+
+    // Everything under a section the bridge does not know is skipped, and
+    // a good section after it is still chosen.
+    const char *const sections[] = { "[other]", "[profile ]", "[profile vulkan", "[profilevulkan]", "[profile vulkan]" };
+    CHECK_EQ_U64(run(sections, 5, &filter), 1 | 32);
+    CHECK(!strcmp(filter.name, "vulkan"));
+
+    unsetenv("OSM_PROFILE");
+}
+
+static void check_identity(const char *dir) {
+    ProfileFilter filter;
+
+    const char *const process[] = { "[profile process:com.*]", "[profile process:*test_profile]" };
+    CHECK_EQ_U64(run(process, 2, &filter), 1 | 4);
+
+    char section[128];
+    snprintf(section, sizeof(section), "[profile cwd:%s]", dir);
+    const char *const cwd[] = { "[profile cwd:*/.minecraft]", section };
+    CHECK_EQ_U64(run(cwd, 2, &filter), 1 | 4);
+
+    // '*' also matches '/'.
+    const char *const nested[] = { "[profile cwd:/tmp*profile*]" };
+    CHECK_EQ_U64(run(nested, 1, &filter), 1 | 2);
+}
+
+int main(void) {
+    // The working directory is read once, at the first selector.
+    char dir[] = "/tmp/osm-test-profile.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0)
+    {
+        perror(dir);
+        return 1;
+    }
+
+    check_global();
+    check_launcher_profile();
+    check_malformed();
+    check_identity(dir);
+
+    if (chdir("/") == 0) rmdir(dir);
+    return check_report("profile");
+}
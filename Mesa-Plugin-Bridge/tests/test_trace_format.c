@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "trace_format.h"
+#include "check.h"
+
+static void check_varint(void) {
+    static const struct {
+        uint64_t value;
+        size_t length;
+    } cases[] = {
+        { 0, 1 }, { 1, 1 }, { 127, 1 }, { 128, 2 }, { 16383, 2 }, { 16384, 3 },
+        { UINT32_MAX, 5 }, { (uint64_t)1 << 63, 10 }, { UINT64_MAX, 10 },
+    };
+    unsigned char buffer[16];
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        unsigned char *end = trace_put_varint(buffer, cases[i].value);
+        CHECK_EQ_U64(end - buffer, cases[i].length);
+
+        uint64_t value = 0;
+        CHECK(trace_get_varint(buffer, end, &value) == end);
+        CHECK_EQ_U64(value, cases[i].value);
+        // One byte short.
+        CHECK(trace_get_varint(buffer, end - 1, &value) == NULL);
+    }
+
+    // Back to back, the way records hold them.
+    unsigned char *p = trace_put_varint(buffer, 300);
+    p = trace_put_varint(p, 5);
+    uint64_t first, second;
+    const unsigned char *q = trace_get_varint(buffer, p, &first);
+    CHECK(q != NULL);
+    if (q) q = trace_get_varint(q, p, &second);
+    CHECK(q == p);
+    CHECK_EQ_U64(first, 300);
+    CHECK_EQ_U64(second, 5);
+
+    // More continuation bytes than any u64 needs.
+    memset(buffer, 0x80, sizeof(buffer));
+    uint64_t value;
+    CHECK(trace_get_varint(buffer, buffer + sizeof(buffer), &value) == NULL);
+    CHECK(trace_get_varint(buffer, buffer, &value) == NULL);
+}
+
+// Code values in order as one field would be and decode them again.
+static void round_trip(const uint64_t *bits, int count, bool isFloat) {
+    uint64_t encodeLast = 0, decodeLast = 0;
+    unsigned char buffer[16];
+    for (int i = 0; i < count; i++)
+    {
+        unsigned char *end = trace_put_varint(buffer, trace_encode(&encodeLast, bits[i], isFloat));
+        uint64_t coded = 0;
+        CHECK(trace_get_varint(buffer, end, &coded) == end);
+        CHECK_EQ_U64(trace_decode(&decodeLast, coded, isFloat), bits[i]);
+    }
+    CHECK_EQ_U64(decodeLast, encodeLast);
+}
+
+static void check_delta(void) {
+    const int64_t ints[] = { 0, -1, 1, -64, 63, INT64_MIN, INT64_MAX, INT64_MIN, -7, 0 };
+    uint64_t bits[10];
+    for (int i = 0; i < 10; i++) bits[i] = TRACE_BITS(ints[i]);
+    round_trip(bits, 10, false);
+
+    // Small steps either way code to one byte, however large the values.
+    const int64_t steps[] = { 1000000, 1000063, 1000000, 999936, 999937 };
+    for (int i = 0; i < 5; i++) bits[i] = TRACE_BITS(steps[i]);
+    uint64_t last = bits[0];
+    for (int i = 1; i < 5; i++) CHECK(trace_encode(&last, bits[i], false) < 0x80);
+
+    // Repeated values code to 0.
+    last = TRACE_BITS((int64_t)-123456789);
+    CHECK_EQ_U64(trace_encode(&last, TRACE_BITS((int64_t)-123456789), false), 0);
+
+    const float floats[] = { 0.0f, 1.0f, -1.0f, 1.0f, 0.5f, -0.0f, 3.4e38f };
+    for (int i = 0; i < 7; i++) bits[i] = TRACE_BITS(floats[i]);
+    round_trip(bits, 7, true);
+    last = TRACE_BITS(1.0f);
+    CHECK_EQ_U64(trace_encode(&last, TRACE_BITS(1.0f), true), 0);
+
+    const double doubles[] = { 0.0, 1e300, -2.5, -2.5, 1e-300 };
+    for (int i = 0; i < 5; i++) bits[i] = TRACE_BITS(doubles[i]);
+    round_trip(bits, 5, true);
+
+    CHECK(TRACE_IS_FLOAT(1.0f));
+    CHECK(TRACE_IS_FLOAT(1.0));
+    CHECK(!TRACE_IS_FLOAT((GLint)1));
+    CHECK(!TRACE_IS_FLOAT((const void*)NULL));
+}
+
+static void check_from_bits(void) {
+    // Integers are stored sign extended; narrow fields keep the low bytes.
+    GLshort s = 0;
+    TRACE_FROM_BITS(TRACE_BITS((GLshort)-2), &s);
+    CHECK(s == -2);
+    GLubyte b = 0;
+    TRACE_FROM_BITS(TRACE_BITS((GLubyte)200), &b);
+    CHECK(b == 200);
+    GLenum e = 0;
+    TRACE_FROM_BITS(TRACE_BITS((GLenum)GL_TEXTURE_2D), &e);
+    CHECK(e == GL_TEXTURE_2D);
+    GLint i = 0;
+    TRACE_FROM_BITS(TRACE_BITS((GLint)INT32_MIN), &i);
+    CHECK(i == INT32_MIN);
+    GLsizeiptr size = 0;
+    TRACE_FROM_BITS(TRACE_BITS((GLsizeiptr)-1), &size);
+    CHECK(size == -1);
+
+    float f = 0.0f;
+    TRACE_FROM_BITS(TRACE_BITS(-0.25f), &f);
+    CHECK(f == -0.25f);
+    double d = 0.0;
+    TRACE_FROM_BITS(TRACE_BITS(1e-300), &d);
+    CHECK(d == 1e-300);
+
+    static const int object = 0;
+    const void *pointer = NULL;
+    TRACE_FROM_BITS(TRACE_BITS((const void*)&object), &pointer);
+    CHECK(pointer == &object);
+}
+
+int main(void) {
+    check_varint();
+    check_delta();
+    check_from_bits();
+    return check_report("trace_format");
+}
@@ -0,0 +1,305 @@
+#include <errno.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "workload.h"
+#include "bench_run.h"
+
+typedef struct {
+    WorkloadResult workload;
+    double loadMs;
+} ChildReport;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+bool bench_write_env(const char *path, const char *basePath, const char *const *overrides, int count) {
+    FILE *out = fopen(path, "w");
+    if (!out) return false;
+
+    // Later entries win, so the overrides go after the global part of the
+    // base file but ahead of its profile sections.
+    bool written = false;
+    FILE *base = basePath ? fopen(basePath, "r") : NULL;
+    if (base)
+    {
+        char line[1024];
+        while (fgets(line, sizeof(line), base))
+        {
+            if (line[0] == '[' && !written)
+            {
+                for (int i = 0; i < count; i++) fprintf(out, "%s\n", overrides[i]);
+                written = true;
+            }
+            fputs(line, out);
+            if (!strchr(line, '\n')) fputc('\n', out);
+        }
+        fclose(base);
+    }
+    if (!written)
+    {
+        for (int i = 0; i < count; i++) fprintf(out, "%s\n", overrides[i]);
+    }
+    return fclose(out) == 0;
+}
+
+static void run_child(const BenchOptions *options, int fd, const char *envPath) {
+    if (!options->verbose)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+        {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            close(null);
+        }
+    }
+    setenv("OSM_ENV_FILE", envPath, 1);
+
+    ChildReport report;
+    double start = now_ms();
+    void *bridge = dlopen(options->bridgePath, RTLD_NOW | RTLD_LOCAL);
+    if (!bridge) _exit(2);
+    report.loadMs = now_ms() - start;
+
+    WorkloadApi api = {
+        .CreateContext = (__typeof__(api.CreateContext))dlsym(bridge, "OSMesaCreateContext"),
+        .MakeCurrent = (__typeof__(api.MakeCurrent))dlsym(bridge, "OSMesaMakeCurrent"),
+        .DestroyContext = (__typeof__(api.DestroyContext))dlsym(bridge, "OSMesaDestroyContext"),
+        .GetProcAddress = (__typeof__(api.GetProcAddress))dlsym(bridge, "OSMesaGetProcAddress"),
+    };
+    bool ok = api.CreateContext && api.MakeCurrent && api.DestroyContext && api.GetProcAddress;
+    if (ok && options->recreate) ok = workload_recreate(&api, options->width, options->height, options->recreate, &report.workload);
+    else if (ok) ok = workload_run(&api, options->width, options->height, options->frames, &report.workload);
+
+    if (ok && write(fd, &report, sizeof(report)) != (ssize_t)sizeof(report)) ok = false;
+    _exit(ok ? 0 : 1);
+}
+
+static bool run_once(const BenchOptions *options, const char *envPath, ChildReport *report) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        run_child(options, fds[1], envPath);
+    }
+    close(fds[1]);
+
+    size_t received = 0;
+    double deadline = now_ms() + options->timeoutMs;
+    while (received < sizeof(*report))
+    {
+        int remaining = (int)(deadline - now_ms());
+        if (remaining <= 0) break;
+
+        struct pollfd pfd = { .fd = fds[0], .events = POLLIN };
+        int ready = poll(&pfd, 1, remaining);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) break;
+
+        ssize_t count = read(fds[0], (char*)report + received, sizeof(*report) - received);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) break;
+        received += (size_t)count;
+    }
+    close(fds[0]);
+
+    if (received < sizeof(*report)) kill(pid, SIGKILL);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    return received == sizeof(*report) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// The GALLIUM_DRIVER that applies to every game: the last one before the
+// first profile section.
+static void env_driver(const char *envPath, char *driver, size_t size) {
+    snprintf(driver, size, "llvmpipe");
+    FILE *in = fopen(envPath, "r");
+    if (!in) return;
+    char line[1024];
+    while (fgets(line, sizeof(line), in) && line[0] != '[')
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!strncmp(line, "GALLIUM_DRIVER=", 15) && line[15]) snprintf(driver, size, "%s", line + 15);
+    }
+    fclose(in);
+}
+
+// Run osm-replay on the trace and add its replay frame times, minus the
+// first, to samples. It prints a line per frame: index, recorded ms and
+// replay ms, separated by tabs.
+static bool replay_once(const BenchOptions *options, const char *envPath, double **samples, int *count, int *capacity) {
+    char driver[1024];
+    env_driver(envPath, driver, sizeof(driver));
+
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        if (!options->verbose)
+        {
+            int null = open("/dev/null", O_WRONLY);
+            if (null >= 0)
+            {
+                dup2(null, STDERR_FILENO);
+                close(null);
+            }
+        }
+        execl(options->replayPath, options->replayPath, "-e", envPath, "-d", driver, "-b", options->bridgePath,
+                options->tracePath, (char*)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    bool complete = true;
+    char line[256];
+    size_t length = 0;
+    double deadline = now_ms() + options->timeoutMs;
+    for (;;)
+    {
+        int remaining = (int)(deadline - now_ms());
+        struct pollfd pfd = { .fd = fds[0], .events = POLLIN };
+        int ready = remaining > 0 ? poll(&pfd, 1, remaining) : 0;
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0)
+        {
+            complete = false;
+            break;
+        }
+        char buffer[4096];
+        ssize_t received = read(fds[0], buffer, sizeof(buffer));
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) break;
+        for (ssize_t i = 0; i < received; i++)
+        {
+            if (buffer[i] != '\n')
+            {
+                if (length < sizeof(line) - 1) line[length++] = buffer[i];
+                continue;
+            }
+            line[length] = '\0';
+            length = 0;
+            int frame;
+            double recorded, replayed;
+            if (sscanf(line, "%d\t%lf\t%lf", &frame, &recorded, &replayed) != 3 || frame == 0) continue;
+            if (*count == *capacity)
+            {
+                int grown = *capacity ? *capacity * 2 : 1024;
+                double *more = realloc(*samples, sizeof(double) * (size_t)grown);
+                if (!more)
+                {
+                    complete = false;
+                    break;
+                }
+                *samples = more;
+                *capacity = grown;
+            }
+            (*samples)[(*count)++] = replayed;
+        }
+        if (!complete) break;
+    }
+    close(fds[0]);
+
+    if (!complete) kill(pid, SIGKILL);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    return complete && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p) {
+    if (count <= 0) return 0;
+    int index = (int)(p / 100.0 * (count - 1) + 0.5);
+    return sorted[index < 0 ? 0 : index >= count ? count - 1 : index];
+}
+
+void bench_measure(const BenchOptions *options, const char *envPath, int repeats, BenchStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    double *samples = NULL;
+    int sampleCount = 0;
+    int sampleCapacity = 0;
+
+    if (options->tracePath)
+    {
+        for (int run = 0; run < repeats; run++)
+        {
+            // A failed run's frames stay out of the pool.
+            int before = sampleCount;
+            if (replay_once(options, envPath, &samples, &sampleCount, &sampleCapacity)) stats->runs++;
+            else sampleCount = before;
+        }
+        snprintf(stats->renderer, sizeof(stats->renderer), "trace replay");
+    }
+    else
+    {
+        sampleCapacity = repeats * WORKLOAD_MAX_FRAMES;
+        samples = malloc(sizeof(double) * (size_t)sampleCapacity);
+    }
+
+    for (int run = 0; !options->tracePath && samples && run < repeats; run++)
+    {
+        ChildReport report;
+        if (!run_once(options, envPath, &report)) continue;
+        // The first frame pays for shader and state compilation, the first
+        // recreate cycle for a cold context the pool could not have held.
+        for (int frame = 1; frame < report.workload.frames; frame++) samples[sampleCount++] = report.workload.frameMs[frame];
+        stats->loadMs += report.loadMs;
+        stats->createMs += report.workload.createMs;
+        stats->readbackMBps += report.workload.readbackMBps;
+        memcpy(stats->renderer, report.workload.renderer, sizeof(stats->renderer));
+        stats->runs++;
+    }
+
+    stats->ok = stats->runs == repeats && sampleCount > 0;
+    if (stats->runs > 0)
+    {
+        stats->loadMs /= stats->runs;
+        stats->createMs /= stats->runs;
+        stats->readbackMBps /= stats->runs;
+    }
+    if (sampleCount > 0)
+    {
+        qsort(samples, sampleCount, sizeof(double), compare_double);
+        stats->p50 = percentile(samples, sampleCount, 50);
+        stats->p95 = percentile(samples, sampleCount, 95);
+        stats->p99 = percentile(samples, sampleCount, 99);
+    }
+    free(samples);
+}
@@ -0,0 +1,52 @@
+#ifndef BENCH_RUN_H
+#define BENCH_RUN_H
+
+#include <stdbool.h>
+
+// Shared by osm-sweep and osm-bench. Every run happens in its own
+// process, which loads libOSMBridge.so with an env.txt handed over through
+// OSM_ENV_FILE, so Mesa and the bridge see the settings exactly as they
+// would in a game. The reference workload from src/workload.c is replayed
+// through the bridge's OSMesa entry points, or, with tracePath set, a
+// trace recorded with OSM_TRACE through osm-replay.
+
+typedef struct {
+    const char *bridgePath;
+    int width;
+    int height;
+    int frames;
+    // Run workload_recreate() with this many cycles instead of frames.
+    int recreate;
+    int timeoutMs;
+    // Keep the bridge's and Mesa's output.
+    bool verbose;
+    // Replay this trace with replayPath (osm-replay) instead of running
+    // the workload; width, height, frames and recreate do not apply. The
+    // replay uses the env.txt's GALLIUM_DRIVER, llvmpipe if it sets none.
+    const char *tracePath;
+    const char *replayPath;
+} BenchOptions;
+
+typedef struct {
+    bool ok;
+    int runs;
+    // Frame (or recreate cycle) times pooled over every run, minus each
+    // run's first one.
+    double p50;
+    double p95;
+    double p99;
+    // dlopen() of the bridge, which includes its constructor and Mesa's.
+    double loadMs;
+    double createMs;
+    double readbackMBps;
+    char renderer[64];
+} BenchStats;
+
+// Write basePath (if any) to path with the KEY=value overrides placed
+// before the first profile section, so they apply to every game.
+bool bench_write_env(const char *path, const char *basePath, const char *const *overrides, int count);
+// Run the workload or replay the trace repeats times; ok only when every
+// run completed.
+void bench_measure(const BenchOptions *options, const char *envPath, int repeats, BenchStats *stats);
+
+#endif // BENCH_RUN_H
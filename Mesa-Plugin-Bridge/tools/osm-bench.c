@@ -0,0 +1,211 @@
+// osm-bench: time the reference workload through the bridge with the
+// current env.txt, once per Gallium driver, and report frame-time
+// percentiles, startup time and glReadPixels bandwidth. With -R it
+// instead times context create/destroy cycles with the context pool off
+// and on, which is what the pool is for:
+//
+//   Mesa-Plugin-Bridge/tools/osm-bench -e env.txt -R 50
+//
+// Built by ndk-build next to libOSMBridge.so for the plugin app, which
+// runs it from its native library directory, and by tools/Makefile for
+// headless runs on Linux:
+//
+//   make -C Mesa-Plugin-Bridge/tools
+//   export MESA_LIBRARY=/usr/lib/x86_64-linux-gnu/libOSMesa.so.8
+//   Mesa-Plugin-Bridge/tools/osm-bench -e env.txt -d llvmpipe,softpipe
+//
+// The bridge itself runs it, from the same directory, for the
+// GALLIUM_DRIVER=auto and OSM_LP_TUNE probes (src/probe.c).
+//
+// One tab separated line per driver goes to stdout, after a header line
+// starting with '#'; a readable summary goes to stderr.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "workload.h"
+#include "bench_run.h"
+
+#define MAX_DRIVERS 8
+#define MAX_NAME 32
+#define MAX_SETTINGS 16
+
+#ifdef __ANDROID__
+#define DEFAULT_ENV_FILE "/sdcard/Mesa/env.txt"
+#define DEFAULT_WORK_DIR "/data/local/tmp"
+#else
+#define DEFAULT_ENV_FILE NULL
+#define DEFAULT_WORK_DIR "/tmp"
+#endif
+
+static void usage(const char *self) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -e FILE   env.txt to benchmark (default: $OSM_ENV_FILE%s%s)\n"
+            "  -d LIST   comma separated Gallium drivers to compare (default: the one in env.txt)\n"
+            "  -s K=V    extra env.txt line for every run, may be repeated\n"
+            "  -b FILE   libOSMBridge.so to load (default: next to this tool)\n"
+            "  -w DIR    directory for the per-run env.txt (default: $TMPDIR or %s)\n"
+            "  -f N      frames per run (default 60, at most %d)\n"
+            "  -R N      time N context recreate cycles per run, pool off vs on, instead of frames\n"
+            "  -r N      runs per driver (default 3)\n"
+            "  -W N, -H N  framebuffer size (default 640x360)\n"
+            "  -t MS     per-run timeout (default 30000)\n"
+            "  -v        keep the bridge's and Mesa's output\n"
+            "MESA_LIBRARY must point at libOSMesa.so.\n",
+            self, DEFAULT_ENV_FILE ? ", then " : "", DEFAULT_ENV_FILE ? DEFAULT_ENV_FILE : "", DEFAULT_WORK_DIR, WORKLOAD_MAX_FRAMES);
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options = {
+        .width = 640,
+        .height = 360,
+        .frames = 60,
+        .timeoutMs = 30000,
+    };
+    const char *envFile = getenv("OSM_ENV_FILE");
+    const char *driverList = NULL;
+    const char *workDir = getenv("TMPDIR");
+    int repeats = 3;
+    const char *settings[MAX_SETTINGS];
+    int settingCount = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "e:d:s:b:w:f:R:r:W:H:t:vh")) != -1)
+    {
+        switch (option)
+        {
+            case 'e': envFile = optarg; break;
+            case 'd': driverList = optarg; break;
+            case 's':
+                if (settingCount == MAX_SETTINGS || !strchr(optarg, '='))
+                {
+                    usage(argv[0]);
+                    return 2;
+                }
+                settings[settingCount++] = optarg;
+                break;
+            case 'b': options.bridgePath = optarg; break;
+            case 'w': workDir = optarg; break;
+            case 'f': options.frames = atoi(optarg); break;
+            case 'R': options.recreate = atoi(optarg); break;
+            case 'r': repeats = atoi(optarg); break;
+            case 'W': options.width = atoi(optarg); break;
+            case 'H': options.height = atoi(optarg); break;
+            case 't': options.timeoutMs = atoi(optarg); break;
+            case 'v': options.verbose = true; break;
+            default: usage(argv[0]); return option == 'h' ? 0 : 2;
+        }
+    }
+    if (options.frames < 2 || options.frames > WORKLOAD_MAX_FRAMES || repeats < 1
+        || (options.recreate && (options.recreate < 2 || options.recreate > WORKLOAD_MAX_FRAMES)) || options.width < 1 || options.height < 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!getenv("MESA_LIBRARY"))
+    {
+        fprintf(stderr, "osm-bench: MESA_LIBRARY is not set\n");
+        return 2;
+    }
+    if (!envFile || !envFile[0]) envFile = DEFAULT_ENV_FILE;
+    if (envFile && access(envFile, R_OK) != 0)
+    {
+        fprintf(stderr, "osm-bench: cannot read %s: %s\n", envFile, strerror(errno));
+        return 2;
+    }
+    if (!workDir || !workDir[0]) workDir = DEFAULT_WORK_DIR;
+
+    char defaultBridge[4096];
+    if (!options.bridgePath)
+    {
+        const char *slash = strrchr(argv[0], '/');
+        snprintf(defaultBridge, sizeof(defaultBridge), "%.*slibOSMBridge.so", slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+        if (!slash) snprintf(defaultBridge, sizeof(defaultBridge), "./libOSMBridge.so");
+        options.bridgePath = defaultBridge;
+    }
+
+    // An empty name keeps whatever env.txt selects.
+    char drivers[MAX_DRIVERS][MAX_NAME] = { "" };
+    int driverCount = 1;
+    if (driverList && driverList[0])
+    {
+        driverCount = 0;
+        for (const char *p = driverList; *p && driverCount < MAX_DRIVERS;)
+        {
+            size_t length = strcspn(p, ",");
+            if (length) snprintf(drivers[driverCount++], MAX_NAME, "%.*s", (int)length, p);
+            p += length + (p[length] == ',');
+        }
+    }
+
+    char directory[4096];
+    snprintf(directory, sizeof(directory), "%s/osm-bench.XXXXXX", workDir);
+    if (!mkdtemp(directory))
+    {
+        fprintf(stderr, "osm-bench: cannot create a work directory in %s: %s\n", workDir, strerror(errno));
+        return 1;
+    }
+    char envPath[sizeof(directory) + 16];
+    char binPath[sizeof(directory) + 16];
+    snprintf(envPath, sizeof(envPath), "%s/env.txt", directory);
+    snprintf(binPath, sizeof(binPath), "%s/env.bin", directory);
+
+    printf("# driver\tstatus\tp50_ms\tp95_ms\tp99_ms\tload_ms\tcreate_ms\treadback_mbps\trenderer\n");
+    // In recreate mode every driver runs once with the pool off, once on.
+    static const char *const poolSettings[] = { "OSM_CONTEXT_POOL_SIZE=0", "OSM_CONTEXT_POOL_SIZE=1" };
+    int variants = options.recreate ? 2 : 1;
+    int completed = 0;
+    for (int i = 0; i < driverCount * variants; i++)
+    {
+        const char *driver = drivers[i / variants];
+        char line[MAX_NAME + 32];
+        const char *overrides[2 + MAX_SETTINGS];
+        int overrideCount = 0;
+        snprintf(line, sizeof(line), "GALLIUM_DRIVER=%.*s", MAX_NAME, driver);
+        if (driver[0]) overrides[overrideCount++] = line;
+        if (options.recreate) overrides[overrideCount++] = poolSettings[i % variants];
+        for (int s = 0; s < settingCount; s++) overrides[overrideCount++] = settings[s];
+
+        unlink(binPath);
+        if (!bench_write_env(envPath, envFile, overrides, overrideCount))
+        {
+            fprintf(stderr, "osm-bench: cannot write %s\n", envPath);
+            continue;
+        }
+
+        BenchStats stats;
+        bench_measure(&options, envPath, repeats, &stats);
+        char name[MAX_NAME + 16];
+        snprintf(name, sizeof(name), "%s%s", driver[0] ? driver : "-", !options.recreate ? "" : i % variants ? "/pool" : "/no-pool");
+        if (!stats.ok)
+        {
+            fprintf(stderr, "%s: failed (%d of %d runs completed)\n", name, stats.runs, repeats);
+            printf("%s\tfail\t0\t0\t0\t0\t0\t0\t\n", name);
+            continue;
+        }
+
+        completed++;
+        if (options.recreate)
+        {
+            fprintf(stderr, "%s (%s): recreate p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, first create %.1f ms\n",
+                    name, stats.renderer, stats.p50, stats.p95, stats.p99, stats.createMs);
+        }
+        else
+        {
+            fprintf(stderr, "%s (%s): p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, startup %.1f + %.1f ms, readback %.0f MB/s\n",
+                    name, stats.renderer, stats.p50, stats.p95, stats.p99, stats.loadMs, stats.createMs, stats.readbackMBps);
+        }
+        printf("%s\tok\t%.3f\t%.3f\t%.3f\t%.2f\t%.2f\t%.1f\t%s\n",
+               name, stats.p50, stats.p95, stats.p99, stats.loadMs, stats.createMs, stats.readbackMBps, stats.renderer);
+        fflush(stdout);
+    }
+    unlink(envPath);
+    unlink(binPath);
+    rmdir(directory);
+
+    return completed ? 0 : 1;
+}
@@ -0,0 +1,1214 @@
+// osm-replay: replay a trace recorded with OSM_TRACE=<file> through the
+// bridge, on llvmpipe by default, and time every frame.
+//
+//   make -C Mesa-Plugin-Bridge/tools
+//   export MESA_LIBRARY=/usr/lib/x86_64-linux-gnu/libOSMesa.so.8
+//   Mesa-Plugin-Bridge/tools/osm-replay -e env.txt game.osmtrace
+//
+// A frame ends at each glFinish() or OSMesaFlushFrontbuffer(). One tab
+// separated line per frame goes to stdout with the frame time the game
+// saw while recording and the replay time; a summary goes to stderr.
+//
+// Calls are replayed from one thread in the order the bridge flushed
+// them, switching to each recording thread's context as its records come
+// up. Client arrays and indices are drawn from the copies recorded ahead
+// of each draw. What the trace cannot reproduce is skipped and counted:
+// draws whose client memory the bridge could not capture, and entry points
+// recorded by name only. Writes through mapped buffers are not recorded.
+
+#include <errno.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <GL/osmesa.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include "trace_format.h"
+#include "bench_run.h"
+
+#define MAX_CONTEXTS 256
+#define MAX_STREAMS 256
+#define MAX_NAMES 8192
+#define MAX_FRAMES (1 << 20)
+#define MAX_CHUNK ((size_t)64 << 20)
+
+typedef struct {
+    uint64_t id;
+    OSMesaContext ctx;
+    void *buffer;
+    size_t bufferBytes;
+} ReplayContext;
+
+typedef struct {
+    unsigned char *data;
+    size_t bytes;
+    size_t capacity;
+} Copy;
+
+typedef struct {
+    Copy copy;
+    GLint size;
+    GLenum type;
+    GLsizei stride;
+    GLint flags;
+    // Bytes from the array pointer to the first copied one.
+    size_t start;
+} ReplayArray;
+
+typedef struct {
+    uint64_t id;
+    TraceDelta delta;
+    ReplayContext *current;
+    GLenum type;
+    GLsizei width;
+    GLsizei height;
+    // What the next draw reads from client memory, from the ClientArray
+    // and ClientIndices records ahead of it.
+    ReplayArray arrays[TRACE_ARRAY_SLOTS];
+    Copy indices;
+    uint32_t pendingArrays;
+    bool pendingIndices;
+    // From the last ClientDraw: 1 to replay the next draw, -1 to skip it.
+    int drawCapture;
+} Stream;
+
+#define CMD(n, ...) void (APIENTRY *n)(__VA_ARGS__);
+#define GL_CMD0(n) void (APIENTRY *n)(void);
+#define GL_CMD1(n, ...) CMD(n, __VA_ARGS__)
+#define GL_CMD2(n, ...) CMD(n, __VA_ARGS__)
+#define GL_CMD3(n, ...) CMD(n, __VA_ARGS__)
+#define GL_CMD4(n, ...) CMD(n, __VA_ARGS__)
+#define GL_CMD5(n, ...) CMD(n, __VA_ARGS__)
+#define GL_CMD6(n, ...) CMD(n, __VA_ARGS__)
+#define GL_UNIFORMV(n, type, width) void (APIENTRY *n)(GLint, GLsizei, const type*);
+#define GL_UNIFORM_MATRIX(n, width) void (APIENTRY *n)(GLint, GLsizei, GLboolean, const GLfloat*);
+#define GL_MATRIX(n) void (APIENTRY *n)(const GLfloat*);
+static struct {
+    OSMesaContext (*CreateContext)(GLenum, OSMesaContext);
+    GLboolean (*MakeCurrent)(OSMesaContext, void*, GLenum, GLsizei, GLsizei);
+    void (*DestroyContext)(OSMesaContext);
+    void (*PixelStore)(GLint, GLint);
+    void (*FlushFrontbuffer)(void);
+    OSMESAproc (*GetProcAddress)(const char*);
+#include "gl_commands.h"
+    void (APIENTRY *VertexArrayElementBuffer)(GLuint, GLuint);
+    void (APIENTRY *ReadPixels)(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void*);
+    void (APIENTRY *Finish)(void);
+    void (APIENTRY *GetIntegerv)(GLenum, GLint*);
+    // glDeleteBuffers and glDeleteVertexArrays among them.
+#define X(n) \
+    void (APIENTRY *Gen##n)(GLsizei, GLuint*); \
+    void (APIENTRY *Delete##n)(GLsizei, const GLuint*);
+    TRACE_NAME_KINDS(X)
+#undef X
+    GLuint (APIENTRY *CreateShader)(GLenum);
+    GLuint (APIENTRY *CreateProgram)(void);
+    void (APIENTRY *ShaderSource)(GLuint, GLsizei, const GLchar *const*, const GLint*);
+    void (APIENTRY *CompileShader)(GLuint);
+    void (APIENTRY *AttachShader)(GLuint, GLuint);
+    void (APIENTRY *DetachShader)(GLuint, GLuint);
+    void (APIENTRY *LinkProgram)(GLuint);
+    void (APIENTRY *DeleteShader)(GLuint);
+    void (APIENTRY *DeleteProgram)(GLuint);
+    void (APIENTRY *BindAttribLocation)(GLuint, GLuint, const GLchar*);
+    void (APIENTRY *BufferData)(GLenum, GLsizeiptr, const void*, GLenum);
+    void (APIENTRY *BufferSubData)(GLenum, GLintptr, GLsizeiptr, const void*);
+    void (APIENTRY *TexImage2D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*);
+    void (APIENTRY *TexSubImage2D)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*);
+    void (APIENTRY *TexImage3D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*);
+    void (APIENTRY *TexSubImage3D)(GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const void*);
+} gl;
+#undef CMD
+#undef GL_CMD0
+#undef GL_CMD1
+#undef GL_CMD2
+#undef GL_CMD3
+#undef GL_CMD4
+#undef GL_CMD5
+#undef GL_CMD6
+#undef GL_UNIFORMV
+#undef GL_UNIFORM_MATRIX
+#undef GL_MATRIX
+
+static ReplayContext contexts[MAX_CONTEXTS];
+static int contextCount = 0;
+static Stream *streams[MAX_STREAMS];
+static int streamCount = 0;
+static Stream *active = NULL;
+static char *names[MAX_NAMES];
+static unsigned long long untraced[MAX_NAMES];
+static unsigned long long replayedCalls = 0;
+static unsigned long long skippedCalls = 0;
+// Objects that got another name than while recording; later calls that
+// use the recorded names hit the wrong object or none.
+static unsigned long long renamedObjects = 0;
+// Uploads from client memory in a format the bridge could not size.
+static unsigned long long missingUploads = 0;
+// Payloads are copied here so GL sees aligned arrays.
+static uint64_t payload[(256 * 1024) / sizeof(uint64_t)];
+static unsigned char *pixels = NULL;
+static size_t pixelBytes = 0;
+
+static double *recordedMs = NULL;
+static double *replayMs = NULL;
+static int frameCount = 0;
+static double frameStart = 0;
+// The tool's own output, kept visible while the bridge's is muted.
+static FILE *messages = NULL;
+static FILE *frameOut = NULL;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void usage(const char *self) {
+    fprintf(stderr,
+            "Usage: %s [options] TRACE\n"
+            "  -e FILE   env.txt to replay with (default: bridge defaults)\n"
+            "  -d NAME   Gallium driver (default llvmpipe)\n"
+            "  -b FILE   libOSMBridge.so to load (default: next to this tool)\n"
+            "  -w DIR    directory for the generated env.txt (default: $TMPDIR or /tmp)\n"
+            "  -v        keep the bridge's and Mesa's output\n"
+            "MESA_LIBRARY must point at libOSMesa.so.\n",
+            self);
+}
+
+// Send fd to /dev/null and return a stream for where it pointed before.
+static FILE* mute(FILE *stream, int fd) {
+    fflush(stream);
+    int saved = dup(fd);
+    FILE *visible = saved >= 0 ? fdopen(saved, "w") : NULL;
+    int null = open("/dev/null", O_WRONLY);
+    if (!visible || null < 0)
+    {
+        if (visible) fclose(visible);
+        if (null >= 0) close(null);
+        return stream;
+    }
+    dup2(null, fd);
+    close(null);
+    return visible;
+}
+
+static bool load_bridge(const char *path) {
+    void *bridge = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!bridge)
+    {
+        fprintf(messages, "osm-replay: %s\n", dlerror());
+        return false;
+    }
+    gl.CreateContext = (__typeof__(gl.CreateContext))dlsym(bridge, "OSMesaCreateContext");
+    gl.MakeCurrent = (__typeof__(gl.MakeCurrent))dlsym(bridge, "OSMesaMakeCurrent");
+    gl.DestroyContext = (__typeof__(gl.DestroyContext))dlsym(bridge, "OSMesaDestroyContext");
+    gl.PixelStore = (__typeof__(gl.PixelStore))dlsym(bridge, "OSMesaPixelStore");
+    gl.FlushFrontbuffer = (__typeof__(gl.FlushFrontbuffer))dlsym(bridge, "OSMesaFlushFrontbuffer");
+    gl.GetProcAddress = (__typeof__(gl.GetProcAddress))dlsym(bridge, "OSMesaGetProcAddress");
+    if (!gl.CreateContext || !gl.MakeCurrent || !gl.DestroyContext || !gl.PixelStore || !gl.FlushFrontbuffer || !gl.GetProcAddress)
+    {
+        fprintf(messages, "osm-replay: %s does not export the OSMesa entry points\n", path);
+        return false;
+    }
+
+    // Through the bridge, so the replay takes the same paths as the game.
+    #define LOAD(n) gl.n = (__typeof__(gl.n))(void (*)(void))gl.GetProcAddress("gl" #n);
+    #define GL_CMD0(n) LOAD(n)
+    #define GL_CMD1(n, ...) LOAD(n)
+    #define GL_CMD2(n, ...) LOAD(n)
+    #define GL_CMD3(n, ...) LOAD(n)
+    #define GL_CMD4(n, ...) LOAD(n)
+    #define GL_CMD5(n, ...) LOAD(n)
+    #define GL_CMD6(n, ...) LOAD(n)
+    #define GL_UNIFORMV(n, ...) LOAD(n)
+    #define GL_UNIFORM_MATRIX(n, ...) LOAD(n)
+    #define GL_MATRIX(n) LOAD(n)
+    #include "gl_commands.h"
+    LOAD(VertexArrayElementBuffer)
+    LOAD(ReadPixels)
+    LOAD(Finish)
+    LOAD(GetIntegerv)
+    #define X(n) LOAD(Gen##n) LOAD(Delete##n)
+    TRACE_NAME_KINDS(X)
+    #undef X
+    LOAD(CreateShader)
+    LOAD(CreateProgram)
+    LOAD(ShaderSource)
+    LOAD(CompileShader)
+    LOAD(AttachShader)
+    LOAD(DetachShader)
+    LOAD(LinkProgram)
+    LOAD(DeleteShader)
+    LOAD(DeleteProgram)
+    LOAD(BindAttribLocation)
+    LOAD(BufferData)
+    LOAD(BufferSubData)
+    LOAD(TexImage2D)
+    LOAD(TexSubImage2D)
+    LOAD(TexImage3D)
+    LOAD(TexSubImage3D)
+    #undef LOAD
+    #undef GL_CMD0
+    #undef GL_CMD1
+    #undef GL_CMD2
+    #undef GL_CMD3
+    #undef GL_CMD4
+    #undef GL_CMD5
+    #undef GL_CMD6
+    #undef GL_UNIFORMV
+    #undef GL_UNIFORM_MATRIX
+    #undef GL_MATRIX
+    return true;
+}
+
+static ReplayContext* find_context(uint64_t id) {
+    for (int i = 0; i < contextCount; i++)
+    {
+        if (contexts[i].id == id) return &contexts[i];
+    }
+    return NULL;
+}
+
+static Stream* find_stream(uint64_t id) {
+    for (int i = 0; i < streamCount; i++)
+    {
+        if (streams[i]->id == id) return streams[i];
+    }
+    if (streamCount == MAX_STREAMS) return NULL;
+    Stream *stream = calloc(1, sizeof(Stream));
+    if (!stream) return NULL;
+    stream->id = id;
+    streams[streamCount++] = stream;
+    return stream;
+}
+
+static GLint get_integer(GLenum pname) {
+    GLint value = 0;
+    if (gl.GetIntegerv) gl.GetIntegerv(pname, &value);
+    return value;
+}
+
+static size_t pixel_size(GLenum type) {
+    switch (type)
+    {
+        case GL_UNSIGNED_SHORT_5_6_5: return 2;
+        case GL_UNSIGNED_SHORT: return 8;
+        case GL_FLOAT: return 16;
+        default: return 4;
+    }
+}
+
+static void bind(Stream *stream) {
+    ReplayContext *context = stream->current;
+    if (!context)
+    {
+        gl.MakeCurrent(NULL, NULL, 0, 0, 0);
+        return;
+    }
+    size_t bytes = (size_t)stream->width * stream->height * pixel_size(stream->type);
+    if (bytes > context->bufferBytes)
+    {
+        void *grown = realloc(context->buffer, bytes);
+        if (!grown) return;
+        context->buffer = grown;
+        context->bufferBytes = bytes;
+    }
+    gl.MakeCurrent(context->ctx, context->buffer, stream->type, stream->width, stream->height);
+}
+
+static void end_frame(uint64_t recordedNs) {
+    if (gl.Finish) gl.Finish();
+    double now = now_ms();
+    if (frameCount < MAX_FRAMES)
+    {
+        recordedMs[frameCount] = recordedNs / 1e6;
+        replayMs[frameCount] = now - frameStart;
+        fprintf(frameOut, "%d\t%.3f\t%.3f\n", frameCount, recordedMs[frameCount], replayMs[frameCount]);
+        frameCount++;
+    }
+    frameStart = now;
+}
+
+// 1 to replay a call, 0 to skip it, -1 to leave it to the next ClientDraw.
+static int can_replay(TraceOp op) {
+    if (!active || !active->current) return 0;
+    switch (op)
+    {
+        case TRACE_OP(VertexPointer):
+        case TRACE_OP(NormalPointer):
+        case TRACE_OP(ColorPointer):
+        case TRACE_OP(TexCoordPointer):
+        case TRACE_OP(VertexAttribPointer):
+        case TRACE_OP(VertexAttribIPointer):
+            // Client memory pointers are set from the copies at the draw.
+            return get_integer(GL_ARRAY_BUFFER_BINDING) ? 1 : -1;
+        case TRACE_OP(DrawArrays):
+        case TRACE_OP(DrawArraysInstanced):
+        case TRACE_OP(DrawElements):
+        case TRACE_OP(DrawElementsInstanced):
+        {
+            int capture = active->drawCapture;
+            active->drawCapture = 0;
+            return capture >= 0;
+        }
+        default:
+            return 1;
+    }
+}
+
+// Place bytes at offset of copy; records of one copy come in order.
+static bool copy_into(Copy *copy, size_t offset, const void *data, size_t bytes) {
+    if (offset == 0) copy->bytes = 0;
+    if (offset != copy->bytes || bytes > MAX_CHUNK) return false;
+    if (offset + bytes > copy->capacity)
+    {
+        unsigned char *grown = realloc(copy->data, offset + bytes);
+        if (!grown) return false;
+        copy->data = grown;
+        copy->capacity = offset + bytes;
+    }
+    if (bytes) memcpy(copy->data + offset, data, bytes);
+    copy->bytes = offset + bytes;
+    return true;
+}
+
+// Point the client arrays of the coming draw at their copies, as if the
+// game's pointer setters had been called with them.
+static void set_client_arrays(Stream *stream) {
+    GLint arrayBuffer = get_integer(GL_ARRAY_BUFFER_BINDING);
+    if (arrayBuffer) gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    for (int slot = 0; slot < TRACE_ARRAY_SLOTS; slot++)
+    {
+        if (!(stream->pendingArrays & (1u << slot))) continue;
+        const ReplayArray *array = &stream->arrays[slot];
+        const void *base = (const void*)((uintptr_t)array->copy.data - array->start);
+        if (slot == TRACE_ARRAY_VERTEX && gl.VertexPointer) gl.VertexPointer(array->size, array->type, array->stride, base);
+        else if (slot == TRACE_ARRAY_NORMAL && gl.NormalPointer) gl.NormalPointer(array->type, array->stride, base);
+        else if (slot == TRACE_ARRAY_COLOR && gl.ColorPointer) gl.ColorPointer(array->size, array->type, array->stride, base);
+        else if (slot >= TRACE_ARRAY_TEXCOORD && slot < TRACE_ARRAY_ATTRIB && gl.TexCoordPointer && gl.ClientActiveTexture)
+        {
+            GLint unit = get_integer(GL_CLIENT_ACTIVE_TEXTURE);
+            gl.ClientActiveTexture(GL_TEXTURE0 + (slot - TRACE_ARRAY_TEXCOORD));
+            gl.TexCoordPointer(array->size, array->type, array->stride, base);
+            gl.ClientActiveTexture(unit ? (GLenum)unit : GL_TEXTURE0);
+        }
+        else if (slot >= TRACE_ARRAY_ATTRIB && (array->flags & TRACE_ARRAY_INTEGER) && gl.VertexAttribIPointer)
+        {
+            gl.VertexAttribIPointer(slot - TRACE_ARRAY_ATTRIB, array->size, array->type, array->stride, base);
+        }
+        else if (slot >= TRACE_ARRAY_ATTRIB && gl.VertexAttribPointer)
+        {
+            gl.VertexAttribPointer(slot - TRACE_ARRAY_ATTRIB, array->size, array->type, (array->flags & TRACE_ARRAY_NORMALIZED) != 0, array->stride, base);
+        }
+    }
+    if (arrayBuffer) gl.BindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
+}
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    TraceOp op;
+    int field;
+    bool failed;
+} Reader;
+
+static uint64_t get_field(Reader *reader, bool isFloat) {
+    uint64_t coded = 0;
+    if (reader->failed || reader->field >= TRACE_MAX_ARGS || !(reader->p = trace_get_varint(reader->p, reader->end, &coded)))
+    {
+        reader->failed = true;
+        return 0;
+    }
+    return trace_decode(&active->delta.last[reader->op][reader->field++], coded, isFloat);
+}
+
+#define FIELD(reader, x) TRACE_FROM_BITS(get_field(reader, TRACE_IS_FLOAT(x)), &(x))
+
+// Copies the payload to aligned memory; NULL when it is empty.
+static const void* get_payload(Reader *reader, size_t *bytes) {
+    uint64_t length = 0;
+    if (reader->failed || !(reader->p = trace_get_varint(reader->p, reader->end, &length)) ||
+        length > sizeof(payload) || length > (uint64_t)(reader->end - reader->p))
+    {
+        reader->failed = true;
+        *bytes = 0;
+        return NULL;
+    }
+    memcpy(payload, reader->p, length);
+    reader->p += length;
+    *bytes = length;
+    return length ? payload : NULL;
+}
+
+// The payload as a string; "" when it is empty.
+static const char* get_string(Reader *reader, size_t *bytes) {
+    const char *text = get_payload(reader, bytes);
+    if (!text) return "";
+    if (*bytes >= sizeof(payload))
+    {
+        reader->failed = true;
+        return "";
+    }
+    ((char*)payload)[*bytes] = '\0';
+    return text;
+}
+
+static void replay_context_op(Reader *reader) {
+    switch (reader->op)
+    {
+        case TRACE_CreateContext:
+        {
+            GLenum format;
+            const void *share, *id;
+            FIELD(reader, format);
+            FIELD(reader, share);
+            FIELD(reader, id);
+            if (reader->failed || find_context((uintptr_t)id) || contextCount == MAX_CONTEXTS) return;
+            ReplayContext *shared = share ? find_context((uintptr_t)share) : NULL;
+            OSMesaContext ctx = gl.CreateContext(format, shared ? shared->ctx : NULL);
+            if (!ctx)
+            {
+                fprintf(messages, "osm-replay: OSMesaCreateContext(0x%x) failed\n", format);
+                return;
+            }
+            contexts[contextCount++] = (ReplayContext){ .id = (uintptr_t)id, .ctx = ctx };
+            return;
+        }
+        case TRACE_MakeCurrent:
+        {
+            const void *id;
+            FIELD(reader, id);
+            FIELD(reader, active->type);
+            FIELD(reader, active->width);
+            FIELD(reader, active->height);
+            if (reader->failed) return;
+            active->current = id ? find_context((uintptr_t)id) : NULL;
+            bind(active);
+            return;
+        }
+        case TRACE_DestroyContext:
+        {
+            const void *id;
+            FIELD(reader, id);
+            ReplayContext *context = find_context((uintptr_t)id);
+            if (reader->failed || !context) return;
+            for (int i = 0; i < streamCount; i++)
+            {
+                if (streams[i]->current == context) streams[i]->current = NULL;
+            }
+            gl.MakeCurrent(NULL, NULL, 0, 0, 0);
+            gl.DestroyContext(context->ctx);
+            free(context->buffer);
+            // Move the last entry into the hole and repoint its streams.
+            ReplayContext *last = &contexts[--contextCount];
+            *context = *last;
+            for (int i = 0; i < streamCount; i++)
+            {
+                if (streams[i]->current == last) streams[i]->current = context;
+            }
+            // The stream being replayed keeps its own context current.
+            if (active->current) bind(active);
+            return;
+        }
+        default:
+            reader->failed = true;
+            return;
+    }
+}
+
+static void replay_client_op(Reader *reader) {
+    switch (reader->op)
+    {
+        case TRACE_ClientArray:
+        {
+            GLint slot, size, flags;
+            GLenum type;
+            GLsizei stride;
+            size_t start, offset, bytes;
+            FIELD(reader, slot);
+            FIELD(reader, size);
+            FIELD(reader, type);
+            FIELD(reader, stride);
+            FIELD(reader, flags);
+            FIELD(reader, start);
+            FIELD(reader, offset);
+            const void *data = get_payload(reader, &bytes);
+            if (reader->failed || slot < 0 || slot >= TRACE_ARRAY_SLOTS) return;
+            ReplayArray *array = &active->arrays[slot];
+            if (!copy_into(&array->copy, offset, data, bytes)) return;
+            array->size = size;
+            array->type = type;
+            array->stride = stride;
+            array->flags = flags;
+            array->start = start;
+            active->pendingArrays |= 1u << slot;
+            return;
+        }
+        case TRACE_ClientIndices:
+        {
+            size_t offset, bytes;
+            FIELD(reader, offset);
+            const void *data = get_payload(reader, &bytes);
+            if (!reader->failed) active->pendingIndices = copy_into(&active->indices, offset, data, bytes);
+            return;
+        }
+        case TRACE_ClientDraw:
+        {
+            bool captured;
+            FIELD(reader, captured);
+            if (reader->failed) return;
+            if (captured && active->current && active->pendingArrays) set_client_arrays(active);
+            active->drawCapture = captured ? 1 : -1;
+            active->pendingArrays = 0;
+            if (!captured) active->pendingIndices = false;
+            return;
+        }
+        default:
+            reader->failed = true;
+            return;
+    }
+}
+
+// Indexed draws take their indices from the copy when there is one.
+static void replay_indexed_draw(Reader *reader) {
+    GLenum mode, type;
+    GLsizei count, instances = 1;
+    const void *indices;
+    bool instanced = reader->op == TRACE_OP(DrawElementsInstanced);
+    FIELD(reader, mode);
+    FIELD(reader, count);
+    FIELD(reader, type);
+    FIELD(reader, indices);
+    if (instanced) FIELD(reader, instances);
+    if (reader->failed || !(instanced ? (void*)gl.DrawElementsInstanced : (void*)gl.DrawElements)) return;
+
+    int decision = can_replay(reader->op);
+    if (decision <= 0)
+    {
+        if (!decision) skippedCalls++;
+        active->pendingIndices = false;
+        return;
+    }
+    if (active->pendingIndices) indices = active->indices.data;
+    active->pendingIndices = false;
+    if (instanced) gl.DrawElementsInstanced(mode, count, type, indices, instances);
+    else gl.DrawElements(mode, count, type, indices);
+    replayedCalls++;
+}
+
+static void gen_names(TraceNameKind kind, GLsizei n, const GLuint *recorded) {
+    GLuint *generated = calloc((size_t)n, sizeof(GLuint));
+    if (!generated) return;
+    switch (kind)
+    {
+#define X(k) case TRACE_NAMES_##k: if (gl.Gen##k) gl.Gen##k(n, generated); break;
+        TRACE_NAME_KINDS(X)
+#undef X
+        default: break;
+    }
+    for (GLsizei i = 0; i < n; i++) renamedObjects += generated[i] != recorded[i];
+    free(generated);
+}
+
+static void delete_names(TraceNameKind kind, GLsizei n, const GLuint *names) {
+    switch (kind)
+    {
+#define X(k) case TRACE_NAMES_##k: if (gl.Delete##k) gl.Delete##k(n, names); break;
+        TRACE_NAME_KINDS(X)
+#undef X
+        default: break;
+    }
+}
+
+static void replay_object_op(Reader *reader) {
+    GLuint a = 0, b = 0;
+    switch (reader->op)
+    {
+        case TRACE_GenNames:
+        case TRACE_DeleteNames:
+        {
+            TraceNameKind kind;
+            GLsizei n;
+            size_t bytes;
+            FIELD(reader, kind);
+            FIELD(reader, n);
+            const GLuint *ids = get_payload(reader, &bytes);
+            if (reader->failed || !active->current || !ids || kind >= TRACE_NAME_KIND_COUNT || n <= 0 || bytes < (size_t)n * sizeof(GLuint)) return;
+            if (reader->op == TRACE_GenNames) gen_names(kind, n, ids);
+            else delete_names(kind, n, ids);
+            break;
+        }
+        case TRACE_CreateShader:
+        {
+            GLenum type;
+            FIELD(reader, type);
+            FIELD(reader, a);
+            if (reader->failed || !active->current || !gl.CreateShader) return;
+            renamedObjects += gl.CreateShader(type) != a;
+            break;
+        }
+        case TRACE_CreateProgram:
+            FIELD(reader, a);
+            if (reader->failed || !active->current || !gl.CreateProgram) return;
+            renamedObjects += gl.CreateProgram() != a;
+            break;
+        case TRACE_ShaderSource:
+        {
+            size_t bytes;
+            FIELD(reader, a);
+            const GLchar *source = get_string(reader, &bytes);
+            GLint length = (GLint)bytes;
+            if (reader->failed || !active->current || !gl.ShaderSource) return;
+            gl.ShaderSource(a, 1, &source, &length);
+            break;
+        }
+        case TRACE_BindAttribLocation:
+        {
+            size_t bytes;
+            FIELD(reader, a);
+            FIELD(reader, b);
+            const GLchar *name = get_string(reader, &bytes);
+            if (reader->failed || !active->current || !gl.BindAttribLocation) return;
+            gl.BindAttribLocation(a, b, name);
+            break;
+        }
+        case TRACE_AttachShader:
+        case TRACE_DetachShader:
+            FIELD(reader, a);
+            FIELD(reader, b);
+            if (reader->failed || !active->current) return;
+            if (reader->op == TRACE_AttachShader && gl.AttachShader) gl.AttachShader(a, b);
+            if (reader->op == TRACE_DetachShader && gl.DetachShader) gl.DetachShader(a, b);
+            break;
+        case TRACE_CompileShader:
+        case TRACE_LinkProgram:
+        case TRACE_DeleteShader:
+        case TRACE_DeleteProgram:
+            FIELD(reader, a);
+            if (reader->failed || !active->current) return;
+            if (reader->op == TRACE_CompileShader && gl.CompileShader) gl.CompileShader(a);
+            if (reader->op == TRACE_LinkProgram && gl.LinkProgram) gl.LinkProgram(a);
+            if (reader->op == TRACE_DeleteShader && gl.DeleteShader) gl.DeleteShader(a);
+            if (reader->op == TRACE_DeleteProgram && gl.DeleteProgram) gl.DeleteProgram(a);
+            break;
+        default:
+            reader->failed = true;
+            return;
+    }
+    replayedCalls++;
+}
+
+static void replay_buffer_op(Reader *reader) {
+    GLenum target, usage = 0;
+    GLsizeiptr size = 0;
+    GLintptr offset = 0;
+    size_t bytes;
+    FIELD(reader, target);
+    if (reader->op == TRACE_BufferData)
+    {
+        FIELD(reader, size);
+        FIELD(reader, usage);
+    }
+    else
+    {
+        FIELD(reader, offset);
+    }
+    const void *data = get_payload(reader, &bytes);
+    if (reader->failed || !active->current) return;
+    if (reader->op == TRACE_BufferData && gl.BufferData) gl.BufferData(target, size, data, usage);
+    if (reader->op == TRACE_BufferSubData && gl.BufferSubData && data) gl.BufferSubData(target, offset, (GLsizeiptr)bytes, data);
+    replayedCalls++;
+}
+
+static void replay_image_op(Reader *reader) {
+    TraceOp op = reader->op;
+    bool full = op == TRACE_TexImage2D || op == TRACE_TexImage3D;
+    bool is3D = op == TRACE_TexImage3D || op == TRACE_TexSubImage3D;
+    GLenum target, format, type;
+    GLint level, internalformat = 0, x = 0, y = 0, z = 0, border = 0;
+    GLsizei width, height, depth = 1;
+    const void *offset;
+    size_t bytes;
+    FIELD(reader, target);
+    FIELD(reader, level);
+    if (full)
+    {
+        FIELD(reader, internalformat);
+    }
+    else
+    {
+        FIELD(reader, x);
+        FIELD(reader, y);
+        if (is3D) FIELD(reader, z);
+    }
+    FIELD(reader, width);
+    FIELD(reader, height);
+    if (is3D) FIELD(reader, depth);
+    if (full) FIELD(reader, border);
+    FIELD(reader, format);
+    FIELD(reader, type);
+    FIELD(reader, offset);
+    const void *pixels = get_payload(reader, &bytes);
+    if (reader->failed || !active->current) return;
+
+    if (!pixels && offset)
+    {
+        if (get_integer(GL_PIXEL_UNPACK_BUFFER_BINDING)) pixels = offset;
+        else
+        {
+            // Client memory the bridge could not size; allocate the
+            // texture but leave its contents undefined.
+            missingUploads++;
+            if (!full)
+            {
+                skippedCalls++;
+                return;
+            }
+        }
+    }
+    if (op == TRACE_TexImage2D && gl.TexImage2D) gl.TexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+    if (op == TRACE_TexSubImage2D && gl.TexSubImage2D) gl.TexSubImage2D(target, level, x, y, width, height, format, type, pixels);
+    if (op == TRACE_TexImage3D && gl.TexImage3D) gl.TexImage3D(target, level, internalformat, width, height, depth, border, format, type, pixels);
+    if (op == TRACE_TexSubImage3D && gl.TexSubImage3D) gl.TexSubImage3D(target, level, x, y, z, width, height, depth, format, type, pixels);
+    replayedCalls++;
+}
+
+static void replay_record(Reader *reader) {
+    // Ahead of their generated cases, which would pass the recorded
+    // address of client memory indices.
+    if (reader->op == TRACE_OP(DrawElements) || reader->op == TRACE_OP(DrawElementsInstanced))
+    {
+        replay_indexed_draw(reader);
+        return;
+    }
+    switch (reader->op)
+    {
+        case TRACE_ClientArray:
+        case TRACE_ClientIndices:
+        case TRACE_ClientDraw:
+            replay_client_op(reader);
+            return;
+        case TRACE_GenNames:
+        case TRACE_DeleteNames:
+        case TRACE_CreateShader:
+        case TRACE_CreateProgram:
+        case TRACE_ShaderSource:
+        case TRACE_CompileShader:
+        case TRACE_AttachShader:
+        case TRACE_DetachShader:
+        case TRACE_LinkProgram:
+        case TRACE_DeleteShader:
+        case TRACE_DeleteProgram:
+        case TRACE_BindAttribLocation:
+            replay_object_op(reader);
+            return;
+        case TRACE_BufferData:
+        case TRACE_BufferSubData:
+            replay_buffer_op(reader);
+            return;
+        case TRACE_TexImage2D:
+        case TRACE_TexSubImage2D:
+        case TRACE_TexImage3D:
+        case TRACE_TexSubImage3D:
+            replay_image_op(reader);
+            return;
+        case TRACE_CreateContext:
+        case TRACE_MakeCurrent:
+        case TRACE_DestroyContext:
+            replay_context_op(reader);
+            return;
+        case TRACE_PixelStore:
+        {
+            GLint pname, value;
+            FIELD(reader, pname);
+            FIELD(reader, value);
+            if (!reader->failed) gl.PixelStore(pname, value);
+            return;
+        }
+        case TRACE_ReadPixels:
+        {
+            GLint x, y;
+            GLsizei width, height;
+            GLenum format, type;
+            const void *offset;
+            FIELD(reader, x);
+            FIELD(reader, y);
+            FIELD(reader, width);
+            FIELD(reader, height);
+            FIELD(reader, format);
+            FIELD(reader, type);
+            FIELD(reader, offset);
+            if (reader->failed || !gl.ReadPixels || !active->current || width <= 0 || height <= 0) return;
+            if (get_integer(GL_PIXEL_PACK_BUFFER_BINDING))
+            {
+                gl.ReadPixels(x, y, width, height, format, type, (void*)offset);
+                return;
+            }
+            size_t bytes = (size_t)width * height * 16;
+            if (bytes > pixelBytes)
+            {
+                unsigned char *grown = realloc(pixels, bytes);
+                if (!grown) return;
+                pixels = grown;
+                pixelBytes = bytes;
+            }
+            gl.ReadPixels(x, y, width, height, format, type, pixels);
+            return;
+        }
+        case TRACE_Finish:
+        case TRACE_FlushFrontbuffer:
+        {
+            long long elapsed;
+            FIELD(reader, elapsed);
+            if (reader->failed) return;
+            if (reader->op == TRACE_FlushFrontbuffer) gl.FlushFrontbuffer();
+            end_frame((uint64_t)elapsed);
+            return;
+        }
+        case TRACE_Name:
+        {
+            GLuint id;
+            size_t bytes;
+            FIELD(reader, id);
+            const char *name = get_payload(reader, &bytes);
+            if (reader->failed || id >= MAX_NAMES || names[id]) return;
+            names[id] = strndup(name ? name : "", bytes);
+            return;
+        }
+        case TRACE_Untraced:
+        {
+            GLuint id;
+            FIELD(reader, id);
+            if (!reader->failed && id < MAX_NAMES) untraced[id]++;
+            return;
+        }
+        case TRACE_DeleteBuffers:
+        case TRACE_DeleteVertexArrays:
+        {
+            GLsizei n;
+            size_t bytes;
+            FIELD(reader, n);
+            const GLuint *ids = get_payload(reader, &bytes);
+            if (reader->failed || !active->current || !ids || bytes < (size_t)n * sizeof(GLuint)) return;
+            if (reader->op == TRACE_DeleteBuffers && gl.DeleteBuffers) gl.DeleteBuffers(n, ids);
+            if (reader->op == TRACE_DeleteVertexArrays && gl.DeleteVertexArrays) gl.DeleteVertexArrays(n, ids);
+            replayedCalls++;
+            return;
+        }
+        case TRACE_VertexArrayElementBuffer:
+        {
+            GLuint vaobj, buffer;
+            FIELD(reader, vaobj);
+            FIELD(reader, buffer);
+            if (reader->failed || !active->current || !gl.VertexArrayElementBuffer) return;
+            gl.VertexArrayElementBuffer(vaobj, buffer);
+            replayedCalls++;
+            return;
+        }
+
+        // Generated cases for gl_commands.h.
+        #define REPLAY(n, call) \
+            if (reader->failed || !gl.n) return; \
+            int decision = can_replay(TRACE_OP(n)); \
+            if (decision <= 0) { skippedCalls += !decision; return; } \
+            gl.n call; \
+            replayedCalls++; \
+            return;
+        #define GL_CMD0(n) case TRACE_OP(n): { REPLAY(n, ()) }
+        #define GL_CMD1(n, t1) case TRACE_OP(n): { t1 a1; FIELD(reader, a1); REPLAY(n, (a1)) }
+        #define GL_CMD2(n, t1, t2) case TRACE_OP(n): { t1 a1; t2 a2; FIELD(reader, a1); FIELD(reader, a2); REPLAY(n, (a1, a2)) }
+        #define GL_CMD3(n, t1, t2, t3) case TRACE_OP(n): { t1 a1; t2 a2; t3 a3; FIELD(reader, a1); FIELD(reader, a2); FIELD(reader, a3); REPLAY(n, (a1, a2, a3)) }
+        #define GL_CMD4(n, t1, t2, t3, t4) case TRACE_OP(n): { t1 a1; t2 a2; t3 a3; t4 a4; FIELD(reader, a1); FIELD(reader, a2); FIELD(reader, a3); FIELD(reader, a4); REPLAY(n, (a1, a2, a3, a4)) }
+        #define GL_CMD5(n, t1, t2, t3, t4, t5) case TRACE_OP(n): { t1 a1; t2 a2; t3 a3; t4 a4; t5 a5; FIELD(reader, a1); FIELD(reader, a2); FIELD(reader, a3); FIELD(reader, a4); FIELD(reader, a5); REPLAY(n, (a1, a2, a3, a4, a5)) }
+        #define GL_CMD6(n, t1, t2, t3, t4, t5, t6) case TRACE_OP(n): { t1 a1; t2 a2; t3 a3; t4 a4; t5 a5; t6 a6; FIELD(reader, a1); FIELD(reader, a2); FIELD(reader, a3); FIELD(reader, a4); FIELD(reader, a5); FIELD(reader, a6); REPLAY(n, (a1, a2, a3, a4, a5, a6)) }
+        #define GL_UNIFORMV(n, type, width) case TRACE_OP(n): { \
+            GLint location; GLsizei count; size_t bytes; \
+            FIELD(reader, location); FIELD(reader, count); \
+            const type *value = get_payload(reader, &bytes); \
+            REPLAY(n, (location, count, value)) }
+        #define GL_UNIFORM_MATRIX(n, width) case TRACE_OP(n): { \
+            GLint location; GLsizei count; GLboolean transpose; size_t bytes; \
+            FIELD(reader, location); FIELD(reader, count); FIELD(reader, transpose); \
+            const GLfloat *value = get_payload(reader, &bytes); \
+            REPLAY(n, (location, count, transpose, value)) }
+        #define GL_MATRIX(n) case TRACE_OP(n): { \
+            size_t bytes; \
+            const GLfloat *m = get_payload(reader, &bytes); \
+            REPLAY(n, (m)) }
+        #include "gl_commands.h"
+        #undef REPLAY
+        #undef GL_CMD0
+        #undef GL_CMD1
+        #undef GL_CMD2
+        #undef GL_CMD3
+        #undef GL_CMD4
+        #undef GL_CMD5
+        #undef GL_CMD6
+        #undef GL_UNIFORMV
+        #undef GL_UNIFORM_MATRIX
+        #undef GL_MATRIX
+
+        default:
+            reader->failed = true;
+            return;
+    }
+}
+
+static bool read_varint(FILE *in, uint64_t *value) {
+    unsigned char bytes[10];
+    int count = 0;
+    int c;
+    while (count < 10 && (c = getc(in)) != EOF)
+    {
+        bytes[count++] = (unsigned char)c;
+        if (!(c & 0x80)) return trace_get_varint(bytes, bytes + count, value) != NULL;
+    }
+    return false;
+}
+
+static bool check_header(FILE *in, const char *path) {
+    unsigned char header[TRACE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), in) != sizeof(header) || memcmp(header, TRACE_MAGIC, 8))
+    {
+        fprintf(stderr, "osm-replay: %s is not a bridge trace\n", path);
+        return false;
+    }
+    uint32_t fields[4];
+    for (int i = 0; i < 4; i++)
+    {
+        fields[i] = 0;
+        for (int b = 0; b < 4; b++) fields[i] |= (uint32_t)header[8 + i * 4 + b] << (b * 8);
+    }
+    if (fields[0] != TRACE_VERSION || fields[1] != TRACE_OP_COUNT || fields[2] != trace_table_hash())
+    {
+        fprintf(stderr, "osm-replay: %s was recorded by a bridge with a different command table\n", path);
+        return false;
+    }
+    return true;
+}
+
+static bool replay(FILE *in) {
+    unsigned char *chunk = NULL;
+    size_t chunkSize = 0;
+    int chunkIndex = 0;
+    const char *error = NULL;
+    bool truncated = false;
+    frameStart = now_ms();
+
+    uint64_t thread, length;
+    while (!error && read_varint(in, &thread))
+    {
+        if (!read_varint(in, &length))
+        {
+            truncated = true;
+            break;
+        }
+        if (length > MAX_CHUNK)
+        {
+            error = "corrupt chunk";
+            break;
+        }
+        if (length > chunkSize)
+        {
+            unsigned char *grown = realloc(chunk, length);
+            if (!grown)
+            {
+                error = "out of memory";
+                break;
+            }
+            chunk = grown;
+            chunkSize = length;
+        }
+        if (fread(chunk, 1, length, in) != length)
+        {
+            truncated = true;
+            break;
+        }
+
+        Stream *stream = find_stream(thread);
+        if (!stream)
+        {
+            error = "too many recording threads";
+            break;
+        }
+        if (stream != active)
+        {
+            active = stream;
+            bind(active);
+        }
+
+        Reader reader = { .p = chunk, .end = chunk + length };
+        while (reader.p < reader.end && !reader.failed)
+        {
+            uint64_t op;
+            if (!(reader.p = trace_get_varint(reader.p, reader.end, &op)) || op >= TRACE_OP_COUNT)
+            {
+                reader.failed = true;
+                break;
+            }
+            reader.op = (TraceOp)op;
+            reader.field = 0;
+            replay_record(&reader);
+        }
+        if (reader.failed) error = "corrupt record";
+        else chunkIndex++;
+    }
+
+    // A game killed while recording leaves a partial last chunk behind.
+    if (truncated || (!error && !feof(in))) fprintf(messages, "osm-replay: trace is truncated after chunk %d\n", chunkIndex);
+    if (error) fprintf(messages, "osm-replay: %s in chunk %d\n", error, chunkIndex);
+
+    gl.MakeCurrent(NULL, NULL, 0, 0, 0);
+    while (contextCount > 0)
+    {
+        contextCount--;
+        gl.DestroyContext(contexts[contextCount].ctx);
+        free(contexts[contextCount].buffer);
+    }
+    for (int i = 0; i < streamCount; i++)
+    {
+        for (int slot = 0; slot < TRACE_ARRAY_SLOTS; slot++) free(streams[i]->arrays[slot].copy.data);
+        free(streams[i]->indices.data);
+    }
+    free(chunk);
+    return !error;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double *values, int count, double p) {
+    if (count <= 0) return 0;
+    qsort(values, count, sizeof(double), compare_double);
+    int index = (int)(p / 100.0 * (count - 1) + 0.5);
+    return values[index];
+}
+
+static void report(void) {
+    // The first frame also pays for context creation and shader compiles.
+    int count = frameCount - 1;
+    if (count > 0)
+    {
+        double *recorded = recordedMs + 1, *replayed = replayMs + 1;
+        double recorded50 = percentile(recorded, count, 50), recorded95 = percentile(recorded, count, 95);
+        double replay50 = percentile(replayed, count, 50), replay95 = percentile(replayed, count, 95), replay99 = percentile(replayed, count, 99);
+        fprintf(messages, "%d frames: replay p50 %.2f ms, p95 %.2f ms, p99 %.2f ms; recorded p50 %.2f ms, p95 %.2f ms\n",
+                frameCount, replay50, replay95, replay99, recorded50, recorded95);
+    }
+    else
+    {
+        fprintf(messages, "%d frames\n", frameCount);
+    }
+    fprintf(messages, "%llu calls replayed, %llu skipped (client memory not in the trace)\n", replayedCalls, skippedCalls);
+    if (renamedObjects) fprintf(messages, "%llu objects got other names than while recording\n", renamedObjects);
+    if (missingUploads) fprintf(messages, "%llu texture uploads without their data\n", missingUploads);
+
+    unsigned long long total = 0;
+    for (int id = 0; id < MAX_NAMES; id++) total += untraced[id];
+    if (!total) return;
+    fprintf(messages, "%llu calls recorded by name only, most frequent:\n", total);
+    for (int shown = 0; shown < 10; shown++)
+    {
+        int best = -1;
+        for (int id = 0; id < MAX_NAMES; id++)
+        {
+            if (untraced[id] && (best < 0 || untraced[id] > untraced[best])) best = id;
+        }
+        if (best < 0) break;
+        fprintf(messages, "  %-40s %llu\n", names[best] ? names[best] : "?", untraced[best]);
+        untraced[best] = 0;
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *envFile = NULL;
+    const char *driver = "llvmpipe";
+    const char *bridgePath = NULL;
+    const char *workDir = getenv("TMPDIR");
+    bool verbose = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "e:d:b:w:vh")) != -1)
+    {
+        switch (option)
+        {
+            case 'e': envFile = optarg; break;
+            case 'd': driver = optarg; break;
+            case 'b': bridgePath = optarg; break;
+            case 'w': workDir = optarg; break;
+            case 'v': verbose = true; break;
+            default: usage(argv[0]); return option == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!getenv("MESA_LIBRARY"))
+    {
+        fprintf(stderr, "osm-replay: MESA_LIBRARY is not set\n");
+        return 2;
+    }
+
+    const char *tracePath = argv[optind];
+    FILE *in = fopen(tracePath, "rb");
+    if (!in)
+    {
+        fprintf(stderr, "osm-replay: cannot open %s: %s\n", tracePath, strerror(errno));
+        return 2;
+    }
+    if (!check_header(in, tracePath)) return 2;
+
+    char defaultBridge[4096];
+    if (!bridgePath)
+    {
+        const char *slash = strrchr(argv[0], '/');
+        snprintf(defaultBridge, sizeof(defaultBridge), "%.*slibOSMBridge.so", slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+        if (!slash) snprintf(defaultBridge, sizeof(defaultBridge), "./libOSMBridge.so");
+        bridgePath = defaultBridge;
+    }
+
+    // The bridge reads its settings once when it loads; never record the replay.
+    char envPath[4096];
+    snprintf(envPath, sizeof(envPath), "%s/osm-replay.%d.env", workDir && workDir[0] ? workDir : "/tmp", (int)getpid());
+    char driverLine[64];
+    snprintf(driverLine, sizeof(driverLine), "GALLIUM_DRIVER=%s", driver);
+    const char *overrides[] = { driverLine, "OSM_TRACE=" };
+    if (!bench_write_env(envPath, envFile, overrides, 2))
+    {
+        fprintf(stderr, "osm-replay: cannot write %s\n", envPath);
+        return 1;
+    }
+    setenv("OSM_ENV_FILE", envPath, 1);
+
+    // The bridge and Mesa print to both streams, the bridge's setenv
+    // notes even to stdout.
+    messages = verbose ? stderr : mute(stderr, STDERR_FILENO);
+    frameOut = verbose ? stdout : mute(stdout, STDOUT_FILENO);
+
+    bool loaded = load_bridge(bridgePath);
+    recordedMs = malloc(sizeof(double) * MAX_FRAMES);
+    replayMs = malloc(sizeof(double) * MAX_FRAMES);
+    bool ok = loaded && recordedMs && replayMs && replay(in);
+    unlink(envPath);
+    fclose(in);
+
+    if (!loaded)
+    {
+        fprintf(messages, "osm-replay: cannot load %s\n", bridgePath);
+        return 1;
+    }
+    report();
+    fflush(frameOut);
+    fflush(messages);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,306 @@
+// osm-startup: time the bridge's constructor reading its config from
+// env.bin against parsing env.txt, with the page cache dropped for both
+// files before every run, as on the first launch after a reboot. With -p
+// it times the first frame instead, with OSM_PRECREATE_CONTEXT off and on.
+//
+//   make -C Mesa-Plugin-Bridge/tools
+//   export MESA_LIBRARY=/usr/lib/x86_64-linux-gnu/libOSMesa.so.8
+//   Mesa-Plugin-Bridge/tools/osm-startup -e env.txt -w /mnt/fuse
+//
+// On Android env.txt lives on /sdcard, which is served by a FUSE daemon:
+// every open, stat and read is a round trip through it. A FUSE passthrough
+// over a local directory is a fair stand-in on Linux, for example
+//
+//   mkdir -p /tmp/osm-real /tmp/osm-fuse
+//   bindfs /tmp/osm-real /tmp/osm-fuse
+//
+// then pass -w /tmp/osm-fuse. Without -w the files go to $TMPDIR or /tmp.
+//
+// A game does its own startup work between loading the bridge and its
+// first OSMesaCreateContext(), which is what the speculative create runs
+// alongside; -d stands in for it:
+//
+//   Mesa-Plugin-Bridge/tools/osm-startup -e env.txt -p -d 50
+//
+// One tab separated line per source goes to stdout, after a header line
+// starting with '#'; a readable summary goes to stderr.
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bridge.h"
+#include "bench_run.h"
+#include "workload.h"
+
+#define MAX_RUNS 1000
+#define MAX_STAGES 64
+
+typedef struct {
+    double configMs;
+    double constructorMs;
+    double firstCreateMs;
+    double firstFrameMs;
+    bool adopted;
+} StartupTimes;
+
+typedef struct {
+    const char *name;
+    // Unlink env.bin before each run, so the constructor parses env.txt.
+    bool fromText;
+    const char *precreate;
+} Source;
+
+static void usage(const char *self) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -e FILE   env.txt to load (default: bridge defaults)\n"
+            "  -b FILE   libOSMBridge.so to load (default: next to this tool)\n"
+            "  -w DIR    directory for env.txt and env.bin, e.g. a FUSE mount (default: $TMPDIR or /tmp)\n"
+            "  -r N      runs per source (default 20, at most %d)\n"
+            "  -p        time the first frame with OSM_PRECREATE_CONTEXT off and on instead\n"
+            "  -d MS     with -p, wait this long between loading the bridge and the first create (default 0)\n"
+            "  -v        keep the bridge's and Mesa's output\n"
+            "MESA_LIBRARY must point at libOSMesa.so.\n",
+            self, MAX_RUNS);
+}
+
+// Drop path from the page cache, so the next run reads it from storage.
+static void evict(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+static double stage_ms(const OSMesaBridgeStartupStage *stage) {
+    return (double)(stage->endNs - stage->startNs) / 1e6;
+}
+
+// In a fresh process, so the constructor runs again. Writes the times to fd.
+static void child(const char *bridgePath, const char *envPath, bool verbose, int frameDelayMs, int fd) {
+    if (!verbose)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+        {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            close(null);
+        }
+    }
+    setenv("OSM_ENV_FILE", envPath, 1);
+
+    StartupTimes times = { 0 };
+    void *bridge = dlopen(bridgePath, RTLD_NOW | RTLD_LOCAL);
+    bool ok = bridge != NULL;
+    if (ok && frameDelayMs >= 0)
+    {
+        WorkloadApi api = {
+            .CreateContext = (__typeof__(api.CreateContext))dlsym(bridge, "OSMesaCreateContext"),
+            .MakeCurrent = (__typeof__(api.MakeCurrent))dlsym(bridge, "OSMesaMakeCurrent"),
+            .DestroyContext = (__typeof__(api.DestroyContext))dlsym(bridge, "OSMesaDestroyContext"),
+            .GetProcAddress = (__typeof__(api.GetProcAddress))dlsym(bridge, "OSMesaGetProcAddress"),
+        };
+        WorkloadResult result;
+        if (frameDelayMs > 0) usleep((useconds_t)frameDelayMs * 1000);
+        ok = api.CreateContext && api.MakeCurrent && api.DestroyContext && api.GetProcAddress &&
+             workload_run(&api, 64, 64, 1, &result);
+    }
+    GLuint (*getStages)(OSMesaBridgeStartupStage*, GLuint) = bridge ? (__typeof__(getStages))dlsym(bridge, "OSMesaBridgeGetStartupStages") : NULL;
+    OSMesaBridgeStartupStage stages[MAX_STAGES];
+    GLuint count = getStages ? getStages(stages, MAX_STAGES) : 0;
+    if (count > MAX_STAGES) count = MAX_STAGES;
+    for (GLuint i = 0; i < count; i++)
+    {
+        if (!strcmp(stages[i].name, "Read env.bin") || !strcmp(stages[i].name, "fopen env.txt") || !strcmp(stages[i].name, "Parse env.txt"))
+        {
+            times.configMs += stage_ms(&stages[i]);
+        }
+        if (!strcmp(stages[i].name, "Constructor")) times.constructorMs = stage_ms(&stages[i]);
+        if (!strcmp(stages[i].name, "First OSMesaCreateContext")) times.firstCreateMs = stage_ms(&stages[i]);
+        if (!strcmp(stages[i].name, "First frame")) times.firstFrameMs = stage_ms(&stages[i]);
+        if (!strcmp(stages[i].name, "Pre-created context adopted")) times.adopted = true;
+    }
+    if (frameDelayMs >= 0 && times.firstFrameMs <= 0) ok = false;
+    if (write(fd, &times, sizeof(times)) != sizeof(times)) ok = false;
+    // exit() rather than _exit(), so the bridge's destructor stops its threads.
+    exit(ok && times.constructorMs > 0 ? 0 : 1);
+}
+
+static bool run_once(const char *bridgePath, const char *envPath, bool verbose, int frameDelayMs, StartupTimes *times) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        child(bridgePath, envPath, verbose, frameDelayMs, fds[1]);
+    }
+    close(fds[1]);
+    ssize_t received;
+    while ((received = read(fds[0], times, sizeof(*times))) < 0 && errno == EINTR);
+    close(fds[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    return received == sizeof(*times) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double *values, int count, double p) {
+    if (count <= 0) return 0;
+    qsort(values, count, sizeof(double), compare_double);
+    return values[(int)(p / 100.0 * (count - 1) + 0.5)];
+}
+
+int main(int argc, char **argv) {
+    const char *envFile = NULL;
+    const char *bridgePath = NULL;
+    const char *workDir = getenv("TMPDIR");
+    int runs = 20;
+    bool firstFrame = false;
+    int frameDelayMs = 0;
+    bool verbose = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "e:b:w:r:pd:vh")) != -1)
+    {
+        switch (option)
+        {
+            case 'e': envFile = optarg; break;
+            case 'b': bridgePath = optarg; break;
+            case 'w': workDir = optarg; break;
+            case 'r': runs = atoi(optarg); break;
+            case 'p': firstFrame = true; break;
+            case 'd': frameDelayMs = atoi(optarg); break;
+            case 'v': verbose = true; break;
+            default: usage(argv[0]); return option == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc || runs < 1 || runs > MAX_RUNS || frameDelayMs < 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!getenv("MESA_LIBRARY"))
+    {
+        fprintf(stderr, "osm-startup: MESA_LIBRARY is not set\n");
+        return 2;
+    }
+
+    char defaultBridge[4096];
+    if (!bridgePath)
+    {
+        const char *slash = strrchr(argv[0], '/');
+        snprintf(defaultBridge, sizeof(defaultBridge), "%.*slibOSMBridge.so", slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+        if (!slash) snprintf(defaultBridge, sizeof(defaultBridge), "./libOSMBridge.so");
+        bridgePath = defaultBridge;
+    }
+
+    // Nothing but what is measured should differ between runs: no probes
+    // that rewrite env.txt, no files written next to it. The format the
+    // workload asks for is the one the pre-create mode is told to expect.
+    const char *overrides[] = {
+        "OSM_TRACE=",
+        "OSM_TIMELINE=",
+        "OSM_STARTUP_REPORT=",
+        "OSM_LOG_SINK=",
+        "OSM_CONFIG_RELOAD=false",
+        "OSM_LP_CALIBRATED=true",
+        "OSM_AUTO_DRIVER=llvmpipe",
+        "OSM_LAST_CONTEXT_FORMAT=0x1908",
+        NULL,
+    };
+    const int overrideCount = (int)(sizeof(overrides) / sizeof(overrides[0]));
+    char envPath[4096], binPath[4096];
+    const char *dir = workDir && workDir[0] ? workDir : "/tmp";
+    snprintf(envPath, sizeof(envPath), "%s/osm-startup.%d.txt", dir, (int)getpid());
+    snprintf(binPath, sizeof(binPath), "%s/osm-startup.%d.bin", dir, (int)getpid());
+
+    static const Source configSources[] = {
+        { "env.bin", false, "OSM_PRECREATE_CONTEXT=false" },
+        { "env.txt", true, "OSM_PRECREATE_CONTEXT=false" },
+    };
+    static const Source frameSources[] = {
+        { "precreate-off", false, "OSM_PRECREATE_CONTEXT=false" },
+        { "precreate-on", false, "OSM_PRECREATE_CONTEXT=true" },
+    };
+    const Source *sources = firstFrame ? frameSources : configSources;
+    if (firstFrame) printf("#mode\truns\tfirst_create_p50_ms\tfirst_create_p95_ms\tfirst_frame_p50_ms\tfirst_frame_p95_ms\tadopted\n");
+    else printf("#source\truns\tconfig_p50_ms\tconfig_p95_ms\tconstructor_p50_ms\tconstructor_p95_ms\n");
+
+    static double first[MAX_RUNS], second[MAX_RUNS];
+    int delay = firstFrame ? frameDelayMs : -1;
+    bool ok = true;
+    for (int s = 0; s < 2 && ok; s++)
+    {
+        const Source *source = &sources[s];
+        overrides[overrideCount - 1] = source->precreate;
+        if (!bench_write_env(envPath, envFile, overrides, overrideCount))
+        {
+            fprintf(stderr, "osm-startup: cannot write %s\n", envPath);
+            ok = false;
+            break;
+        }
+        unlink(binPath);
+
+        // The first run parses env.txt and writes env.bin for the rest.
+        if (!source->fromText && !run_once(bridgePath, envPath, verbose, delay, &(StartupTimes){ 0 })) ok = false;
+        int adopted = 0;
+        for (int i = 0; i < runs && ok; i++)
+        {
+            if (source->fromText) unlink(binPath);
+            evict(envPath);
+            evict(binPath);
+            StartupTimes times;
+            if (!run_once(bridgePath, envPath, verbose, delay, &times))
+            {
+                ok = false;
+                break;
+            }
+            first[i] = firstFrame ? times.firstCreateMs : times.configMs;
+            second[i] = firstFrame ? times.firstFrameMs : times.constructorMs;
+            if (times.adopted) adopted++;
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "osm-startup: loading %s with %s failed\n", bridgePath, source->name);
+            break;
+        }
+        double first50 = percentile(first, runs, 50), first95 = percentile(first, runs, 95);
+        double second50 = percentile(second, runs, 50), second95 = percentile(second, runs, 95);
+        if (firstFrame)
+        {
+            printf("%s\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%d\n", source->name, runs, first50, first95, second50, second95, adopted);
+            fprintf(stderr, "%s: first create p50 %.3f ms, p95 %.3f ms; first frame p50 %.3f ms, p95 %.3f ms; adopted %d/%d\n",
+                    source->name, first50, first95, second50, second95, adopted, runs);
+        }
+        else
+        {
+            printf("%s\t%d\t%.3f\t%.3f\t%.3f\t%.3f\n", source->name, runs, first50, first95, second50, second95);
+            fprintf(stderr, "%s: config p50 %.3f ms, p95 %.3f ms; constructor p50 %.3f ms, p95 %.3f ms\n",
+                    source->name, first50, first95, second50, second95);
+        }
+    }
+
+    unlink(envPath);
+    unlink(binPath);
+    return ok ? 0 : 1;
+}
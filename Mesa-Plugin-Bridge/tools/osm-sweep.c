@@ -0,0 +1,351 @@
+// osm-sweep: time the bridge under every combination of a set of env.txt
+// knobs and print the best combination as an env.txt fragment.
+//
+//   make -C Mesa-Plugin-Bridge/tools
+//   export MESA_LIBRARY=/usr/lib/x86_64-linux-gnu/libOSMesa.so.8
+//   Mesa-Plugin-Bridge/tools/osm-sweep -s sweep.txt -o best.txt
+//   Mesa-Plugin-Bridge/tools/osm-sweep -s sweep.txt -T game.osmtrace
+//
+// The sweep file lists one knob per line as KEY=value1|value2|...; lines
+// starting with '#' are ignored. Every combination is measured with a
+// fresh env.txt, see bench_run.h: on the reference scene, or with -T on a
+// trace recorded in the game with OSM_TRACE=<file>, which osm-replay
+// replays through the bridge once per run.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "workload.h"
+#include "bench_run.h"
+
+#define MAX_KNOBS 16
+#define MAX_VALUES 16
+#define MAX_FIELD 128
+#define MAX_COMBINATIONS 4096
+
+typedef struct {
+    char key[MAX_FIELD];
+    int count;
+    char values[MAX_VALUES][MAX_FIELD];
+} Knob;
+
+typedef struct {
+    int choice[MAX_KNOBS];
+    BenchStats stats;
+} Combination;
+
+static Knob knobs[MAX_KNOBS];
+static int knobCount = 0;
+
+static BenchOptions options = {
+    .width = 640,
+    .height = 360,
+    .frames = 60,
+    .timeoutMs = 30000,
+};
+static const char *baseEnvPath = NULL;
+static const char *tracePath = NULL;
+static const char *outputPath = NULL;
+static int repeats = 3;
+static int rankPercentile = 95;
+
+static void usage(const char *self) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s FILE   knobs to sweep, one KEY=v1|v2|... per line (default: mesa_glthread,\n"
+            "            CUSTOM_GL_GLSL and LP_NUM_THREADS on llvmpipe)\n"
+            "  -e FILE   env.txt lines every combination starts from\n"
+            "  -b FILE   libOSMBridge.so to load (default: next to this tool)\n"
+            "  -T FILE   time a trace recorded with OSM_TRACE instead of the reference scene\n"
+            "  -R FILE   osm-replay to replay it with (default: next to this tool)\n"
+            "  -o FILE   write the best combination as an env.txt fragment (default: stdout)\n"
+            "  -k N      rank by the Nth frame-time percentile: 50, 95 or 99 (default 95)\n"
+            "  -f N      frames per run (default 60, at most %d; not with -T)\n"
+            "  -r N      runs per combination (default 3)\n"
+            "  -W N, -H N  framebuffer size (default 640x360; not with -T)\n"
+            "  -t MS     per-run timeout (default 30000; a long trace needs more)\n"
+            "  -v        keep the bridge's and Mesa's output\n"
+            "MESA_LIBRARY must point at libOSMesa.so.\n",
+            self, WORKLOAD_MAX_FRAMES);
+}
+
+static bool add_knob(const char *line) {
+    const char *delimiter = strchr(line, '=');
+    if (!delimiter || delimiter == line) return false;
+    if (knobCount == MAX_KNOBS)
+    {
+        fprintf(stderr, "osm-sweep: more than %d knobs, ignoring %s\n", MAX_KNOBS, line);
+        return true;
+    }
+
+    Knob *knob = &knobs[knobCount];
+    memset(knob, 0, sizeof(*knob));
+    snprintf(knob->key, sizeof(knob->key), "%.*s", (int)(delimiter - line), line);
+
+    const char *value = delimiter + 1;
+    while (knob->count < MAX_VALUES)
+    {
+        size_t length = strcspn(value, "|");
+        snprintf(knob->values[knob->count++], MAX_FIELD, "%.*s", (int)length, value);
+        if (!value[length]) break;
+        value += length + 1;
+    }
+    knobCount++;
+    return true;
+}
+
+static bool load_sweep(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        fprintf(stderr, "osm-sweep: cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!line[0] || line[0] == '#') continue;
+        if (!add_knob(line)) fprintf(stderr, "osm-sweep: ignoring %s\n", line);
+    }
+    fclose(file);
+    return knobCount > 0;
+}
+
+static void default_sweep(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    char threads[64];
+    if (cpus > 4)
+        snprintf(threads, sizeof(threads), "LP_NUM_THREADS=1|2|4|%ld", cpus);
+    else
+        snprintf(threads, sizeof(threads), "LP_NUM_THREADS=1|2|4");
+
+    add_knob("GALLIUM_DRIVER=llvmpipe");
+    add_knob("mesa_glthread=false|true");
+    add_knob("CUSTOM_GL_GLSL=1|2");
+    add_knob(threads);
+}
+
+static bool write_env(const char *path, const Combination *combination) {
+    char lines[MAX_KNOBS][2 * MAX_FIELD + 2];
+    const char *overrides[MAX_KNOBS];
+    for (int i = 0; i < knobCount; i++)
+    {
+        snprintf(lines[i], sizeof(lines[i]), "%s=%s", knobs[i].key, knobs[i].values[combination->choice[i]]);
+        overrides[i] = lines[i];
+    }
+    return bench_write_env(path, baseEnvPath, overrides, knobCount);
+}
+
+static double rank_value(const BenchStats *stats) {
+    if (rankPercentile == 50) return stats->p50;
+    if (rankPercentile == 99) return stats->p99;
+    return stats->p95;
+}
+
+static int compare_combination(const void *a, const void *b) {
+    const BenchStats *x = &((const Combination*)a)->stats, *y = &((const Combination*)b)->stats;
+    if (x->ok != y->ok) return x->ok ? -1 : 1;
+    double rx = rank_value(x), ry = rank_value(y);
+    if (rx != ry) return rx < ry ? -1 : 1;
+    return (x->p50 > y->p50) - (x->p50 < y->p50);
+}
+
+static void describe(const Combination *combination, char *buffer, size_t size) {
+    size_t used = 0;
+    buffer[0] = '\0';
+    for (int i = 0; i < knobCount && used < size; i++)
+    {
+        if (knobs[i].count < 2) continue;
+        used += snprintf(buffer + used, size - used, "%s%s=%s", used ? " " : "", knobs[i].key, knobs[i].values[combination->choice[i]]);
+    }
+}
+
+static void write_fragment(FILE *out, const Combination *best, int total) {
+    if (tracePath)
+        fprintf(out, "# osm-sweep: best of %d combinations on %s, p50 %.2f ms, p95 %.2f ms, p99 %.2f ms\n",
+                total, tracePath, best->stats.p50, best->stats.p95, best->stats.p99);
+    else
+        fprintf(out, "# osm-sweep: best of %d combinations at %dx%d, p50 %.2f ms, p95 %.2f ms, p99 %.2f ms\n",
+                total, options.width, options.height, best->stats.p50, best->stats.p95, best->stats.p99);
+    for (int i = 0; i < knobCount; i++)
+    {
+        fprintf(out, "%s=%s\n", knobs[i].key, knobs[i].values[best->choice[i]]);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *sweepPath = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "s:e:b:T:R:o:k:f:r:W:H:t:vh")) != -1)
+    {
+        switch (option)
+        {
+            case 's': sweepPath = optarg; break;
+            case 'e': baseEnvPath = optarg; break;
+            case 'b': options.bridgePath = optarg; break;
+            case 'T': tracePath = optarg; break;
+            case 'R': options.replayPath = optarg; break;
+            case 'o': outputPath = optarg; break;
+            case 'k': rankPercentile = atoi(optarg); break;
+            case 'f': options.frames = atoi(optarg); break;
+            case 'r': repeats = atoi(optarg); break;
+            case 'W': options.width = atoi(optarg); break;
+            case 'H': options.height = atoi(optarg); break;
+            case 't': options.timeoutMs = atoi(optarg); break;
+            case 'v': options.verbose = true; break;
+            default: usage(argv[0]); return option == 'h' ? 0 : 2;
+        }
+    }
+    if (options.frames < 2 || options.frames > WORKLOAD_MAX_FRAMES || repeats < 1 || options.width < 1 || options.height < 1 ||
+        (rankPercentile != 50 && rankPercentile != 95 && rankPercentile != 99))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!getenv("MESA_LIBRARY"))
+    {
+        fprintf(stderr, "osm-sweep: MESA_LIBRARY is not set\n");
+        return 2;
+    }
+
+    char defaultBridge[4096];
+    if (!options.bridgePath)
+    {
+        const char *slash = strrchr(argv[0], '/');
+        snprintf(defaultBridge, sizeof(defaultBridge), "%.*slibOSMBridge.so", slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+        if (!slash) snprintf(defaultBridge, sizeof(defaultBridge), "./libOSMBridge.so");
+        options.bridgePath = defaultBridge;
+    }
+
+    char defaultReplay[4096];
+    if (tracePath)
+    {
+        if (access(tracePath, R_OK) != 0)
+        {
+            fprintf(stderr, "osm-sweep: cannot read %s: %s\n", tracePath, strerror(errno));
+            return 2;
+        }
+        if (!options.replayPath)
+        {
+            const char *slash = strrchr(argv[0], '/');
+            snprintf(defaultReplay, sizeof(defaultReplay), "%.*sosm-replay", slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+            if (!slash) snprintf(defaultReplay, sizeof(defaultReplay), "./osm-replay");
+            options.replayPath = defaultReplay;
+        }
+        if (access(options.replayPath, X_OK) != 0)
+        {
+            fprintf(stderr, "osm-sweep: cannot run %s, build it or pass -R\n", options.replayPath);
+            return 2;
+        }
+        options.tracePath = tracePath;
+    }
+
+    if (sweepPath)
+    {
+        if (!load_sweep(sweepPath)) return 2;
+    }
+    else
+    {
+        default_sweep();
+    }
+
+    int total = 1;
+    for (int i = 0; i < knobCount; i++)
+    {
+        if (total > MAX_COMBINATIONS / knobs[i].count)
+        {
+            fprintf(stderr, "osm-sweep: more than %d combinations, narrow the sweep\n", MAX_COMBINATIONS);
+            return 2;
+        }
+        total *= knobs[i].count;
+    }
+
+    char directory[] = "/tmp/osm-sweep.XXXXXX";
+    if (!mkdtemp(directory))
+    {
+        fprintf(stderr, "osm-sweep: cannot create a work directory: %s\n", strerror(errno));
+        return 1;
+    }
+    char envPath[sizeof(directory) + 16];
+    char binPath[sizeof(directory) + 16];
+    snprintf(envPath, sizeof(envPath), "%s/env.txt", directory);
+    snprintf(binPath, sizeof(binPath), "%s/env.bin", directory);
+
+    Combination *combinations = calloc((size_t)total, sizeof(Combination));
+    if (!combinations) return 1;
+
+    for (int index = 0; index < total; index++)
+    {
+        Combination *combination = &combinations[index];
+        for (int i = 0, rest = index; i < knobCount; i++)
+        {
+            combination->choice[i] = rest % knobs[i].count;
+            rest /= knobs[i].count;
+        }
+
+        // Fresh file per combination; a stale env.bin would win over it.
+        unlink(binPath);
+        if (!write_env(envPath, combination))
+        {
+            fprintf(stderr, "osm-sweep: cannot write %s\n", envPath);
+            continue;
+        }
+        bench_measure(&options, envPath, repeats, &combination->stats);
+
+        char name[1024];
+        describe(combination, name, sizeof(name));
+        const BenchStats *stats = &combination->stats;
+        if (stats->ok && tracePath)
+            fprintf(stderr, "[%d/%d] %s: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms\n",
+                    index + 1, total, name, stats->p50, stats->p95, stats->p99);
+        else if (stats->ok)
+            fprintf(stderr, "[%d/%d] %s: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, create %.1f ms\n",
+                    index + 1, total, name, stats->p50, stats->p95, stats->p99, stats->createMs);
+        else
+            fprintf(stderr, "[%d/%d] %s: failed\n", index + 1, total, name);
+    }
+    unlink(envPath);
+    unlink(binPath);
+    rmdir(directory);
+
+    qsort(combinations, total, sizeof(Combination), compare_combination);
+
+    fprintf(stderr, "\nRanked by p%d:\n", rankPercentile);
+    for (int index = 0; index < total; index++)
+    {
+        const Combination *combination = &combinations[index];
+        const BenchStats *stats = &combination->stats;
+        char name[1024];
+        describe(combination, name, sizeof(name));
+        if (stats->ok)
+            fprintf(stderr, "%3d. p50 %7.2f  p95 %7.2f  p99 %7.2f  %s\n", index + 1, stats->p50, stats->p95, stats->p99, name);
+        else
+            fprintf(stderr, "  -  failed                               %s\n", name);
+    }
+
+    if (!combinations[0].stats.ok)
+    {
+        fprintf(stderr, "osm-sweep: no combination completed\n");
+        free(combinations);
+        return 1;
+    }
+
+    FILE *out = outputPath ? fopen(outputPath, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "osm-sweep: cannot write %s: %s\n", outputPath, strerror(errno));
+        free(combinations);
+        return 1;
+    }
+    write_fragment(out, &combinations[0], total);
+    if (outputPath) fclose(out);
+
+    free(combinations);
+    return 0;
+}
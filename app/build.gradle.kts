@@ -3,6 +3,8 @@ plugins {
     alias(libs.plugins.jetbrains.kotlin.android)
 }
 
+val osmBenchLibs = layout.buildDirectory.dir("generated/osmbench/jniLibs").get().asFile
+
 android {
     namespace = "com.mio.plugin.renderer"
     compileSdk = 34
@@ -40,10 +42,12 @@ android {
             //DLOPEN=libxxx.so used to load external library
             //如果有多个库,可以使用","隔开,例如  DLOPEN=libxxx.so,libyyy.so
             //If there are multiple libraries, you can use "," to separate them, for example  DLOPEN=libxxx.so,libyyy.so
+            //OSM_PROFILE 用于在 env.txt 中选择 [profile ...] 配置, 多个 Mesa 插件共用 /sdcard/Mesa/env.txt 时可以区分
+            //OSM_PROFILE selects a [profile ...] section of env.txt, so several Mesa plugins can share /sdcard/Mesa/env.txt
             manifestPlaceholders["boatEnv"] = mutableMapOf<String,String>().apply {
-
+                put("OSM_PROFILE", "mesa2500")
             }.run {
-                var env = "LIBGL_STRING=custom_gallium:LIBGL_NAME=libOSMesa.so:LIB_MESA_NAME=libOSMesa.so:MESA_LIBRARY=libOSMesa.so:DLOPEN=libOSMBridge.so"
+                var env = "LIBGL_STRING=custom_gallium:LIBGL_NAME=libOSMesa.so:LIB_MESA_NAME=libOSMesa.so:MESA_LIBRARY=libOSMesa.so:DLOPEN=libOSMBridge.so:"
                 forEach { (key, value) ->
                     env += "$key=$value:"
                 }
@@ -51,9 +55,9 @@ android {
             }
 
             manifestPlaceholders["pojavEnv"] = mutableMapOf<String,String>().apply {
-
+                put("OSM_PROFILE", "mesa2500")
             }.run {
-                var env = "POJAV_RENDERER=custom_gallium:LIB_MESA_NAME=libOSMBridge.so:MESA_LIBRARY=libOSMesa.so:DLOPEN=libOSMesa.so"
+                var env = "POJAV_RENDERER=custom_gallium:LIB_MESA_NAME=libOSMBridge.so:MESA_LIBRARY=libOSMesa.so:DLOPEN=libOSMesa.so:"
                 forEach { (key, value) ->
                     env += "$key=$value:"
                 }
@@ -68,6 +72,25 @@ android {
     kotlinOptions {
         jvmTarget = "1.8"
     }
+    sourceSets {
+        getByName("main") {
+            jniLibs.srcDir(osmBenchLibs)
+        }
+    }
+}
+
+//osm-bench 由 Mesa-Plugin-Bridge 的 ndk-build 生成, 改名为 libosmbench.so 打包, 应用只能执行 nativeLibraryDir 中的 lib*.so
+//osm-bench is built by ndk-build in Mesa-Plugin-Bridge and packaged as libosmbench.so, since an app may only execute lib*.so files from its native library directory
+val packageOsmBench by tasks.registering(Sync::class) {
+    from(rootProject.file("Mesa-Plugin-Bridge/libs")) {
+        include("*/osm-bench")
+        rename("osm-bench", "libosmbench.so")
+    }
+    into(osmBenchLibs)
+}
+
+tasks.named("preBuild") {
+    dependsOn(packageOsmBench)
 }
 
 dependencies {
@@ -0,0 +1,140 @@
+package com.mio.plugin.renderer
+
+import android.content.Context
+import android.os.Handler
+import android.os.Looper
+import java.io.File
+import java.util.concurrent.Executors
+import java.util.concurrent.TimeUnit
+import kotlin.concurrent.thread
+
+// 运行 osm-bench (Mesa-Plugin-Bridge/tools/osm-bench.c, 以 libosmbench.so 打包),
+// 用固定场景通过插件渲染, 测量各驱动的帧时间, 启动时间和读回带宽, 并保存历史结果
+class BenchRunner(private val context: Context, private val envFile: File) {
+
+    class Result(
+        val time: Long,
+        val settings: String,
+        val driver: String,
+        val ok: Boolean,
+        val p50: Double,
+        val p95: Double,
+        val p99: Double,
+        val loadMs: Double,
+        val createMs: Double,
+        val readbackMBps: Double,
+        val renderer: String
+    ) {
+        fun toLine(): String = listOf(time, settings, driver, if (ok) "ok" else "fail",
+            p50, p95, p99, loadMs, createMs, readbackMBps, renderer).joinToString("\t")
+
+        companion object {
+            fun fromLine(line: String): Result? {
+                val fields = line.split("\t")
+                if (fields.size < 11) return null
+                return try {
+                    Result(fields[0].toLong(), fields[1], fields[2], fields[3] == "ok",
+                        fields[4].toDouble(), fields[5].toDouble(), fields[6].toDouble(),
+                        fields[7].toDouble(), fields[8].toDouble(), fields[9].toDouble(), fields[10])
+                } catch (e: NumberFormatException) {
+                    null
+                }
+            }
+        }
+    }
+
+    private val historyFile = File(context.filesDir, "bench_history.tsv")
+    private val executor = Executors.newSingleThreadExecutor()
+    private val mainHandler = Handler(Looper.getMainLooper())
+
+    var running = false
+        private set
+
+    // settings: 测试时的主要设置, 与结果一起保存, 方便对比修改前后
+    // 出错时 results 为 null, message 为错误信息
+    fun run(drivers: List<String>, settings: String, onDone: (results: List<Result>?, message: String) -> Unit) {
+        if (running) return
+        running = true
+        executor.execute {
+            val (results, message) = runBench(drivers, settings)
+            if (results != null) appendHistory(results)
+            mainHandler.post {
+                running = false
+                onDone(results, message)
+            }
+        }
+    }
+
+    // 最新的结果在前
+    fun loadHistory(onLoaded: (List<Result>) -> Unit) {
+        executor.execute {
+            val history = readHistory().reversed()
+            mainHandler.post { onLoaded(history) }
+        }
+    }
+
+    private fun runBench(drivers: List<String>, settings: String): Pair<List<Result>?, String> {
+        val libDir = File(context.applicationInfo.nativeLibraryDir)
+        val bench = File(libDir, "libosmbench.so")
+        if (!bench.exists()) return Pair(null, "未找到测试程序 ${bench.name}")
+
+        val logFile = File(context.cacheDir, "osm-bench.log")
+        val command = mutableListOf(bench.path,
+            "-b", File(libDir, "libOSMBridge.so").path,
+            "-e", envFile.path,
+            "-w", context.cacheDir.path)
+        if (drivers.isNotEmpty()) command += listOf("-d", drivers.joinToString(","))
+
+        return try {
+            val process = ProcessBuilder(command).apply {
+                environment()["MESA_LIBRARY"] = File(libDir, "libOSMesa.so").path
+                environment()["LD_LIBRARY_PATH"] = libDir.path
+                redirectError(logFile)
+            }.start()
+
+            val time = System.currentTimeMillis()
+            // readLines() 要等到 osm-bench 退出才返回, 放在另一个线程读, 超时才能生效
+            // readLines() only returns once osm-bench exits, so read on another thread for the timeout to apply
+            val lines = mutableListOf<String>()
+            val reader = thread(name = "osm-bench-output") {
+                val output = process.inputStream.bufferedReader().readLines()
+                synchronized(lines) { lines += output }
+            }
+            if (!process.waitFor(TIMEOUT_MINUTES, TimeUnit.MINUTES)) {
+                process.destroyForcibly()
+                reader.join(READER_JOIN_MS)
+                return Pair(null, "测试超过 $TIMEOUT_MINUTES 分钟, 已终止")
+            }
+            reader.join(READER_JOIN_MS)
+
+            val results = synchronized(lines) { lines.toList() }
+                .filter { !it.startsWith("#") && it.isNotBlank() }
+                .mapNotNull { Result.fromLine("$time\t$settings\t$it") }
+
+            if (results.isEmpty())
+                Pair(null, logFile.readText().lines().lastOrNull { it.isNotBlank() } ?: "测试失败")
+            else
+                Pair(results, "")
+        } catch (e: Exception) {
+            Pair(null, e.toString())
+        }
+    }
+
+    private fun readHistory(): List<Result> =
+        if (historyFile.exists()) historyFile.readLines().mapNotNull { Result.fromLine(it) } else emptyList()
+
+    private fun appendHistory(results: List<Result>) {
+        val lines = (readHistory() + results).takeLast(MAX_HISTORY).map { it.toLine() }
+        val tmpFile = File(historyFile.path + ".tmp")
+        tmpFile.writeText(lines.joinToString("\n"))
+        if (!tmpFile.renameTo(historyFile)) tmpFile.delete()
+    }
+
+    companion object {
+        private const val MAX_HISTORY = 100
+        private const val TIMEOUT_MINUTES = 10L
+        // osm-bench 的子进程可能还开着输出
+        // osm-bench's child processes may still hold the output open
+        private const val READER_JOIN_MS = 5000L
+    }
+}
@@ -0,0 +1,236 @@
+package com.mio.plugin.renderer
+
+import android.os.Handler
+import android.os.Looper
+import java.io.File
+import java.util.concurrent.Executors
+
+// env.txt 的内存模型: 在后台线程读取一次, 之后界面只读写内存中的数据
+// 每次修改后在后台线程写入临时文件, 先生成 env.bin 再重命名为 env.txt,
+// 插件不会读到写了一半的文件, 也能只看 env.bin 文件头就知道配置是否变化
+// 插件在游戏运行时也会重写 env.txt 记录设置, 所以写入前重新读取文件,
+// 只把界面改过的设置应用上去, 不用内存中的旧值覆盖插件的记录
+class ConfigStore(private val envFile: File) {
+
+    // 游戏配置(Profile): 插件按 OSM_PROFILE, 进程名或游戏目录选中第一个匹配的配置,
+    // 其中的设置覆盖全局设置
+    class Profile(val header: String, val lines: MutableList<String>) {
+        val selector: String get() = header.removePrefix("[profile ").removeSuffix("]")
+    }
+
+    // 批量修改, 全部完成后只写入一次
+    inner class Editor {
+        // 改过的设置, null 表示删除
+        internal val changes = LinkedHashMap<String, String?>()
+
+        fun get(key: String): String? = this@ConfigStore.get(key)
+
+        fun set(key: String, value: String) {
+            setGlobal(globals, key, value)
+            changes[key] = value
+        }
+
+        fun remove(vararg keys: String) {
+            for (key in keys) {
+                setGlobal(globals, key, null)
+                changes[key] = null
+            }
+        }
+    }
+
+    private val executor = Executors.newSingleThreadExecutor()
+    private val mainHandler = Handler(Looper.getMainLooper())
+
+    // 第一个 [profile ...] 之前的行对所有游戏生效, 各开关只修改这一部分
+    private val globals = mutableListOf<String>()
+    private val profiles = mutableListOf<Profile>()
+    // 读取完成前的修改, 读取完成后按顺序应用
+    private val queued = mutableListOf<() -> Unit>()
+    // 重新读取期间的修改, 读到的内容可能还没有包含它们, 读取完成后再应用一次
+    private var loadsRunning = 0
+    private val editsDuringLoad = mutableListOf<Pair<Map<String, String?>, List<Profile>?>>()
+
+    // 还没写入文件的修改, 连续修改时合并为一次写入
+    private val pendingLock = Any()
+    private val pendingChanges = LinkedHashMap<String, String?>()
+    private var pendingProfiles: List<Profile>? = null
+    private var flushScheduled = false
+
+    var loaded = false
+        private set
+
+    // 重新读取 env.txt (插件可能在游戏运行时写入记录), 完成后在主线程回调
+    fun load(onLoaded: () -> Unit) {
+        loadsRunning++
+        executor.execute {
+            if (!envFile.exists()) {
+                envFile.parentFile?.mkdirs()
+                persist(DEFAULT_ENV) { true }
+            }
+            val lines = readLines()
+
+            mainHandler.post {
+                globals.clear()
+                profiles.clear()
+                parse(lines, globals, profiles)
+                for ((changes, updatedProfiles) in editsDuringLoad) {
+                    for ((key, value) in changes) setGlobal(globals, key, value)
+                    if (updatedProfiles != null) {
+                        profiles.clear()
+                        profiles.addAll(copy(updatedProfiles))
+                    }
+                }
+                if (--loadsRunning == 0) editsDuringLoad.clear()
+                loaded = true
+                val waiting = queued.toList()
+                queued.clear()
+                waiting.forEach { it() }
+                onLoaded()
+            }
+        }
+    }
+
+    fun get(key: String): String? =
+        globals.firstOrNull { it.startsWith("$key=") }?.substringAfter("=")?.trim()
+
+    fun getBoolean(key: String): Boolean = get(key) == "true"
+
+    fun set(key: String, value: String) = edit { set(key, value) }
+
+    fun edit(block: Editor.() -> Unit) {
+        // 读取完成前修改会用默认值覆盖文件中的其他设置, 先排队
+        if (!loaded) {
+            queued.add { edit(block) }
+            return
+        }
+        val editor = Editor()
+        editor.block()
+        commit(editor.changes, null)
+    }
+
+    fun profiles(): MutableList<Profile> = copy(profiles)
+
+    fun setProfiles(updated: List<Profile>) {
+        if (!loaded) {
+            val copied = copy(updated)
+            queued.add { setProfiles(copied) }
+            return
+        }
+        profiles.clear()
+        profiles.addAll(updated)
+        commit(emptyMap(), copy(profiles))
+    }
+
+    private fun commit(changes: Map<String, String?>, updatedProfiles: List<Profile>?) {
+        if (loadsRunning > 0) editsDuringLoad.add(Pair(LinkedHashMap(changes), updatedProfiles))
+        synchronized(pendingLock) {
+            pendingChanges.putAll(changes)
+            if (updatedProfiles != null) pendingProfiles = updatedProfiles
+            if (flushScheduled) return
+            flushScheduled = true
+        }
+        executor.execute { flush() }
+    }
+
+    // 只在 executor 线程调用
+    private fun flush() {
+        val (changes, updatedProfiles) = synchronized(pendingLock) {
+            val taken = Pair(LinkedHashMap(pendingChanges), pendingProfiles)
+            pendingChanges.clear()
+            pendingProfiles = null
+            flushScheduled = false
+            taken
+        }
+
+        // 读取之后插件又写入了 env.txt 时重新合并, 最后一次不再检查
+        for (attempt in 1..MERGE_ATTEMPTS) {
+            val length = envFile.length()
+            val modified = envFile.lastModified()
+            val fileGlobals = mutableListOf<String>()
+            val fileProfiles = mutableListOf<Profile>()
+            parse(readLines(), fileGlobals, fileProfiles)
+            for ((key, value) in changes) setGlobal(fileGlobals, key, value)
+            val text = render(fileGlobals, updatedProfiles ?: fileProfiles)
+
+            val unchanged = { envFile.length() == length && envFile.lastModified() == modified }
+            if (persist(text) { attempt == MERGE_ATTEMPTS || unchanged() }) return
+        }
+    }
+
+    private fun readLines(): List<String> =
+        try { envFile.readLines() } catch (e: Exception) { DEFAULT_ENV.lines() }
+
+    // 只在 executor 线程调用. 临时文件写好后 current() 为 false 时放弃写入并返回 false
+    private fun persist(text: String, current: () -> Boolean): Boolean {
+        val tmpFile = File(envFile.parentFile, ".${envFile.name}.app.tmp")
+        val binFile = EnvBinary.binFileFor(envFile)
+        try {
+            tmpFile.writeText(text)
+            if (!current()) {
+                tmpFile.delete()
+                return false
+            }
+            try {
+                // 插件重写 env.txt 时也会增加修改代数, 所以从文件中的代数继续
+                EnvBinary.write(tmpFile, binFile, EnvBinary.readGeneration(binFile) + 1)
+            } catch (e: Exception) {
+                // env.bin 写入失败时插件会回退到解析 env.txt
+                binFile.delete()
+            }
+            if (!tmpFile.renameTo(envFile)) {
+                tmpFile.delete()
+                binFile.delete()
+            }
+        } catch (e: Exception) {
+            tmpFile.delete()
+        }
+        return true
+    }
+
+    companion object {
+        private const val MERGE_ATTEMPTS = 3
+
+        private fun parse(lines: List<String>, globals: MutableList<String>, profiles: MutableList<Profile>) {
+            for (line in lines) {
+                if (line.startsWith("["))
+                    profiles.add(Profile(line, mutableListOf()))
+                else if (profiles.isEmpty())
+                    globals.add(line)
+                else if (line.isNotBlank())
+                    profiles.last().lines.add(line)
+            }
+        }
+
+        // value 为 null 时删除
+        private fun setGlobal(globals: MutableList<String>, key: String, value: String?) {
+            if (value == null) {
+                globals.removeAll { it.startsWith("$key=") }
+                return
+            }
+            val index = globals.indexOfFirst { it.startsWith("$key=") }
+            if (index >= 0) globals[index] = "$key=$value" else globals.add("$key=$value")
+        }
+
+        private fun render(globals: List<String>, profiles: List<Profile>): String {
+            val lines = globals.toMutableList()
+            for (profile in profiles) {
+                lines.add(profile.header)
+                lines.addAll(profile.lines)
+            }
+            return lines.joinToString("\n")
+        }
+
+        private fun copy(profiles: List<Profile>): MutableList<Profile> =
+            profiles.map { Profile(it.header, it.lines.toMutableList()) }.toMutableList()
+
+        private val DEFAULT_ENV = """
+            GALLIUM_DRIVER=zink
+            mesa_glthread=false
+            CUSTOM_GL_GLSL=2
+            MESA_GL_VERSION_OVERRIDE=4.6
+            MESA_GLSL_VERSION_OVERRIDE=460
+            OSM_PLUGIN_LOGE=false
+            ONLY_GET_PROC_ADDRESS=false
+            """.trimIndent()
+    }
+}
@@ -0,0 +1,93 @@
+package com.mio.plugin.renderer
+
+import java.io.ByteArrayOutputStream
+import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+// env.bin: env.txt 预先拆分好的二进制版本, 插件启动时直接 mmap 读取
+// 格式与 Mesa-Plugin-Bridge/src/env_bin.h 保持一致 (小端):
+// "OSMB", u32 版本, u64 env.txt 大小, i64 env.txt 修改时间(ms), u32 条目数, u32 FNV-1a,
+// u32 修改代数, u32 0
+// 条目: u16 key 长度, u16 value 长度, key, 0, value, 0
+// 每次写入修改代数加一, 插件只读文件头即可判断配置是否变化
+object EnvBinary {
+    private const val VERSION = 2
+    private const val HEADER_SIZE = 40
+    private const val MAX_FIELD = 0xffff
+
+    fun binFileFor(envFile: File): File =
+        File(envFile.parentFile, envFile.nameWithoutExtension + ".bin")
+
+    // 读取上次写入的修改代数, 文件不存在或格式不符时为 0
+    fun readGeneration(binFile: File): Int {
+        try {
+            val header = ByteArray(HEADER_SIZE)
+            binFile.inputStream().use { if (it.read(header) != HEADER_SIZE) return 0 }
+            val buffer = ByteBuffer.wrap(header).order(ByteOrder.LITTLE_ENDIAN)
+            if (String(header, 0, 4) != "OSMB" || buffer.getInt(4) != VERSION) return 0
+            return buffer.getInt(32)
+        } catch (e: Exception) {
+            return 0
+        }
+    }
+
+    // textFile 是即将重命名为 env.txt 的临时文件, 重命名不改变大小和修改时间
+    fun write(textFile: File, binFile: File, generation: Int) {
+        val payload = ByteArrayOutputStream()
+        var count = 0
+
+        // 与插件的解析规则相同: 按行拆分, 在第一个 '=' 处分开, 不去除空白
+        // [profile ...] 节标题整行作为 key, value 为空, 由插件按当前游戏选择
+        for (line in textFile.readLines()) {
+            val isSection = line.startsWith("[")
+            val index = line.indexOf('=')
+            if (!isSection && index < 0) continue
+            val key = (if (isSection) line else line.substring(0, index)).toByteArray()
+            val value = (if (isSection) "" else line.substring(index + 1)).toByteArray()
+            if (key.size > MAX_FIELD || value.size > MAX_FIELD) {
+                binFile.delete()
+                return
+            }
+
+            val sizes = ByteBuffer.allocate(4).order(ByteOrder.LITTLE_ENDIAN)
+            sizes.putShort(key.size.toShort())
+            sizes.putShort(value.size.toShort())
+            payload.write(sizes.array())
+            payload.write(key)
+            payload.write(0)
+            payload.write(value)
+            payload.write(0)
+            count++
+        }
+
+        val body = payload.toByteArray()
+        val header = ByteBuffer.allocate(HEADER_SIZE).order(ByteOrder.LITTLE_ENDIAN)
+        header.put("OSMB".toByteArray())
+        header.putInt(VERSION)
+        header.putLong(textFile.length())
+        header.putLong(textFile.lastModified())
+        header.putInt(count)
+        header.putInt(fnv1a(body))
+        header.putInt(generation)
+        header.putInt(0)
+
+        val tmpFile = File(binFile.path + ".tmp")
+        tmpFile.outputStream().use {
+            it.write(header.array())
+            it.write(body)
+        }
+        if (!tmpFile.renameTo(binFile)) {
+            tmpFile.delete()
+            binFile.delete()
+        }
+    }
+
+    private fun fnv1a(data: ByteArray): Int {
+        var hash = 0x811c9dc5.toInt()
+        for (b in data) {
+            hash = (hash xor (b.toInt() and 0xff)) * 16777619
+        }
+        return hash
+    }
+}
@@ -29,17 +29,25 @@ class MainActivity : Activity() {
     private var hasAllFilesPermission = false
     private var isNoticedAllFilesPermissionMissing = false
     private val envFile = File(Environment.getExternalStorageDirectory(), "Mesa/env.txt")
+    private val store = ConfigStore(envFile)
+    private val bench by lazy { BenchRunner(this, envFile) }
+    // 按读取结果刷新开关时不写回文件
+    private var refreshing = false
 
     private lateinit var logSwitch: Switch
     private lateinit var ogpaSwitch: Switch
     private lateinit var glThreadSwitch: Switch
+    private lateinit var glOffloadSwitch: Switch
+    private lateinit var configReloadSwitch: Switch
+    private lateinit var hudSwitch: Switch
     private lateinit var galliumSettings: Button
     private lateinit var glVersionSettings: Button
+    private lateinit var profileSettings: Button
+    private lateinit var benchButton: Button
 
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
         checkPermission()
-        checkAndCreateEnvFile()
 
         val scrollView = ScrollView(this)
         val mainLayout = LinearLayout(this).apply {
@@ -102,13 +110,18 @@ class MainActivity : Activity() {
             text = "修改渲染器设置"
             setOnClickListener {
                 if (hasAllFilesPermission) {
-                    checkAndCreateEnvFile()
+                    if (!store.loaded) loadConfig()
                     visibility = Button.GONE
                     logSwitch.visibility = Switch.VISIBLE
                     ogpaSwitch.visibility = Switch.VISIBLE
                     glThreadSwitch.visibility = Switch.VISIBLE
+                    glOffloadSwitch.visibility = Switch.VISIBLE
+                    configReloadSwitch.visibility = Switch.VISIBLE
+                    hudSwitch.visibility = Switch.VISIBLE
                     galliumSettings.visibility = Button.VISIBLE
                     glVersionSettings.visibility = Button.VISIBLE
+                    profileSettings.visibility = Button.VISIBLE
+                    benchButton.visibility = Button.VISIBLE
                 } else {
                     checkPermission()
                 }
@@ -117,25 +130,50 @@ class MainActivity : Activity() {
 
         logSwitch = Switch(this).apply {
             text = "插件日志输出"
-            isChecked = readLogStatus()
             setOnCheckedChangeListener { _, isChecked ->
-                updateLogStatus(isChecked)
+                if (!refreshing) store.set("OSM_PLUGIN_LOGE", isChecked.toString())
             }
         }
 
         ogpaSwitch = Switch(this).apply {
             text = "仅使用getProcAddress(不建议使用)"
-            isChecked = readOGPAStatus()
             setOnCheckedChangeListener { _, isChecked ->
-                updateOGPAStatus(isChecked)
+                if (!refreshing) store.set("ONLY_GET_PROC_ADDRESS", isChecked.toString())
             }
         }
 
         glThreadSwitch = Switch(this).apply {
             text = "启用 mesa_glthread"
-            isChecked = readGLThreadStatus()
             setOnCheckedChangeListener { _, isChecked ->
-                updateGLThreadStatus(isChecked)
+                if (refreshing) return@setOnCheckedChangeListener
+                store.set("mesa_glthread", isChecked.toString())
+                if (isChecked) glOffloadSwitch.isChecked = false
+            }
+        }
+
+        // 与 mesa_glthread 互斥, 两者同时开启时插件会忽略本选项
+        glOffloadSwitch = Switch(this).apply {
+            text = "启用插件 GL 命令线程(mesa_glthread 不可用时使用)"
+            setOnCheckedChangeListener { _, isChecked ->
+                if (refreshing) return@setOnCheckedChangeListener
+                store.set("OSM_GL_OFFLOAD", isChecked.toString())
+                if (isChecked) glThreadSwitch.isChecked = false
+            }
+        }
+
+        // 开启后日志, 上下文池等插件选项在游戏运行中修改即可生效
+        configReloadSwitch = Switch(this).apply {
+            text = "插件设置实时生效(Mesa 变量仍需重启游戏)"
+            setOnCheckedChangeListener { _, isChecked ->
+                if (!refreshing) store.set("OSM_CONFIG_RELOAD", isChecked.toString())
+            }
+        }
+
+        // 在游戏画面左上角显示帧率, 帧时间和回读耗时
+        hudSwitch = Switch(this).apply {
+            text = "显示性能信息覆盖层"
+            setOnCheckedChangeListener { _, isChecked ->
+                if (!refreshing) store.set("OSM_HUD", isChecked.toString())
             }
         }
 
@@ -153,11 +191,30 @@ class MainActivity : Activity() {
             }
         }
 
+        profileSettings = Button(this).apply {
+            text = "游戏配置(Profile)设置"
+            setOnClickListener {
+                showProfilesDialog()
+            }
+        }
+
+        benchButton = Button(this).apply {
+            text = "性能测试"
+            setOnClickListener {
+                showBenchDialog()
+            }
+        }
+
         logSwitch.visibility = Switch.GONE
         ogpaSwitch.visibility = Switch.GONE
         glThreadSwitch.visibility = Switch.GONE
+        glOffloadSwitch.visibility = Switch.GONE
+        configReloadSwitch.visibility = Switch.GONE
+        hudSwitch.visibility = Switch.GONE
         galliumSettings.visibility = Button.GONE
         glVersionSettings.visibility = Button.GONE
+        profileSettings.visibility = Button.GONE
+        benchButton.visibility = Button.GONE
 
         mainLayout.apply {
             addView(rendererNameTextView)
@@ -170,8 +227,13 @@ class MainActivity : Activity() {
             addView(logSwitch)
             addView(ogpaSwitch)
             addView(glThreadSwitch)
+            addView(glOffloadSwitch)
+            addView(configReloadSwitch)
+            addView(hudSwitch)
             addView(galliumSettings)
             addView(glVersionSettings)
+            addView(profileSettings)
+            addView(benchButton)
         }
 
         scrollView.addView(mainLayout)
@@ -182,7 +244,7 @@ class MainActivity : Activity() {
         if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.R) {
             if (Environment.isExternalStorageManager()) {
                 hasAllFilesPermission = true
-                checkAndCreateEnvFile()
+                loadConfig()
             } else {
                 showPermissionDialog()
             }
@@ -227,7 +289,7 @@ class MainActivity : Activity() {
             )
         } else {
             hasAllFilesPermission = true
-            checkAndCreateEnvFile()
+            loadConfig()
         }
     }
 
@@ -240,151 +302,75 @@ class MainActivity : Activity() {
                 isNoticedAllFilesPermissionMissing = true
             }
         }
+        // 插件可能在游戏运行时写入了记录, 回到界面时重新读取
+        if (hasAllFilesPermission && store.loaded) loadConfig()
     }
 
-    private fun checkAndCreateEnvFile() {
+    private fun loadConfig() {
         if (!hasAllFilesPermission) return
-        if (!envFile.exists()) {
-            envFile.parentFile?.mkdirs()
-            envFile.writeText(
-                """
-                GALLIUM_DRIVER=zink
-                mesa_glthread=false
-                CUSTOM_GL_GLSL=2
-                MESA_GL_VERSION_OVERRIDE=4.6
-                MESA_GLSL_VERSION_OVERRIDE=460
-                OSM_PLUGIN_LOGE=false
-                ONLY_GET_PROC_ADDRESS=false
-                """.trimIndent()
-            )
-        }
-    }
-
-    // 插件日志输出
-    private fun readLogStatus(): Boolean {
-        if (!envFile.exists() || !hasAllFilesPermission) return false
-        return envFile.readLines().any { it.trim() == "OSM_PLUGIN_LOGE=true" }
-    }
-
-    private fun updateLogStatus(enabled: Boolean) {
-        checkAndCreateEnvFile()
-        if (!envFile.exists()) return
-
-        val lines = envFile.readLines().toMutableList()
-        var found = false
-
-        for (i in lines.indices) {
-            if (lines[i].startsWith("OSM_PLUGIN_LOGE=")) {
-                lines[i] = "OSM_PLUGIN_LOGE=$enabled"
-                found = true
-                break
-            }
-        }
-
-        if (!found)
-            lines.add("OSM_PLUGIN_LOGE=$enabled")
-
-        envFile.writeText(lines.joinToString("\n"))
-    }
-
-    // 仅使用 getProcAddress
-    private fun readOGPAStatus(): Boolean {
-        if (!envFile.exists() || !hasAllFilesPermission) return false
-        return envFile.readLines().any { it.trim() == "ONLY_GET_PROC_ADDRESS=true" }
+        store.load { refreshSwitches() }
     }
 
-    private fun updateOGPAStatus(enabled: Boolean) {
-        checkAndCreateEnvFile()
-        if (!envFile.exists()) return
-
-        val lines = envFile.readLines().toMutableList()
-        var found = false
-
-        for (i in lines.indices) {
-            if (lines[i].startsWith("ONLY_GET_PROC_ADDRESS=")) {
-                lines[i] = "ONLY_GET_PROC_ADDRESS=$enabled"
-                found = true
-                break
-            }
-        }
-
-        if (!found)
-            lines.add("ONLY_GET_PROC_ADDRESS=$enabled")
-
-        envFile.writeText(lines.joinToString("\n"))
-    }
-
-    // 是否启用 mesa_glthread
-    private fun readGLThreadStatus(): Boolean {
-        if (!envFile.exists() || !hasAllFilesPermission) return false
-        return envFile.readLines().any { it.trim() == "mesa_glthread=true" }
-    }
-
-    private fun updateGLThreadStatus(enabled: Boolean) {
-        checkAndCreateEnvFile()
-        if (!envFile.exists()) return
-
-        val lines = envFile.readLines().toMutableList()
-        var found = false
-
-        for (i in lines.indices) {
-            if (lines[i].startsWith("mesa_glthread=")) {
-                lines[i] = "mesa_glthread=$enabled"
-                found = true
-                break
-            }
-        }
-
-        if (!found)
-            lines.add("mesa_glthread=$enabled")
-
-        envFile.writeText(lines.joinToString("\n"))
+    private fun refreshSwitches() {
+        refreshing = true
+        logSwitch.isChecked = store.getBoolean("OSM_PLUGIN_LOGE")
+        ogpaSwitch.isChecked = store.getBoolean("ONLY_GET_PROC_ADDRESS")
+        glThreadSwitch.isChecked = store.getBoolean("mesa_glthread")
+        glOffloadSwitch.isChecked = store.getBoolean("OSM_GL_OFFLOAD")
+        configReloadSwitch.isChecked = store.getBoolean("OSM_CONFIG_RELOAD")
+        hudSwitch.isChecked = store.getBoolean("OSM_HUD")
+        refreshing = false
     }
 
     // 选择 gallium 驱动
     private fun showGalliumDriverDialog() {
-        val drivers = arrayOf("zink", "freedreno", "panfrost"/*, "softpipe", "llvmpipe"*/)
+        val drivers = arrayOf("auto", "zink", "freedreno", "panfrost", "llvmpipe"/*, "softpipe"*/)
         val currentDriver = readCurrentGalliumDriver()
         val selectedIndex = drivers.indexOf(currentDriver)
 
+        // auto: 插件首次启动时逐个测试驱动并记录最快且稳定的一个
+        val autoResult = readAutoDriverResult()
+        val labels = drivers.map {
+            when {
+                it != "auto" -> it
+                autoResult == null -> "auto(首次启动时自动测试)"
+                else -> "auto(已选择 ${autoResult.first})"
+            }
+        }.toTypedArray()
+
         AlertDialog.Builder(this)
             .setTitle("选择 Gallium 驱动")
-            .setSingleChoiceItems(drivers, selectedIndex) { dialog, which ->
+            .setSingleChoiceItems(labels, selectedIndex) { dialog, which ->
                 val selectedDriver = drivers[which]
                 updateGalliumDriver(selectedDriver)
-                Toast.makeText(this, "已选择: $selectedDriver", Toast.LENGTH_SHORT).show()
+                val message = if (selectedDriver == "auto" && autoResult != null && autoResult.second.isNotEmpty())
+                    "已选择: auto, 上次测试结果 ${autoResult.second}, 下次启动将重新测试"
+                else
+                    "已选择: $selectedDriver"
+                Toast.makeText(this, message, Toast.LENGTH_SHORT).show()
                 dialog.dismiss()
             }
             .show()
     }
 
-    private fun readCurrentGalliumDriver(): String {
-        if (!envFile.exists() || !hasAllFilesPermission) return "zink"
-        return envFile.readLines()
-            .firstOrNull { it.startsWith("GALLIUM_DRIVER=") }
-            ?.substringAfter("=")
-            ?.trim() ?: "zink"
+    // 插件记录的自动选择结果: 驱动名与各驱动的帧时间(ms, fail 为不可用, ~ 为不稳定)
+    private fun readAutoDriverResult(): Pair<String, String>? {
+        val driver = store.get("OSM_AUTO_DRIVER") ?: return null
+        return Pair(driver, store.get("OSM_AUTO_DRIVER_TIMINGS") ?: "")
     }
 
+    private fun readCurrentGalliumDriver(): String = store.get("GALLIUM_DRIVER") ?: "zink"
+
     private fun updateGalliumDriver(newDriver: String) {
-        checkAndCreateEnvFile()
-        if (!hasAllFilesPermission || !envFile.exists()) return
+        store.edit {
+            set("GALLIUM_DRIVER", newDriver)
 
-        val lines = envFile.readLines().toMutableList()
-        var found = false
+            // 重新选择 auto 时清除上次的测试结果, 下次启动重新测试
+            if (newDriver == "auto") remove("OSM_AUTO_DRIVER", "OSM_AUTO_DRIVER_TIMINGS")
 
-        for (i in lines.indices) {
-            if (lines[i].startsWith("GALLIUM_DRIVER=")) {
-                lines[i] = "GALLIUM_DRIVER=$newDriver"
-                found = true
-                break
-            }
+            // llvmpipe 由插件按 CPU 拓扑自动调整 LP_NUM_THREADS
+            if (newDriver == "llvmpipe" && get("OSM_LP_TUNE") == null) set("OSM_LP_TUNE", "true")
         }
-
-        if (!found)
-            lines.add("GALLIUM_DRIVER=$newDriver")
-
-        envFile.writeText(lines.joinToString("\n"))
     }
 
     // GL/GLSL 版本设置
@@ -414,31 +400,9 @@ class MainActivity : Activity() {
             .show()
     }
 
-    private fun readCustomGLSetting(): String {
-        if (!envFile.exists() || !hasAllFilesPermission) return "1"
-        return envFile.readLines().firstOrNull { it.startsWith("CUSTOM_GL_GLSL=") }
-            ?.substringAfter("=")?.trim() ?: "1"
-    }
-
-    private fun updateCustomGLSetting(newSetting: String) {
-        checkAndCreateEnvFile()
-        if (!hasAllFilesPermission || !envFile.exists()) return
-
-        val lines = envFile.readLines().toMutableList()
-        var found = false
-
-        for (i in lines.indices) {
-            if (lines[i].startsWith("CUSTOM_GL_GLSL=")) {
-                lines[i] = "CUSTOM_GL_GLSL=$newSetting"
-                found = true
-                break
-            }
-        }
+    private fun readCustomGLSetting(): String = store.get("CUSTOM_GL_GLSL") ?: "1"
 
-        if (!found) lines.add("CUSTOM_GL_GLSL=$newSetting")
-
-        envFile.writeText(lines.joinToString("\n"))
-    }
+    private fun updateCustomGLSetting(newSetting: String) = store.set("CUSTOM_GL_GLSL", newSetting)
 
     // 自定义 GL/GLSL
     private fun customGLVersionDialog() {
@@ -539,44 +503,170 @@ class MainActivity : Activity() {
     }
 
     // 读取当前 GL 版本
-    private fun readGLVersion(): String {
-        if (!envFile.exists() || !hasAllFilesPermission) return "4.6"
-        return envFile.readLines().firstOrNull { it.startsWith("MESA_GL_VERSION_OVERRIDE=") }
-            ?.substringAfter("=")?.trim() ?: "4.6"
-    }
+    private fun readGLVersion(): String = store.get("MESA_GL_VERSION_OVERRIDE") ?: "4.6"
 
     // 读取当前 GLSL 版本
-    private fun readGLSLVersion(): String {
-        if (!envFile.exists() || !hasAllFilesPermission) return "460"
-        return envFile.readLines().firstOrNull { it.startsWith("MESA_GLSL_VERSION_OVERRIDE=") }
-            ?.substringAfter("=")?.trim() ?: "460"
-    }
+    private fun readGLSLVersion(): String = store.get("MESA_GLSL_VERSION_OVERRIDE") ?: "460"
 
     // 更新 GL/GLSL 版本
     private fun updateGLVersions(newGL: String, newGLSL: String) {
-        checkAndCreateEnvFile()
-        if (!hasAllFilesPermission || !envFile.exists()) return
-
-        val lines = envFile.readLines().toMutableList()
-    
-        var glFound = false
-        var glslFound = false
-
-        for (i in lines.indices) {
-            if (lines[i].startsWith("MESA_GL_VERSION_OVERRIDE=")) {
-                lines[i] = "MESA_GL_VERSION_OVERRIDE=$newGL"
-                glFound = true
+        store.edit {
+            set("MESA_GL_VERSION_OVERRIDE", newGL)
+            set("MESA_GLSL_VERSION_OVERRIDE", newGLSL)
+        }
+    }
+
+    private fun showProfilesDialog() {
+        val profiles = store.profiles()
+        val names = profiles.map { it.selector } + "新建配置"
+
+        AlertDialog.Builder(this)
+            .setTitle("游戏配置(Profile)")
+            .setItems(names.toTypedArray()) { dialog, which ->
+                dialog.dismiss()
+                editProfileDialog(profiles, which)
+            }
+            .show()
+    }
+
+    private fun editProfileDialog(profiles: MutableList<ConfigStore.Profile>, index: Int) {
+        val profile = profiles.getOrNull(index)
+
+        val layout = LinearLayout(this).apply {
+            orientation = LinearLayout.VERTICAL
+            setPadding(50, 20, 50, 20)
+        }
+
+        val selectorText = TextView(this).apply {
+            text = "匹配规则: 启动器提供的 OSM_PROFILE, process:进程名 或 cwd:游戏目录, 可使用 * 通配符"
+            textSize = 14f
+            setTextColor(Color.BLUE)
+        }
+
+        val selectorInput = EditText(this).apply {
+            hint = "例如 mesa2500 或 cwd:*1.20.1*"
+            setText(profile?.selector ?: "")
+        }
+
+        val entriesText = TextView(this).apply {
+            text = "设置(每行一个 KEY=VALUE)"
+            textSize = 14f
+            setTextColor(Color.BLUE)
+        }
+
+        val entriesInput = EditText(this).apply {
+            hint = "GALLIUM_DRIVER=zink"
+            minLines = 5
+            gravity = Gravity.TOP
+            setText(profile?.lines?.joinToString("\n") ?: "")
+        }
+
+        layout.apply {
+            addView(selectorText)
+            addView(selectorInput)
+            addView(entriesText)
+            addView(entriesInput)
+        }
+
+        val builder = AlertDialog.Builder(this)
+            .setTitle(if (profile == null) "新建配置" else "编辑配置")
+            .setView(layout)
+            .setPositiveButton("保存") { _, _ ->
+                val selector = selectorInput.text.toString().trim()
+                if (selector.isEmpty() || selector.contains(']')) {
+                    Toast.makeText(this, "匹配规则不合法", Toast.LENGTH_SHORT).show()
+                    return@setPositiveButton
+                }
+                val entries = entriesInput.text.toString().lines()
+                    .map { it.trim() }
+                    .filter { it.contains('=') && !it.startsWith("[") }
+                    .toMutableList()
+
+                val updated = ConfigStore.Profile("[profile $selector]", entries)
+                if (profile == null) profiles.add(updated) else profiles[index] = updated
+                store.setProfiles(profiles)
+                Toast.makeText(this, "配置已保存", Toast.LENGTH_SHORT).show()
             }
-            if (lines[i].startsWith("MESA_GLSL_VERSION_OVERRIDE=")) {
-                lines[i] = "MESA_GLSL_VERSION_OVERRIDE=$newGLSL"
-                glslFound = true
+            .setNegativeButton("取消", null)
+
+        if (profile != null) {
+            builder.setNeutralButton("删除") { _, _ ->
+                profiles.removeAt(index)
+                store.setProfiles(profiles)
+                Toast.makeText(this, "配置已删除", Toast.LENGTH_SHORT).show()
             }
         }
+        builder.show()
+    }
+
+    // 性能测试: 用当前设置依次测试所选驱动, 结果保存到历史记录
+    private fun showBenchDialog() {
+        val drivers = arrayOf("zink", "freedreno", "panfrost", "llvmpipe")
+        val current = store.get("OSM_AUTO_DRIVER") ?: readCurrentGalliumDriver()
+        val checked = drivers.map { it == current }.toBooleanArray()
+
+        AlertDialog.Builder(this)
+            .setTitle("性能测试(选择要测试的驱动)")
+            .setMultiChoiceItems(drivers, checked) { _, which, isChecked ->
+                checked[which] = isChecked
+            }
+            .setPositiveButton("开始测试") { _, _ ->
+                runBench(drivers.filterIndexed { index, _ -> checked[index] }.ifEmpty { listOf(current) })
+            }
+            .setNeutralButton("历史记录") { _, _ ->
+                showBenchHistory()
+            }
+            .setNegativeButton("取消", null)
+            .show()
+    }
+
+    private fun runBench(drivers: List<String>) {
+        if (bench.running) return
+        // 记录影响性能的主要设置, 便于对比修改前后的结果
+        val settings = listOf("mesa_glthread", "OSM_GL_OFFLOAD", "CUSTOM_GL_GLSL", "LP_NUM_THREADS", "OSM_THREAD_PLACEMENT")
+            .mapNotNull { key -> store.get(key)?.let { "$key=$it" } }
+            .joinToString(" ")
 
-        if (!glFound) lines.add("MESA_GL_VERSION_OVERRIDE=$newGL")
-        if (!glslFound) lines.add("MESA_GLSL_VERSION_OVERRIDE=$newGLSL")
+        val progress = AlertDialog.Builder(this)
+            .setTitle("性能测试")
+            .setMessage("测试中, 每个驱动约需十几秒...")
+            .setCancelable(false)
+            .show()
 
-        envFile.writeText(lines.joinToString("\n"))
+        bench.run(drivers, settings) { results, message ->
+            progress.dismiss()
+            if (results == null) {
+                Toast.makeText(this, "测试失败: $message", Toast.LENGTH_LONG).show()
+                return@run
+            }
+            AlertDialog.Builder(this)
+                .setTitle("测试结果")
+                .setMessage(results.joinToString("\n\n") { formatBenchResult(it) })
+                .setPositiveButton("确定", null)
+                .setNeutralButton("历史记录") { _, _ -> showBenchHistory() }
+                .show()
+        }
     }
 
-}
\ No newline at end of file
+    private fun showBenchHistory() {
+        bench.loadHistory { history ->
+            val format = java.text.SimpleDateFormat("MM-dd HH:mm", java.util.Locale.getDefault())
+            val text = if (history.isEmpty()) "暂无记录" else history.joinToString("\n\n") {
+                "${format.format(java.util.Date(it.time))}  ${formatBenchResult(it)}" +
+                    if (it.settings.isNotEmpty()) "\n${it.settings}" else ""
+            }
+            AlertDialog.Builder(this)
+                .setTitle("测试历史")
+                .setMessage(text)
+                .setPositiveButton("确定", null)
+                .show()
+        }
+    }
+
+    private fun formatBenchResult(result: BenchRunner.Result): String {
+        if (!result.ok) return "${result.driver}: 不可用"
+        return "${result.driver} (${result.renderer})\n" +
+            "帧时间 p50 %.2f / p95 %.2f / p99 %.2f ms\n".format(result.p50, result.p95, result.p99) +
+            "启动 %.0f ms, 读回 %.0f MB/s".format(result.loadMs + result.createMs, result.readbackMBps)
+    }
+}